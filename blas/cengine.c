@@ -0,0 +1,451 @@
+#include "blas.h"
+#include "engine.h"
+#include <stdlib.h>
+
+static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
+
+static const float zero = 0.0f;
+static const float complex czero = 0.0f + 0.0f * I;
+
+void cgemm_pack_a(CBlasComplexGemm method, CBlasTranspose trans, size_t mb, size_t kb,
+                  const float complex * restrict A, size_t lda, float * restrict P) {
+  const size_t mr = sgemm_selected->mr;
+  const size_t np = (mb + mr - 1) / mr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t i0 = p * mr;
+    const size_t ib = min(mb - i0, mr);
+    float * restrict P0 = &P[3 * p * mr * kb];
+    float * restrict P1 = &P0[mr * kb];
+    float * restrict P2 = &P1[mr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t i = 0; i < ib; i++) {
+        const float complex a = (trans == CBlasNoTrans) ? A[l * lda + i0 + i] : A[(i0 + i) * lda + l];
+        const float re = crealf(a);
+        const float im = (trans == CBlasConjTrans) ? -cimagf(a) : cimagf(a);
+        if (method == CBlasGemm3M) {
+          P0[l * mr + i] = re;
+          P1[l * mr + i] = im;
+          P2[l * mr + i] = re + im;
+        }
+        else {
+          P0[l * mr + i] = im;
+          P1[l * mr + i] = re;
+          P2[l * mr + i] = -im;
+        }
+      }
+      for (size_t i = ib; i < mr; i++)
+        P0[l * mr + i] = P1[l * mr + i] = P2[l * mr + i] = zero;
+    }
+  }
+}
+
+void cgemm_pack_b(CBlasComplexGemm method, CBlasTranspose trans, size_t kb, size_t nb,
+                  const float complex * restrict B, size_t ldb, float * restrict P) {
+  const size_t nr = sgemm_selected->nr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t j0 = p * nr;
+    const size_t jb = min(nb - j0, nr);
+    float * restrict P0 = &P[3 * p * nr * kb];
+    float * restrict P1 = &P0[nr * kb];
+    float * restrict P2 = &P1[nr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t j = 0; j < jb; j++) {
+        const float complex b = (trans == CBlasNoTrans) ? B[(j0 + j) * ldb + l] : B[l * ldb + j0 + j];
+        const float re = crealf(b);
+        const float im = (trans == CBlasConjTrans) ? -cimagf(b) : cimagf(b);
+        P0[l * nr + j] = re;
+        P1[l * nr + j] = im;
+        if (method == CBlasGemm3M)
+          P2[l * nr + j] = re + im;
+      }
+      for (size_t j = jb; j < nr; j++) {
+        P0[l * nr + j] = P1[l * nr + j] = zero;
+        if (method == CBlasGemm3M)
+          P2[l * nr + j] = zero;
+      }
+    }
+  }
+}
+
+/**
+ * Computes the real and imaginary parts of an MR x NR tile of op(A) * op(B)
+ * from packed split panels.
+ */
+static inline void cgemm_tile(CBlasComplexGemm method, size_t kb,
+                              const float * restrict Ap, const float * restrict Bp,
+                              float * restrict Re, float * restrict Im) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const sgemm_micro_t micro = sgemm_selected->micro;
+
+  if (method == CBlasGemm3M) {
+    // Re = Ar * Br - Ai * Bi, Im = (Ar + Ai) * (Br + Bi) - Ar * Br - Ai * Bi
+    float T[SGEMM_MR_MAX * SGEMM_NR_MAX];
+    micro(kb, 1.0f, Ap, Bp, zero, Re, mr);
+    micro(kb, 1.0f, &Ap[mr * kb], &Bp[nr * kb], zero, T, mr);
+    micro(kb, 1.0f, &Ap[2 * mr * kb], &Bp[2 * nr * kb], zero, Im, mr);
+    for (size_t ii = 0; ii < mr * nr; ii++) {
+      Im[ii] -= Re[ii] + T[ii];
+      Re[ii] -= T[ii];
+    }
+  }
+  else {
+    // The A panel holds [Ai Ar -Ai] and the B panel [Br; Bi] so each part is
+    // a single product of depth 2 * kb:
+    //   Re = [Ar -Ai] * [Br; Bi], Im = [Ai Ar] * [Br; Bi]
+    micro(2 * kb, 1.0f, &Ap[mr * kb], Bp, zero, Re, mr);
+    micro(2 * kb, 1.0f, Ap, Bp, zero, Im, mr);
+  }
+}
+
+void cgemm_kernel(CBlasComplexGemm method, size_t mb, size_t nb, size_t kb,
+                  float complex alpha, const float * restrict A, const float * restrict B,
+                  float complex beta, float complex * restrict C, size_t ldc) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const size_t mp = (mb + mr - 1) / mr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for collapse(2)
+  for (size_t q = 0; q < np; q++) {
+    for (size_t p = 0; p < mp; p++) {
+      const size_t i = p * mr, j = q * nr;
+      const size_t ib = min(mb - i, mr);
+      const size_t jb = min(nb - j, nr);
+
+      // Real and imaginary parts of the tile of op(A) * op(B)
+      float Re[SGEMM_MR_MAX * SGEMM_NR_MAX], Im[SGEMM_MR_MAX * SGEMM_NR_MAX];
+      cgemm_tile(method, kb, &A[3 * i * kb], &B[3 * j * kb], Re, Im);
+
+      if (beta == czero) {
+        for (size_t jj = 0; jj < jb; jj++) {
+          for (size_t ii = 0; ii < ib; ii++)
+            C[(j + jj) * ldc + i + ii] = alpha * (Re[jj * mr + ii] + Im[jj * mr + ii] * I);
+        }
+      }
+      else {
+        for (size_t jj = 0; jj < jb; jj++) {
+          for (size_t ii = 0; ii < ib; ii++)
+            C[(j + jj) * ldc + i + ii] = alpha * (Re[jj * mr + ii] + Im[jj * mr + ii] * I) +
+                                         beta * C[(j + jj) * ldc + i + ii];
+        }
+      }
+    }
+  }
+}
+
+bool cgemm_packed(CBlasTranspose transA, CBlasTranspose transB,
+                  size_t m, size_t n, size_t k,
+                  float complex alpha, const float complex * restrict A, size_t lda,
+                  const float complex * restrict B, size_t ldb,
+                  float complex beta, float complex * restrict C, size_t ldc) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&cblocking);
+  // Read once so a concurrent change can't mix methods within a call
+  const CBlasComplexGemm method = complexGemm;
+
+  const size_t mc = ((min(m, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  // Three planes of each panel (see cgemm_pack_a/cgemm_pack_b)
+  float * Ap = malloc(3 * mc * kc * sizeof(float));
+  float * Bp = malloc(3 * kc * nc * sizeof(float));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+      // Only the first pass over k scales C by beta
+      const float complex b = (l == 0) ? beta : 1.0f + 0.0f * I;
+
+      cgemm_pack_b(method, transB, lb, jb,
+                   (transB == CBlasNoTrans) ? &B[j * ldb + l] : &B[l * ldb + j], ldb, Bp);
+
+      for (size_t i = 0; i < m; i += blocking.mb) {
+        const size_t ib = min(m - i, blocking.mb);
+
+        cgemm_pack_a(method, transA, ib, lb,
+                     (transA == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+        cgemm_kernel(method, ib, jb, lb, alpha, Ap, Bp, b, &C[j * ldc + i], ldc);
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
+
+void cherk_kernel(CBlasComplexGemm method, CBlasUplo uplo, ptrdiff_t offset,
+                  size_t mb, size_t nb, size_t kb,
+                  float alpha, const float * restrict A, const float * restrict B,
+                  float beta, float complex * restrict C, size_t ldc) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const size_t mp = (mb + mr - 1) / mr;
+  const size_t np = (nb + nr - 1) / nr;
+
+  // Tiles outside the triangle are skipped so share them out dynamically
+#pragma omp for collapse(2) schedule(dynamic)
+  for (size_t q = 0; q < np; q++) {
+    for (size_t p = 0; p < mp; p++) {
+      const size_t i = p * mr, j = q * nr;
+      const size_t ib = min(mb - i, mr);
+      const size_t jb = min(nb - j, nr);
+
+      // Position of the tile relative to the diagonal of C
+      const ptrdiff_t top = (ptrdiff_t)i + offset, bottom = top + (ptrdiff_t)ib - 1;
+      const ptrdiff_t left = (ptrdiff_t)j, right = left + (ptrdiff_t)jb - 1;
+      if ((uplo == CBlasUpper) ? top > right : bottom < left)
+        continue;
+
+      float Re[SGEMM_MR_MAX * SGEMM_NR_MAX], Im[SGEMM_MR_MAX * SGEMM_NR_MAX];
+      cgemm_tile(method, kb, &A[3 * i * kb], &B[3 * j * kb], Re, Im);
+
+      for (size_t jj = 0; jj < jb; jj++) {
+        for (size_t ii = 0; ii < ib; ii++) {
+          const ptrdiff_t r = top + (ptrdiff_t)ii, c = left + (ptrdiff_t)jj;
+          float complex * restrict x = &C[(j + jj) * ldc + i + ii];
+          if ((uplo == CBlasUpper) ? r > c : r < c)
+            continue;
+          // The imaginary parts of the diagonal are zero
+          if (r == c)
+            *x = (beta == zero) ? alpha * Re[jj * mr + ii]
+                                : alpha * Re[jj * mr + ii] + beta * crealf(*x);
+          else
+            *x = (beta == zero) ? alpha * (Re[jj * mr + ii] + Im[jj * mr + ii] * I)
+                                : alpha * (Re[jj * mr + ii] + Im[jj * mr + ii] * I) + beta * *x;
+        }
+      }
+    }
+  }
+}
+
+bool cherk_packed(CBlasUplo uplo, CBlasTranspose trans, size_t n, size_t k,
+                  float alpha, const float complex * restrict A, size_t lda,
+                  float beta, float complex * restrict C, size_t ldc) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&cblocking);
+  const CBlasComplexGemm method = complexGemm;
+  // C = alpha * op(A) * op(A)^H + beta * C is a GEMM with A as both operands
+  const CBlasTranspose transA = (trans == CBlasNoTrans) ? CBlasNoTrans : CBlasConjTrans;
+  const CBlasTranspose transB = (trans == CBlasNoTrans) ? CBlasConjTrans : CBlasNoTrans;
+
+  const size_t mc = ((min(n, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  float * Ap = malloc(3 * mc * kc * sizeof(float));
+  float * Bp = malloc(3 * kc * nc * sizeof(float));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+    // Only the row blocks that intersect the triangle are computed
+    const size_t i0 = (uplo == CBlasUpper) ? 0 : j;
+    const size_t i1 = (uplo == CBlasUpper) ? j + jb : n;
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+      const float b = (l == 0) ? beta : 1.0f;
+
+      cgemm_pack_b(method, transB, lb, jb,
+                   (trans == CBlasNoTrans) ? &A[l * lda + j] : &A[j * lda + l], lda, Bp);
+
+      for (size_t i = i0; i < i1; i += blocking.mb) {
+        const size_t ib = min(i1 - i, blocking.mb);
+
+        cgemm_pack_a(method, transA, ib, lb,
+                     (trans == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+        cherk_kernel(method, uplo, (ptrdiff_t)i - (ptrdiff_t)j, ib, jb, lb,
+                     alpha, Ap, Bp, b, &C[j * ldc + i], ldc);
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
+
+void ctrmm_pack_a(CBlasComplexGemm method, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
+                  ptrdiff_t offset, size_t mb, size_t kb,
+                  const float complex * restrict A, size_t lda, float * restrict P) {
+  const size_t mr = sgemm_selected->mr;
+  const size_t np = (mb + mr - 1) / mr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t i0 = p * mr;
+    const size_t ib = min(mb - i0, mr);
+    float * restrict P0 = &P[3 * p * mr * kb];
+    float * restrict P1 = &P0[mr * kb];
+    float * restrict P2 = &P1[mr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t i = 0; i < ib; i++) {
+        const ptrdiff_t d = (ptrdiff_t)(i0 + i) - (ptrdiff_t)l + offset;
+        float re, im;
+        if ((uplo == CBlasUpper) ? d > 0 : d < 0)
+          re = im = zero;
+        else if (d == 0 && diag == CBlasUnit) {
+          re = 1.0f;
+          im = zero;
+        }
+        else {
+          const float complex a = (trans == CBlasNoTrans) ? A[l * lda + i0 + i] : A[(i0 + i) * lda + l];
+          re = crealf(a);
+          im = (trans == CBlasConjTrans) ? -cimagf(a) : cimagf(a);
+        }
+        if (method == CBlasGemm3M) {
+          P0[l * mr + i] = re;
+          P1[l * mr + i] = im;
+          P2[l * mr + i] = re + im;
+        }
+        else {
+          P0[l * mr + i] = im;
+          P1[l * mr + i] = re;
+          P2[l * mr + i] = -im;
+        }
+      }
+      for (size_t i = ib; i < mr; i++)
+        P0[l * mr + i] = P1[l * mr + i] = P2[l * mr + i] = zero;
+    }
+  }
+}
+
+void ctrmm_pack_b(CBlasComplexGemm method, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
+                  ptrdiff_t offset, size_t kb, size_t nb,
+                  const float complex * restrict B, size_t ldb, float * restrict P) {
+  const size_t nr = sgemm_selected->nr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t j0 = p * nr;
+    const size_t jb = min(nb - j0, nr);
+    float * restrict P0 = &P[3 * p * nr * kb];
+    float * restrict P1 = &P0[nr * kb];
+    float * restrict P2 = &P1[nr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t j = 0; j < jb; j++) {
+        const ptrdiff_t d = (ptrdiff_t)l - (ptrdiff_t)(j0 + j) + offset;
+        float re, im;
+        if ((uplo == CBlasUpper) ? d > 0 : d < 0)
+          re = im = zero;
+        else if (d == 0 && diag == CBlasUnit) {
+          re = 1.0f;
+          im = zero;
+        }
+        else {
+          const float complex b = (trans == CBlasNoTrans) ? B[(j0 + j) * ldb + l] : B[l * ldb + j0 + j];
+          re = crealf(b);
+          im = (trans == CBlasConjTrans) ? -cimagf(b) : cimagf(b);
+        }
+        P0[l * nr + j] = re;
+        P1[l * nr + j] = im;
+        if (method == CBlasGemm3M)
+          P2[l * nr + j] = re + im;
+      }
+      for (size_t j = jb; j < nr; j++) {
+        P0[l * nr + j] = P1[l * nr + j] = zero;
+        if (method == CBlasGemm3M)
+          P2[l * nr + j] = zero;
+      }
+    }
+  }
+}
+
+bool ctrmm_packed(CBlasSide side, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
+                  size_t m, size_t n,
+                  float complex alpha, const float complex * restrict A, size_t lda,
+                  const float complex * restrict B, size_t ldb,
+                  float complex * restrict X, size_t ldx) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&cblocking);
+  const CBlasComplexGemm method = complexGemm;
+  // The triangle of op(A) that is referenced
+  const CBlasUplo op = ((uplo == CBlasUpper) == (trans == CBlasNoTrans)) ? CBlasUpper : CBlasLower;
+  const size_t k = (side == CBlasLeft) ? m : n;
+
+  const size_t mc = ((min(m, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  float * Ap = malloc(3 * mc * kc * sizeof(float));
+  float * Bp = malloc(3 * kc * nc * sizeof(float));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+
+      if (side == CBlasLeft) {
+        // X = alpha * op(A) * B
+        cgemm_pack_b(method, CBlasNoTrans, lb, jb, &B[j * ldb + l], ldb, Bp);
+
+        for (size_t i = 0; i < m; i += blocking.mb) {
+          const size_t ib = min(m - i, blocking.mb);
+
+          // Skip blocks of op(A) outside the triangle.  The first block inside
+          // it overwrites X.
+          if ((op == CBlasUpper) ? l + lb <= i : l >= i + ib)
+            continue;
+          const float complex b = (l == ((op == CBlasUpper) ? (i / blocking.kb) * blocking.kb : 0)) ? czero : 1.0f + 0.0f * I;
+
+          ctrmm_pack_a(method, op, trans, diag, (ptrdiff_t)i - (ptrdiff_t)l, ib, lb,
+                       (trans == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+          cgemm_kernel(method, ib, jb, lb, alpha, Ap, Bp, b, &X[j * ldx + i], ldx);
+        }
+      }
+      else {
+        // X = alpha * B * op(A)
+        if ((op == CBlasUpper) ? l >= j + jb : l + lb <= j)
+          continue;
+        const float complex b = (l == ((op == CBlasUpper) ? 0 : (j / blocking.kb) * blocking.kb)) ? czero : 1.0f + 0.0f * I;
+
+        ctrmm_pack_b(method, op, trans, diag, (ptrdiff_t)l - (ptrdiff_t)j, lb, jb,
+                     (trans == CBlasNoTrans) ? &A[j * lda + l] : &A[l * lda + j], lda, Bp);
+
+        for (size_t i = 0; i < m; i += blocking.mb) {
+          const size_t ib = min(m - i, blocking.mb);
+
+          cgemm_pack_a(method, CBlasNoTrans, ib, lb, &B[l * ldb + i], ldb, Ap);
+          cgemm_kernel(method, ib, jb, lb, alpha, Ap, Bp, b, &X[j * ldx + i], ldx);
+        }
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
@@ -2,7 +2,7 @@
 #include "error.h"
 #include <stdio.h>
 #include "handle.h"
-#include "config.h"
+#include "engine.h"
 #include "cherk.fatbin.c"
 
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
@@ -53,7 +53,7 @@ void cherk(CBlasUplo uplo, CBlasTranspose trans,
   if (n == 0 || ((alpha == zero || k == 0) && beta == one))
     return;
 
-  if (alpha == zero) {
+  if (alpha == zero || k == 0) {
     if (uplo == CBlasUpper) {
       if (beta == zero) {
 #pragma omp parallel for
@@ -91,6 +91,10 @@ void cherk(CBlasUplo uplo, CBlasTranspose trans,
     return;
   }
 
+  if (cherk_packed(uplo, trans, n, k, alpha, A, lda, beta, C, ldc))
+    return;
+
+  // Fall back to unpacked loops if the packing buffers could not be allocated
   if (trans == CBlasNoTrans) {
     if (uplo == CBlasUpper) {
 #pragma omp parallel for
@@ -156,7 +160,7 @@ void cherk(CBlasUplo uplo, CBlasTranspose trans,
         }
         register float rtemp = zero;
         for (size_t l = 0; l < k; l++)
-          rtemp += conjf(A[j * lda + l]) * A[j * lda + l];
+          rtemp += crealf(conjf(A[j * lda + l]) * A[j * lda + l]);
         if (beta == zero)
           C[j * ldc + j] = alpha * rtemp;
         else
@@ -168,7 +172,7 @@ void cherk(CBlasUplo uplo, CBlasTranspose trans,
       for (size_t j = 0; j < n; j++) {
         register float rtemp = zero;
         for (size_t l = 0; l < k; l++)
-          rtemp += conjf(A[j * lda + l]) * A[j * lda + l];
+          rtemp += crealf(conjf(A[j * lda + l]) * A[j * lda + l]);
         if (beta == zero)
           C[j * ldc + j] = alpha * rtemp;
         else
@@ -187,6 +191,55 @@ void cherk(CBlasUplo uplo, CBlasTranspose trans,
   }
 }
 
+/**
+ * Looks up the kernel for one combination of options and the block sizes it was
+ * compiled for.
+ */
+static CUresult lookup(CUmodule module, CBlasUplo uplo, CBlasTranspose trans,
+                       struct cukernel * kernel) {
+  const unsigned int mb = (trans == CBlasNoTrans) ? 64 : 32;
+  const unsigned int nb = (trans == CBlasNoTrans) ?  8 : 16;
+  const unsigned int kb = 8;
+  const unsigned int bx = 8;
+  const unsigned int by = 8;
+
+  char name[89];
+  snprintf(name, 89,
+           "_Z5cherkIL9CBlasUplo%dEL14CBlasTranspose%dELj%uELj%uELj%uELj%uELj%uEEvPK6float2PS2_ffiiii",
+           uplo, trans, mb, nb, kb, bx, by);
+
+  CU_ERROR_CHECK(cuModuleGetFunction(&kernel->function, module, name));
+  kernel->mb = mb;
+  kernel->nb = nb;
+  kernel->kb = kb;
+  kernel->bx = bx;
+  kernel->by = by;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Loads the CHERK module and looks up the kernel for each uplo and trans so
+ * that a launch only has to index the handle's table.  The handle's context
+ * must be current.
+ */
+CUresult cherk_load(CUBLAShandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const CBlasTranspose transs[] = { CBlasNoTrans, CBlasConjTrans };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    for (int t = 0; t < 2; t++)
+      CU_ERROR_CHECK(lookup(module, uplos[u], transs[t], &handle->cherkKernels[u][t]));
+  }
+
+  handle->cherk = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuCherk(CUBLAShandle handle, CBlasUplo uplo, CBlasTranspose trans,
                  size_t n, size_t k,
                  float alpha, CUdeviceptr A, size_t lda,
@@ -211,25 +264,15 @@ CUresult cuCherk(CUBLAShandle handle, CBlasUplo uplo, CBlasTranspose trans,
   CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
 
   if (handle->cherk == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->cherk, imageBytes));
+    CU_ERROR_CHECK(cherk_load(handle));
 
-  const unsigned int mb = (trans == CBlasNoTrans) ? 64 : 32;
-  const unsigned int nb = (trans == CBlasNoTrans) ?  8 : 16;
-  const unsigned int kb = 8;
-  const unsigned int bx = 8;
-  const unsigned int by = 8;
-
-  char name[89];
-  snprintf(name, 89,
-           "_Z5cherkIL9CBlasUplo%dEL14CBlasTranspose%dELj%uELj%uELj%uELj%uELj%uEEvPK6float2PS2_ffiiii",
-           uplo, trans, mb, nb, kb, bx, by);
-
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->cherk, name));
+  // trans is either CBlasNoTrans or CBlasConjTrans
+  const struct cukernel * kernel = &handle->cherkKernels[uploIndex(uplo)][(trans == CBlasNoTrans) ? 0 : 1];
+  const unsigned int mb = kernel->mb, nb = kernel->nb, bx = kernel->bx, by = kernel->by;
 
   void * params[] = { &A, &C, &alpha, &beta, &lda, &ldc, &n, &k };
 
-  CU_ERROR_CHECK(cuLaunchKernel(function, (unsigned int)(n + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
+  CU_ERROR_CHECK(cuLaunchKernel(kernel->function, (unsigned int)(n + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
                                 bx, by, 1, 0, stream, params, NULL));
 
   CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
@@ -259,6 +302,9 @@ CUresult cuMultiGPUCherk(CUmultiGPUBLAShandle handle,
   if (n == 0 || ((alpha == zero || k == 0) && beta == one))
     return CUDA_SUCCESS;
 
+  // Any copies of C cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, C, ldc, n, n, sizeof(float complex)));
+
   if (alpha == zero) {
     if (uplo == CBlasUpper) {
       if (beta == zero) {
@@ -295,7 +341,9 @@ CUresult cuMultiGPUCherk(CUmultiGPUBLAShandle handle,
     return CUDA_SUCCESS;
   }
 
-  const size_t nb = (trans == CBlasNoTrans) ? CGEMM_N_MB : CGEMM_C_NB;
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, (trans == CBlasNoTrans) ? CBlasCgemmN : CBlasCgemmC, &blocking));
+  const size_t nb = (trans == CBlasNoTrans) ? blocking.mb : blocking.nb;
 
   if (n < nb) {
     cherk(uplo, trans, n, k, alpha, A, lda, beta, C, ldc);
@@ -0,0 +1,81 @@
+#include "blas.h"
+#include "engine.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Micro-kernels used by the packed engine (portable ones until cpu_init runs) */
+const struct sgemm_ukernel * sgemm_selected = &sgemm_ukernel_c;
+const struct dgemm_ukernel * dgemm_selected = &dgemm_ukernel_c;
+
+CBlasComplexGemm complexGemm = CBlasGemm4M;
+
+/**
+ * Blocking of the engines (MC, NC, KC, TRSM and TRMM block sizes and threads)
+ * unless the tuning database has entries for the host processor.  Complex
+ * blocks use half the depth as 4M runs the real kernel over 2 * KC.
+ */
+CBlasBlocking sblocking = { .mb = 256, .nb = 4096, .kb = 256, .trsm = 128, .trmm = 512, .threads = 0 };
+CBlasBlocking dblocking = { .mb = 128, .nb = 2048, .kb = 256, .trsm =  64, .trmm = 256, .threads = 0 };
+CBlasBlocking cblocking = { .mb = 256, .nb = 2048, .kb = 128, .trsm =  64, .trmm = 256, .threads = 0 };
+CBlasBlocking zblocking = { .mb = 128, .nb = 1024, .kb = 128, .trsm =  32, .trmm = 128, .threads = 0 };
+
+/**
+ * Selects the micro-kernels for the host CPU when the library is loaded so the
+ * same library runs at full speed on every node without being rebuilt.
+ *
+ * The BLAS_KERNEL environment variable may be set to "c", "sse2", "avx2" or
+ * "avx512" to use a less capable kernel than the host supports (e.g. for
+ * testing).  Asking for a kernel the host cannot run has no effect.
+ * BLAS_COMPLEX_GEMM may be set to "3m" or "4m" to choose the complex algorithm.
+ */
+static void __attribute__((constructor)) cpu_init(void) {
+  const char * method = getenv("BLAS_COMPLEX_GEMM");
+  if (method != NULL) {
+    if (strcmp(method, "3m") == 0)
+      complexGemm = CBlasGemm3M;
+    else if (strcmp(method, "4m") == 0)
+      complexGemm = CBlasGemm4M;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+
+  int level = 0;
+  if (__builtin_cpu_supports("sse2"))
+    level = 1;
+  if (level == 1 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    level = 2;
+  if (level == 2 && __builtin_cpu_supports("avx512f"))
+    level = 3;
+
+  const char * isa = getenv("BLAS_KERNEL");
+  if (isa != NULL) {
+    int limit = level;
+    if (strcmp(isa, "c") == 0)
+      limit = 0;
+    else if (strcmp(isa, "sse2") == 0)
+      limit = 1;
+    else if (strcmp(isa, "avx2") == 0)
+      limit = 2;
+    if (limit < level)
+      level = limit;
+  }
+
+  switch (level) {
+    case 3:
+      sgemm_selected = &sgemm_ukernel_avx512;
+      dgemm_selected = &dgemm_ukernel_avx512;
+      break;
+    case 2:
+      sgemm_selected = &sgemm_ukernel_avx2;
+      dgemm_selected = &dgemm_ukernel_avx2;
+      break;
+    case 1:
+      sgemm_selected = &sgemm_ukernel_sse2;
+      dgemm_selected = &dgemm_ukernel_sse2;
+      break;
+    default:
+      break;
+  }
+#endif
+}
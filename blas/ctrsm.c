@@ -2,7 +2,7 @@
 #include "error.h"
 #include <stdio.h>
 #include "handle.h"
-#include "config.h"
+#include "engine.h"
 #include "ctrsm.fatbin.c"
 
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
@@ -31,34 +31,14 @@ static inline CUresult cuMemcpyDtoH2DAsync(void * A, size_t lda, size_t ai, size
 static const float complex zero = 0.0f + 0.0f * I;
 static const float complex one = 1.0f + 0.0f * I;
 
-void ctrsm(CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
-           size_t m, size_t n,
-           float complex alpha, const float complex * restrict A, size_t lda,
-           float complex * restrict B, size_t ldb) {
-  const size_t nRowA = (side == CBlasLeft) ? m : n;
-
-  int info = 0;
-  if (lda < nRowA)
-    info = 9;
-  else if (ldb < m)
-    info = 11;
-  if (info != 0) {
-    XERBLA(info);
-    return;
-  }
-
-  if (m == 0 || n == 0)
-    return;
-
-  if (alpha == zero) {
-#pragma omp parallel for
-    for (size_t j = 0; j < n; j++) {
-      for (size_t i = 0; i < m; i++)
-        B[j * ldb + i] = zero;
-    }
-    return;
-  }
-
+/**
+ * Level 2 triangular solve.  Used when A is small and for the diagonal blocks
+ * of the blocked algorithm.
+ */
+static void ctrsm_unblocked(CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+                            size_t m, size_t n,
+                            float complex alpha, const float complex * restrict A, size_t lda,
+                            float complex * restrict B, size_t ldb) {
   if (side == CBlasLeft) {
     if (transA == CBlasNoTrans) {
       if (uplo == CBlasUpper) {
@@ -245,11 +225,23 @@ void ctrsm(CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag
   }
 }
 
-CUresult cuCtrsm(CUBLAShandle handle,
-                 CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
-                 size_t m, size_t n,
-                 float complex alpha, CUdeviceptr A, size_t lda,
-                 CUdeviceptr B, size_t ldb, CUstream stream) {
+/**
+ * Solves X * op(A) = alpha * B.  The rows of B are independent so strips of
+ * nb rows are solved in parallel.
+ */
+static void ctrsm_right(CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+                        size_t m, size_t n, size_t nb,
+                        float complex alpha, const float complex * restrict A, size_t lda,
+                        float complex * restrict B, size_t ldb) {
+#pragma omp parallel for
+  for (size_t i = 0; i < m; i += nb)
+    ctrsm_unblocked(CBlasRight, uplo, transA, diag, min(nb, m - i), n, alpha, A, lda, &B[i], ldb);
+}
+
+void ctrsm(CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+           size_t m, size_t n,
+           float complex alpha, const float complex * restrict A, size_t lda,
+           float complex * restrict B, size_t ldb) {
   const size_t nRowA = (side == CBlasLeft) ? m : n;
 
   int info = 0;
@@ -259,17 +251,125 @@ CUresult cuCtrsm(CUBLAShandle handle,
     info = 11;
   if (info != 0) {
     XERBLA(info);
-    return CUDA_ERROR_INVALID_VALUE;
+    return;
   }
 
   if (m == 0 || n == 0)
-    return CUDA_SUCCESS;
+    return;
 
-  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+  if (alpha == zero) {
+#pragma omp parallel for
+    for (size_t j = 0; j < n; j++) {
+      for (size_t i = 0; i < m; i++)
+        B[j * ldb + i] = zero;
+    }
+    return;
+  }
 
-  if (handle->ctrsm == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->ctrsm, imageBytes));
+  const size_t nb = engine_blocking(&cblocking).trsm;
+
+  if (nRowA <= nb) {
+    if (side == CBlasLeft)
+      ctrsm_unblocked(side, uplo, transA, diag, m, n, alpha, A, lda, B, ldb);
+    else
+      ctrsm_right(uplo, transA, diag, m, n, nb, alpha, A, lda, B, ldb);
+    return;
+  }
+
+  // Each block of B is updated by a GEMM with the blocks already solved and
+  // then solved against the diagonal block of A
+  if (side == CBlasLeft) {
+    if (transA == CBlasNoTrans) {
+      if (uplo == CBlasUpper) {
+        size_t r = m % nb;
+        size_t i = (r == 0) ? m : m + nb - r;
+        do {
+          i -= nb;
+          const size_t ib = min(nb, m - i);
+          cgemm(CBlasNoTrans, CBlasNoTrans, ib, n, m - i - ib, -one, &A[(i + ib) * lda + i], lda, &B[i + ib], ldb, alpha, &B[i], ldb);
+          ctrsm_unblocked(CBlasLeft, CBlasUpper, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+        } while (i > 0);
+      }
+      else {
+        for (size_t i = 0; i < m; i += nb) {
+          const size_t ib = min(nb, m - i);
+          cgemm(CBlasNoTrans, CBlasNoTrans, ib, n, i, -one, &A[i], lda, B, ldb, alpha, &B[i], ldb);
+          ctrsm_unblocked(CBlasLeft, CBlasLower, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+        }
+      }
+
+    }
+    else {
+      if (uplo == CBlasUpper) {
+        for (size_t i = 0; i < m; i += nb) {
+          const size_t ib = min(nb, m - i);
+          cgemm(transA, CBlasNoTrans, ib, n, i, -one, &A[i * lda], lda, B, ldb, alpha, &B[i], ldb);
+          ctrsm_unblocked(CBlasLeft, CBlasUpper, transA, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+        }
+      }
+      else {
+        size_t r = m % nb;
+        size_t i = (r == 0) ? m : m + nb - r;
+        do {
+          i -= nb;
+          const size_t ib = min(nb, m - i);
+          cgemm(transA, CBlasNoTrans, ib, n, m - i - ib, -one, &A[i * lda + i + ib], lda, &B[i + ib], ldb, alpha, &B[i], ldb);
+          ctrsm_unblocked(CBlasLeft, CBlasLower, transA, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+        } while (i > 0);
+      }
+
+    }
+  }
+  else {
+    if (transA == CBlasNoTrans) {
+      if (uplo == CBlasUpper) {
+        for (size_t j = 0; j < n; j += nb) {
+          const size_t jb = min(nb, n - j);
+          cgemm(CBlasNoTrans, CBlasNoTrans, m, jb, j, -one, B, ldb, &A[j * lda], lda, alpha, &B[j * ldb], ldb);
+          ctrsm_right(CBlasUpper, CBlasNoTrans, diag, m, jb, nb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+        }
+      }
+      else {
+        size_t r = n % nb;
+        size_t j = (r == 0) ? n : n + nb - r;
+        do {
+          j -= nb;
+          const size_t jb = min(nb, n - j);
+          cgemm(CBlasNoTrans, CBlasNoTrans, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[j * lda + j + jb], lda, alpha, &B[j * ldb], ldb);
+          ctrsm_right(CBlasLower, CBlasNoTrans, diag, m, jb, nb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+        } while (j > 0);
+      }
+
+    }
+    else {
+      if (uplo == CBlasUpper) {
+        size_t r = n % nb;
+        size_t j = (r == 0) ? n : n + nb - r;
+        do {
+          j -= nb;
+          const size_t jb = min(nb, n - j);
+          cgemm(CBlasNoTrans, transA, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[(j + jb) * lda + j], lda, alpha, &B[j * ldb], ldb);
+          ctrsm_right(CBlasUpper, transA, diag, m, jb, nb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+        } while (j > 0);
+      }
+      else {
+        for (size_t j = 0; j < n; j += nb) {
+          const size_t jb = min(nb, n - j);
+          cgemm(CBlasNoTrans, transA, m, jb, j, -one, B, ldb, &A[j], lda, alpha, &B[j * ldb], ldb);
+          ctrsm_right(CBlasLower, transA, diag, m, jb, nb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+        }
+      }
+
+    }
+  }
+}
 
+/**
+ * Looks up the kernel for one combination of options and the block sizes it was
+ * compiled for.
+ */
+static CUresult lookup(CUmodule module, CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+                       struct cukernel * kernel) {
   const unsigned int bx =  4;
   const unsigned int by =  4;
   const unsigned int mb = (side == CBlasLeft) ?  4 : 16;
@@ -280,12 +380,74 @@ CUresult cuCtrsm(CUBLAShandle handle,
            "_Z5ctrsmIL9CBlasSide%dEL9CBlasUplo%dEL14CBlasTranspose%dEL9CBlasDiag%dELj%uELj%uELj%uELj%uEEvPK6float2PS4_S4_iiii",
            side, uplo, transA, diag, mb, nb, bx, by);
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->ctrsm, name));
+  CU_ERROR_CHECK(cuModuleGetFunction(&kernel->function, module, name));
+  kernel->mb = mb;
+  kernel->nb = nb;
+  kernel->bx = bx;
+  kernel->by = by;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Loads the CTRSM module and looks up the kernel for each side, uplo, transA
+ * and diag so that a launch only has to index the handle's table.  The handle's
+ * context must be current.
+ */
+CUresult ctrsm_load(CUBLAShandle handle) {
+  const CBlasSide sides[] = { CBlasLeft, CBlasRight };
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const CBlasTranspose transs[] = { CBlasNoTrans, CBlasTrans, CBlasConjTrans };
+  const CBlasDiag diags[] = { CBlasNonUnit, CBlasUnit };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int s = 0; s < 2; s++) {
+    for (int u = 0; u < 2; u++) {
+      for (int a = 0; a < 3; a++) {
+        for (int d = 0; d < 2; d++)
+          CU_ERROR_CHECK(lookup(module, sides[s], uplos[u], transs[a], diags[d], &handle->ctrsmKernels[s][u][a][d]));
+      }
+    }
+  }
+
+  handle->ctrsm = module;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuCtrsm(CUBLAShandle handle,
+                 CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+                 size_t m, size_t n,
+                 float complex alpha, CUdeviceptr A, size_t lda,
+                 CUdeviceptr B, size_t ldb, CUstream stream) {
+  const size_t nRowA = (side == CBlasLeft) ? m : n;
+
+  int info = 0;
+  if (lda < nRowA)
+    info = 9;
+  else if (ldb < m)
+    info = 11;
+  if (info != 0) {
+    XERBLA(info);
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+
+  if (handle->ctrsm == NULL)
+    CU_ERROR_CHECK(ctrsm_load(handle));
+
+  const struct cukernel * kernel = &handle->ctrsmKernels[sideIndex(side)][uploIndex(uplo)][transIndex(transA)][diagIndex(diag)];
+  const unsigned int mb = kernel->mb, nb = kernel->nb, bx = kernel->bx, by = kernel->by;
 
   void * params[] = { &A, &B, &alpha, &lda, &ldb, &m, &n };
 
-  CU_ERROR_CHECK(cuLaunchKernel(function, (unsigned int)(m + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
+  CU_ERROR_CHECK(cuLaunchKernel(kernel->function, (unsigned int)(m + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
                                 bx, by, 1, 0, stream, params, NULL));
 
   CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
@@ -313,13 +475,23 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
   if (m == 0 || n == 0)
     return CUDA_SUCCESS;
 
+  // Any copies of B cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, B, ldb, m, n, sizeof(float complex)));
+
   if (alpha == zero) {
-    cgemm(CBlasNoTrans, CBlasNoTrans, m, n, 0, zero, A, lda, B, ldb, zero, B, ldb);
+#pragma omp parallel for
+    for (size_t j = 0; j < n; j++) {
+      for (size_t i = 0; i < m; i++)
+        B[j * ldb + i] = zero;
+    }
     return CUDA_SUCCESS;
   }
 
-  const size_t mb = (transA == CBlasNoTrans) ? CGEMM_N_MB : CGEMM_C_MB;
-  const size_t nb = CGEMM_N_NB;
+  CBlasBlocking blocking, blockingN;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, (transA == CBlasNoTrans) ? CBlasCgemmN : CBlasCgemmC, &blocking));
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, CBlasCgemmN, &blockingN));
+  const size_t mb = blocking.mb;
+  const size_t nb = blockingN.nb;
 
   if (side == CBlasLeft) {
     if (transA == CBlasNoTrans) {
@@ -330,7 +502,6 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
           i -= mb;
           const size_t ib = min(mb, m - i);
           CU_ERROR_CHECK(cuMultiGPUCgemm(handle, CBlasNoTrans, CBlasNoTrans, ib, n, m - i - ib, -one, &A[(i + ib) * lda + i], lda, &B[i + ib], ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           ctrsm(CBlasLeft, CBlasUpper, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
         } while (i > 0);
       }
@@ -338,7 +509,6 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
         for (size_t i = 0; i < m; i += mb) {
           const size_t ib = min(mb, m - i);
           CU_ERROR_CHECK(cuMultiGPUCgemm(handle, CBlasNoTrans, CBlasNoTrans, ib, n, i, -one, &A[i], lda, B, ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           ctrsm(CBlasLeft, CBlasLower, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
         }
       }
@@ -349,7 +519,6 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
         for (size_t i = 0; i < m; i += mb) {
           const size_t ib = min(mb, m - i);
           CU_ERROR_CHECK(cuMultiGPUCgemm(handle, transA, CBlasNoTrans, ib, n, i, -one, &A[i * lda], lda, B, ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           ctrsm(CBlasLeft, CBlasUpper, transA, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
         }
       }
@@ -360,7 +529,6 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
           i -= mb;
           const size_t ib = min(mb, m - i);
           CU_ERROR_CHECK(cuMultiGPUCgemm(handle, transA, CBlasNoTrans, ib, n, m - i - ib, -one, &A[i * lda + i + ib], lda, &B[i + ib], ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           ctrsm(CBlasLeft, CBlasLower, transA, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
         } while (i > 0);
       }
@@ -373,7 +541,6 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
         for (size_t j = 0; j < n; j += nb) {
           const size_t jb = min(nb, n - j);
           CU_ERROR_CHECK(cuMultiGPUCgemm(handle, CBlasNoTrans, CBlasNoTrans, m, jb, j, -one, B, ldb, &A[j * lda], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           ctrsm(CBlasRight, CBlasUpper, CBlasNoTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
         }
       }
@@ -384,7 +551,6 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
           j -= nb;
           const size_t jb = min(nb, n - j);
           CU_ERROR_CHECK(cuMultiGPUCgemm(handle, CBlasNoTrans, CBlasNoTrans, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[j * lda + j + jb], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           ctrsm(CBlasRight, CBlasLower, CBlasNoTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
         } while (j > 0);
       }
@@ -398,7 +564,6 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
           j -= nb;
           const size_t jb = min(nb, n - j);
           CU_ERROR_CHECK(cuMultiGPUCgemm(handle, CBlasNoTrans, transA, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[(j + jb) * lda + j], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           ctrsm(CBlasRight, CBlasUpper, transA, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
         } while (j > 0);
       }
@@ -406,7 +571,6 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
         for (size_t j = 0; j < n; j += nb) {
           const size_t jb = min(nb, n - j);
           CU_ERROR_CHECK(cuMultiGPUCgemm(handle, CBlasNoTrans, transA, m, jb, j, -one, B, ldb, &A[j], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           ctrsm(CBlasRight, CBlasLower, transA, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
         }
       }
@@ -414,5 +578,8 @@ CUresult cuMultiGPUCtrsm(CUmultiGPUBLAShandle handle,
     }
   }
 
+  // Blocks of B were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, B, ldb, m, n, sizeof(float complex)));
+
   return CUDA_SUCCESS;
 }
@@ -1,8 +1,10 @@
 #include "blas.h"
 #include "error.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
 #include "handle.h"
-#include "config.h"
+#include "engine.h"
 #include "dgemm.fatbin.c"
 
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
@@ -53,7 +55,7 @@ void dgemm(CBlasTranspose transA, CBlasTranspose transB,
   if (m == 0 || n == 0 || ((alpha == zero || k == 0) && beta == one))
     return;
 
-  if (alpha == zero) {
+  if (alpha == zero || k == 0) {
     if (beta == zero) {
 #pragma omp parallel for
       for (size_t j = 0; j < n; j++) {
@@ -71,6 +73,10 @@ void dgemm(CBlasTranspose transA, CBlasTranspose transB,
     return;
   }
 
+  if (dgemm_packed(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc))
+    return;
+
+  // Fall back to unpacked loops if the packing buffers could not be allocated
   if (transB == CBlasNoTrans) {
     if (transA == CBlasNoTrans) {
 #pragma omp parallel for
@@ -145,6 +151,55 @@ void dgemm(CBlasTranspose transA, CBlasTranspose transB,
   }
 }
 
+/**
+ * Looks up the kernel for one combination of options and the block sizes it was
+ * compiled for.
+ */
+static CUresult lookup(CUmodule module, CBlasTranspose transA, CBlasTranspose transB,
+                       struct cukernel * kernel) {
+  const unsigned int mb = (transA == CBlasNoTrans) ? 64 : 32;
+  const unsigned int nb = (transA == CBlasNoTrans) ?  8 : 16;
+  const unsigned int kb = (transA == CBlasNoTrans) ? 16 :  8;
+  const unsigned int bx = (transA == CBlasNoTrans) ? ((transB == CBlasNoTrans) ? 16 : 8) :  8;
+  const unsigned int by = (transA == CBlasNoTrans) ? ((transB == CBlasNoTrans) ?  4 : 8) :  8;
+
+  char name[84];
+  snprintf(name, 84,
+           "_Z6dgemm2IL14CBlasTranspose%dELS0_%dELj%uELj%uELj%uELj%uELj%uEEvPKdS2_S2_Pdddiiiiiii",
+           transA, transB, mb, nb, kb, bx, by);
+
+  CU_ERROR_CHECK(cuModuleGetFunction(&kernel->function, module, name));
+  kernel->mb = mb;
+  kernel->nb = nb;
+  kernel->kb = kb;
+  kernel->bx = bx;
+  kernel->by = by;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Loads the DGEMM2 module and looks up the kernel for each transA and transB so
+ * that a launch only has to index the handle's table.  The handle's context
+ * must be current.
+ */
+CUresult dgemm2_load(CUBLAShandle handle) {
+  // The conjugate transpose of a real matrix is its transpose
+  const CBlasTranspose transs[] = { CBlasNoTrans, CBlasTrans, CBlasTrans };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int a = 0; a < 3; a++) {
+    for (int b = 0; b < 3; b++)
+      CU_ERROR_CHECK(lookup(module, transs[a], transs[b], &handle->dgemm2Kernels[a][b]));
+  }
+
+  handle->dgemm2 = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuDgemm2(CUBLAShandle handle, CBlasTranspose transA, CBlasTranspose transB,
                   size_t m, size_t n, size_t k,
                   double alpha, CUdeviceptr A, size_t lda, CUdeviceptr B, size_t ldb,
@@ -173,25 +228,14 @@ CUresult cuDgemm2(CUBLAShandle handle, CBlasTranspose transA, CBlasTranspose tra
   CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
 
   if (handle->dgemm2 == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->dgemm2, imageBytes));
+    CU_ERROR_CHECK(dgemm2_load(handle));
 
-  const unsigned int mb = (transA == CBlasNoTrans) ? 64 : 32;
-  const unsigned int nb = (transA == CBlasNoTrans) ?  8 : 16;
-  const unsigned int kb = (transA == CBlasNoTrans) ? 16 :  8;
-  const unsigned int bx = (transA == CBlasNoTrans) ? ((transB == CBlasNoTrans) ? 16 : 8) :  8;
-  const unsigned int by = (transA == CBlasNoTrans) ? ((transB == CBlasNoTrans) ?  4 : 8) :  8;
-
-  char name[84];
-  snprintf(name, 84,
-           "_Z6dgemm2IL14CBlasTranspose%dELS0_%dELj%uELj%uELj%uELj%uELj%uEEvPKdS2_S2_Pdddiiiiiii",
-           transA, transB, mb, nb, kb, bx, by);
-
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->dgemm2, name));
+  const struct cukernel * kernel = &handle->dgemm2Kernels[transIndex(transA)][transIndex(transB)];
+  const unsigned int mb = kernel->mb, nb = kernel->nb, bx = kernel->bx, by = kernel->by;
 
   void * params[] = { &A, &B, &C, &D, &alpha, &beta, &lda, &ldb, &ldc, &ldd, &m, &n, &k };
 
-  CU_ERROR_CHECK(cuLaunchKernel(function, (unsigned int)(m + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
+  CU_ERROR_CHECK(cuLaunchKernel(kernel->function, (unsigned int)(m + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
                                 bx, by, 1, 0, stream, params, NULL));
 
   CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
@@ -200,7 +244,7 @@ CUresult cuDgemm2(CUBLAShandle handle, CBlasTranspose transA, CBlasTranspose tra
 }
 
 struct dgemm_args {
-  CUBLAShandle handle;
+  CUmultiGPUBLAShandle handle;
   const double * A, * B;
   double * C;
   size_t m, n, k, lda, ldb, ldc;
@@ -208,223 +252,268 @@ struct dgemm_args {
   CBlasTranspose transA, transB;
 };
 
-static CUresult background_dgemm(const void * a) {
-  struct dgemm_args * args = (struct dgemm_args *)a;
-  CUBLAShandle handle = args->handle;
+/**
+ * Gets rows (columns) [l, l + lb) of an n column (row) host matrix onto the
+ * device on a stream.  The block comes from the tile cache if it has room for
+ * it and is otherwise copied into the buffer given.
+ */
+static inline CUresult fetch(CUBLAShandle handle, bool columns,
+                             const double * X, size_t ldx, size_t l, size_t lb, size_t n,
+                             CUdeviceptr buffer, size_t ldbuf, CUstream stream,
+                             CUdeviceptr * ptr, size_t * ld) {
+  const double * block = (columns) ? &X[l * ldx] : &X[l];
+  const size_t m = (columns) ? n : lb;
+  const size_t c = (columns) ? lb : n;
+
+  CU_ERROR_CHECK(tilecache_get(handle, block, ldx, m, c, sizeof(double), stream, ptr, ld));
+  if (*ptr == 0) {
+    CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(buffer, ldbuf, 0, 0, block, ldx, 0, 0,
+                                       m, c, sizeof(double), stream));
+    *ptr = buffer;
+    *ld = ldbuf;
+  }
 
-  // Block sizes
-  const size_t mb = (args->transA == CBlasNoTrans) ? DGEMM_N_MB : DGEMM_T_MB;
-  const size_t nb = (args->transA == CBlasNoTrans) ? DGEMM_N_NB : DGEMM_T_NB;
-  const size_t kb = (args->transA == CBlasNoTrans) ? DGEMM_N_KB : DGEMM_T_KB;
+  return CUDA_SUCCESS;
+}
+
+static CUresult device_dgemm(CUBLAShandle handle, const struct dgemm_args * args) {
+  // Block sizes.  The tile of C is the one the driver split off and the inner
+  // block size is the one tuned for this device.
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuBLASGetBlocking(handle, (args->transA == CBlasNoTrans) ? CBlasDgemmN : CBlasDgemmT, &blocking));
+  const size_t mb = args->m, nb = args->n, kb = blocking.kb;
 
-  // Temporary device memory and streams
+  // Temporary device memory
   CUdeviceptr A0, A1, B0, B1, C;
   size_t lda, ldb, ldc;
-  CUstream copy, compute;
 
   // Allocate two matrices for blocks of A and B on the device and one for a
   // block of C
   if (args->transA == CBlasNoTrans) {
-    CU_ERROR_CHECK(cuMemAllocPitch(&A0, &lda, mb * sizeof(double), kb, sizeof(double)));
-    CU_ERROR_CHECK(cuMemAllocPitch(&A1, &lda, mb * sizeof(double), kb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &A0, &lda, mb * sizeof(double), kb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &A1, &lda, mb * sizeof(double), kb, sizeof(double)));
   }
   else {
-    CU_ERROR_CHECK(cuMemAllocPitch(&A0, &lda, kb * sizeof(double), mb, sizeof(double)));
-    CU_ERROR_CHECK(cuMemAllocPitch(&A1, &lda, kb * sizeof(double), mb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &A0, &lda, kb * sizeof(double), mb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &A1, &lda, kb * sizeof(double), mb, sizeof(double)));
   }
   lda /= sizeof(double);
 
   if (args->transB == CBlasNoTrans) {
-    CU_ERROR_CHECK(cuMemAllocPitch(&B0, &ldb, kb * sizeof(double), nb, sizeof(double)));
-    CU_ERROR_CHECK(cuMemAllocPitch(&B1, &ldb, kb * sizeof(double), nb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &B0, &ldb, kb * sizeof(double), nb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &B1, &ldb, kb * sizeof(double), nb, sizeof(double)));
   }
   else {
-    CU_ERROR_CHECK(cuMemAllocPitch(&B0, &ldb, nb * sizeof(double), kb, sizeof(double)));
-    CU_ERROR_CHECK(cuMemAllocPitch(&B1, &ldb, nb * sizeof(double), kb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &B0, &ldb, nb * sizeof(double), kb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &B1, &ldb, nb * sizeof(double), kb, sizeof(double)));
   }
   ldb /= sizeof(double);
 
-  CU_ERROR_CHECK(cuMemAllocPitch(&C, &ldc, mb * sizeof(double), nb, sizeof(double)));
+  CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &C, &ldc, mb * sizeof(double), nb, sizeof(double)));
   ldc /= sizeof(double);
 
-  // Create streams
-  CU_ERROR_CHECK(cuStreamCreate(&copy, CU_STREAM_NON_BLOCKING));
-  CU_ERROR_CHECK(cuStreamCreate(&compute, CU_STREAM_NON_BLOCKING));
+  // Start the task on the handle's pipeline
+  CU_ERROR_CHECK(pipeline_begin(handle));
+  struct cupipeline * pipeline = &handle->pipeline;
+  CUdeviceptr A[] = { A0, A1 }, B[] = { B0, B1 };
 
-  // Copy C onto the device using the compute stream
+  // Copy C onto the device on the same stream as the first blocks of A and B
+  // so that it can be scaled as soon as they are ready
   CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(C, ldc, 0, 0,
                                      args->C, args->ldc, 0, 0,
-                                     args->m, args->n, sizeof(double), compute));
+                                     args->m, args->n, sizeof(double), pipeline->h2d));
+
+  // Blocks of op(A) are columns of A if it is not transposed and blocks of
+  // op(B) are columns of B if it is
+  const bool columnsA = (args->transA == CBlasNoTrans);
+  const bool columnsB = (args->transB != CBlasNoTrans);
+  const bool multiply = (args->alpha != zero && args->k > 0);
+  CUdeviceptr dA, dB;
+  size_t ldda, lddb;
+
+  if (multiply) {
+    const size_t lb = min(args->k, kb);
+    CU_ERROR_CHECK(fetch(handle, columnsA, args->A, args->lda, 0, lb, args->m,
+                         A[0], lda, pipeline->h2d, &dA, &ldda));
+    CU_ERROR_CHECK(fetch(handle, columnsB, args->B, args->ldb, 0, lb, args->n,
+                         B[0], ldb, pipeline->h2d, &dB, &lddb));
+  }
+  CU_ERROR_CHECK(cuEventRecord(pipeline->ready[0], pipeline->h2d));
 
-  // Perform C *= beta on the compute stream to ensure C has finished copying
+  // Perform C *= beta once C is on the device
+  CU_ERROR_CHECK(cuStreamWaitEvent(pipeline->compute, pipeline->ready[0], 0));
   CU_ERROR_CHECK(cuDgemm(handle, CBlasNoTrans, CBlasNoTrans,
                          args->m, args->n, 0,
                          zero, 0, ldc, 0, 0,
-                         args->beta, C, ldc, compute));
-
-  // Can exit early if alpha * op(A) * op(B) will evaluate to zero
-  if (args->alpha != zero && args->k > 0) {
-
-    // Perform C += alpha * op(A) * op(B)
-    if (args->transB == CBlasNoTrans) {
-      if (args->transA == CBlasNoTrans) {
-        // Copy A and B onto the device asynchronously on the same stream as C
-        const size_t lb = min(args->k, kb);
-        CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A0, lda, 0, 0,
-                                           args->A, args->lda, 0, 0,
-                                           args->m, lb, sizeof(double), compute));
-        CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(B0, ldb, 0, 0,
-                                           args->B, args->ldb, 0, 0,
-                                           lb, args->n, sizeof(double), compute));
-
-        for (size_t l = 0; l < args->k; l += kb) {
-          // Compute C on the same stream as the copies to ensure they have finished first
-          CU_ERROR_CHECK(cuDgemm(handle, args->transA, args->transB,
-                                 args->m, args->n, min(args->k - l, kb),
-                                 args->alpha, A0, lda, B0, ldb,
-                                 one, C, ldc, compute));
-
-          // If there is more work to do
-          if (l + kb < args->k) {
-            const size_t lb = min(args->k - l - kb, kb);
-            // Copy the next blocks of A and B on the opposite stream from the dgemm
-            CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A1, lda, 0, 0,
-                                               args->A, args->lda, 0, l + kb,
-                                               args->m, lb, sizeof(double), copy));
-            CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(B1, ldb, 0, 0,
-                                               args->B, args->ldb, l + kb, 0,
-                                               lb, args->n, sizeof(double), copy));
-
-            // Swap the streams and pointers so that the compute starts after the copy
-            CUstream stream = compute; compute = copy; copy = stream;
-            CUdeviceptr ptr = A0; A0 = A1; A1 = ptr;
-            ptr = B0; B0 = B1; B1 = ptr;
-          }
-        }
+                         args->beta, C, ldc, pipeline->compute));
+
+  // Can skip the multiply if alpha * op(A) * op(B) will evaluate to zero
+  if (multiply) {
+    // Perform C += alpha * op(A) * op(B), copying the next blocks of A and B
+    // into the other buffer while the current ones are multiplied
+    for (size_t l = 0, b = 0; l < args->k; l += kb, b++) {
+      if (b > 0)
+        CU_ERROR_CHECK(cuStreamWaitEvent(pipeline->compute, pipeline->ready[b & 1], 0));
+      CU_ERROR_CHECK(cuDgemm(handle, args->transA, args->transB,
+                             args->m, args->n, min(args->k - l, kb),
+                             args->alpha, dA, ldda, dB, lddb,
+                             one, C, ldc, pipeline->compute));
+      CU_ERROR_CHECK(cuEventRecord(pipeline->consumed[b & 1], pipeline->compute));
+
+      // If there is more work to do
+      if (l + kb < args->k) {
+        const size_t lb = min(args->k - l - kb, kb);
+        const size_t next = (b + 1) & 1;
+
+        // Wait for the multiply two blocks ago to finish with the buffer
+        if (b > 0)
+          CU_ERROR_CHECK(cuStreamWaitEvent(pipeline->h2d, pipeline->consumed[next], 0));
+        CU_ERROR_CHECK(fetch(handle, columnsA, args->A, args->lda, l + kb, lb, args->m,
+                             A[next], lda, pipeline->h2d, &dA, &ldda));
+        CU_ERROR_CHECK(fetch(handle, columnsB, args->B, args->ldb, l + kb, lb, args->n,
+                             B[next], ldb, pipeline->h2d, &dB, &lddb));
+        CU_ERROR_CHECK(cuEventRecord(pipeline->ready[next], pipeline->h2d));
       }
-      else {
-        // Copy A and B onto the device asynchronously on the same stream as C
-        const size_t lb = min(args->k, kb);
-        CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A0, lda, 0, 0,
-                                           args->A, args->lda, 0, 0,
-                                           lb, args->m, sizeof(double), compute));
-        CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(B0, ldb, 0, 0,
-                                           args->B, args->ldb, 0, 0,
-                                           lb, args->n, sizeof(double), compute));
-
-        for (size_t l = 0; l < args->k; l += kb) {
-          // Compute C on the same stream as the copies to ensure they have finished first
-          CU_ERROR_CHECK(cuDgemm(handle, args->transA, args->transB,
-                                 args->m, args->n, min(args->k - l, kb),
-                                 args->alpha, A0, lda, B0, ldb,
-                                 one, C, ldc, compute));
-
-          // If there is more work to do
-          if (l + kb < args->k) {
-            const size_t lb = min(args->k - l - kb, kb);
-            // Copy the next blocks of A and B on the opposite stream from the dgemm
-            CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A1, lda, 0, 0,
-                                               args->A, args->lda, l + kb, 0,
-                                               lb, args->m, sizeof(double), copy));
-            CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(B1, ldb, 0, 0,
-                                               args->B, args->ldb, l + kb, 0,
-                                               lb, args->n, sizeof(double), copy));
-
-            // Swap the streams and pointers so that the compute starts after the copy
-            CUstream stream = compute; compute = copy; copy = stream;
-            CUdeviceptr ptr = A0; A0 = A1; A1 = ptr;
-            ptr = B0; B0 = B1; B1 = ptr;
-          }
+    }
+  }
+
+  // Copy C back onto the host once it has been computed
+  CU_ERROR_CHECK(cuEventRecord(pipeline->computed, pipeline->compute));
+  CU_ERROR_CHECK(cuStreamWaitEvent(pipeline->d2h, pipeline->computed, 0));
+  CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(args->C, args->ldc, 0, 0, C, ldc, 0, 0,
+                                     args->m, args->n, sizeof(double), pipeline->d2h));
+
+  // Wait for the previous task instead of this one so that the next task can
+  // start copying while this one computes.  The memory goes back to the pool
+  // once the next task (or the flush at the end of the call) has waited for C.
+  const CUdeviceptr buffers[] = { A0, A1, B0, B1, C };
+  CU_ERROR_CHECK(pipeline_end(handle, buffers, 5));
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult background_dgemm(const void * a) {
+  const struct dgemm_args * args = (const struct dgemm_args *)a;
+
+  // Use the handle for the context the tile is running on as it may have been
+  // stolen from another context
+  const int context = cuMultiGPUGetCurrentContext();
+  CUBLAShandle handle = &args->handle->handles[context];
+
+  struct timeval start, stop;
+  ERROR_CHECK(gettimeofday(&start, NULL));
+
+  // The host context computes the tile in place using the CPU BLAS
+  if (handle->host)
+    dgemm(args->transA, args->transB, args->m, args->n, args->k,
+          args->alpha, args->A, args->lda, args->B, args->ldb,
+          args->beta, args->C, args->ldc);
+  else
+    CU_ERROR_CHECK(device_dgemm(handle, args));
+
+  ERROR_CHECK(gettimeofday(&stop, NULL));
+
+  // Record how fast the context got through the tile so that it is given a
+  // share of later tiles in proportion to its speed.  A and B are copied onto
+  // the device and C is copied both ways.  Device tiles return once they are
+  // queued behind the previous tile so the time is how long the pipeline took
+  // to make room for this one.
+  const double time = (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_usec - start.tv_usec) * 1.E-6;
+  const double flops = 2.0 * (double)args->m * (double)args->n * (double)args->k;
+  const double bytes = (double)(((args->m + args->n) * args->k + 2 * args->m * args->n) * sizeof(double));
+  if (args->k > 0 && time > 0.0)
+    CU_ERROR_CHECK(cuMultiGPURecordThroughput(args->handle->mGPU, context, flops, bytes, time));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Creates a task for each mb by nb tile of C, deals the tasks out to the
+ * contexts and waits for them to finish.
+ *
+ * @param args      arguments shared by every tile.
+ * @param m         the number of rows of C.
+ * @param n         the number of columns of C.
+ * @param mb        the number of rows in each tile.
+ * @param nb        the number of columns in each tile.
+ * @param A, B, C   the matrices.
+ * @param tasks     storage for one task per tile.
+ * @param contexts  storage for the context of each task.
+ * @param result    the first unsuccessful result returned by the tasks.
+ * @return CUDA_SUCCESS if the tasks ran, or the error that stopped them.
+ */
+static CUresult tiled_dgemm(struct dgemm_args args, size_t m, size_t n, size_t mb, size_t nb,
+                            const double * A, const double * B, double * C,
+                            CUtask * tasks, int * contexts, CUresult * result) {
+  const CBlasTranspose transA = args.transA, transB = args.transB;
+  const size_t k = args.k, lda = args.lda, ldb = args.ldb, ldc = args.ldc;
+  int task = 0, nTasks = (int)(((m + mb - 1) / mb) * ((n + nb - 1) / nb));
+
+  if (transB == CBlasNoTrans) {
+    if (transA == CBlasNoTrans) {
+      for (size_t j = 0; j < n; j += nb) {
+        args.n = min(n - j, nb);
+        for (size_t i = 0; i < m; i += mb) {
+          args.m = min(m - i, mb);
+          args.A = &A[i];
+          args.B = &B[j * ldb];
+          args.C = &C[j * ldc + i];
+          CU_ERROR_CHECK(cuTaskCreate(&tasks[task], background_dgemm, &args, sizeof(struct dgemm_args)));
+          task++;
         }
       }
     }
     else {
-      if (args->transA == CBlasNoTrans) {
-        // Copy A and B onto the device asynchronously on the same stream as C
-        const size_t lb = min(args->k, kb);
-        CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A0, lda, 0, 0,
-                                           args->A, args->lda, 0, 0,
-                                           args->m, lb, sizeof(double), compute));
-        CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(B0, ldb, 0, 0,
-                                           args->B, args->ldb, 0, 0,
-                                           args->n, lb, sizeof(double), compute));
-
-        for (size_t l = 0; l < args->k; l += kb) {
-          // Compute C on the same stream as the copies to ensure they have finished first
-          CU_ERROR_CHECK(cuDgemm(handle, args->transA, args->transB,
-                                 args->m, args->n, min(args->k - l, kb),
-                                 args->alpha, A0, lda, B0, ldb,
-                                 one, C, ldc, compute));
-
-          // If there is more work to do
-          if (l + kb < args->k) {
-            const size_t lb = min(args->k - l - kb, kb);
-            // Copy the next blocks of A and B on the opposite stream from the dgemm
-            CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A1, lda, 0, 0,
-                                               args->A, args->lda, 0, l + kb,
-                                               args->m, lb, sizeof(double), copy));
-            CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(B1, ldb, 0, 0,
-                                               args->B, args->ldb, 0, l + kb,
-                                               args->n, lb, sizeof(double), copy));
-
-            // Swap the streams and pointers so that the compute starts after the copy
-            CUstream stream = compute; compute = copy; copy = stream;
-            CUdeviceptr ptr = A0; A0 = A1; A1 = ptr;
-            ptr = B0; B0 = B1; B1 = ptr;
-          }
+      for (size_t j = 0; j < n; j += nb) {
+        args.n = min(n - j, nb);
+        for (size_t i = 0; i < m; i += mb) {
+          args.m = min(m - i, mb);
+          args.A = &A[i * lda];
+          args.B = &B[j * ldb];
+          args.C = &C[j * ldc + i];
+          CU_ERROR_CHECK(cuTaskCreate(&tasks[task], background_dgemm, &args, sizeof(struct dgemm_args)));
+          task++;
         }
       }
-      else {
-        // Copy A and B onto the device asynchronously on the same stream as C
-        const size_t lb = min(args->k, kb);
-        CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A0, lda, 0, 0,
-                                           args->A, args->lda, 0, 0,
-                                           lb, args->m, sizeof(double), compute));
-        CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(B0, ldb, 0, 0,
-                                           args->B, args->ldb, 0, 0,
-                                           args->n, lb, sizeof(double), compute));
-
-        for (size_t l = 0; l < args->k; l += kb) {
-          // Compute C on the same stream as the copies to ensure they have finished first
-          CU_ERROR_CHECK(cuDgemm(handle, args->transA, args->transB,
-                                 args->m, args->n, min(args->k - l, kb),
-                                 args->alpha, A0, lda, B0, ldb,
-                                 one, C, ldc, compute));
-
-          // If there is more work to do
-          if (l + kb < args->k) {
-            const size_t lb = min(args->k - l - kb, kb);
-            // Copy the next blocks of A and B on the opposite stream from the dgemm
-            CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A1, lda, 0, 0,
-                                               args->A, args->lda, l + kb, 0,
-                                               lb, args->m, sizeof(double), copy));
-            CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(B1, ldb, 0, 0,
-                                               args->B, args->ldb, 0, l + kb,
-                                               args->n, lb, sizeof(double), copy));
-
-            // Swap the streams and pointers so that the compute starts after the copy
-            CUstream stream = compute; compute = copy; copy = stream;
-            CUdeviceptr ptr = A0; A0 = A1; A1 = ptr;
-            ptr = B0; B0 = B1; B1 = ptr;
-          }
+    }
+  }
+  else {
+    if (transA == CBlasNoTrans) {
+      for (size_t j = 0; j < n; j += nb) {
+        args.n = min(n - j, nb);
+        for (size_t i = 0; i < m; i += mb) {
+          args.m = min(m - i, mb);
+          args.A = &A[i];
+          args.B = &B[j];
+          args.C = &C[j * ldc + i];
+          CU_ERROR_CHECK(cuTaskCreate(&tasks[task], background_dgemm, &args, sizeof(struct dgemm_args)));
+          task++;
+        }
+      }
+    }
+    else {
+      for (size_t j = 0; j < n; j += nb) {
+        args.n = min(n - j, nb);
+        for (size_t i = 0; i < m; i += mb) {
+          args.m = min(m - i, mb);
+          args.A = &A[i * lda];
+          args.B = &B[j];
+          args.C = &C[j * ldc + i];
+          CU_ERROR_CHECK(cuTaskCreate(&tasks[task], background_dgemm, &args, sizeof(struct dgemm_args)));
+          task++;
         }
       }
     }
   }
 
-  // Copy C back onto the host on the compute stream
-  CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(args->C, args->ldc, 0, 0, C, ldc, 0, 0,
-                                     args->m, args->n, sizeof(double), compute));
-
-  // Clean up temporary memory and streams
-  CU_ERROR_CHECK(cuMemFree(A0));
-  CU_ERROR_CHECK(cuMemFree(A1));
-  CU_ERROR_CHECK(cuMemFree(B0));
-  CU_ERROR_CHECK(cuMemFree(B1));
-  CU_ERROR_CHECK(cuMemFree(C));
+  // Deal the tiles out in proportion to the rate each context is predicted to
+  // get through them and hand them all to the background threads at once
+  const double flops = 2.0 * (double)mb * (double)nb * (double)k;
+  const double bytes = (double)(((mb + nb) * k + 2 * mb * nb) * sizeof(double));
+  CU_ERROR_CHECK(cuMultiGPUPartition(args.handle->mGPU, flops, bytes, contexts, (size_t)nTasks));
+  CU_ERROR_CHECK(cuMultiGPURunTasks(args.handle->mGPU, contexts, tasks, (size_t)nTasks));
 
-  CU_ERROR_CHECK(cuStreamDestroy(copy));
-  CU_ERROR_CHECK(cuStreamDestroy(compute));
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, (size_t)nTasks, result));
 
   return CUDA_SUCCESS;
 }
@@ -453,6 +542,9 @@ CUresult cuMultiGPUDgemm(CUmultiGPUBLAShandle handle,
   if (m == 0 || n == 0 || ((alpha == zero || k == 0) && beta == one))
     return CUDA_SUCCESS;
 
+  // Any copies of C cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, C, ldc, m, n, sizeof(double)));
+
   if (alpha == zero) {
     if (beta == zero) {
 #pragma omp parallel for
@@ -470,97 +562,41 @@ CUresult cuMultiGPUDgemm(CUmultiGPUBLAShandle handle,
     }
     return CUDA_SUCCESS;
   }
-  const size_t mb = (transA == CBlasNoTrans) ? DGEMM_N_MB : DGEMM_T_MB;
-  const size_t nb = (transA == CBlasNoTrans) ? DGEMM_N_NB : DGEMM_T_NB;
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, (transA == CBlasNoTrans) ? CBlasDgemmN : CBlasDgemmT, &blocking));
+  const size_t mb = blocking.mb, nb = blocking.nb;
 
   if (m < mb && n < nb) {
     dgemm(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
     return CUDA_SUCCESS;
   }
 
-  int task = 0, nTasks = (int)(((m + mb - 1) / mb) * ((n + nb - 1) / nb));
-  CUtask tasks[nTasks];
-
-  int ctx = 0;
-  int nCtxs = cuMultiGPUGetContextCount(handle->mGPU);
+  // The tasks go on the heap as the number of tiles depends on the blocking
+  const size_t nTasks = ((m + mb - 1) / mb) * ((n + nb - 1) / nb);
+  CUtask * tasks = malloc(nTasks * sizeof(CUtask));
+  int * contexts = malloc(nTasks * sizeof(int));
+  if (tasks == NULL || contexts == NULL) {
+    free(tasks);
+    free(contexts);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
 
-  struct dgemm_args args = { .transA = transA, .transB = transB,
+  struct dgemm_args args = { .handle = handle,
+                             .transA = transA, .transB = transB,
                              .k = k,
                              .alpha = alpha, .lda = lda, .ldb = ldb,
                              .beta = beta, .ldc = ldc };
 
-  if (transB == CBlasNoTrans) {
-    if (transA == CBlasNoTrans) {
-      for (size_t j = 0; j < n; j += nb) {
-        args.n = min(n - j, nb);
-        for (size_t i = 0; i < m; i += mb) {
-          args.m = min(m - i, mb);
-          args.A = &A[i];
-          args.B = &B[j * ldb];
-          args.C = &C[j * ldc + i];
-          args.handle = &handle->handles[ctx];
-          CU_ERROR_CHECK(cuTaskCreate(&tasks[task], background_dgemm, &args, sizeof(struct dgemm_args)));
-          CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, ctx++, tasks[task++]));
-          if (ctx == nCtxs)
-            ctx = 0;
-        }
-      }
-    }
-    else {
-      for (size_t j = 0; j < n; j += nb) {
-        args.n = min(n - j, nb);
-        for (size_t i = 0; i < m; i += mb) {
-          args.m = min(m - i, mb);
-          args.A = &A[i * lda];
-          args.B = &B[j * ldb];
-          args.C = &C[j * ldc + i];
-          args.handle = &handle->handles[ctx];
-          CU_ERROR_CHECK(cuTaskCreate(&tasks[task], background_dgemm, &args, sizeof(struct dgemm_args)));
-          CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, ctx++, tasks[task++]));
-          if (ctx == nCtxs)
-            ctx = 0;
-        }
-      }
-    }
-  }
-  else {
-    if (transA == CBlasNoTrans) {
-      for (size_t j = 0; j < n; j += nb) {
-        args.n = min(n - j, nb);
-        for (size_t i = 0; i < m; i += mb) {
-          args.m = min(m - i, mb);
-          args.A = &A[i];
-          args.B = &B[j];
-          args.C = &C[j * ldc + i];
-          args.handle = &handle->handles[ctx];
-          CU_ERROR_CHECK(cuTaskCreate(&tasks[task], background_dgemm, &args, sizeof(struct dgemm_args)));
-          CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, ctx++, tasks[task++]));
-          if (ctx == nCtxs)
-            ctx = 0;
-        }
-      }
-    }
-    else {
-      for (size_t j = 0; j < n; j += nb) {
-        args.n = min(n - j, nb);
-        for (size_t i = 0; i < m; i += mb) {
-          args.m = min(m - i, mb);
-          args.A = &A[i * lda];
-          args.B = &B[j];
-          args.C = &C[j * ldc + i];
-          args.handle = &handle->handles[ctx];
-          CU_ERROR_CHECK(cuTaskCreate(&tasks[task], background_dgemm, &args, sizeof(struct dgemm_args)));
-          CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, ctx++, tasks[task++]));
-          if (ctx == nCtxs)
-            ctx = 0;
-        }
-      }
-    }
-  }
-
   CUresult result;
-  for (task = 0; task < nTasks; task++)
-    CU_ERROR_CHECK(cuTaskDestroy(tasks[task], &result));
+  CUresult error = tiled_dgemm(args, m, n, mb, nb, A, B, C, tasks, contexts, &result);
+
+  free(tasks);
+  free(contexts);
+
+  if (error != CUDA_SUCCESS)
+    return error;
 
-  return result;
+  // The last tile on each context may still be copying back
+  CUresult flushed = pipeline_flush(handle);
+  return (result != CUDA_SUCCESS) ? result : flushed;
 }
@@ -0,0 +1,307 @@
+#include "blas.h"
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Host implementations of the BLAS kernels for the emulated driver API
+ * (make EMULATION=1).  Each kernel is called once per launch with the
+ * parameters laid out as the CUDA kernel declares them and computes the whole
+ * grid using the CPU BLAS.  The tables are loaded by cuModuleLoadData in place
+ * of the fatbins and are named after the module they replace.
+ */
+
+static inline void * pointer(void ** params, int i) {
+  CUdeviceptr ptr;
+  memcpy(&ptr, params[i], sizeof(CUdeviceptr));
+  return (void *)(uintptr_t)ptr;
+}
+
+static inline size_t integer(void ** params, int i) {
+  int n;
+  memcpy(&n, params[i], sizeof(int));
+  return (size_t)n;
+}
+
+/**
+ * Copies an m by n matrix.  Used to give the out-of-place kernels the semantics
+ * of the in-place CPU routines.
+ */
+static inline void copy(void * B, size_t ldb, const void * A, size_t lda,
+                        size_t m, size_t n, size_t size) {
+  if (A == B)
+    return;
+  for (size_t j = 0; j < n; j++)
+    memcpy((char *)B + j * ldb * size, (const char *)A + j * lda * size, m * size);
+}
+
+/**
+ * Side, uplo, trans and diag of a trmm kernel.  The side, uplo and trans are
+ * the last three characters of the kernel name.  The complex transposed
+ * kernels have a 'T' in the name and take the transpose as their first
+ * template argument.
+ */
+static inline void trmm(const char * name, const int * args, CBlasSide * side,
+                        CBlasUplo * uplo, CBlasTranspose * trans, CBlasDiag * diag,
+                        bool templated) {
+  size_t length = strlen(name);
+  *side = (CBlasSide)name[length - 3];
+  *uplo = (CBlasUplo)name[length - 2];
+  if (templated && name[length - 1] == 'T') {
+    *trans = (CBlasTranspose)args[0];
+    *diag = (CBlasDiag)args[1];
+  }
+  else {
+    *trans = (CBlasTranspose)name[length - 1];
+    *diag = (CBlasDiag)args[0];
+  }
+}
+
+/*
+ * Single precision
+ */
+
+// sgemm2(A, B, C, D, alpha, beta, lda, ldb, ldc, ldd, m, n, k)
+static void sgemm2_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const float * A = pointer(params, 0), * B = pointer(params, 1), * C = pointer(params, 2);
+  float * D = pointer(params, 3);
+  const float alpha = *(float *)params[4], beta = *(float *)params[5];
+  const size_t lda = integer(params, 6), ldb = integer(params, 7);
+  const size_t ldc = integer(params, 8), ldd = integer(params, 9);
+  const size_t m = integer(params, 10), n = integer(params, 11), k = integer(params, 12);
+
+  copy(D, ldd, C, ldc, m, n, sizeof(float));
+  sgemm((CBlasTranspose)args[0], (CBlasTranspose)args[1], m, n, k, alpha, A, lda, B, ldb, beta, D, ldd);
+}
+
+// ssyrk(A, C, alpha, beta, lda, ldc, n, k)
+static void ssyrk_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const float * A = pointer(params, 0);
+  float * C = pointer(params, 1);
+  const float alpha = *(float *)params[2], beta = *(float *)params[3];
+
+  ssyrk((CBlasUplo)args[0], (CBlasTranspose)args[1], integer(params, 6), integer(params, 7),
+        alpha, A, integer(params, 4), beta, C, integer(params, 5));
+}
+
+// strmm2(A, B, X, alpha, lda, ldb, ldx, m, n)
+static void strmm2_kernel(const char * name, const int * args, void ** params) {
+  CBlasSide side; CBlasUplo uplo; CBlasTranspose trans; CBlasDiag diag;
+  trmm(name, args, &side, &uplo, &trans, &diag, false);
+
+  const float * A = pointer(params, 0), * B = pointer(params, 1);
+  float * X = pointer(params, 2);
+  const float alpha = *(float *)params[3];
+  const size_t lda = integer(params, 4), ldb = integer(params, 5), ldx = integer(params, 6);
+  const size_t m = integer(params, 7), n = integer(params, 8);
+
+  copy(X, ldx, B, ldb, m, n, sizeof(float));
+  strmm(side, uplo, trans, diag, m, n, alpha, A, lda, X, ldx);
+}
+
+// strsm(A, B, alpha, lda, ldb, m, n)
+static void strsm_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const float * A = pointer(params, 0);
+  float * B = pointer(params, 1);
+  const float alpha = *(float *)params[2];
+
+  strsm((CBlasSide)args[0], (CBlasUplo)args[1], (CBlasTranspose)args[2], (CBlasDiag)args[3],
+        integer(params, 5), integer(params, 6), alpha, A, integer(params, 3), B, integer(params, 4));
+}
+
+/*
+ * Double precision
+ */
+
+// dgemm2(A, B, C, D, alpha, beta, lda, ldb, ldc, ldd, m, n, k)
+static void dgemm2_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const double * A = pointer(params, 0), * B = pointer(params, 1), * C = pointer(params, 2);
+  double * D = pointer(params, 3);
+  const double alpha = *(double *)params[4], beta = *(double *)params[5];
+  const size_t lda = integer(params, 6), ldb = integer(params, 7);
+  const size_t ldc = integer(params, 8), ldd = integer(params, 9);
+  const size_t m = integer(params, 10), n = integer(params, 11), k = integer(params, 12);
+
+  copy(D, ldd, C, ldc, m, n, sizeof(double));
+  dgemm((CBlasTranspose)args[0], (CBlasTranspose)args[1], m, n, k, alpha, A, lda, B, ldb, beta, D, ldd);
+}
+
+// dsyrk(A, C, alpha, beta, lda, ldc, n, k)
+static void dsyrk_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const double * A = pointer(params, 0);
+  double * C = pointer(params, 1);
+  const double alpha = *(double *)params[2], beta = *(double *)params[3];
+
+  dsyrk((CBlasUplo)args[0], (CBlasTranspose)args[1], integer(params, 6), integer(params, 7),
+        alpha, A, integer(params, 4), beta, C, integer(params, 5));
+}
+
+// dtrmm(A, B, X, alpha, lda, ldb, ldx, m, n)
+static void dtrmm2_kernel(const char * name, const int * args, void ** params) {
+  CBlasSide side; CBlasUplo uplo; CBlasTranspose trans; CBlasDiag diag;
+  trmm(name, args, &side, &uplo, &trans, &diag, false);
+
+  const double * A = pointer(params, 0), * B = pointer(params, 1);
+  double * X = pointer(params, 2);
+  const double alpha = *(double *)params[3];
+  const size_t lda = integer(params, 4), ldb = integer(params, 5), ldx = integer(params, 6);
+  const size_t m = integer(params, 7), n = integer(params, 8);
+
+  copy(X, ldx, B, ldb, m, n, sizeof(double));
+  dtrmm(side, uplo, trans, diag, m, n, alpha, A, lda, X, ldx);
+}
+
+// dtrsm(A, B, alpha, lda, ldb, m, n)
+static void dtrsm_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const double * A = pointer(params, 0);
+  double * B = pointer(params, 1);
+  const double alpha = *(double *)params[2];
+
+  dtrsm((CBlasSide)args[0], (CBlasUplo)args[1], (CBlasTranspose)args[2], (CBlasDiag)args[3],
+        integer(params, 5), integer(params, 6), alpha, A, integer(params, 3), B, integer(params, 4));
+}
+
+/*
+ * Single precision complex
+ */
+
+// cgemm2(A, B, C, D, alpha, beta, lda, ldb, ldc, ldd, m, n, k)
+static void cgemm2_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const float complex * A = pointer(params, 0), * B = pointer(params, 1), * C = pointer(params, 2);
+  float complex * D = pointer(params, 3);
+  const float complex alpha = *(float complex *)params[4], beta = *(float complex *)params[5];
+  const size_t lda = integer(params, 6), ldb = integer(params, 7);
+  const size_t ldc = integer(params, 8), ldd = integer(params, 9);
+  const size_t m = integer(params, 10), n = integer(params, 11), k = integer(params, 12);
+
+  copy(D, ldd, C, ldc, m, n, sizeof(float complex));
+  cgemm((CBlasTranspose)args[0], (CBlasTranspose)args[1], m, n, k, alpha, A, lda, B, ldb, beta, D, ldd);
+}
+
+// cherk(A, C, alpha, beta, lda, ldc, n, k)
+static void cherk_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const float complex * A = pointer(params, 0);
+  float complex * C = pointer(params, 1);
+  const float alpha = *(float *)params[2], beta = *(float *)params[3];
+
+  cherk((CBlasUplo)args[0], (CBlasTranspose)args[1], integer(params, 6), integer(params, 7),
+        alpha, A, integer(params, 4), beta, C, integer(params, 5));
+}
+
+// ctrmm(A, B, X, alpha, lda, ldb, ldx, m, n)
+static void ctrmm2_kernel(const char * name, const int * args, void ** params) {
+  CBlasSide side; CBlasUplo uplo; CBlasTranspose trans; CBlasDiag diag;
+  trmm(name, args, &side, &uplo, &trans, &diag, true);
+
+  const float complex * A = pointer(params, 0), * B = pointer(params, 1);
+  float complex * X = pointer(params, 2);
+  const float complex alpha = *(float complex *)params[3];
+  const size_t lda = integer(params, 4), ldb = integer(params, 5), ldx = integer(params, 6);
+  const size_t m = integer(params, 7), n = integer(params, 8);
+
+  copy(X, ldx, B, ldb, m, n, sizeof(float complex));
+  ctrmm(side, uplo, trans, diag, m, n, alpha, A, lda, X, ldx);
+}
+
+// ctrsm(A, B, alpha, lda, ldb, m, n)
+static void ctrsm_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const float complex * A = pointer(params, 0);
+  float complex * B = pointer(params, 1);
+  const float complex alpha = *(float complex *)params[2];
+
+  ctrsm((CBlasSide)args[0], (CBlasUplo)args[1], (CBlasTranspose)args[2], (CBlasDiag)args[3],
+        integer(params, 5), integer(params, 6), alpha, A, integer(params, 3), B, integer(params, 4));
+}
+
+/*
+ * Double precision complex
+ */
+
+// zgemm2N(alpha, beta, A, B, C, D, lda, ldb, ldc, ldd, m, n, k) has transB as
+// its first template argument and zgemm2T has transA and transB
+static void zgemm2_kernel(const char * name, const int * args, void ** params) {
+  const CBlasTranspose transA = (name[6] == 'N') ? CBlasNoTrans : (CBlasTranspose)args[0];
+  const CBlasTranspose transB = (name[6] == 'N') ? (CBlasTranspose)args[0] : (CBlasTranspose)args[1];
+
+  const double complex alpha = *(double complex *)params[0], beta = *(double complex *)params[1];
+  const double complex * A = pointer(params, 2), * B = pointer(params, 3), * C = pointer(params, 4);
+  double complex * D = pointer(params, 5);
+  const size_t lda = integer(params, 6), ldb = integer(params, 7);
+  const size_t ldc = integer(params, 8), ldd = integer(params, 9);
+  const size_t m = integer(params, 10), n = integer(params, 11), k = integer(params, 12);
+
+  copy(D, ldd, C, ldc, m, n, sizeof(double complex));
+  zgemm(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, D, ldd);
+}
+
+// zherkN/zherkC(A, C, alpha, beta, lda, ldc, n, k)
+static void zherk_kernel(const char * name, const int * args, void ** params) {
+  const double complex * A = pointer(params, 0);
+  double complex * C = pointer(params, 1);
+  const double alpha = *(double *)params[2], beta = *(double *)params[3];
+
+  zherk((CBlasUplo)args[0], (CBlasTranspose)name[5], integer(params, 6), integer(params, 7),
+        alpha, A, integer(params, 4), beta, C, integer(params, 5));
+}
+
+// ztrmm(alpha, A, B, X, lda, ldb, ldx, m, n)
+static void ztrmm2_kernel(const char * name, const int * args, void ** params) {
+  CBlasSide side; CBlasUplo uplo; CBlasTranspose trans; CBlasDiag diag;
+  trmm(name, args, &side, &uplo, &trans, &diag, true);
+
+  const double complex alpha = *(double complex *)params[0];
+  const double complex * A = pointer(params, 1), * B = pointer(params, 2);
+  double complex * X = pointer(params, 3);
+  const size_t lda = integer(params, 4), ldb = integer(params, 5), ldx = integer(params, 6);
+  const size_t m = integer(params, 7), n = integer(params, 8);
+
+  copy(X, ldx, B, ldb, m, n, sizeof(double complex));
+  ztrmm(side, uplo, trans, diag, m, n, alpha, A, lda, X, ldx);
+}
+
+// ztrsm(alpha, A, B, lda, ldb, m, n)
+static void ztrsm_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const double complex alpha = *(double complex *)params[0];
+  const double complex * A = pointer(params, 1);
+  double complex * B = pointer(params, 2);
+
+  ztrsm((CBlasSide)args[0], (CBlasUplo)args[1], (CBlasTranspose)args[2], (CBlasDiag)args[3],
+        integer(params, 5), integer(params, 6), alpha, A, integer(params, 3), B, integer(params, 4));
+}
+
+// Parameter sizes
+#define PTR sizeof(CUdeviceptr)
+#define INT sizeof(int)
+#define S sizeof(float)
+#define D sizeof(double)
+#define C sizeof(float complex)
+#define Z sizeof(double complex)
+
+const CUemukernel sgemm_emulation[] = { { "sgemm2", sgemm2_kernel, 13, { PTR, PTR, PTR, PTR, S, S, INT, INT, INT, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel ssyrk_emulation[] = { { "ssyrk", ssyrk_kernel, 8, { PTR, PTR, S, S, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel strmm_emulation[] = { { "strmm2", strmm2_kernel, 9, { PTR, PTR, PTR, S, INT, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel strsm_emulation[] = { { "strsm", strsm_kernel, 7, { PTR, PTR, S, INT, INT, INT, INT } }, { NULL } };
+
+const CUemukernel dgemm_emulation[] = { { "dgemm2", dgemm2_kernel, 13, { PTR, PTR, PTR, PTR, D, D, INT, INT, INT, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel dsyrk_emulation[] = { { "dsyrk", dsyrk_kernel, 8, { PTR, PTR, D, D, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel dtrmm_emulation[] = { { "dtrmm", dtrmm2_kernel, 9, { PTR, PTR, PTR, D, INT, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel dtrsm_emulation[] = { { "dtrsm", dtrsm_kernel, 7, { PTR, PTR, D, INT, INT, INT, INT } }, { NULL } };
+
+const CUemukernel cgemm_emulation[] = { { "cgemm2", cgemm2_kernel, 13, { PTR, PTR, PTR, PTR, C, C, INT, INT, INT, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel cherk_emulation[] = { { "cherk", cherk_kernel, 8, { PTR, PTR, S, S, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel ctrmm_emulation[] = { { "ctrmm", ctrmm2_kernel, 9, { PTR, PTR, PTR, C, INT, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel ctrsm_emulation[] = { { "ctrsm", ctrsm_kernel, 7, { PTR, PTR, C, INT, INT, INT, INT } }, { NULL } };
+
+const CUemukernel zgemm_emulation[] = { { "zgemm2", zgemm2_kernel, 13, { Z, Z, PTR, PTR, PTR, PTR, INT, INT, INT, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel zherk_emulation[] = { { "zherk", zherk_kernel, 8, { PTR, PTR, D, D, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel ztrmm_emulation[] = { { "ztrmm", ztrmm2_kernel, 9, { Z, PTR, PTR, PTR, INT, INT, INT, INT, INT } }, { NULL } };
+const CUemukernel ztrsm_emulation[] = { { "ztrsm", ztrsm_kernel, 7, { Z, PTR, PTR, INT, INT, INT, INT } }, { NULL } };
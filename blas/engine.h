@@ -0,0 +1,288 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Packed GEMM engine for the real CPU BLAS routines.
+ *
+ * Panels of op(A) and op(B) are copied into contiguous buffers sized to stay
+ * resident in cache and a register-blocked micro-kernel computes MR x NR tiles
+ * of C from them:
+ *
+ *   NC  columns of op(B) packed per outer iteration (KC x NC panel in L3)
+ *   KC  depth of the packed panels (KC x NR sliver of B in L1)
+ *   MC  rows of op(A) packed per inner iteration (MC x KC block in L2)
+ *   MR  rows of the micro-tile of C held in registers
+ *   NR  columns of the micro-tile of C held in registers
+ *
+ * The pack and kernel functions contain orphaned OpenMP worksharing loops so
+ * they may be called either from inside a parallel region (where the work is
+ * shared between the threads of the team) or from serial code.
+ *
+ * MR and NR depend on the micro-kernel, which is chosen once when the library
+ * is loaded to match the instruction set of the host (see cpu.c).  MC, KC and
+ * NC are the mb, kb and nb of the blocking of each precision so that they can
+ * be tuned for the host at run time.  The blocking also holds the size of the
+ * diagonal blocks in the blocked TRSM (a multiple of the largest MR as the rest
+ * of the work is done by the packed GEMM), the width of the strips of B that
+ * the in-place TRMM multiplies out of place and the number of threads.
+ */
+
+/**
+ * Blocking of the engine for each precision.  These start with the defaults in
+ * cpu.c and are replaced by the entries for the host processor in the tuning
+ * database whenever it changes (see tuning.c).
+ */
+extern CBlasBlocking sblocking, dblocking, cblocking, zblocking;
+
+/**
+ * Applies the entries for the host processor in the tuning database to the
+ * blocking of the engines.
+ */
+void engine_tune(void);
+
+/**
+ * Copies the blocking of an engine under the lock engine_tune holds while it
+ * updates them.  Routines take one copy when they start and use it throughout
+ * so that tuning the engines while they run only affects later calls.
+ */
+CBlasBlocking engine_blocking(const CBlasBlocking *);
+
+static inline int engine_threads(int threads) {
+#ifdef _OPENMP
+  return (threads > 0) ? threads : omp_get_max_threads();
+#else
+  return (threads > 0) ? threads : 1;
+#endif
+}
+
+/** Largest micro-tile of any micro-kernel (used to size temporaries) */
+#define SGEMM_MR_MAX 32
+#define SGEMM_NR_MAX 8
+#define DGEMM_MR_MAX 16
+#define DGEMM_NR_MAX 8
+
+/**
+ * Micro-kernel.  Computes a full MR x NR tile C = alpha * A * B + beta * C from
+ * a packed MR x kb panel of A and a packed kb x NR panel of B.  C is not read
+ * when beta is zero.
+ */
+typedef void (*sgemm_micro_t)(size_t,  float, const  float * restrict, const  float * restrict,  float,  float * restrict, size_t);
+typedef void (*dgemm_micro_t)(size_t, double, const double * restrict, const double * restrict, double, double * restrict, size_t);
+
+struct sgemm_ukernel {
+  const char * isa;             /** Instruction set the kernel is written for */
+  size_t mr, nr;                /** Size of the micro-tile                    */
+  sgemm_micro_t micro;          /** The micro-kernel                          */
+};
+
+struct dgemm_ukernel {
+  const char * isa;             /** Instruction set the kernel is written for */
+  size_t mr, nr;                /** Size of the micro-tile                    */
+  dgemm_micro_t micro;          /** The micro-kernel                          */
+};
+
+/** Portable C micro-kernels (always available) */
+extern const struct sgemm_ukernel sgemm_ukernel_c;
+extern const struct dgemm_ukernel dgemm_ukernel_c;
+
+#if defined(__x86_64__) || defined(__i386__)
+/** x86 micro-kernels (kernel_sse2.c, kernel_avx2.c, kernel_avx512.c) */
+extern const struct sgemm_ukernel sgemm_ukernel_sse2, sgemm_ukernel_avx2, sgemm_ukernel_avx512;
+extern const struct dgemm_ukernel dgemm_ukernel_sse2, dgemm_ukernel_avx2, dgemm_ukernel_avx512;
+#endif
+
+/** The micro-kernels selected for the host CPU */
+extern const struct sgemm_ukernel * sgemm_selected;
+extern const struct dgemm_ukernel * dgemm_selected;
+
+/**
+ * Packs an mb x kb block of op(A) into row panels of height MR.  Rows past the
+ * edge of the block are zero filled.
+ *
+ * @param trans  whether op(A) = A or op(A) = A^T.
+ * @param mb     the number of rows of op(A) to pack.
+ * @param kb     the number of columns of op(A) to pack.
+ * @param A      the matrix.
+ * @param lda    the leading dimension of A.
+ * @param P      the packed buffer (at least ((mb + MR - 1) / MR) * MR * kb).
+ */
+void sgemm_pack_a(CBlasTranspose, size_t, size_t, const  float * restrict, size_t,  float * restrict);
+void dgemm_pack_a(CBlasTranspose, size_t, size_t, const double * restrict, size_t, double * restrict);
+
+/**
+ * Packs a kb x nb block of op(B) into column panels of width NR.  Columns past
+ * the edge of the block are zero filled.
+ *
+ * @param trans  whether op(B) = B or op(B) = B^T.
+ * @param kb     the number of rows of op(B) to pack.
+ * @param nb     the number of columns of op(B) to pack.
+ * @param B      the matrix.
+ * @param ldb    the leading dimension of B.
+ * @param P      the packed buffer (at least kb * ((nb + NR - 1) / NR) * NR).
+ */
+void sgemm_pack_b(CBlasTranspose, size_t, size_t, const  float * restrict, size_t,  float * restrict);
+void dgemm_pack_b(CBlasTranspose, size_t, size_t, const double * restrict, size_t, double * restrict);
+
+/**
+ * Computes C = alpha * A * B + beta * C for an mb x nb block of C from packed
+ * blocks of A and B with inner dimension kb.  C is not read when beta is zero.
+ */
+void sgemm_kernel(size_t, size_t, size_t,  float, const  float * restrict, const  float * restrict,  float,  float * restrict, size_t);
+void dgemm_kernel(size_t, size_t, size_t, double, const double * restrict, const double * restrict, double, double * restrict, size_t);
+
+/**
+ * Computes C = alpha * op(A) * op(B) + beta * C using the packed engine.
+ *
+ * @return <b>false</b> if the packing buffers could not be allocated (C is not
+ *         modified), <b>true</b> otherwise.
+ */
+bool sgemm_packed(CBlasTranspose, CBlasTranspose, size_t, size_t, size_t,
+                   float, const  float * restrict, size_t, const  float * restrict, size_t,
+                   float,  float * restrict, size_t);
+bool dgemm_packed(CBlasTranspose, CBlasTranspose, size_t, size_t, size_t,
+                  double, const double * restrict, size_t, const double * restrict, size_t,
+                  double, double * restrict, size_t);
+
+/**
+ * Triangle-aware macro-kernel for SYRK.  Computes the tiles of an mb x nb block
+ * of C that intersect the upper or lower triangle.  Tiles wholly inside the
+ * triangle are computed by the micro-kernel directly, tiles that straddle the
+ * diagonal are masked and tiles outside it are skipped.
+ *
+ * @param uplo    the triangle of C to update.
+ * @param offset  the row of C minus the column of C of the top left element of
+ *                the block.
+ */
+void ssyrk_kernel(CBlasUplo, ptrdiff_t, size_t, size_t, size_t,  float, const  float * restrict, const  float * restrict,  float,  float * restrict, size_t);
+void dsyrk_kernel(CBlasUplo, ptrdiff_t, size_t, size_t, size_t, double, const double * restrict, const double * restrict, double, double * restrict, size_t);
+
+/**
+ * Computes C = alpha * op(A) * op(A)^T + beta * C for the upper or lower
+ * triangle of C using the packed engine.
+ *
+ * @return <b>false</b> if the packing buffers could not be allocated (C is not
+ *         modified), <b>true</b> otherwise.
+ */
+bool ssyrk_packed(CBlasUplo, CBlasTranspose, size_t, size_t,
+                   float, const  float * restrict, size_t,
+                   float,  float * restrict, size_t);
+bool dsyrk_packed(CBlasUplo, CBlasTranspose, size_t, size_t,
+                  double, const double * restrict, size_t,
+                  double, double * restrict, size_t);
+
+/**
+ * Pack a block of the triangular matrix op(A) as the A or B operand of the
+ * micro-kernel.  Elements outside the triangle are packed as zero and the
+ * diagonal as one when it is unit so that diagonal blocks can be multiplied by
+ * the GEMM macro-kernel.
+ *
+ * @param uplo    the triangle of op(A) (not of A).
+ * @param offset  the row of op(A) minus the column of op(A) of the top left
+ *                element of the block.
+ */
+void strmm_pack_a(CBlasUplo, CBlasTranspose, CBlasDiag, ptrdiff_t, size_t, size_t, const  float * restrict, size_t,  float * restrict);
+void dtrmm_pack_a(CBlasUplo, CBlasTranspose, CBlasDiag, ptrdiff_t, size_t, size_t, const double * restrict, size_t, double * restrict);
+
+void strmm_pack_b(CBlasUplo, CBlasTranspose, CBlasDiag, ptrdiff_t, size_t, size_t, const  float * restrict, size_t,  float * restrict);
+void dtrmm_pack_b(CBlasUplo, CBlasTranspose, CBlasDiag, ptrdiff_t, size_t, size_t, const double * restrict, size_t, double * restrict);
+
+/**
+ * Computes X = alpha * op(A) * B or X = alpha * B * op(A) for triangular A
+ * using the packed engine.  Blocks of op(A) outside the triangle are skipped.
+ * X must not overlap B.
+ *
+ * @return <b>false</b> if the packing buffers could not be allocated (X is not
+ *         modified), <b>true</b> otherwise.
+ */
+bool strmm_packed(CBlasSide, CBlasUplo, CBlasTranspose, CBlasDiag, size_t, size_t,
+                   float, const  float * restrict, size_t, const  float * restrict, size_t,
+                   float * restrict, size_t);
+bool dtrmm_packed(CBlasSide, CBlasUplo, CBlasTranspose, CBlasDiag, size_t, size_t,
+                  double, const double * restrict, size_t, const double * restrict, size_t,
+                  double * restrict, size_t);
+
+/**
+ * Complex GEMM on the real micro-kernels.  op(A) and op(B) are packed with the
+ * real and imaginary parts split into separate planes (conjugation is applied
+ * while packing) so each panel holds three real MR x kb (kb x NR) planes:
+ *
+ *   CBlasGemm4M  A: [Ai Ar -Ai]     B: [Br; Bi]  (third plane unused)
+ *   CBlasGemm3M  A: [Ar Ai Ar+Ai]   B: [Br Bi Br+Bi]
+ *
+ * With 4M the real and imaginary parts of each tile are a single real product
+ * of depth 2 * kb.  3M computes them from three real products of depth kb.
+ */
+void cgemm_pack_a(CBlasComplexGemm, CBlasTranspose, size_t, size_t, const  float complex * restrict, size_t,  float * restrict);
+void zgemm_pack_a(CBlasComplexGemm, CBlasTranspose, size_t, size_t, const double complex * restrict, size_t, double * restrict);
+
+void cgemm_pack_b(CBlasComplexGemm, CBlasTranspose, size_t, size_t, const  float complex * restrict, size_t,  float * restrict);
+void zgemm_pack_b(CBlasComplexGemm, CBlasTranspose, size_t, size_t, const double complex * restrict, size_t, double * restrict);
+
+void cgemm_kernel(CBlasComplexGemm, size_t, size_t, size_t,
+                   float complex, const  float * restrict, const  float * restrict,
+                   float complex,  float complex * restrict, size_t);
+void zgemm_kernel(CBlasComplexGemm, size_t, size_t, size_t,
+                  double complex, const double * restrict, const double * restrict,
+                  double complex, double complex * restrict, size_t);
+
+/**
+ * Computes C = alpha * op(A) * op(B) + beta * C using the packed engine and the
+ * algorithm selected by complexGemm.
+ *
+ * @return <b>false</b> if the packing buffers could not be allocated (C is not
+ *         modified), <b>true</b> otherwise.
+ */
+bool cgemm_packed(CBlasTranspose, CBlasTranspose, size_t, size_t, size_t,
+                   float complex, const  float complex * restrict, size_t, const  float complex * restrict, size_t,
+                   float complex,  float complex * restrict, size_t);
+bool zgemm_packed(CBlasTranspose, CBlasTranspose, size_t, size_t, size_t,
+                  double complex, const double complex * restrict, size_t, const double complex * restrict, size_t,
+                  double complex, double complex * restrict, size_t);
+
+/**
+ * Triangle-aware macro-kernel and driver for HERK on the split panels (see
+ * ssyrk_kernel and ssyrk_packed).  The imaginary parts of the diagonal of C
+ * are set to zero.
+ */
+void cherk_kernel(CBlasComplexGemm, CBlasUplo, ptrdiff_t, size_t, size_t, size_t,
+                   float, const  float * restrict, const  float * restrict,
+                   float,  float complex * restrict, size_t);
+void zherk_kernel(CBlasComplexGemm, CBlasUplo, ptrdiff_t, size_t, size_t, size_t,
+                  double, const double * restrict, const double * restrict,
+                  double, double complex * restrict, size_t);
+
+bool cherk_packed(CBlasUplo, CBlasTranspose, size_t, size_t,
+                   float, const  float complex * restrict, size_t,
+                   float,  float complex * restrict, size_t);
+bool zherk_packed(CBlasUplo, CBlasTranspose, size_t, size_t,
+                  double, const double complex * restrict, size_t,
+                  double, double complex * restrict, size_t);
+
+/**
+ * Triangular packing and TRMM driver on the split panels (see strmm_pack_a and
+ * strmm_packed).
+ */
+void ctrmm_pack_a(CBlasComplexGemm, CBlasUplo, CBlasTranspose, CBlasDiag, ptrdiff_t, size_t, size_t,
+                  const  float complex * restrict, size_t,  float * restrict);
+void ztrmm_pack_a(CBlasComplexGemm, CBlasUplo, CBlasTranspose, CBlasDiag, ptrdiff_t, size_t, size_t,
+                  const double complex * restrict, size_t, double * restrict);
+
+void ctrmm_pack_b(CBlasComplexGemm, CBlasUplo, CBlasTranspose, CBlasDiag, ptrdiff_t, size_t, size_t,
+                  const  float complex * restrict, size_t,  float * restrict);
+void ztrmm_pack_b(CBlasComplexGemm, CBlasUplo, CBlasTranspose, CBlasDiag, ptrdiff_t, size_t, size_t,
+                  const double complex * restrict, size_t, double * restrict);
+
+bool ctrmm_packed(CBlasSide, CBlasUplo, CBlasTranspose, CBlasDiag, size_t, size_t,
+                   float complex, const  float complex * restrict, size_t, const  float complex * restrict, size_t,
+                   float complex * restrict, size_t);
+bool ztrmm_packed(CBlasSide, CBlasUplo, CBlasTranspose, CBlasDiag, size_t, size_t,
+                  double complex, const double complex * restrict, size_t, const double complex * restrict, size_t,
+                  double complex * restrict, size_t);
+
+#endif
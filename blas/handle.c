@@ -1,6 +1,8 @@
 #include "blas.h"
 #include "handle.h"
 #include "error.h"
+#include <stdint.h>
+#include <sys/time.h>
 
 static inline CUresult cublashandle_init(struct __cublashandle_st * handle) {
   CU_ERROR_CHECK(cuCtxGetCurrent(&handle->context));
@@ -12,6 +14,30 @@ static inline CUresult cublashandle_init(struct __cublashandle_st * handle) {
   }
   else
     handle->contextOwner = false;
+  handle->host = false;
+
+  CUdevice device;
+  CU_ERROR_CHECK(cuCtxGetDevice(&device));
+  CU_ERROR_CHECK(cuDeviceGetName(handle->device, (int)sizeof(handle->device), device));
+
+  handle->cached = NULL;
+  handle->borrowed = NULL;
+  handle->cachedBytes = 0;
+  handle->borrowedBytes = 0;
+  handle->highWater = 0;
+
+  handle->hostCached = NULL;
+  handle->hostBorrowed = NULL;
+  handle->streams = NULL;
+  handle->streamsBorrowed = NULL;
+
+  handle->tiles = NULL;
+  handle->tileCapacity = 0;
+  handle->tileBytes = 0;
+  handle->tileHits = 0;
+  handle->tileMisses = 0;
+
+  memset(&handle->pipeline, 0, sizeof(struct cupipeline));
 
   handle->sgemm2 = NULL;
   handle->ssyrk = NULL;
@@ -36,9 +62,76 @@ static inline CUresult cublashandle_init(struct __cublashandle_st * handle) {
   return CUDA_SUCCESS;
 }
 
+/**
+ * Frees a list of blocks from the memory pool.  The handle's context must be
+ * current.
+ */
+static CUresult cumemblock_free(struct cumemblock * block) {
+  while (block != NULL) {
+    struct cumemblock * next = block->next;
+    CU_ERROR_CHECK(cuMemFree(block->ptr));
+    free(block);
+    block = next;
+  }
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Frees a list of staging buffers.  The handle's context must be current.
+ */
+static CUresult cuhostblock_free(struct cuhostblock * block) {
+  while (block != NULL) {
+    struct cuhostblock * next = block->next;
+    CU_ERROR_CHECK(cuMemFreeHost(block->ptr));
+    free(block);
+    block = next;
+  }
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Destroys a list of streams.  The handle's context must be current.
+ */
+static CUresult custream_destroy(struct custream * stream) {
+  while (stream != NULL) {
+    struct custream * next = stream->next;
+    CU_ERROR_CHECK(cuStreamDestroy(stream->stream));
+    free(stream);
+    stream = next;
+  }
+  return CUDA_SUCCESS;
+}
+
 static inline CUresult cublashandle_cleanup(struct __cublashandle_st * handle) {
   CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
 
+  // The pipeline's streams are borrowed from the pool but its events are not
+  struct cupipeline * pipeline = &handle->pipeline;
+  if (pipeline->h2d != 0) {
+    CU_ERROR_CHECK(cuEventSynchronize(pipeline->done));
+    for (int i = 0; i < 2; i++) {
+      CU_ERROR_CHECK(cuEventDestroy(pipeline->ready[i]));
+      CU_ERROR_CHECK(cuEventDestroy(pipeline->consumed[i]));
+    }
+    CU_ERROR_CHECK(cuEventDestroy(pipeline->computed));
+    CU_ERROR_CHECK(cuEventDestroy(pipeline->done));
+  }
+
+  // The device memory held by the tiles is borrowed from the pool
+  while (handle->tiles != NULL) {
+    struct cutile * next = handle->tiles->next;
+    free(handle->tiles);
+    handle->tiles = next;
+  }
+
+  // Anything still borrowed is freed along with the cache
+  CU_ERROR_CHECK(cumemblock_free(handle->cached));
+  CU_ERROR_CHECK(cumemblock_free(handle->borrowed));
+  CU_ERROR_CHECK(cuhostblock_free(handle->hostCached));
+  CU_ERROR_CHECK(cuhostblock_free(handle->hostBorrowed));
+  CU_ERROR_CHECK(custream_destroy(handle->streams));
+  CU_ERROR_CHECK(custream_destroy(handle->streamsBorrowed));
+
   if (handle->sgemm2 != NULL)
     CU_ERROR_CHECK(cuModuleUnload(handle->sgemm2));
   if (handle->ssyrk != NULL)
@@ -94,18 +187,596 @@ CUresult cuBLASDestroy(CUBLAShandle handle) {
   return CUDA_SUCCESS;
 }
 
+CUresult cuBLASPreload(CUBLAShandle handle) {
+  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+
+  if (handle->sgemm2 == NULL)
+    CU_ERROR_CHECK(sgemm2_load(handle));
+  if (handle->ssyrk == NULL)
+    CU_ERROR_CHECK(ssyrk_load(handle));
+  if (handle->strmm2 == NULL)
+    CU_ERROR_CHECK(strmm2_load(handle));
+  if (handle->strsm == NULL)
+    CU_ERROR_CHECK(strsm_load(handle));
+
+  if (handle->cgemm2 == NULL)
+    CU_ERROR_CHECK(cgemm2_load(handle));
+  if (handle->cherk == NULL)
+    CU_ERROR_CHECK(cherk_load(handle));
+  if (handle->ctrmm2 == NULL)
+    CU_ERROR_CHECK(ctrmm2_load(handle));
+  if (handle->ctrsm == NULL)
+    CU_ERROR_CHECK(ctrsm_load(handle));
+
+  if (handle->dgemm2 == NULL)
+    CU_ERROR_CHECK(dgemm2_load(handle));
+  if (handle->dsyrk == NULL)
+    CU_ERROR_CHECK(dsyrk_load(handle));
+  if (handle->dtrmm2 == NULL)
+    CU_ERROR_CHECK(dtrmm2_load(handle));
+  if (handle->dtrsm == NULL)
+    CU_ERROR_CHECK(dtrsm_load(handle));
+
+  if (handle->zgemm2 == NULL)
+    CU_ERROR_CHECK(zgemm2_load(handle));
+  if (handle->zherk == NULL)
+    CU_ERROR_CHECK(zherk_load(handle));
+  if (handle->ztrmm2 == NULL)
+    CU_ERROR_CHECK(ztrmm2_load(handle));
+  if (handle->ztrsm == NULL)
+    CU_ERROR_CHECK(ztrsm_load(handle));
+
+  CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Device memory and staging buffers in the pools are allocated in size classes
+ * so that blocks can be reused for requests of slightly different sizes.  There
+ * are four classes between each power of two above the minimum so no more than
+ * a quarter of the size requested is wasted.
+ */
+#define CU_MEMPOOL_MIN 4096
+
+/**
+ * Alignment of the pitch of 2D allocations from the memory pool in bytes.
+ */
+#define CU_MEMPOOL_PITCH 512
+
+static inline size_t sizeClass(size_t size) {
+  if (size <= CU_MEMPOOL_MIN)
+    return CU_MEMPOOL_MIN;
+  size_t power = CU_MEMPOOL_MIN;
+  while (2 * power < size)
+    power *= 2;
+  const size_t step = power / 4;
+  return (size + step - 1) / step * step;
+}
+
+CUresult cuBLASMemAlloc(CUBLAShandle handle, CUdeviceptr * ptr, size_t size) {
+  if (size == 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  size = sizeClass(size);
+
+  // Reuse a cached block of the same size class if there is one
+  struct cumemblock ** cached = &handle->cached;
+  while (*cached != NULL && (*cached)->size != size)
+    cached = &(*cached)->next;
+
+  struct cumemblock * block = *cached;
+  if (block != NULL) {
+    *cached = block->next;
+    handle->cachedBytes -= size;
+  }
+  else {
+    if ((block = malloc(sizeof(struct cumemblock))) == NULL)
+      return CUDA_ERROR_OUT_OF_MEMORY;
+
+    // Give the cache back to the driver and try again if the device is full
+    CUresult error = cuMemAlloc(&block->ptr, size);
+    if (error == CUDA_ERROR_OUT_OF_MEMORY && handle->cached != NULL) {
+      CU_ERROR_CHECK(cumemblock_free(handle->cached));
+      handle->cached = NULL;
+      handle->cachedBytes = 0;
+      error = cuMemAlloc(&block->ptr, size);
+    }
+    if (error != CUDA_SUCCESS) {
+      free(block);
+      return error;
+    }
+    block->size = size;
+  }
+
+  block->next = handle->borrowed;
+  handle->borrowed = block;
+  handle->borrowedBytes += size;
+  if (handle->borrowedBytes + handle->cachedBytes > handle->highWater)
+    handle->highWater = handle->borrowedBytes + handle->cachedBytes;
+
+  *ptr = block->ptr;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuBLASMemAllocPitch(CUBLAShandle handle, CUdeviceptr * ptr, size_t * pitch,
+                             size_t width, size_t height, unsigned int elemSize) {
+  if (width == 0 || height == 0 || (elemSize != 4 && elemSize != 8 && elemSize != 16))
+    return CUDA_ERROR_INVALID_VALUE;
+
+  *pitch = (width + CU_MEMPOOL_PITCH - 1) & ~((size_t)CU_MEMPOOL_PITCH - 1);
+  CU_ERROR_CHECK(cuBLASMemAlloc(handle, ptr, *pitch * height));
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuBLASMemFree(CUBLAShandle handle, CUdeviceptr ptr) {
+  struct cumemblock ** borrowed = &handle->borrowed;
+  while (*borrowed != NULL && (*borrowed)->ptr != ptr)
+    borrowed = &(*borrowed)->next;
+
+  struct cumemblock * block = *borrowed;
+  if (block == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  *borrowed = block->next;
+  handle->borrowedBytes -= block->size;
+
+  block->next = handle->cached;
+  handle->cached = block;
+  handle->cachedBytes += block->size;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuBLASMemAllocHost(CUBLAShandle handle, void ** ptr, size_t size) {
+  if (size == 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  size = sizeClass(size);
+
+  // Reuse a cached buffer of the same size class if there is one
+  struct cuhostblock ** cached = &handle->hostCached;
+  while (*cached != NULL && (*cached)->size != size)
+    cached = &(*cached)->next;
+
+  struct cuhostblock * block = *cached;
+  if (block != NULL)
+    *cached = block->next;
+  else {
+    if ((block = malloc(sizeof(struct cuhostblock))) == NULL)
+      return CUDA_ERROR_OUT_OF_MEMORY;
+
+    // Unpin the cache and try again if there is no more page-locked memory
+    CUresult error = cuMemAllocHost(&block->ptr, size);
+    if (error == CUDA_ERROR_OUT_OF_MEMORY && handle->hostCached != NULL) {
+      CU_ERROR_CHECK(cuhostblock_free(handle->hostCached));
+      handle->hostCached = NULL;
+      error = cuMemAllocHost(&block->ptr, size);
+    }
+    if (error != CUDA_SUCCESS) {
+      free(block);
+      return error;
+    }
+    block->size = size;
+  }
+
+  block->next = handle->hostBorrowed;
+  handle->hostBorrowed = block;
+
+  *ptr = block->ptr;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuBLASMemFreeHost(CUBLAShandle handle, void * ptr) {
+  struct cuhostblock ** borrowed = &handle->hostBorrowed;
+  while (*borrowed != NULL && (*borrowed)->ptr != ptr)
+    borrowed = &(*borrowed)->next;
+
+  struct cuhostblock * block = *borrowed;
+  if (block == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  *borrowed = block->next;
+  block->next = handle->hostCached;
+  handle->hostCached = block;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuBLASStreamAlloc(CUBLAShandle handle, CUstream * stream, unsigned int flags) {
+  // Reuse an idle stream created with the same flags if there is one
+  struct custream ** idle = &handle->streams;
+  while (*idle != NULL && (*idle)->flags != flags)
+    idle = &(*idle)->next;
+
+  struct custream * s = *idle;
+  if (s != NULL)
+    *idle = s->next;
+  else {
+    if ((s = malloc(sizeof(struct custream))) == NULL)
+      return CUDA_ERROR_OUT_OF_MEMORY;
+
+    CUresult error = cuStreamCreate(&s->stream, flags);
+    if (error != CUDA_SUCCESS) {
+      free(s);
+      return error;
+    }
+    s->flags = flags;
+  }
+
+  s->next = handle->streamsBorrowed;
+  handle->streamsBorrowed = s;
+
+  *stream = s->stream;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuBLASStreamFree(CUBLAShandle handle, CUstream stream) {
+  struct custream ** borrowed = &handle->streamsBorrowed;
+  while (*borrowed != NULL && (*borrowed)->stream != stream)
+    borrowed = &(*borrowed)->next;
+
+  struct custream * s = *borrowed;
+  if (s == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  *borrowed = s->next;
+  s->next = handle->streams;
+  handle->streams = s;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuBLASMemTrim(CUBLAShandle handle) {
+  if (handle->cached == NULL && handle->hostCached == NULL && handle->streams == NULL)
+    return CUDA_SUCCESS;
+
+  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+  CU_ERROR_CHECK(cumemblock_free(handle->cached));
+  CU_ERROR_CHECK(cuhostblock_free(handle->hostCached));
+  CU_ERROR_CHECK(custream_destroy(handle->streams));
+  CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
+
+  handle->cached = NULL;
+  handle->cachedBytes = 0;
+  handle->hostCached = NULL;
+  handle->streams = NULL;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuBLASMemGetInfo(CUBLAShandle handle, size_t * borrowed, size_t * cached,
+                          size_t * highWater) {
+  if (borrowed != NULL)
+    *borrowed = handle->borrowedBytes;
+  if (cached != NULL)
+    *cached = handle->cachedBytes;
+  if (highWater != NULL)
+    *highWater = handle->highWater;
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Whether a tile overlaps an m by n block of host memory (in bytes and columns)
+ * with leading dimension ld.  Blocks with the same leading dimension as the
+ * tile are compared row and column wise, otherwise by the addresses they span.
+ */
+static inline bool tile_overlaps(const struct cutile * tile, const void * host,
+                                 size_t ld, size_t m, size_t n) {
+  const uintptr_t a = (uintptr_t)tile->host, b = (uintptr_t)host;
+  if (a + (tile->n - 1) * tile->ld + tile->m <= b || b + (n - 1) * ld + m <= a)
+    return false;
+  if (ld != tile->ld || ld == 0)
+    return true;
+
+  // Offsets from the first element of whichever starts first
+  const uintptr_t origin = (a < b) ? a : b;
+  const size_t ai = (a - origin) % ld, aj = (a - origin) / ld;
+  const size_t bi = (b - origin) % ld, bj = (b - origin) / ld;
+  if (ai + tile->m > ld || bi + m > ld)
+    return true;
+
+  return ai < bi + m && bi < ai + tile->m && aj < bj + n && bj < aj + tile->n;
+}
+
+/**
+ * Removes a tile from the cache and gives its device memory back to the pool.
+ */
+static inline CUresult tile_evict(CUBLAShandle handle, struct cutile ** tile) {
+  struct cutile * t = *tile;
+  *tile = t->next;
+  handle->tileBytes -= t->pitch * t->n;
+  CU_ERROR_CHECK(cuBLASMemFree(handle, t->ptr));
+  free(t);
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Evicts the least recently used tiles not in use until the cache can take
+ * another size bytes.  Whether there is room is returned through room.
+ */
+static CUresult tilecache_reserve(CUBLAShandle handle, size_t size, bool * room) {
+  while (handle->tileBytes + size > handle->tileCapacity) {
+    struct cutile ** last = NULL;
+    for (struct cutile ** tile = &handle->tiles; *tile != NULL; tile = &(*tile)->next) {
+      if ((*tile)->task <= handle->pipeline.retired)
+        last = tile;
+    }
+    if (last == NULL) {
+      *room = false;
+      return CUDA_SUCCESS;
+    }
+    CU_ERROR_CHECK(tile_evict(handle, last));
+  }
+  *room = true;
+  return CUDA_SUCCESS;
+}
+
+CUresult tilecache_get(CUBLAShandle handle, const void * host, size_t ld, size_t m, size_t n,
+                       size_t elemSize, CUstream stream, CUdeviceptr * ptr, size_t * ldd) {
+  *ptr = 0;
+  if (handle->tileCapacity == 0 || m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  ld *= elemSize;
+  const size_t width = m * elemSize;
+
+  // Move a tile that is already cached to the front of the list
+  struct cutile ** tile = &handle->tiles;
+  while (*tile != NULL && ((*tile)->host != host || (*tile)->ld != ld ||
+                           (*tile)->m != width || (*tile)->n != n))
+    tile = &(*tile)->next;
+
+  struct cutile * t = *tile;
+  if (t != NULL) {
+    *tile = t->next;
+    handle->tileHits++;
+  }
+  else {
+    handle->tileMisses++;
+
+    const size_t pitch = (width + CU_MEMPOOL_PITCH - 1) & ~((size_t)CU_MEMPOOL_PITCH - 1);
+    bool room;
+    CU_ERROR_CHECK(tilecache_reserve(handle, pitch * n, &room));
+    if (!room)
+      return CUDA_SUCCESS;
+
+    if ((t = malloc(sizeof(struct cutile))) == NULL)
+      return CUDA_ERROR_OUT_OF_MEMORY;
+
+    // The block is copied the usual way if the device is full
+    CUresult error = cuBLASMemAllocPitch(handle, &t->ptr, &t->pitch, width, n, (unsigned int)elemSize);
+    if (error != CUDA_SUCCESS) {
+      free(t);
+      return (error == CUDA_ERROR_OUT_OF_MEMORY) ? CUDA_SUCCESS : error;
+    }
+
+    CUDA_MEMCPY2D copy = {
+      0, 0, CU_MEMORYTYPE_HOST, host, 0, 0, ld,
+      0, 0, CU_MEMORYTYPE_DEVICE, NULL, t->ptr, 0, t->pitch,
+      width, n };
+    if ((error = cuMemcpy2DAsync(&copy, stream)) != CUDA_SUCCESS) {
+      CU_ERROR_CHECK(cuBLASMemFree(handle, t->ptr));
+      free(t);
+      return error;
+    }
+
+    t->host = host;
+    t->ld = ld;
+    t->m = width;
+    t->n = n;
+    handle->tileBytes += t->pitch * n;
+  }
+
+  t->task = handle->pipeline.task;
+  t->next = handle->tiles;
+  handle->tiles = t;
+
+  *ptr = t->ptr;
+  *ldd = t->pitch / elemSize;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult pipeline_begin(CUBLAShandle handle) {
+  struct cupipeline * pipeline = &handle->pipeline;
+
+  if (pipeline->h2d == 0) {
+    CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &pipeline->h2d, CU_STREAM_NON_BLOCKING));
+    CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &pipeline->compute, CU_STREAM_NON_BLOCKING));
+    CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &pipeline->d2h, CU_STREAM_NON_BLOCKING));
+    for (int i = 0; i < 2; i++) {
+      CU_ERROR_CHECK(cuEventCreate(&pipeline->ready[i], CU_EVENT_DISABLE_TIMING));
+      CU_ERROR_CHECK(cuEventCreate(&pipeline->consumed[i], CU_EVENT_DISABLE_TIMING));
+    }
+    CU_ERROR_CHECK(cuEventCreate(&pipeline->computed, CU_EVENT_DISABLE_TIMING));
+    CU_ERROR_CHECK(cuEventCreate(&pipeline->done, CU_EVENT_DISABLE_TIMING));
+  }
+
+  pipeline->task++;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Waits for the tasks queued on a pipeline to finish on the device and gives
+ * the memory held by the last one back to the pool.  Tiles they used may be
+ * evicted again afterwards.
+ */
+static CUresult pipeline_retire(CUBLAShandle handle, unsigned long task) {
+  struct cupipeline * pipeline = &handle->pipeline;
+
+  if (pipeline->retired >= task)
+    return CUDA_SUCCESS;
+
+  CU_ERROR_CHECK(cuEventSynchronize(pipeline->done));
+
+  for (int i = 0; i < pipeline->nPending; i++)
+    CU_ERROR_CHECK(cuBLASMemFree(handle, pipeline->pending[i]));
+  pipeline->nPending = 0;
+  pipeline->retired = task;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult pipeline_end(CUBLAShandle handle, const CUdeviceptr * buffers, int n) {
+  struct cupipeline * pipeline = &handle->pipeline;
+
+  // The previous task's copy back was queued before this task's so has to
+  // finish first
+  CU_ERROR_CHECK(pipeline_retire(handle, pipeline->task - 1));
+
+  CU_ERROR_CHECK(cuEventRecord(pipeline->done, pipeline->d2h));
+  for (int i = 0; i < n; i++)
+    pipeline->pending[i] = buffers[i];
+  pipeline->nPending = n;
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult flush(const void * args) {
+  CUBLAShandle handle = *(CUBLAShandle *)args;
+  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+  CU_ERROR_CHECK(pipeline_retire(handle, handle->pipeline.task));
+  CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
+  return CUDA_SUCCESS;
+}
+
+CUresult pipeline_flush(CUmultiGPUBLAShandle handle) {
+  int n = cuMultiGPUGetContextCount(handle->mGPU);
+  CUtask tasks[n];
+  int nTasks = 0;
+
+  // Only contexts that ran a task since the last flush have anything to wait
+  // for.  The tasks have to run on the context they are for so are not stolen.
+  for (int i = 0; i < n; i++) {
+    CUBLAShandle h = &handle->handles[i];
+    if (h->host || h->pipeline.retired == h->pipeline.task)
+      continue;
+
+    CU_ERROR_CHECK(cuTaskCreate(&tasks[nTasks], flush, &h, sizeof(CUBLAShandle)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, i, tasks[nTasks]));
+    nTasks++;
+  }
+
+  CUresult result;
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, (size_t)nTasks, &result));
+
+  return result;
+}
+
 static CUresult init(const void * args) {
-  CUBLAShandle handle = (CUBLAShandle)args;
-  CU_ERROR_CHECK(cuBLASCreate(&handle));
+  CUBLAShandle handle = *(CUBLAShandle *)args;
+  CU_ERROR_CHECK(cublashandle_init(handle));
   return CUDA_SUCCESS;
 }
 
 static CUresult cleanup(const void * args) {
-  CUBLAShandle handle = (CUBLAShandle)args;
-  CU_ERROR_CHECK(cuBLASDestroy(handle));
+  CUBLAShandle handle = *(CUBLAShandle *)args;
+  CU_ERROR_CHECK(cublashandle_cleanup(handle));
   return CUDA_SUCCESS;
 }
 
+/**
+ * Size of the matrices multiplied to calibrate the performance model of each
+ * context.
+ */
+#define CALIBRATION_SIZE 256
+
+/**
+ * Works out a rate from an amount of work and the times it started and
+ * stopped.  Times too short to measure give zero, which leaves the model
+ * unknown.
+ */
+static inline double rate(double work, struct timeval start, struct timeval stop) {
+  const double time = (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_usec - start.tv_usec) * 1.E-6;
+  return (time > 0.0) ? work / time : 0.0;
+}
+
+/**
+ * Calibrates the performance model of the context the task is running on by
+ * timing a copy onto the device and a double precision matrix multiply.  The
+ * host context has nothing to copy so only the multiply is timed.
+ */
+static CUresult calibrate(const void * args) {
+  CUmultiGPUBLAShandle handle = *(CUmultiGPUBLAShandle *)args;
+  const int i = cuMultiGPUGetCurrentContext();
+  CUBLAShandle h = &handle->handles[i];
+
+  const size_t n = CALIBRATION_SIZE, size = n * n * sizeof(double);
+  const double flops = 2.0 * (double)n * (double)n * (double)n;
+  CUmultiGPUModel model = { 0.0, 0.0 };
+  struct timeval start, stop;
+
+  if (h->host) {
+    double * A;
+    if ((A = calloc(3 * n * n, sizeof(double))) == NULL)
+      return CUDA_ERROR_OUT_OF_MEMORY;
+
+    ERROR_CHECK(gettimeofday(&start, NULL));
+    dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, n, &A[n * n], n, 0.0, &A[2 * n * n], n);
+    ERROR_CHECK(gettimeofday(&stop, NULL));
+    model.throughput = rate(flops, start, stop);
+
+    free(A);
+  }
+  else {
+    void * H;
+    CUdeviceptr A, B, C;
+    CU_ERROR_CHECK(cuMemAllocHost(&H, size));
+    CU_ERROR_CHECK(cuMemAlloc(&A, size));
+    CU_ERROR_CHECK(cuMemAlloc(&B, size));
+    CU_ERROR_CHECK(cuMemAlloc(&C, size));
+    memset(H, 0, size);
+
+    // The first copy and multiply also load the module so are not timed
+    CU_ERROR_CHECK(cuMemcpyHtoD(A, H, size));
+    CU_ERROR_CHECK(cuMemcpyHtoD(B, H, size));
+
+    ERROR_CHECK(gettimeofday(&start, NULL));
+    CU_ERROR_CHECK(cuMemcpyHtoD(C, H, size));
+    ERROR_CHECK(gettimeofday(&stop, NULL));
+    model.bandwidth = rate((double)size, start, stop);
+
+    CU_ERROR_CHECK(cuDgemm(h, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, n, B, n, 0.0, C, n, NULL));
+    CU_ERROR_CHECK(cuCtxSynchronize());
+
+    ERROR_CHECK(gettimeofday(&start, NULL));
+    CU_ERROR_CHECK(cuDgemm(h, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, n, B, n, 0.0, C, n, NULL));
+    CU_ERROR_CHECK(cuCtxSynchronize());
+    ERROR_CHECK(gettimeofday(&stop, NULL));
+    model.throughput = rate(flops, start, stop);
+
+    CU_ERROR_CHECK(cuMemFree(A));
+    CU_ERROR_CHECK(cuMemFree(B));
+    CU_ERROR_CHECK(cuMemFree(C));
+    CU_ERROR_CHECK(cuMemFreeHost(H));
+  }
+
+  CU_ERROR_CHECK(cuMultiGPUSetModel(handle->mGPU, i, &model));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Gets the default size of the tile cache on each context from
+ * CUMULTIGPU_TILE_CACHE (in MiB).  The cache is disabled if it is not set.
+ */
+static size_t tileCacheSize(void) {
+  const char * size = getenv("CUMULTIGPU_TILE_CACHE");
+  if (size != NULL) {
+    char * end;
+    unsigned long long n = strtoull(size, &end, 10);
+    if (end != size && *end == '\0')
+      return (size_t)n << 20;
+  }
+  return 0;
+}
+
 CUresult cuMultiGPUBLASCreate(CUmultiGPUBLAShandle * handle, CUmultiGPU mGPU) {
   if ((*handle = malloc(sizeof(struct __cumultigpublashandle_st))) == NULL)
     return CUDA_ERROR_OUT_OF_MEMORY;
@@ -119,10 +790,36 @@ CUresult cuMultiGPUBLASCreate(CUmultiGPUBLAShandle * handle, CUmultiGPU mGPU) {
   for (int i = 0; i < n; i++) {
     CUBLAShandle h = &(*handle)->handles[i];
 
+    // The host context has no CUDA context to load modules into
+    if (cuMultiGPUIsHost(mGPU, i)) {
+      memset(h, 0, sizeof(struct __cublashandle_st));
+      h->host = true;
+      continue;
+    }
+
     CUtask task;
     CU_ERROR_CHECK(cuTaskCreate(&task, init, &h, sizeof(CUBLAShandle)));
     CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, i, task));
 
+    CUresult result;
+    CU_ERROR_CHECK(cuTaskDestroy(task, &result));
+    if (result != CUDA_SUCCESS)
+      return result;
+
+    h->tileCapacity = tileCacheSize();
+  }
+
+  // Calibrate the contexts that do not have a performance model yet
+  for (int i = 0; i < n; i++) {
+    CUmultiGPUModel model;
+    CU_ERROR_CHECK(cuMultiGPUGetModel(mGPU, i, &model));
+    if (model.throughput > 0.0)
+      continue;
+
+    CUtask task;
+    CU_ERROR_CHECK(cuTaskCreate(&task, calibrate, handle, sizeof(CUmultiGPUBLAShandle)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, i, task));
+
     CUresult result;
     CU_ERROR_CHECK(cuTaskDestroy(task, &result));
     if (result != CUDA_SUCCESS)
@@ -135,8 +832,74 @@ CUresult cuMultiGPUBLASCreate(CUmultiGPUBLAShandle * handle, CUmultiGPU mGPU) {
 CUresult cuMultiGPUBLASDestroy(CUmultiGPUBLAShandle handle) {
   int n = cuMultiGPUGetContextCount(handle->mGPU);
   for (int i = 0; i < n; i++) {
+    CUBLAShandle h = &handle->handles[i];
+    if (h->host)
+      continue;
+
+    CUtask task;
+    CU_ERROR_CHECK(cuTaskCreate(&task, cleanup, &h, sizeof(CUBLAShandle)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, i, task));
+
+    CUresult result;
+    CU_ERROR_CHECK(cuTaskDestroy(task, &result));
+    if (result != CUDA_SUCCESS)
+      return result;
+  }
+  free(handle->handles);
+  free(handle);
+  return CUDA_SUCCESS;
+}
+
+CUmultiGPU cuMultiGPUBLASGetMultiGPU(CUmultiGPUBLAShandle handle) {
+  return handle->mGPU;
+}
+
+CUBLAShandle cuMultiGPUBLASGetHandle(CUmultiGPUBLAShandle handle, int i) {
+  if (i < 0 || i >= cuMultiGPUGetContextCount(handle->mGPU) || handle->handles[i].host)
+    return NULL;
+  return &handle->handles[i];
+}
+
+static CUresult preload(const void * args) {
+  CUBLAShandle handle = *(CUBLAShandle *)args;
+  CU_ERROR_CHECK(cuBLASPreload(handle));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPUBLASPreload(CUmultiGPUBLAShandle handle) {
+  int n = cuMultiGPUGetContextCount(handle->mGPU);
+  for (int i = 0; i < n; i++) {
+    CUBLAShandle h = &handle->handles[i];
+    if (h->host)
+      continue;
+
+    CUtask task;
+    CU_ERROR_CHECK(cuTaskCreate(&task, preload, &h, sizeof(CUBLAShandle)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, i, task));
+
+    CUresult result;
+    CU_ERROR_CHECK(cuTaskDestroy(task, &result));
+    if (result != CUDA_SUCCESS)
+      return result;
+  }
+  return CUDA_SUCCESS;
+}
+
+static CUresult trim(const void * args) {
+  CUBLAShandle handle = *(CUBLAShandle *)args;
+  CU_ERROR_CHECK(cuBLASMemTrim(handle));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPUBLASMemTrim(CUmultiGPUBLAShandle handle) {
+  int n = cuMultiGPUGetContextCount(handle->mGPU);
+  for (int i = 0; i < n; i++) {
+    CUBLAShandle h = &handle->handles[i];
+    if (h->host)
+      continue;
+
     CUtask task;
-    CU_ERROR_CHECK(cuTaskCreate(&task, cleanup, &handle->handles[i], sizeof(CUBLAShandle)));
+    CU_ERROR_CHECK(cuTaskCreate(&task, trim, &h, sizeof(CUBLAShandle)));
     CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, i, task));
 
     CUresult result;
@@ -147,6 +910,154 @@ CUresult cuMultiGPUBLASDestroy(CUmultiGPUBLAShandle handle) {
   return CUDA_SUCCESS;
 }
 
+CUresult cuMultiGPUBLASMemGetInfo(CUmultiGPUBLAShandle handle, size_t * borrowed,
+                                  size_t * cached, size_t * highWater) {
+  size_t b = 0, c = 0, h = 0;
+  int n = cuMultiGPUGetContextCount(handle->mGPU);
+  for (int i = 0; i < n; i++) {
+    b += handle->handles[i].borrowedBytes;
+    c += handle->handles[i].cachedBytes;
+    h += handle->handles[i].highWater;
+  }
+
+  if (borrowed != NULL)
+    *borrowed = b;
+  if (cached != NULL)
+    *cached = c;
+  if (highWater != NULL)
+    *highWater = h;
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Arguments for resizing the tile cache of a context or dropping the tiles
+ * overlapping a block of host memory from it.
+ */
+struct tilecache_args {
+  CUBLAShandle handle;
+  const void * host;            /** Block to drop                             */
+  size_t ld, m, n;              /** Leading dimension and rows in bytes and
+                                    columns of the block                      */
+  size_t bytes;                 /** New capacity of the cache                 */
+};
+
+/**
+ * Shrinks the tile cache of a context to its new capacity.  Runs as a task on
+ * the context so that it is serialised with the tasks using the tiles.
+ */
+static CUresult resize(const void * args) {
+  const struct tilecache_args * a = (const struct tilecache_args *)args;
+  CUBLAShandle handle = a->handle;
+  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+
+  // Wait for the tiles still in use by the pipeline so that all of them may be
+  // evicted
+  handle->tileCapacity = a->bytes;
+  if (handle->tileBytes > handle->tileCapacity)
+    CU_ERROR_CHECK(pipeline_retire(handle, handle->pipeline.task));
+
+  bool room;
+  CU_ERROR_CHECK(tilecache_reserve(handle, 0, &room));
+
+  CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Drops the tiles of a context overlapping a block of host memory.  Runs as a
+ * task on the context so that it is serialised with the tasks using the tiles.
+ */
+static CUresult invalidate(const void * args) {
+  const struct tilecache_args * a = (const struct tilecache_args *)args;
+  CUBLAShandle handle = a->handle;
+  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+
+  struct cutile ** tile = &handle->tiles;
+  while (*tile != NULL) {
+    if (tile_overlaps(*tile, a->host, a->ld, a->m, a->n)) {
+      // The device may still be reading the tile
+      if ((*tile)->task > handle->pipeline.retired)
+        CU_ERROR_CHECK(pipeline_retire(handle, handle->pipeline.task));
+      CU_ERROR_CHECK(tile_evict(handle, tile));
+    }
+    else
+      tile = &(*tile)->next;
+  }
+
+  CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPUBLASSetTileCache(CUmultiGPUBLAShandle handle, size_t bytes) {
+  int n = cuMultiGPUGetContextCount(handle->mGPU);
+  CUtask tasks[n];
+  int nTasks = 0;
+
+  for (int i = 0; i < n; i++) {
+    CUBLAShandle h = &handle->handles[i];
+    if (h->host)
+      continue;
+
+    struct tilecache_args args = { .handle = h, .bytes = bytes };
+    CU_ERROR_CHECK(cuTaskCreate(&tasks[nTasks], resize, &args, sizeof(struct tilecache_args)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, i, tasks[nTasks]));
+    nTasks++;
+  }
+
+  CUresult result;
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, (size_t)nTasks, &result));
+
+  return result;
+}
+
+CUresult cuMultiGPUBLASInvalidate(CUmultiGPUBLAShandle handle, const void * ptr, size_t ld,
+                                  size_t m, size_t n, size_t elemSize) {
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  int count = cuMultiGPUGetContextCount(handle->mGPU);
+  CUtask tasks[count];
+  int nTasks = 0;
+
+  // Contexts without a cache hold no tiles as shrinking the cache evicts all of
+  // them
+  for (int i = 0; i < count; i++) {
+    CUBLAShandle h = &handle->handles[i];
+    if (h->host || h->tileCapacity == 0)
+      continue;
+
+    struct tilecache_args args = { .handle = h, .host = ptr,
+                                   .ld = ld * elemSize, .m = m * elemSize, .n = n };
+    CU_ERROR_CHECK(cuTaskCreate(&tasks[nTasks], invalidate, &args, sizeof(struct tilecache_args)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(handle->mGPU, i, tasks[nTasks]));
+    nTasks++;
+  }
+
+  CUresult result;
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, (size_t)nTasks, &result));
+
+  return result;
+}
+
+CUresult cuMultiGPUBLASTileCacheGetInfo(CUmultiGPUBLAShandle handle, size_t * hits,
+                                        size_t * misses, size_t * bytes) {
+  size_t h = 0, m = 0, b = 0;
+  int n = cuMultiGPUGetContextCount(handle->mGPU);
+  for (int i = 0; i < n; i++) {
+    h += handle->handles[i].tileHits;
+    m += handle->handles[i].tileMisses;
+    b += handle->handles[i].tileBytes;
+  }
+
+  if (hits != NULL)
+    *hits = h;
+  if (misses != NULL)
+    *misses = m;
+  if (bytes != NULL)
+    *bytes = b;
+  return CUDA_SUCCESS;
+}
+
 CUresult cuMultiGPUBLASSynchronize(CUmultiGPUBLAShandle handle) {
   CU_ERROR_CHECK(cuMultiGPUSynchronize(handle->mGPU));
   return CUDA_SUCCESS;
@@ -1,15 +1,194 @@
 #ifndef HANDLE_H
 #define HANDLE_H
 
+/**
+ * Block of device memory in a handle's memory pool.
+ */
+struct cumemblock {
+  CUdeviceptr ptr;              /** Device pointer                            */
+  size_t size;                  /** Size of the block (a size class)          */
+  struct cumemblock * next;     /** Next block in the list                    */
+};
+
+/**
+ * Block of page-locked host memory in a handle's staging buffer pool.
+ */
+struct cuhostblock {
+  void * ptr;                   /** Host pointer                              */
+  size_t size;                  /** Size of the block (a size class)          */
+  struct cuhostblock * next;    /** Next block in the list                    */
+};
+
+/**
+ * Stream in a handle's stream pool.
+ */
+struct custream {
+  CUstream stream;              /** The stream                                */
+  unsigned int flags;           /** Flags the stream was created with         */
+  struct custream * next;       /** Next stream in the list                   */
+};
+
+/**
+ * Copy of a block of a host matrix kept on the device by a handle's tile cache.
+ * Tiles are matched by the host address, leading dimension and extent of the
+ * block.
+ */
+struct cutile {
+  const void * host;            /** Host address of the first element         */
+  size_t ld;                    /** Leading dimension on the host in bytes    */
+  size_t m, n;                  /** Bytes in each column and columns          */
+  CUdeviceptr ptr;              /** Device copy (borrowed from the pool)      */
+  size_t pitch;                 /** Pitch of the device copy                  */
+  unsigned long task;           /** Last task to use the tile (not evicted
+                                    until the pipeline has retired it)        */
+  struct cutile * next;         /** Next (less recently used) tile            */
+};
+
+/**
+ * Copy/compute/copy-back pipeline shared by the background tasks that run on a
+ * handle.  Each stage has its own stream and the stages wait for each other
+ * with events, so a task returns as soon as its work is queued.  Its device
+ * memory is only given back to the pool once the next task has been queued
+ * behind it, which lets the upload for one task overlap the multiply for the
+ * task before and the download of the task before that.
+ */
+struct cupipeline {
+  CUstream h2d, compute, d2h;   /** Copy onto the device, compute and copy
+                                    back streams (zero until first used)      */
+  CUevent ready[2];             /** Blocks in each buffer are on the device   */
+  CUevent consumed[2];          /** Compute has finished with each buffer     */
+  CUevent computed;             /** The result has been computed              */
+  CUevent done;                 /** The result is back on the host            */
+  CUdeviceptr pending[5];       /** Memory still in use by the last task      */
+  int nPending;                 /** Number of blocks in pending               */
+  unsigned long task;           /** Tasks started on the pipeline             */
+  unsigned long retired;        /** Tasks known to have finished on the device */
+};
+
+/**
+ * Kernel looked up in a module together with the block sizes it was compiled
+ * for.
+ */
+struct cukernel {
+  CUfunction function;          /** The kernel                                */
+  unsigned int mb, nb, kb;      /** Block of the result computed by each
+                                    thread block and the inner loop length    */
+  unsigned int bx, by;          /** Thread block size                         */
+};
+
+/**
+ * Index of each option in the kernel tables.
+ */
+static inline int sideIndex(CBlasSide side) { return (side == CBlasLeft) ? 0 : 1; }
+static inline int uploIndex(CBlasUplo uplo) { return (uplo == CBlasUpper) ? 0 : 1; }
+static inline int transIndex(CBlasTranspose trans) {
+  return (trans == CBlasNoTrans) ? 0 : (trans == CBlasTrans) ? 1 : 2;
+}
+static inline int diagIndex(CBlasDiag diag) { return (diag == CBlasNonUnit) ? 0 : 1; }
+
 struct __cublashandle_st {
   CUcontext context;
   CUmodule sgemm2, ssyrk, strsm, strmm2;
   CUmodule cgemm2, cherk, ctrsm, ctrmm2;
   CUmodule dgemm2, dsyrk, dtrsm, dtrmm2;
   CUmodule zgemm2, zherk, ztrsm, ztrmm2;
+  // Kernels in each module indexed by [transA][transB], [uplo][trans] and
+  // [side][uplo][trans][diag].  Filled in when the module is loaded.
+  struct cukernel sgemm2Kernels[3][3], ssyrkKernels[2][3], strsmKernels[2][2][3][2], strmm2Kernels[2][2][3][2];
+  struct cukernel cgemm2Kernels[3][3], cherkKernels[2][2], ctrsmKernels[2][2][3][2], ctrmm2Kernels[2][2][3][2];
+  struct cukernel dgemm2Kernels[3][3], dsyrkKernels[2][3], dtrsmKernels[2][2][3][2], dtrmm2Kernels[2][2][3][2];
+  struct cukernel zgemm2Kernels[3][3], zherkKernels[2][2], ztrsmKernels[2][2][3][2], ztrmm2Kernels[2][2][3][2];
   bool contextOwner;
+  bool host;                    /** Computes on the host with the CPU BLAS    */
+  char device[256];             /** Name of the device used to look up block
+                                    sizes (empty on the host)                 */
+  struct cumemblock * cached;   /** Device memory ready to be borrowed        */
+  struct cumemblock * borrowed; /** Device memory lent out                    */
+  size_t cachedBytes;           /** Total size of the cached blocks           */
+  size_t borrowedBytes;         /** Total size of the borrowed blocks         */
+  size_t highWater;             /** Most device memory held by the pool       */
+  struct cuhostblock * hostCached;   /** Staging buffers ready to be borrowed */
+  struct cuhostblock * hostBorrowed; /** Staging buffers lent out             */
+  struct custream * streams;         /** Streams ready to be borrowed         */
+  struct custream * streamsBorrowed; /** Streams lent out                     */
+  struct cutile * tiles;        /** Cached tiles, most recently used first    */
+  size_t tileCapacity;          /** Most device memory the tiles may hold     */
+  size_t tileBytes;             /** Device memory held by the tiles           */
+  size_t tileHits, tileMisses;  /** Tile lookups that were found (not found)  */
+  struct cupipeline pipeline;   /** Pipeline for background tasks             */
 };
 
+/**
+ * Loads a module and fills in its kernel table.  The handle's context must be
+ * current.
+ */
+CUresult sgemm2_load(CUBLAShandle);
+CUresult ssyrk_load(CUBLAShandle);
+CUresult strsm_load(CUBLAShandle);
+CUresult strmm2_load(CUBLAShandle);
+CUresult cgemm2_load(CUBLAShandle);
+CUresult cherk_load(CUBLAShandle);
+CUresult ctrsm_load(CUBLAShandle);
+CUresult ctrmm2_load(CUBLAShandle);
+CUresult dgemm2_load(CUBLAShandle);
+CUresult dsyrk_load(CUBLAShandle);
+CUresult dtrsm_load(CUBLAShandle);
+CUresult dtrmm2_load(CUBLAShandle);
+CUresult zgemm2_load(CUBLAShandle);
+CUresult zherk_load(CUBLAShandle);
+CUresult ztrsm_load(CUBLAShandle);
+CUresult ztrmm2_load(CUBLAShandle);
+
+/**
+ * Gets a device copy of an m by n block of a host matrix from the handle's tile
+ * cache.  Blocks that are not cached are copied onto the device on the stream
+ * given and may only be used after it.  Tiles are not evicted until the
+ * pipeline has retired the running task.  The handle's context must be
+ * current.
+ *
+ * @param handle    the handle.
+ * @param host      the address of the first element of the block.
+ * @param ld        the leading dimension of the host matrix.
+ * @param m         the number of rows in the block.
+ * @param n         the number of columns in the block.
+ * @param elemSize  the size of each element.
+ * @param stream    the stream to copy the block on.
+ * @param ptr       the device copy is returned through this pointer, or zero if
+ *                  the cache is disabled or has no room for the block.
+ * @param ldd       the leading dimension of the device copy is returned through
+ *                  this pointer.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OUT_OF_MEMORY or any error from the copy.
+ */
+CUresult tilecache_get(CUBLAShandle, const void *, size_t, size_t, size_t, size_t,
+                       CUstream, CUdeviceptr *, size_t *);
+
+/**
+ * Starts a task on the handle's pipeline, creating its streams and events the
+ * first time.  The handle's context must be current.
+ */
+CUresult pipeline_begin(CUBLAShandle);
+
+/**
+ * Finishes queueing a task on the handle's pipeline.  The task's result must
+ * have been queued for copying back to the host on the d2h stream.  Waits for
+ * the previous task to finish on the device and gives its memory back to the
+ * pool, then keeps the memory given until the next task (or a flush) does the
+ * same.  The handle's context must be current.
+ *
+ * @param handle   the handle.
+ * @param buffers  device memory borrowed from the pool by the task.
+ * @param n        the number of buffers (at most five).
+ * @return CUDA_SUCCESS or any error from synchronising or freeing.
+ */
+CUresult pipeline_end(CUBLAShandle, const CUdeviceptr *, int);
+
+/**
+ * Waits for the last task on the pipeline of each context to finish on the
+ * device.  Must be called after the tasks have been waited for and before
+ * their results are used on the host.
+ */
+CUresult pipeline_flush(CUmultiGPUBLAShandle);
+
 struct __cumultigpublashandle_st {
   CUmultiGPU mGPU;
   struct __cublashandle_st * handles;
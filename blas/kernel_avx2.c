@@ -0,0 +1,94 @@
+#include "blas.h"
+#include "engine.h"
+#include <immintrin.h>
+
+/**
+ * AVX2 + FMA micro-kernels (Haswell, Zen and later).  Each column of the
+ * micro-tile is held in two ymm registers so the 16 x 6 (single) and 8 x 6
+ * (double) tiles use 12 of the 16 registers for accumulators, leaving room for
+ * a column of A and a broadcast element of B.
+ */
+
+#define COLUMNS6(F) F(0) F(1) F(2) F(3) F(4) F(5)
+
+static void sgemm_micro_avx2(size_t kb, float alpha,
+                             const float * restrict A, const float * restrict B,
+                             float beta, float * restrict C, size_t ldc) {
+#define DECLARE(j) __m256 c##j##0 = _mm256_setzero_ps(), c##j##1 = _mm256_setzero_ps();
+  COLUMNS6(DECLARE)
+#undef DECLARE
+
+  for (size_t l = 0; l < kb; l++) {
+    const __m256 a0 = _mm256_loadu_ps(&A[0]), a1 = _mm256_loadu_ps(&A[8]);
+#define UPDATE(j) \
+    do { \
+      const __m256 b = _mm256_broadcast_ss(&B[j]); \
+      c##j##0 = _mm256_fmadd_ps(a0, b, c##j##0); \
+      c##j##1 = _mm256_fmadd_ps(a1, b, c##j##1); \
+    } while (false);
+    COLUMNS6(UPDATE)
+#undef UPDATE
+    A += 16;
+    B += 6;
+  }
+
+  const __m256 a = _mm256_set1_ps(alpha);
+  if (beta == 0.0f) {
+#define STORE(j) \
+    _mm256_storeu_ps(&C[j * ldc], _mm256_mul_ps(a, c##j##0)); \
+    _mm256_storeu_ps(&C[j * ldc + 8], _mm256_mul_ps(a, c##j##1));
+    COLUMNS6(STORE)
+#undef STORE
+  }
+  else {
+    const __m256 b = _mm256_set1_ps(beta);
+#define STORE(j) \
+    _mm256_storeu_ps(&C[j * ldc], _mm256_fmadd_ps(b, _mm256_loadu_ps(&C[j * ldc]), _mm256_mul_ps(a, c##j##0))); \
+    _mm256_storeu_ps(&C[j * ldc + 8], _mm256_fmadd_ps(b, _mm256_loadu_ps(&C[j * ldc + 8]), _mm256_mul_ps(a, c##j##1)));
+    COLUMNS6(STORE)
+#undef STORE
+  }
+}
+
+const struct sgemm_ukernel sgemm_ukernel_avx2 = { "avx2", 16, 6, sgemm_micro_avx2 };
+
+static void dgemm_micro_avx2(size_t kb, double alpha,
+                             const double * restrict A, const double * restrict B,
+                             double beta, double * restrict C, size_t ldc) {
+#define DECLARE(j) __m256d c##j##0 = _mm256_setzero_pd(), c##j##1 = _mm256_setzero_pd();
+  COLUMNS6(DECLARE)
+#undef DECLARE
+
+  for (size_t l = 0; l < kb; l++) {
+    const __m256d a0 = _mm256_loadu_pd(&A[0]), a1 = _mm256_loadu_pd(&A[4]);
+#define UPDATE(j) \
+    do { \
+      const __m256d b = _mm256_broadcast_sd(&B[j]); \
+      c##j##0 = _mm256_fmadd_pd(a0, b, c##j##0); \
+      c##j##1 = _mm256_fmadd_pd(a1, b, c##j##1); \
+    } while (false);
+    COLUMNS6(UPDATE)
+#undef UPDATE
+    A += 8;
+    B += 6;
+  }
+
+  const __m256d a = _mm256_set1_pd(alpha);
+  if (beta == 0.0) {
+#define STORE(j) \
+    _mm256_storeu_pd(&C[j * ldc], _mm256_mul_pd(a, c##j##0)); \
+    _mm256_storeu_pd(&C[j * ldc + 4], _mm256_mul_pd(a, c##j##1));
+    COLUMNS6(STORE)
+#undef STORE
+  }
+  else {
+    const __m256d b = _mm256_set1_pd(beta);
+#define STORE(j) \
+    _mm256_storeu_pd(&C[j * ldc], _mm256_fmadd_pd(b, _mm256_loadu_pd(&C[j * ldc]), _mm256_mul_pd(a, c##j##0))); \
+    _mm256_storeu_pd(&C[j * ldc + 4], _mm256_fmadd_pd(b, _mm256_loadu_pd(&C[j * ldc + 4]), _mm256_mul_pd(a, c##j##1)));
+    COLUMNS6(STORE)
+#undef STORE
+  }
+}
+
+const struct dgemm_ukernel dgemm_ukernel_avx2 = { "avx2", 8, 6, dgemm_micro_avx2 };
@@ -0,0 +1,93 @@
+#include "blas.h"
+#include "engine.h"
+#include <immintrin.h>
+
+/**
+ * AVX-512 micro-kernels (Skylake-SP and later).  Each column of the
+ * micro-tile is held in two zmm registers so the 32 x 8 (single) and 16 x 8
+ * (double) tiles use 16 of the 32 registers for accumulators.
+ */
+
+#define COLUMNS8(F) F(0) F(1) F(2) F(3) F(4) F(5) F(6) F(7)
+
+static void sgemm_micro_avx512(size_t kb, float alpha,
+                               const float * restrict A, const float * restrict B,
+                               float beta, float * restrict C, size_t ldc) {
+#define DECLARE(j) __m512 c##j##0 = _mm512_setzero_ps(), c##j##1 = _mm512_setzero_ps();
+  COLUMNS8(DECLARE)
+#undef DECLARE
+
+  for (size_t l = 0; l < kb; l++) {
+    const __m512 a0 = _mm512_loadu_ps(&A[0]), a1 = _mm512_loadu_ps(&A[16]);
+#define UPDATE(j) \
+    do { \
+      const __m512 b = _mm512_set1_ps(B[j]); \
+      c##j##0 = _mm512_fmadd_ps(a0, b, c##j##0); \
+      c##j##1 = _mm512_fmadd_ps(a1, b, c##j##1); \
+    } while (false);
+    COLUMNS8(UPDATE)
+#undef UPDATE
+    A += 32;
+    B += 8;
+  }
+
+  const __m512 a = _mm512_set1_ps(alpha);
+  if (beta == 0.0f) {
+#define STORE(j) \
+    _mm512_storeu_ps(&C[j * ldc], _mm512_mul_ps(a, c##j##0)); \
+    _mm512_storeu_ps(&C[j * ldc + 16], _mm512_mul_ps(a, c##j##1));
+    COLUMNS8(STORE)
+#undef STORE
+  }
+  else {
+    const __m512 b = _mm512_set1_ps(beta);
+#define STORE(j) \
+    _mm512_storeu_ps(&C[j * ldc], _mm512_fmadd_ps(b, _mm512_loadu_ps(&C[j * ldc]), _mm512_mul_ps(a, c##j##0))); \
+    _mm512_storeu_ps(&C[j * ldc + 16], _mm512_fmadd_ps(b, _mm512_loadu_ps(&C[j * ldc + 16]), _mm512_mul_ps(a, c##j##1)));
+    COLUMNS8(STORE)
+#undef STORE
+  }
+}
+
+const struct sgemm_ukernel sgemm_ukernel_avx512 = { "avx512", 32, 8, sgemm_micro_avx512 };
+
+static void dgemm_micro_avx512(size_t kb, double alpha,
+                               const double * restrict A, const double * restrict B,
+                               double beta, double * restrict C, size_t ldc) {
+#define DECLARE(j) __m512d c##j##0 = _mm512_setzero_pd(), c##j##1 = _mm512_setzero_pd();
+  COLUMNS8(DECLARE)
+#undef DECLARE
+
+  for (size_t l = 0; l < kb; l++) {
+    const __m512d a0 = _mm512_loadu_pd(&A[0]), a1 = _mm512_loadu_pd(&A[8]);
+#define UPDATE(j) \
+    do { \
+      const __m512d b = _mm512_set1_pd(B[j]); \
+      c##j##0 = _mm512_fmadd_pd(a0, b, c##j##0); \
+      c##j##1 = _mm512_fmadd_pd(a1, b, c##j##1); \
+    } while (false);
+    COLUMNS8(UPDATE)
+#undef UPDATE
+    A += 16;
+    B += 8;
+  }
+
+  const __m512d a = _mm512_set1_pd(alpha);
+  if (beta == 0.0) {
+#define STORE(j) \
+    _mm512_storeu_pd(&C[j * ldc], _mm512_mul_pd(a, c##j##0)); \
+    _mm512_storeu_pd(&C[j * ldc + 8], _mm512_mul_pd(a, c##j##1));
+    COLUMNS8(STORE)
+#undef STORE
+  }
+  else {
+    const __m512d b = _mm512_set1_pd(beta);
+#define STORE(j) \
+    _mm512_storeu_pd(&C[j * ldc], _mm512_fmadd_pd(b, _mm512_loadu_pd(&C[j * ldc]), _mm512_mul_pd(a, c##j##0))); \
+    _mm512_storeu_pd(&C[j * ldc + 8], _mm512_fmadd_pd(b, _mm512_loadu_pd(&C[j * ldc + 8]), _mm512_mul_pd(a, c##j##1)));
+    COLUMNS8(STORE)
+#undef STORE
+  }
+}
+
+const struct dgemm_ukernel dgemm_ukernel_avx512 = { "avx512", 16, 8, dgemm_micro_avx512 };
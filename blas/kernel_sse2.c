@@ -0,0 +1,94 @@
+#include "blas.h"
+#include "engine.h"
+#include <emmintrin.h>
+
+/**
+ * SSE2 micro-kernels.  This is the x86-64 baseline so these are always
+ * available.  Each column of the micro-tile is held in two xmm registers so the
+ * 8 x 4 (single) and 4 x 4 (double) tiles use 8 of the 16 registers for
+ * accumulators.
+ */
+
+#define COLUMNS4(F) F(0) F(1) F(2) F(3)
+
+static void sgemm_micro_sse2(size_t kb, float alpha,
+                             const float * restrict A, const float * restrict B,
+                             float beta, float * restrict C, size_t ldc) {
+#define DECLARE(j) __m128 c##j##0 = _mm_setzero_ps(), c##j##1 = _mm_setzero_ps();
+  COLUMNS4(DECLARE)
+#undef DECLARE
+
+  for (size_t l = 0; l < kb; l++) {
+    const __m128 a0 = _mm_loadu_ps(&A[0]), a1 = _mm_loadu_ps(&A[4]);
+#define UPDATE(j) \
+    do { \
+      const __m128 b = _mm_set1_ps(B[j]); \
+      c##j##0 = _mm_add_ps(c##j##0, _mm_mul_ps(a0, b)); \
+      c##j##1 = _mm_add_ps(c##j##1, _mm_mul_ps(a1, b)); \
+    } while (false);
+    COLUMNS4(UPDATE)
+#undef UPDATE
+    A += 8;
+    B += 4;
+  }
+
+  const __m128 a = _mm_set1_ps(alpha);
+  if (beta == 0.0f) {
+#define STORE(j) \
+    _mm_storeu_ps(&C[j * ldc], _mm_mul_ps(a, c##j##0)); \
+    _mm_storeu_ps(&C[j * ldc + 4], _mm_mul_ps(a, c##j##1));
+    COLUMNS4(STORE)
+#undef STORE
+  }
+  else {
+    const __m128 b = _mm_set1_ps(beta);
+#define STORE(j) \
+    _mm_storeu_ps(&C[j * ldc], _mm_add_ps(_mm_mul_ps(a, c##j##0), _mm_mul_ps(b, _mm_loadu_ps(&C[j * ldc])))); \
+    _mm_storeu_ps(&C[j * ldc + 4], _mm_add_ps(_mm_mul_ps(a, c##j##1), _mm_mul_ps(b, _mm_loadu_ps(&C[j * ldc + 4]))));
+    COLUMNS4(STORE)
+#undef STORE
+  }
+}
+
+const struct sgemm_ukernel sgemm_ukernel_sse2 = { "sse2", 8, 4, sgemm_micro_sse2 };
+
+static void dgemm_micro_sse2(size_t kb, double alpha,
+                             const double * restrict A, const double * restrict B,
+                             double beta, double * restrict C, size_t ldc) {
+#define DECLARE(j) __m128d c##j##0 = _mm_setzero_pd(), c##j##1 = _mm_setzero_pd();
+  COLUMNS4(DECLARE)
+#undef DECLARE
+
+  for (size_t l = 0; l < kb; l++) {
+    const __m128d a0 = _mm_loadu_pd(&A[0]), a1 = _mm_loadu_pd(&A[2]);
+#define UPDATE(j) \
+    do { \
+      const __m128d b = _mm_set1_pd(B[j]); \
+      c##j##0 = _mm_add_pd(c##j##0, _mm_mul_pd(a0, b)); \
+      c##j##1 = _mm_add_pd(c##j##1, _mm_mul_pd(a1, b)); \
+    } while (false);
+    COLUMNS4(UPDATE)
+#undef UPDATE
+    A += 4;
+    B += 4;
+  }
+
+  const __m128d a = _mm_set1_pd(alpha);
+  if (beta == 0.0) {
+#define STORE(j) \
+    _mm_storeu_pd(&C[j * ldc], _mm_mul_pd(a, c##j##0)); \
+    _mm_storeu_pd(&C[j * ldc + 2], _mm_mul_pd(a, c##j##1));
+    COLUMNS4(STORE)
+#undef STORE
+  }
+  else {
+    const __m128d b = _mm_set1_pd(beta);
+#define STORE(j) \
+    _mm_storeu_pd(&C[j * ldc], _mm_add_pd(_mm_mul_pd(a, c##j##0), _mm_mul_pd(b, _mm_loadu_pd(&C[j * ldc])))); \
+    _mm_storeu_pd(&C[j * ldc + 2], _mm_add_pd(_mm_mul_pd(a, c##j##1), _mm_mul_pd(b, _mm_loadu_pd(&C[j * ldc + 2]))));
+    COLUMNS4(STORE)
+#undef STORE
+  }
+}
+
+const struct dgemm_ukernel dgemm_ukernel_sse2 = { "sse2", 4, 4, dgemm_micro_sse2 };
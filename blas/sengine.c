@@ -0,0 +1,418 @@
+#include "blas.h"
+#include "engine.h"
+#include <stdlib.h>
+
+static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
+
+static const float zero = 0.0f;
+static const float one = 1.0f;
+
+void sgemm_pack_a(CBlasTranspose trans, size_t mb, size_t kb,
+                  const float * restrict A, size_t lda, float * restrict P) {
+  const size_t mr = sgemm_selected->mr;
+  const size_t np = (mb + mr - 1) / mr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t i0 = p * mr;
+    const size_t ib = min(mb - i0, mr);
+    float * restrict panel = &P[p * mr * kb];
+
+    if (trans == CBlasNoTrans) {
+      for (size_t l = 0; l < kb; l++) {
+        for (size_t i = 0; i < ib; i++)
+          panel[l * mr + i] = A[l * lda + i0 + i];
+        for (size_t i = ib; i < mr; i++)
+          panel[l * mr + i] = zero;
+      }
+    }
+    else {
+      for (size_t l = 0; l < kb; l++) {
+        for (size_t i = 0; i < ib; i++)
+          panel[l * mr + i] = A[(i0 + i) * lda + l];
+        for (size_t i = ib; i < mr; i++)
+          panel[l * mr + i] = zero;
+      }
+    }
+  }
+}
+
+void sgemm_pack_b(CBlasTranspose trans, size_t kb, size_t nb,
+                  const float * restrict B, size_t ldb, float * restrict P) {
+  const size_t nr = sgemm_selected->nr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t j0 = p * nr;
+    const size_t jb = min(nb - j0, nr);
+    float * restrict panel = &P[p * nr * kb];
+
+    if (trans == CBlasNoTrans) {
+      for (size_t l = 0; l < kb; l++) {
+        for (size_t j = 0; j < jb; j++)
+          panel[l * nr + j] = B[(j0 + j) * ldb + l];
+        for (size_t j = jb; j < nr; j++)
+          panel[l * nr + j] = zero;
+      }
+    }
+    else {
+      for (size_t l = 0; l < kb; l++) {
+        for (size_t j = 0; j < jb; j++)
+          panel[l * nr + j] = B[l * ldb + j0 + j];
+        for (size_t j = jb; j < nr; j++)
+          panel[l * nr + j] = zero;
+      }
+    }
+  }
+}
+
+/**
+ * Portable micro-kernel.  The accumulator is small enough for the compiler to
+ * keep in vector registers.
+ */
+#define MR 16
+#define NR 4
+
+static void sgemm_micro_c(size_t kb, float alpha,
+                          const float * restrict A, const float * restrict B,
+                          float beta, float * restrict C, size_t ldc) {
+  float AB[MR * NR];
+  for (size_t i = 0; i < MR * NR; i++)
+    AB[i] = zero;
+
+  for (size_t l = 0; l < kb; l++) {
+    for (size_t j = 0; j < NR; j++) {
+      const float b = B[l * NR + j];
+      for (size_t i = 0; i < MR; i++)
+        AB[j * MR + i] += A[l * MR + i] * b;
+    }
+  }
+
+  if (beta == zero) {
+    for (size_t j = 0; j < NR; j++) {
+      for (size_t i = 0; i < MR; i++)
+        C[j * ldc + i] = alpha * AB[j * MR + i];
+    }
+  }
+  else {
+    for (size_t j = 0; j < NR; j++) {
+      for (size_t i = 0; i < MR; i++)
+        C[j * ldc + i] = alpha * AB[j * MR + i] + beta * C[j * ldc + i];
+    }
+  }
+}
+
+const struct sgemm_ukernel sgemm_ukernel_c = { "c", MR, NR, sgemm_micro_c };
+
+#undef MR
+#undef NR
+
+void sgemm_kernel(size_t mb, size_t nb, size_t kb,
+                  float alpha, const float * restrict A, const float * restrict B,
+                  float beta, float * restrict C, size_t ldc) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const sgemm_micro_t micro = sgemm_selected->micro;
+  const size_t mp = (mb + mr - 1) / mr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for collapse(2)
+  for (size_t q = 0; q < np; q++) {
+    for (size_t p = 0; p < mp; p++) {
+      const size_t i = p * mr, j = q * nr;
+      const size_t ib = min(mb - i, mr);
+      const size_t jb = min(nb - j, nr);
+
+      if (ib == mr && jb == nr)
+        micro(kb, alpha, &A[i * kb], &B[j * kb], beta, &C[j * ldc + i], ldc);
+      else {
+        // Edge tile - compute into a temporary and copy out the valid part
+        float T[SGEMM_MR_MAX * SGEMM_NR_MAX];
+        micro(kb, alpha, &A[i * kb], &B[j * kb], zero, T, mr);
+        if (beta == zero) {
+          for (size_t jj = 0; jj < jb; jj++) {
+            for (size_t ii = 0; ii < ib; ii++)
+              C[(j + jj) * ldc + i + ii] = T[jj * mr + ii];
+          }
+        }
+        else {
+          for (size_t jj = 0; jj < jb; jj++) {
+            for (size_t ii = 0; ii < ib; ii++)
+              C[(j + jj) * ldc + i + ii] = T[jj * mr + ii] + beta * C[(j + jj) * ldc + i + ii];
+          }
+        }
+      }
+    }
+  }
+}
+
+bool sgemm_packed(CBlasTranspose transA, CBlasTranspose transB,
+                  size_t m, size_t n, size_t k,
+                  float alpha, const float * restrict A, size_t lda, const float * restrict B, size_t ldb,
+                  float beta, float * restrict C, size_t ldc) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&sblocking);
+
+  // Size the buffers for the problem so small updates don't touch whole pages
+  const size_t mc = ((min(m, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  float * Ap = malloc(mc * kc * sizeof(float));
+  float * Bp = malloc(kc * nc * sizeof(float));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+      // Only the first pass over k scales C by beta
+      const float b = (l == 0) ? beta : one;
+
+      sgemm_pack_b(transB, lb, jb,
+                   (transB == CBlasNoTrans) ? &B[j * ldb + l] : &B[l * ldb + j], ldb, Bp);
+
+      for (size_t i = 0; i < m; i += blocking.mb) {
+        const size_t ib = min(m - i, blocking.mb);
+
+        sgemm_pack_a(transA, ib, lb,
+                     (transA == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+        sgemm_kernel(ib, jb, lb, alpha, Ap, Bp, b, &C[j * ldc + i], ldc);
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
+
+void ssyrk_kernel(CBlasUplo uplo, ptrdiff_t offset, size_t mb, size_t nb, size_t kb,
+                  float alpha, const float * restrict A, const float * restrict B,
+                  float beta, float * restrict C, size_t ldc) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const sgemm_micro_t micro = sgemm_selected->micro;
+  const size_t mp = (mb + mr - 1) / mr;
+  const size_t np = (nb + nr - 1) / nr;
+
+  // Tiles outside the triangle are skipped so share them out dynamically
+#pragma omp for collapse(2) schedule(dynamic)
+  for (size_t q = 0; q < np; q++) {
+    for (size_t p = 0; p < mp; p++) {
+      const size_t i = p * mr, j = q * nr;
+      const size_t ib = min(mb - i, mr);
+      const size_t jb = min(nb - j, nr);
+
+      // Position of the tile relative to the diagonal of C
+      const ptrdiff_t top = (ptrdiff_t)i + offset, bottom = top + (ptrdiff_t)ib - 1;
+      const ptrdiff_t left = (ptrdiff_t)j, right = left + (ptrdiff_t)jb - 1;
+      if ((uplo == CBlasUpper) ? top > right : bottom < left)
+        continue;
+      const bool inside = (uplo == CBlasUpper) ? bottom <= left : top >= right;
+
+      if (inside && ib == mr && jb == nr)
+        micro(kb, alpha, &A[i * kb], &B[j * kb], beta, &C[j * ldc + i], ldc);
+      else {
+        // Diagonal or edge tile - compute into a temporary and copy out the
+        // part that lies in the triangle
+        float T[SGEMM_MR_MAX * SGEMM_NR_MAX];
+        micro(kb, alpha, &A[i * kb], &B[j * kb], zero, T, mr);
+        for (size_t jj = 0; jj < jb; jj++) {
+          for (size_t ii = 0; ii < ib; ii++) {
+            const ptrdiff_t r = top + (ptrdiff_t)ii, c = left + (ptrdiff_t)jj;
+            if ((uplo == CBlasUpper) ? r > c : r < c)
+              continue;
+            if (beta == zero)
+              C[(j + jj) * ldc + i + ii] = T[jj * mr + ii];
+            else
+              C[(j + jj) * ldc + i + ii] = T[jj * mr + ii] + beta * C[(j + jj) * ldc + i + ii];
+          }
+        }
+      }
+    }
+  }
+}
+
+bool ssyrk_packed(CBlasUplo uplo, CBlasTranspose trans, size_t n, size_t k,
+                  float alpha, const float * restrict A, size_t lda,
+                  float beta, float * restrict C, size_t ldc) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&sblocking);
+  // C = alpha * op(A) * op(A)^T + beta * C is a GEMM with A as both operands
+  const CBlasTranspose transB = (trans == CBlasNoTrans) ? CBlasTrans : CBlasNoTrans;
+
+  const size_t mc = ((min(n, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  float * Ap = malloc(mc * kc * sizeof(float));
+  float * Bp = malloc(kc * nc * sizeof(float));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+    // Only the row blocks that intersect the triangle are computed
+    const size_t i0 = (uplo == CBlasUpper) ? 0 : j;
+    const size_t i1 = (uplo == CBlasUpper) ? j + jb : n;
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+      const float b = (l == 0) ? beta : one;
+
+      sgemm_pack_b(transB, lb, jb,
+                   (trans == CBlasNoTrans) ? &A[l * lda + j] : &A[j * lda + l], lda, Bp);
+
+      for (size_t i = i0; i < i1; i += blocking.mb) {
+        const size_t ib = min(i1 - i, blocking.mb);
+
+        sgemm_pack_a(trans, ib, lb,
+                     (trans == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+        ssyrk_kernel(uplo, (ptrdiff_t)i - (ptrdiff_t)j, ib, jb, lb, alpha, Ap, Bp, b, &C[j * ldc + i], ldc);
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
+
+void strmm_pack_a(CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag, ptrdiff_t offset,
+                  size_t mb, size_t kb, const float * restrict A, size_t lda, float * restrict P) {
+  const size_t mr = sgemm_selected->mr;
+  const size_t np = (mb + mr - 1) / mr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t i0 = p * mr;
+    const size_t ib = min(mb - i0, mr);
+    float * restrict panel = &P[p * mr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t i = 0; i < ib; i++) {
+        const ptrdiff_t d = (ptrdiff_t)(i0 + i) - (ptrdiff_t)l + offset;
+        if ((uplo == CBlasUpper) ? d > 0 : d < 0)
+          panel[l * mr + i] = zero;
+        else if (d == 0 && diag == CBlasUnit)
+          panel[l * mr + i] = one;
+        else
+          panel[l * mr + i] = (trans == CBlasNoTrans) ? A[l * lda + i0 + i] : A[(i0 + i) * lda + l];
+      }
+      for (size_t i = ib; i < mr; i++)
+        panel[l * mr + i] = zero;
+    }
+  }
+}
+
+void strmm_pack_b(CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag, ptrdiff_t offset,
+                  size_t kb, size_t nb, const float * restrict B, size_t ldb, float * restrict P) {
+  const size_t nr = sgemm_selected->nr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t j0 = p * nr;
+    const size_t jb = min(nb - j0, nr);
+    float * restrict panel = &P[p * nr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t j = 0; j < jb; j++) {
+        const ptrdiff_t d = (ptrdiff_t)l - (ptrdiff_t)(j0 + j) + offset;
+        if ((uplo == CBlasUpper) ? d > 0 : d < 0)
+          panel[l * nr + j] = zero;
+        else if (d == 0 && diag == CBlasUnit)
+          panel[l * nr + j] = one;
+        else
+          panel[l * nr + j] = (trans == CBlasNoTrans) ? B[(j0 + j) * ldb + l] : B[l * ldb + j0 + j];
+      }
+      for (size_t j = jb; j < nr; j++)
+        panel[l * nr + j] = zero;
+    }
+  }
+}
+
+bool strmm_packed(CBlasSide side, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
+                  size_t m, size_t n,
+                  float alpha, const float * restrict A, size_t lda,
+                  const float * restrict B, size_t ldb,
+                  float * restrict X, size_t ldx) {
+  const size_t mr = sgemm_selected->mr, nr = sgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&sblocking);
+  // The triangle of op(A) that is referenced
+  const CBlasUplo op = ((uplo == CBlasUpper) == (trans == CBlasNoTrans)) ? CBlasUpper : CBlasLower;
+  const size_t k = (side == CBlasLeft) ? m : n;
+
+  const size_t mc = ((min(m, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  float * Ap = malloc(mc * kc * sizeof(float));
+  float * Bp = malloc(kc * nc * sizeof(float));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+
+      if (side == CBlasLeft) {
+        // X = alpha * op(A) * B
+        sgemm_pack_b(CBlasNoTrans, lb, jb, &B[j * ldb + l], ldb, Bp);
+
+        for (size_t i = 0; i < m; i += blocking.mb) {
+          const size_t ib = min(m - i, blocking.mb);
+
+          // Skip blocks of op(A) outside the triangle.  The first block inside
+          // it overwrites X.
+          if ((op == CBlasUpper) ? l + lb <= i : l >= i + ib)
+            continue;
+          const float b = (l == ((op == CBlasUpper) ? (i / blocking.kb) * blocking.kb : 0)) ? zero : one;
+
+          strmm_pack_a(op, trans, diag, (ptrdiff_t)i - (ptrdiff_t)l, ib, lb,
+                       (trans == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+          sgemm_kernel(ib, jb, lb, alpha, Ap, Bp, b, &X[j * ldx + i], ldx);
+        }
+      }
+      else {
+        // X = alpha * B * op(A)
+        if ((op == CBlasUpper) ? l >= j + jb : l + lb <= j)
+          continue;
+        const float b = (l == ((op == CBlasUpper) ? 0 : (j / blocking.kb) * blocking.kb)) ? zero : one;
+
+        strmm_pack_b(op, trans, diag, (ptrdiff_t)l - (ptrdiff_t)j, lb, jb,
+                     (trans == CBlasNoTrans) ? &A[j * lda + l] : &A[l * lda + j], lda, Bp);
+
+        for (size_t i = 0; i < m; i += blocking.mb) {
+          const size_t ib = min(m - i, blocking.mb);
+
+          sgemm_pack_a(CBlasNoTrans, ib, lb, &B[l * ldb + i], ldb, Ap);
+          sgemm_kernel(ib, jb, lb, alpha, Ap, Bp, b, &X[j * ldx + i], ldx);
+        }
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
@@ -2,7 +2,7 @@
 #include "error.h"
 #include <stdio.h>
 #include "handle.h"
-#include "config.h"
+#include "engine.h"
 #include "ssyrk.fatbin.c"
 
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
@@ -50,7 +50,7 @@ void ssyrk(CBlasUplo uplo, CBlasTranspose trans,
   if (n == 0 || ((alpha == zero || k == 0) && beta == one))
     return;
 
-  if (alpha == zero) {
+  if (alpha == zero || k == 0) {
     if (uplo == CBlasUpper) {
       if (beta == zero) {
 #pragma omp parallel for
@@ -86,6 +86,10 @@ void ssyrk(CBlasUplo uplo, CBlasTranspose trans,
     return;
   }
 
+  if (ssyrk_packed(uplo, trans, n, k, alpha, A, lda, beta, C, ldc))
+    return;
+
+  // Fall back to unpacked loops if the packing buffers could not be allocated
   if (trans == CBlasNoTrans) {
     if (uplo == CBlasUpper) {
 #pragma omp parallel for
@@ -160,6 +164,56 @@ void ssyrk(CBlasUplo uplo, CBlasTranspose trans,
   }
 }
 
+/**
+ * Looks up the kernel for one combination of options and the block sizes it was
+ * compiled for.
+ */
+static CUresult lookup(CUmodule module, CBlasUplo uplo, CBlasTranspose trans,
+                       struct cukernel * kernel) {
+  const unsigned int mb = (trans == CBlasNoTrans) ? 64 : 32;
+  const unsigned int nb = (trans == CBlasNoTrans) ? 16 : 32;
+  const unsigned int kb = (trans == CBlasNoTrans) ? 16 :  8;
+  const unsigned int bx = (trans == CBlasNoTrans) ? 16 :  8;
+  const unsigned int by = (trans == CBlasNoTrans) ?  4 :  8;
+
+  char name[82];
+  snprintf(name, 82,
+           "_Z5ssyrkIL9CBlasUplo%dEL14CBlasTranspose%dELj%uELj%uELj%uELj%uELj%uEEvPKfPfffiiii",
+           uplo, trans, mb, nb, kb, bx, by);
+
+  CU_ERROR_CHECK(cuModuleGetFunction(&kernel->function, module, name));
+  kernel->mb = mb;
+  kernel->nb = nb;
+  kernel->kb = kb;
+  kernel->bx = bx;
+  kernel->by = by;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Loads the SSYRK module and looks up the kernel for each uplo and trans so
+ * that a launch only has to index the handle's table.  The handle's context
+ * must be current.
+ */
+CUresult ssyrk_load(CUBLAShandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  // The conjugate transpose of a real matrix is its transpose
+  const CBlasTranspose transs[] = { CBlasNoTrans, CBlasTrans, CBlasTrans };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    for (int t = 0; t < 3; t++)
+      CU_ERROR_CHECK(lookup(module, uplos[u], transs[t], &handle->ssyrkKernels[u][t]));
+  }
+
+  handle->ssyrk = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuSsyrk(CUBLAShandle handle, CBlasUplo uplo, CBlasTranspose trans,
                  size_t n, size_t k,
                  float alpha, CUdeviceptr A, size_t lda,
@@ -182,28 +236,17 @@ CUresult cuSsyrk(CUBLAShandle handle, CBlasUplo uplo, CBlasTranspose trans,
   CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
 
   if (handle->ssyrk == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->ssyrk, imageBytes));
-
-  const unsigned int mb = (trans == CBlasNoTrans) ? 64 : 32;
-  const unsigned int nb = (trans == CBlasNoTrans) ? 16 : 32;
-  const unsigned int kb = (trans == CBlasNoTrans) ? 16 :  8;
-  const unsigned int bx = (trans == CBlasNoTrans) ? 16 :  8;
-  const unsigned int by = (trans == CBlasNoTrans) ?  4 :  8;
+    CU_ERROR_CHECK(ssyrk_load(handle));
 
-  char name[82];
-  snprintf(name, 82,
-           "_Z5ssyrkIL9CBlasUplo%dEL14CBlasTranspose%dELj%uELj%uELj%uELj%uELj%uEEvPKfPfffiiii",
-           uplo, trans, mb, nb, kb, bx, by);
-
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->ssyrk, name));
+  const struct cukernel * kernel = &handle->ssyrkKernels[uploIndex(uplo)][transIndex(trans)];
+  const unsigned int mb = kernel->mb, nb = kernel->nb, bx = kernel->bx, by = kernel->by;
 
   void * params[] = { &A, &C, &alpha, &beta, &lda, &ldc, &n, &k };
 
 //   unsigned int blocks = (unsigned int)(n + nb - 1) / nb;
 //   blocks = (blocks * (blocks + 1)) / 2;
 
-  CU_ERROR_CHECK(cuLaunchKernel(function, (unsigned int)(n + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
+  CU_ERROR_CHECK(cuLaunchKernel(kernel->function, (unsigned int)(n + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
                                 bx, by, 1, 0, stream, params, NULL));
 
   CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
@@ -231,6 +274,9 @@ CUresult cuMultiGPUSsyrk(CUmultiGPUBLAShandle handle,
   if (n == 0 || ((alpha == zero || k == 0) && beta == one))
     return CUDA_SUCCESS;
 
+  // Any copies of C cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, C, ldc, n, n, sizeof(float)));
+
   if (alpha == zero) {
     if (uplo == CBlasUpper) {
       if (beta == zero) {
@@ -267,7 +313,9 @@ CUresult cuMultiGPUSsyrk(CUmultiGPUBLAShandle handle,
     return CUDA_SUCCESS;
   }
 
-  const size_t nb = (trans == CBlasNoTrans) ? SGEMM_N_MB : SGEMM_T_NB;
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, (trans == CBlasNoTrans) ? CBlasSgemmN : CBlasSgemmT, &blocking));
+  const size_t nb = (trans == CBlasNoTrans) ? blocking.mb : blocking.nb;
 
   if (n < nb) {
     ssyrk(uplo, trans, n, k, alpha, A, lda, beta, C, ldc);
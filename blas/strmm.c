@@ -1,8 +1,9 @@
 #include "blas.h"
 #include "error.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include "handle.h"
-#include "config.h"
+#include "engine.h"
 #include "strmm.fatbin.c"
 
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
@@ -69,6 +70,46 @@ void strmm(CBlasSide side, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
     return;
   }
 
+  // Columns of B are independent when A is on the left (rows when it is on the
+  // right) so B is copied to a workspace in strips which are multiplied out of
+  // place by the packed engine.
+  const size_t strip = engine_blocking(&sblocking).trmm;
+  if (side == CBlasLeft) {
+    const size_t nb = min(n, strip);
+    float * W;
+    if ((W = malloc(m * nb * sizeof(float))) != NULL) {
+      for (size_t j = 0; j < n; j += nb) {
+        const size_t jb = min(n - j, nb);
+#pragma omp parallel for
+        for (size_t jj = 0; jj < jb; jj++) {
+          for (size_t i = 0; i < m; i++)
+            W[jj * m + i] = B[(j + jj) * ldb + i];
+        }
+        strmm2(CBlasLeft, uplo, trans, diag, m, jb, alpha, A, lda, W, m, &B[j * ldb], ldb);
+      }
+      free(W);
+      return;
+    }
+  }
+  else {
+    const size_t mb = min(m, strip);
+    float * W;
+    if ((W = malloc(mb * n * sizeof(float))) != NULL) {
+      for (size_t i = 0; i < m; i += mb) {
+        const size_t ib = min(m - i, mb);
+#pragma omp parallel for
+        for (size_t j = 0; j < n; j++) {
+          for (size_t ii = 0; ii < ib; ii++)
+            W[j * mb + ii] = B[j * ldb + i + ii];
+        }
+        strmm2(CBlasRight, uplo, trans, diag, ib, n, alpha, A, lda, W, mb, &B[i], ldb);
+      }
+      free(W);
+      return;
+    }
+  }
+
+  // Fall back to in-place loops if the workspace could not be allocated
   if (side == CBlasLeft) {
     if (trans == CBlasNoTrans) {
       if (uplo == CBlasUpper) {
@@ -234,6 +275,10 @@ void strmm2(CBlasSide side, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag
     return;
   }
 
+  if (strmm_packed(side, uplo, trans, diag, m, n, alpha, A, lda, B, ldb, X, ldx))
+    return;
+
+  // Fall back to unpacked loops if the packing buffers could not be allocated
   if (side == CBlasLeft) {
     if (trans == CBlasNoTrans) {
       if (uplo == CBlasUpper) {
@@ -371,6 +416,62 @@ void strmm2(CBlasSide side, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag
   }
 }
 
+/**
+ * Looks up the kernel for one combination of options and the block sizes it was
+ * compiled for.
+ */
+static CUresult lookup(CUmodule module, CBlasSide side, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
+                       struct cukernel * kernel) {
+  const unsigned int mb = (side == CBlasLeft && trans != CBlasNoTrans) ? 32 : 64;
+  const unsigned int nb = (side == CBlasLeft && trans != CBlasNoTrans) ? 32 : 16;
+  const unsigned int kb = (side == CBlasLeft && trans != CBlasNoTrans) ?  8 : 16;
+  const unsigned int bx = (side == CBlasLeft && trans != CBlasNoTrans) ?  8 : 16;
+  const unsigned int by = (side == CBlasLeft && trans != CBlasNoTrans) ?  8 :  4;
+
+  char name[69];
+  snprintf(name, 69,
+           "_Z9strmm2%c%c%cIL9CBlasDiag%dELj%uELj%uELj%uELj%uELj%uEEvPKfS2_Pffiiiii",
+           side, uplo, trans, diag, mb, nb, kb, bx, by);
+
+  CU_ERROR_CHECK(cuModuleGetFunction(&kernel->function, module, name));
+  kernel->mb = mb;
+  kernel->nb = nb;
+  kernel->kb = kb;
+  kernel->bx = bx;
+  kernel->by = by;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Loads the STRMM2 module and looks up the kernel for each side, uplo, trans
+ * and diag so that a launch only has to index the handle's table.  The handle's
+ * context must be current.
+ */
+CUresult strmm2_load(CUBLAShandle handle) {
+  const CBlasSide sides[] = { CBlasLeft, CBlasRight };
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  // The conjugate transpose of a real matrix is its transpose
+  const CBlasTranspose transs[] = { CBlasNoTrans, CBlasTrans, CBlasTrans };
+  const CBlasDiag diags[] = { CBlasNonUnit, CBlasUnit };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int s = 0; s < 2; s++) {
+    for (int u = 0; u < 2; u++) {
+      for (int t = 0; t < 3; t++) {
+        for (int d = 0; d < 2; d++)
+          CU_ERROR_CHECK(lookup(module, sides[s], uplos[u], transs[t], diags[d], &handle->strmm2Kernels[s][u][t][d]));
+      }
+    }
+  }
+
+  handle->strmm2 = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuStrmm2(CUBLAShandle handle,
                   CBlasSide side, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
                   size_t m, size_t n,
@@ -397,25 +498,14 @@ CUresult cuStrmm2(CUBLAShandle handle,
   CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
 
   if (handle->strmm2 == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->strmm2, imageBytes));
-
-  const unsigned int mb = (side == CBlasLeft && trans != CBlasNoTrans) ? 32 : 64;
-  const unsigned int nb = (side == CBlasLeft && trans != CBlasNoTrans) ? 32 : 16;
-  const unsigned int kb = (side == CBlasLeft && trans != CBlasNoTrans) ?  8 : 16;
-  const unsigned int bx = (side == CBlasLeft && trans != CBlasNoTrans) ?  8 : 16;
-  const unsigned int by = (side == CBlasLeft && trans != CBlasNoTrans) ?  8 :  4;
-
-  char name[69];
-  snprintf(name, 69,
-           "_Z9strmm2%c%c%cIL9CBlasDiag%dELj%uELj%uELj%uELj%uELj%uEEvPKfS2_Pffiiiii",
-           side, uplo, trans, diag, mb, nb, kb, bx, by);
+    CU_ERROR_CHECK(strmm2_load(handle));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->strmm2, name));
+  const struct cukernel * kernel = &handle->strmm2Kernels[sideIndex(side)][uploIndex(uplo)][transIndex(trans)][diagIndex(diag)];
+  const unsigned int mb = kernel->mb, nb = kernel->nb, bx = kernel->bx, by = kernel->by;
 
   void * params[] = { &A, &B, &X, &alpha, &lda, &ldb, &ldx, &m, &n };
 
-  CU_ERROR_CHECK(cuLaunchKernel(function,
+  CU_ERROR_CHECK(cuLaunchKernel(kernel->function,
                                 (unsigned int)(m + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
                                 bx, by, 1,
                                 0, stream, params, NULL));
@@ -450,14 +540,16 @@ CUresult cuStrmm(CUBLAShandle handle,
 
   CUdeviceptr X;
   size_t ldx;
-  CU_ERROR_CHECK(cuMemAllocPitch(&X, &ldx, m * sizeof(float), n, sizeof(float)));
+  CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &X, &ldx, m * sizeof(float), n, sizeof(float)));
   ldx /= sizeof(float);
 
   CU_ERROR_CHECK(cuStrmm2(handle, side, uplo, trans, diag, m, n, alpha, A, lda, B, ldb, X, ldx, stream));
 
   CU_ERROR_CHECK(cuMemcpyDtoD2DAsync(B, ldb, 0, 0, X, ldx, 0, 0, m, n, sizeof(float), stream));
 
-  CU_ERROR_CHECK(cuMemFree(X));
+  // Wait for the copy before X goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
 
   CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
 
@@ -484,103 +576,116 @@ CUresult cuMultiGPUStrmm(CUmultiGPUBLAShandle handle,
   if (m == 0 || n == 0)
     return CUDA_SUCCESS;
 
+  // Any copies of B cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, B, ldb, m, n, sizeof(float)));
+
   if (alpha == zero) {
-    sgemm(CBlasNoTrans, CBlasNoTrans, m, n, 0, zero, A, lda, B, ldb, zero, B, ldb);
+#pragma omp parallel for
+    for (size_t j = 0; j < n; j++) {
+      for (size_t i = 0; i < m; i++)
+        B[j * ldb + i] = zero;
+    }
     return CUDA_SUCCESS;
   }
 
-  const size_t mb = (trans == CBlasNoTrans) ? SGEMM_N_MB : SGEMM_T_MB;
-  const size_t nb = SGEMM_N_NB;
+  CBlasBlocking blocking, blockingN;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, (trans == CBlasNoTrans) ? CBlasSgemmN : CBlasSgemmT, &blocking));
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, CBlasSgemmN, &blockingN));
+  const size_t mb = blocking.mb;
+  const size_t nb = blockingN.nb;
 
   if (m <= mb || n <= nb) {
     strmm(side, uplo, trans, diag, m, n, alpha, A, lda, B, ldb);
     return CUDA_SUCCESS;
   }
 
+  // B := alpha * op(A) * B (or B * op(A)) one block at a time.  Each block is
+  // first multiplied by the diagonal block of A on the host and then updated
+  // using the blocks of B that have not been overwritten yet, so the blocks are
+  // visited in the opposite order to trsm.
   if (side == CBlasLeft) {
     if (trans == CBlasNoTrans) {
       if (uplo == CBlasUpper) {
-        size_t i = (m + mb - 1) & ~(mb - 1);
-        do {
-          i -= mb;
+        for (size_t i = 0; i < m; i += mb) {
           const size_t ib = min(mb, m - i);
-          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, ib, n, m - i - ib, -one, &A[(i + ib) * lda + i], lda, &B[i + ib], ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
-          strmm(CBlasLeft, CBlasUpper, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
-        } while (i > 0);
+          strmm(CBlasLeft, CBlasUpper, CBlasNoTrans, diag, ib, n, alpha, &A[i * lda + i], lda, &B[i], ldb);
+          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, ib, n, m - i - ib, alpha, &A[(i + ib) * lda + i], lda, &B[i + ib], ldb, one, &B[i], ldb));
+        }
       }
       else {
-        for (size_t i = 0; i < m; i += mb) {
+        size_t r = m % mb;
+        size_t i = (r == 0) ? m : m + mb - r;
+        do {
+          i -= mb;
           const size_t ib = min(mb, m - i);
-          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, ib, n, i, -one, &A[i], lda, B, ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
-          strmm(CBlasLeft, CBlasLower, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
-        }
+          strmm(CBlasLeft, CBlasLower, CBlasNoTrans, diag, ib, n, alpha, &A[i * lda + i], lda, &B[i], ldb);
+          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, ib, n, i, alpha, &A[i], lda, B, ldb, one, &B[i], ldb));
+        } while (i > 0);
       }
     }
     else {
       if (uplo == CBlasUpper) {
-        for (size_t i = 0; i < m; i += mb) {
-          const size_t ib = min(mb, m - i);
-          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasTrans, CBlasNoTrans, ib, n, i, -one, &A[i * lda], lda, B, ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
-          strmm(CBlasLeft, CBlasUpper, CBlasTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
-        }
-      }
-      else {
-        size_t i = (m + mb - 1) & ~(mb - 1);
+        size_t r = m % mb;
+        size_t i = (r == 0) ? m : m + mb - r;
         do {
           i -= mb;
           const size_t ib = min(mb, m - i);
-          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasTrans, CBlasNoTrans, ib, n, m - i - ib, -one, &A[i * lda + i + ib], lda, &B[i + ib], ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
-          strmm(CBlasLeft, CBlasLower, CBlasTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+          strmm(CBlasLeft, CBlasUpper, CBlasTrans, diag, ib, n, alpha, &A[i * lda + i], lda, &B[i], ldb);
+          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasTrans, CBlasNoTrans, ib, n, i, alpha, &A[i * lda], lda, B, ldb, one, &B[i], ldb));
         } while (i > 0);
       }
+      else {
+        for (size_t i = 0; i < m; i += mb) {
+          const size_t ib = min(mb, m - i);
+          strmm(CBlasLeft, CBlasLower, CBlasTrans, diag, ib, n, alpha, &A[i * lda + i], lda, &B[i], ldb);
+          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasTrans, CBlasNoTrans, ib, n, m - i - ib, alpha, &A[i * lda + i + ib], lda, &B[i + ib], ldb, one, &B[i], ldb));
+        }
+      }
     }
   }
   else {
     if (trans == CBlasNoTrans) {
       if (uplo == CBlasUpper) {
-        for (size_t j = 0; j < n; j += nb) {
-          const size_t jb = min(nb, n - j);
-          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, m, jb, j, -one, B, ldb, &A[j * lda], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
-          strmm(CBlasRight, CBlasUpper, CBlasNoTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
-        }
-      }
-      else {
-        size_t j = (n + nb - 1) & ~(nb - 1);
+        size_t r = n % nb;
+        size_t j = (r == 0) ? n : n + nb - r;
         do {
           j -= nb;
           const size_t jb = min(nb, n - j);
-          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[j * lda + j + jb], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
-          strmm(CBlasRight, CBlasLower, CBlasNoTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+          strmm(CBlasRight, CBlasUpper, CBlasNoTrans, diag, m, jb, alpha, &A[j * lda + j], lda, &B[j * ldb], ldb);
+          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, m, jb, j, alpha, B, ldb, &A[j * lda], lda, one, &B[j * ldb], ldb));
         } while (j > 0);
       }
+      else {
+        for (size_t j = 0; j < n; j += nb) {
+          const size_t jb = min(nb, n - j);
+          strmm(CBlasRight, CBlasLower, CBlasNoTrans, diag, m, jb, alpha, &A[j * lda + j], lda, &B[j * ldb], ldb);
+          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, m, jb, n - j - jb, alpha, &B[(j + jb) * ldb], ldb, &A[j * lda + j + jb], lda, one, &B[j * ldb], ldb));
+        }
+      }
     }
     else {
       if (uplo == CBlasUpper) {
-        size_t j = (n + nb - 1) & ~(nb - 1);
-        do {
-          j -= nb;
+        for (size_t j = 0; j < n; j += nb) {
           const size_t jb = min(nb, n - j);
-          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasTrans, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[(j + jb) * lda + j], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
-          strmm(CBlasRight, CBlasUpper, CBlasTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
-        } while (j > 0);
+          strmm(CBlasRight, CBlasUpper, CBlasTrans, diag, m, jb, alpha, &A[j * lda + j], lda, &B[j * ldb], ldb);
+          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasTrans, m, jb, n - j - jb, alpha, &B[(j + jb) * ldb], ldb, &A[(j + jb) * lda + j], lda, one, &B[j * ldb], ldb));
+        }
       }
       else {
-        for (size_t j = 0; j < n; j += nb) {
+        size_t r = n % nb;
+        size_t j = (r == 0) ? n : n + nb - r;
+        do {
+          j -= nb;
           const size_t jb = min(nb, n - j);
-          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasTrans, m, jb, j, -one, B, ldb, &A[j], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
-          strmm(CBlasRight, CBlasLower, CBlasTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
-        }
+          strmm(CBlasRight, CBlasLower, CBlasTrans, diag, m, jb, alpha, &A[j * lda + j], lda, &B[j * ldb], ldb);
+          CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasTrans, m, jb, j, alpha, B, ldb, &A[j], lda, one, &B[j * ldb], ldb));
+        } while (j > 0);
       }
     }
   }
 
+  // Blocks of B were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, B, ldb, m, n, sizeof(float)));
+
   return CUDA_SUCCESS;
 }
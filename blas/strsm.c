@@ -2,7 +2,7 @@
 #include "error.h"
 #include <stdio.h>
 #include "handle.h"
-#include "config.h"
+#include "engine.h"
 #include "strsm.fatbin.c"
 
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
@@ -31,34 +31,14 @@ static inline CUresult cuMemcpyDtoH2DAsync(void * A, size_t lda, size_t ai, size
 static const float zero = 0.0f;
 static const float one = 1.0f;
 
-void strsm(CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
-           size_t m, size_t n,
-           float alpha, const float * restrict A, size_t lda,
-           float * restrict B, size_t ldb) {
-  const size_t nRowA = (side == CBlasLeft) ? m : n;
-
-  int info = 0;
-  if (lda < nRowA)
-    info = 9;
-  else if (ldb < m)
-    info = 11;
-  if (info != 0) {
-    XERBLA(info);
-    return;
-  }
-
-  if (m == 0 || n == 0)
-    return;
-
-  if (alpha == zero) {
-#pragma omp parallel for
-    for (size_t j = 0; j < n; j++) {
-      for (size_t i = 0; i < m; i++)
-        B[j * ldb + i] = zero;
-    }
-    return;
-  }
-
+/**
+ * Level 2 triangular solve.  Used when A is small and for the diagonal blocks
+ * of the blocked algorithm.
+ */
+static void strsm_unblocked(CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+                            size_t m, size_t n,
+                            float alpha, const float * restrict A, size_t lda,
+                            float * restrict B, size_t ldb) {
   if (side == CBlasLeft) {
     if (transA == CBlasNoTrans) {
       if (uplo == CBlasUpper) {
@@ -215,11 +195,23 @@ void strsm(CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag
   }
 }
 
-CUresult cuStrsm(CUBLAShandle handle,
-                 CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
-                 size_t m, size_t n,
-                 float alpha, CUdeviceptr A, size_t lda,
-                 CUdeviceptr B, size_t ldb, CUstream stream) {
+/**
+ * Solves X * op(A) = alpha * B.  The rows of B are independent so strips of
+ * nb rows are solved in parallel.
+ */
+static void strsm_right(CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+                        size_t m, size_t n, size_t nb,
+                        float alpha, const float * restrict A, size_t lda,
+                        float * restrict B, size_t ldb) {
+#pragma omp parallel for
+  for (size_t i = 0; i < m; i += nb)
+    strsm_unblocked(CBlasRight, uplo, transA, diag, min(nb, m - i), n, alpha, A, lda, &B[i], ldb);
+}
+
+void strsm(CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+           size_t m, size_t n,
+           float alpha, const float * restrict A, size_t lda,
+           float * restrict B, size_t ldb) {
   const size_t nRowA = (side == CBlasLeft) ? m : n;
 
   int info = 0;
@@ -229,17 +221,125 @@ CUresult cuStrsm(CUBLAShandle handle,
     info = 11;
   if (info != 0) {
     XERBLA(info);
-    return CUDA_ERROR_INVALID_VALUE;
+    return;
   }
 
   if (m == 0 || n == 0)
-    return CUDA_SUCCESS;
+    return;
 
-  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+  if (alpha == zero) {
+#pragma omp parallel for
+    for (size_t j = 0; j < n; j++) {
+      for (size_t i = 0; i < m; i++)
+        B[j * ldb + i] = zero;
+    }
+    return;
+  }
 
-  if (handle->strsm == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->strsm, imageBytes));
+  const size_t nb = engine_blocking(&sblocking).trsm;
+
+  if (nRowA <= nb) {
+    if (side == CBlasLeft)
+      strsm_unblocked(side, uplo, transA, diag, m, n, alpha, A, lda, B, ldb);
+    else
+      strsm_right(uplo, transA, diag, m, n, nb, alpha, A, lda, B, ldb);
+    return;
+  }
+
+  // Each block of B is updated by a GEMM with the blocks already solved and
+  // then solved against the diagonal block of A
+  if (side == CBlasLeft) {
+    if (transA == CBlasNoTrans) {
+      if (uplo == CBlasUpper) {
+        size_t r = m % nb;
+        size_t i = (r == 0) ? m : m + nb - r;
+        do {
+          i -= nb;
+          const size_t ib = min(nb, m - i);
+          sgemm(CBlasNoTrans, CBlasNoTrans, ib, n, m - i - ib, -one, &A[(i + ib) * lda + i], lda, &B[i + ib], ldb, alpha, &B[i], ldb);
+          strsm_unblocked(CBlasLeft, CBlasUpper, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+        } while (i > 0);
+      }
+      else {
+        for (size_t i = 0; i < m; i += nb) {
+          const size_t ib = min(nb, m - i);
+          sgemm(CBlasNoTrans, CBlasNoTrans, ib, n, i, -one, &A[i], lda, B, ldb, alpha, &B[i], ldb);
+          strsm_unblocked(CBlasLeft, CBlasLower, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+        }
+      }
+
+    }
+    else {
+      if (uplo == CBlasUpper) {
+        for (size_t i = 0; i < m; i += nb) {
+          const size_t ib = min(nb, m - i);
+          sgemm(CBlasTrans, CBlasNoTrans, ib, n, i, -one, &A[i * lda], lda, B, ldb, alpha, &B[i], ldb);
+          strsm_unblocked(CBlasLeft, CBlasUpper, CBlasTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+        }
+      }
+      else {
+        size_t r = m % nb;
+        size_t i = (r == 0) ? m : m + nb - r;
+        do {
+          i -= nb;
+          const size_t ib = min(nb, m - i);
+          sgemm(CBlasTrans, CBlasNoTrans, ib, n, m - i - ib, -one, &A[i * lda + i + ib], lda, &B[i + ib], ldb, alpha, &B[i], ldb);
+          strsm_unblocked(CBlasLeft, CBlasLower, CBlasTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
+        } while (i > 0);
+      }
+
+    }
+  }
+  else {
+    if (transA == CBlasNoTrans) {
+      if (uplo == CBlasUpper) {
+        for (size_t j = 0; j < n; j += nb) {
+          const size_t jb = min(nb, n - j);
+          sgemm(CBlasNoTrans, CBlasNoTrans, m, jb, j, -one, B, ldb, &A[j * lda], lda, alpha, &B[j * ldb], ldb);
+          strsm_right(CBlasUpper, CBlasNoTrans, diag, m, jb, nb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+        }
+      }
+      else {
+        size_t r = n % nb;
+        size_t j = (r == 0) ? n : n + nb - r;
+        do {
+          j -= nb;
+          const size_t jb = min(nb, n - j);
+          sgemm(CBlasNoTrans, CBlasNoTrans, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[j * lda + j + jb], lda, alpha, &B[j * ldb], ldb);
+          strsm_right(CBlasLower, CBlasNoTrans, diag, m, jb, nb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+        } while (j > 0);
+      }
+
+    }
+    else {
+      if (uplo == CBlasUpper) {
+        size_t r = n % nb;
+        size_t j = (r == 0) ? n : n + nb - r;
+        do {
+          j -= nb;
+          const size_t jb = min(nb, n - j);
+          sgemm(CBlasNoTrans, CBlasTrans, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[(j + jb) * lda + j], lda, alpha, &B[j * ldb], ldb);
+          strsm_right(CBlasUpper, CBlasTrans, diag, m, jb, nb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+        } while (j > 0);
+      }
+      else {
+        for (size_t j = 0; j < n; j += nb) {
+          const size_t jb = min(nb, n - j);
+          sgemm(CBlasNoTrans, CBlasTrans, m, jb, j, -one, B, ldb, &A[j], lda, alpha, &B[j * ldb], ldb);
+          strsm_right(CBlasLower, CBlasTrans, diag, m, jb, nb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
+        }
+      }
+
+    }
+  }
+}
 
+/**
+ * Looks up the kernel for one combination of options and the block sizes it was
+ * compiled for.
+ */
+static CUresult lookup(CUmodule module, CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+                       struct cukernel * kernel) {
   const unsigned int bx =  8;
   const unsigned int by =  8;
   const unsigned int mb = (side == CBlasLeft) ?  8 : 64;
@@ -250,14 +350,77 @@ CUresult cuStrsm(CUBLAShandle handle,
            "_Z5strsmIL9CBlasSide%dEL9CBlasUplo%dEL14CBlasTranspose%dEL9CBlasDiag%dELj%uELj%uELj%uELj%uEEvPKfPffiiii",
            side, uplo, transA, diag, mb, nb, bx, by);
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->strsm, name));
+  CU_ERROR_CHECK(cuModuleGetFunction(&kernel->function, module, name));
+  kernel->mb = mb;
+  kernel->nb = nb;
+  kernel->bx = bx;
+  kernel->by = by;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Loads the STRSM module and looks up the kernel for each side, uplo, transA
+ * and diag so that a launch only has to index the handle's table.  The handle's
+ * context must be current.
+ */
+CUresult strsm_load(CUBLAShandle handle) {
+  const CBlasSide sides[] = { CBlasLeft, CBlasRight };
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  // The conjugate transpose of a real matrix is its transpose
+  const CBlasTranspose transs[] = { CBlasNoTrans, CBlasTrans, CBlasTrans };
+  const CBlasDiag diags[] = { CBlasNonUnit, CBlasUnit };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int s = 0; s < 2; s++) {
+    for (int u = 0; u < 2; u++) {
+      for (int a = 0; a < 3; a++) {
+        for (int d = 0; d < 2; d++)
+          CU_ERROR_CHECK(lookup(module, sides[s], uplos[u], transs[a], diags[d], &handle->strsmKernels[s][u][a][d]));
+      }
+    }
+  }
+
+  handle->strsm = module;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuStrsm(CUBLAShandle handle,
+                 CBlasSide side, CBlasUplo uplo, CBlasTranspose transA, CBlasDiag diag,
+                 size_t m, size_t n,
+                 float alpha, CUdeviceptr A, size_t lda,
+                 CUdeviceptr B, size_t ldb, CUstream stream) {
+  const size_t nRowA = (side == CBlasLeft) ? m : n;
+
+  int info = 0;
+  if (lda < nRowA)
+    info = 9;
+  else if (ldb < m)
+    info = 11;
+  if (info != 0) {
+    XERBLA(info);
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+
+  if (handle->strsm == NULL)
+    CU_ERROR_CHECK(strsm_load(handle));
+
+  const struct cukernel * kernel = &handle->strsmKernels[sideIndex(side)][uploIndex(uplo)][transIndex(transA)][diagIndex(diag)];
+  const unsigned int mb = kernel->mb, nb = kernel->nb, bx = kernel->bx, by = kernel->by;
 
   void * params[] = { &A, &B, &alpha, &lda, &ldb, &m, &n };
 
   const unsigned int gx = (side == CBlasLeft) ? 1 : (unsigned int)(m + mb - 1) / mb;
   const unsigned int gy = (side == CBlasLeft) ? (unsigned int)(n + nb - 1) / nb : 1;
-  CU_ERROR_CHECK(cuLaunchKernel(function, gx, gy, 1, bx, by, 1, 0, stream, params, NULL));
+  CU_ERROR_CHECK(cuLaunchKernel(kernel->function, gx, gy, 1, bx, by, 1, 0, stream, params, NULL));
 
   CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
 
@@ -284,13 +447,23 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
   if (m == 0 || n == 0)
     return CUDA_SUCCESS;
 
+  // Any copies of B cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, B, ldb, m, n, sizeof(float)));
+
   if (alpha == zero) {
-    sgemm(CBlasNoTrans, CBlasNoTrans, m, n, 0, zero, A, lda, B, ldb, zero, B, ldb);
+#pragma omp parallel for
+    for (size_t j = 0; j < n; j++) {
+      for (size_t i = 0; i < m; i++)
+        B[j * ldb + i] = zero;
+    }
     return CUDA_SUCCESS;
   }
 
-  const size_t mb = (transA == CBlasNoTrans) ? SGEMM_N_MB : SGEMM_T_MB;
-  const size_t nb = SGEMM_N_NB;
+  CBlasBlocking blocking, blockingN;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, (transA == CBlasNoTrans) ? CBlasSgemmN : CBlasSgemmT, &blocking));
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, CBlasSgemmN, &blockingN));
+  const size_t mb = blocking.mb;
+  const size_t nb = blockingN.nb;
 
   if (side == CBlasLeft) {
     if (transA == CBlasNoTrans) {
@@ -301,7 +474,6 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
           i -= mb;
           const size_t ib = min(mb, m - i);
           CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, ib, n, m - i - ib, -one, &A[(i + ib) * lda + i], lda, &B[i + ib], ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           strsm(CBlasLeft, CBlasUpper, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
         } while (i > 0);
       }
@@ -309,7 +481,6 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
         for (size_t i = 0; i < m; i += mb) {
           const size_t ib = min(mb, m - i);
           CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, ib, n, i, -one, &A[i], lda, B, ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           strsm(CBlasLeft, CBlasLower, CBlasNoTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
         }
       }
@@ -320,7 +491,6 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
         for (size_t i = 0; i < m; i += mb) {
           const size_t ib = min(mb, m - i);
           CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasTrans, CBlasNoTrans, ib, n, i, -one, &A[i * lda], lda, B, ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           strsm(CBlasLeft, CBlasUpper, CBlasTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
         }
       }
@@ -331,7 +501,6 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
           i -= mb;
           const size_t ib = min(mb, m - i);
           CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasTrans, CBlasNoTrans, ib, n, m - i - ib, -one, &A[i * lda + i + ib], lda, &B[i + ib], ldb, alpha, &B[i], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           strsm(CBlasLeft, CBlasLower, CBlasTrans, diag, ib, n, one, &A[i * lda + i], lda, &B[i], ldb);
         } while (i > 0);
       }
@@ -344,7 +513,6 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
         for (size_t j = 0; j < n; j += nb) {
           const size_t jb = min(nb, n - j);
           CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, m, jb, j, -one, B, ldb, &A[j * lda], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           strsm(CBlasRight, CBlasUpper, CBlasNoTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
         }
       }
@@ -355,7 +523,6 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
           j -= nb;
           const size_t jb = min(nb, n - j);
           CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasNoTrans, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[j * lda + j + jb], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           strsm(CBlasRight, CBlasLower, CBlasNoTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
         } while (j > 0);
       }
@@ -369,7 +536,6 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
           j -= nb;
           const size_t jb = min(nb, n - j);
           CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasTrans, m, jb, n - j - jb, -one, &B[(j + jb) * ldb], ldb, &A[(j + jb) * lda + j], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           strsm(CBlasRight, CBlasUpper, CBlasTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
         } while (j > 0);
       }
@@ -377,7 +543,6 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
         for (size_t j = 0; j < n; j += nb) {
           const size_t jb = min(nb, n - j);
           CU_ERROR_CHECK(cuMultiGPUSgemm(handle, CBlasNoTrans, CBlasTrans, m, jb, j, -one, B, ldb, &A[j], lda, alpha, &B[j * ldb], ldb));
-          CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
           strsm(CBlasRight, CBlasLower, CBlasTrans, diag, m, jb, one, &A[j * lda + j], lda, &B[j * ldb], ldb);
         }
       }
@@ -385,5 +550,8 @@ CUresult cuMultiGPUStrsm(CUmultiGPUBLAShandle handle,
     }
   }
 
+  // Blocks of B were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, B, ldb, m, n, sizeof(float)));
+
   return CUDA_SUCCESS;
 }
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cuda.h>
+#include "error.h"
+#include "blas.h"
+
+/**
+ * Fills in a tuning database for the host and the devices it can see.  An
+ * existing database is loaded first so that entries for other hosts are kept.
+ * Set CUMULTIGPU_TUNING to the database to use it on each host.
+ */
+int main(int argc, char * argv[]) {
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "Usage: %s <database> [cpu size] [gpu size]\n"
+                    "where:\n"
+                    "  database   is the tuning database to update\n"
+                    "  cpu size   is the size of the matrices to time on the host (default 1024)\n"
+                    "  gpu size   is the size of the matrices to time on the devices (default 4096)\n", argv[0]);
+    return 1;
+  }
+
+  size_t cpuSize = 1024, gpuSize = 4096;
+  if (argc > 2 && sscanf(argv[2], "%zu", &cpuSize) != 1) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[2]);
+    return 1;
+  }
+  if (argc > 3 && sscanf(argv[3], "%zu", &gpuSize) != 1) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[3]);
+    return 2;
+  }
+
+  CUresult result = cuBLASTuningLoad(argv[1]);
+  if (result != CUDA_SUCCESS && result != CUDA_ERROR_FILE_NOT_FOUND) {
+    fprintf(stderr, "Unable to load '%s'\n", argv[1]);
+    return 3;
+  }
+
+  const char * names[CBLAS_TUNING_ROUTINES] = {
+    "SGEMM N", "SGEMM T", "DGEMM N", "DGEMM T", "CGEMM N", "CGEMM C",
+    "ZGEMM N", "ZGEMM CN", "ZGEMM CC", "SGEMM engine", "DGEMM engine",
+    "CGEMM engine", "ZGEMM engine", "SPOTRF", "DPOTRF", "CPOTRF", "ZPOTRF"
+  };
+
+  fprintf(stdout, "%s\n", cuBLASTuningHostModel());
+  for (int r = CBlasSengine; r <= CBlasZengine; r++) {
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuBLASTuneHost((CBlasTuningRoutine)r, cpuSize));
+    CU_ERROR_CHECK(cuBLASTuningGet(NULL, (CBlasTuningRoutine)r, &blocking));
+    fprintf(stdout, "  %-12s MC %zu NC %zu KC %zu TRSM %zu TRMM %zu threads %d\n", names[r],
+            blocking.mb, blocking.nb, blocking.kb, blocking.trsm, blocking.trmm, blocking.threads);
+  }
+
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  if (deviceCount > 0) {
+    CUdevice devices[deviceCount];
+    for (int i = 0; i < deviceCount; i++)
+      CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+    CUmultiGPU mGPU;
+    CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+    CUmultiGPUBLAShandle handle;
+    CU_ERROR_CHECK(cuMultiGPUBLASCreate(&handle, mGPU));
+
+    for (int i = 0; i < deviceCount; i++) {
+      char name[256];
+      CU_ERROR_CHECK(cuDeviceGetName(name, 256, devices[i]));
+      fprintf(stdout, "%s\n", name);
+    }
+    for (int r = CBlasSgemmN; r <= CBlasZgemmCC; r++) {
+      CBlasBlocking blocking;
+      CU_ERROR_CHECK(cuMultiGPUBLASTune(handle, (CBlasTuningRoutine)r, gpuSize));
+      CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, (CBlasTuningRoutine)r, &blocking));
+      fprintf(stdout, "  %-12s MB %zu NB %zu KB %zu\n", names[r], blocking.mb, blocking.nb, blocking.kb);
+    }
+
+    CU_ERROR_CHECK(cuMultiGPUBLASDestroy(handle));
+    CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+  }
+
+  if (cuBLASTuningSave(argv[1]) != CUDA_SUCCESS) {
+    fprintf(stderr, "Unable to save '%s'\n", argv[1]);
+    return 4;
+  }
+
+  return 0;
+}
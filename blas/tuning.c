@@ -0,0 +1,664 @@
+#include "blas.h"
+#include "handle.h"
+#include "engine.h"
+#include "error.h"
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/**
+ * Block sizes used for routines that have no entry in the tuning database.
+ * The GEMM tiles come from config.h.  The engines start with the blocking in
+ * cpu.c and the Cholesky tiles with the sizes in lapack so they have no
+ * defaults here.
+ */
+static const CBlasBlocking defaults[CBLAS_TUNING_ROUTINES] = {
+  [CBlasSgemmN]  = { .mb = SGEMM_N_MB,  .nb = SGEMM_N_NB,  .kb = SGEMM_N_KB  },
+  [CBlasSgemmT]  = { .mb = SGEMM_T_MB,  .nb = SGEMM_T_NB,  .kb = SGEMM_T_KB  },
+  [CBlasDgemmN]  = { .mb = DGEMM_N_MB,  .nb = DGEMM_N_NB,  .kb = DGEMM_N_KB  },
+  [CBlasDgemmT]  = { .mb = DGEMM_T_MB,  .nb = DGEMM_T_NB,  .kb = DGEMM_T_KB  },
+  [CBlasCgemmN]  = { .mb = CGEMM_N_MB,  .nb = CGEMM_N_NB,  .kb = CGEMM_N_KB  },
+  [CBlasCgemmC]  = { .mb = CGEMM_C_MB,  .nb = CGEMM_C_NB,  .kb = CGEMM_C_KB  },
+  [CBlasZgemmN]  = { .mb = ZGEMM_N_MB,  .nb = ZGEMM_N_NB,  .kb = ZGEMM_N_KB  },
+  [CBlasZgemmCN] = { .mb = ZGEMM_CN_MB, .nb = ZGEMM_CN_NB, .kb = ZGEMM_CN_KB },
+  [CBlasZgemmCC] = { .mb = ZGEMM_CC_MB, .nb = ZGEMM_CC_NB, .kb = ZGEMM_CC_KB }
+};
+
+/**
+ * Name of each routine in the database file.
+ */
+static const char * names[CBLAS_TUNING_ROUTINES] = {
+  "sgemm_n", "sgemm_t", "dgemm_n", "dgemm_t", "cgemm_n", "cgemm_c",
+  "zgemm_n", "zgemm_cn", "zgemm_cc",
+  "sengine", "dengine", "cengine", "zengine",
+  "spotrf", "dpotrf", "cpotrf", "zpotrf"
+};
+
+#define MODEL_LENGTH 256
+
+/**
+ * Block sizes of a routine on a device or processor model.
+ */
+struct entry {
+  char model[MODEL_LENGTH];     /** Device name or processor model            */
+  CBlasTuningRoutine routine;   /** The routine                               */
+  CBlasBlocking blocking;       /** Its block sizes                           */
+};
+
+/**
+ * The tuning database.  Entries are kept in the order they were added so that
+ * saving and loading a database gives back the same file.
+ */
+static struct entry * entries = NULL;
+static size_t nEntries = 0, capacity = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Model name of the host processor */
+static char hostModel[MODEL_LENGTH] = "unknown";
+
+static inline bool isEngine(CBlasTuningRoutine routine) {
+  return routine >= CBlasSengine && routine <= CBlasZengine;
+}
+
+/** Routines looked up by the model of the host processor */
+static inline bool isHost(CBlasTuningRoutine routine) {
+  return routine >= CBlasSengine;
+}
+
+static inline bool valid(CBlasTuningRoutine routine, const CBlasBlocking * blocking) {
+  if ((int)routine < 0 || routine >= CBLAS_TUNING_ROUTINES || blocking->mb == 0)
+    return false;
+  if (routine >= CBlasSpotrf)
+    return true;
+  if (blocking->nb == 0 || blocking->kb == 0)
+    return false;
+  if (isEngine(routine))
+    return blocking->trsm > 0 && blocking->trmm > 0 && blocking->threads >= 0;
+  return true;
+}
+
+/**
+ * Finds the entry for a routine on a model.  The caller must hold the mutex.
+ */
+static struct entry * find(struct entry * list, size_t n, const char * model, CBlasTuningRoutine routine) {
+  for (size_t i = 0; i < n; i++) {
+    if (list[i].routine == routine && strcmp(list[i].model, model) == 0)
+      return &list[i];
+  }
+  return NULL;
+}
+
+/**
+ * Adds or replaces the entry for a routine on a model.  The caller must hold
+ * the mutex.
+ */
+static CUresult insert(const char * model, CBlasTuningRoutine routine, const CBlasBlocking * blocking) {
+  struct entry * e = find(entries, nEntries, model, routine);
+  if (e == NULL) {
+    if (nEntries == capacity) {
+      const size_t c = (capacity == 0) ? 16 : 2 * capacity;
+      struct entry * list;
+      if ((list = realloc(entries, c * sizeof(struct entry))) == NULL)
+        return CUDA_ERROR_OUT_OF_MEMORY;
+      entries = list;
+      capacity = c;
+    }
+    e = &entries[nEntries++];
+    strncpy(e->model, model, MODEL_LENGTH - 1);
+    e->model[MODEL_LENGTH - 1] = '\0';
+    e->routine = routine;
+  }
+  e->blocking = *blocking;
+  return CUDA_SUCCESS;
+}
+
+void engine_tune(void) {
+  CBlasBlocking * blocking[] = { &sblocking, &dblocking, &cblocking, &zblocking };
+
+  ERROR_CHECK_VOID(pthread_mutex_lock(&mutex));
+  for (int i = 0; i < 4; i++) {
+    const struct entry * e = find(entries, nEntries, hostModel, (CBlasTuningRoutine)(CBlasSengine + i));
+    if (e != NULL)
+      *blocking[i] = e->blocking;
+  }
+  ERROR_CHECK_VOID(pthread_mutex_unlock(&mutex));
+}
+
+CBlasBlocking engine_blocking(const CBlasBlocking * blocking) {
+  // The lock only fails if it is misused so the blocking is copied regardless
+  const int locked = pthread_mutex_lock(&mutex);
+  const CBlasBlocking copy = *blocking;
+  if (locked == 0)
+    pthread_mutex_unlock(&mutex);
+  return copy;
+}
+
+/**
+ * Reads the model name of the host processor and loads the database named by
+ * CUMULTIGPU_TUNING when the library is loaded.  A missing or malformed
+ * database leaves the compiled-in block sizes.
+ */
+static void __attribute__((constructor)) tuning_init(void) {
+  FILE * cpuinfo;
+  if ((cpuinfo = fopen("/proc/cpuinfo", "r")) != NULL) {
+    char line[MODEL_LENGTH];
+    while (fgets(line, (int)sizeof(line), cpuinfo) != NULL) {
+      if (strncmp(line, "model name", 10) != 0)
+        continue;
+      const char * name = strchr(line, ':');
+      if (name == NULL)
+        continue;
+      name += strspn(name + 1, " \t") + 1;
+      const size_t length = strcspn(name, "\n");
+      if (length > 0) {
+        memcpy(hostModel, name, length);
+        hostModel[length] = '\0';
+      }
+      break;
+    }
+    fclose(cpuinfo);
+  }
+
+  const char * path = getenv("CUMULTIGPU_TUNING");
+  if (path != NULL)
+    (void)cuBLASTuningLoad(path);
+}
+
+const char * cuBLASTuningHostModel(void) {
+  return hostModel;
+}
+
+/**
+ * Writes the tuning database to a file.  Each line holds the name of a routine,
+ * its block sizes, the number of threads and the device or processor model it
+ * was tuned on.
+ *
+ * @param path  the file to write.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuBLASTuningSave(const char * path) {
+  FILE * file;
+  if ((file = fopen(path, "w")) == NULL)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  ERROR_CHECK(pthread_mutex_lock(&mutex));
+  int error = (fputs("# routine mb nb kb trsm trmm threads model\n", file) < 0);
+  for (size_t i = 0; i < nEntries && !error; i++) {
+    const CBlasBlocking * b = &entries[i].blocking;
+    error = (fprintf(file, "%s %zu %zu %zu %zu %zu %d %s\n", names[entries[i].routine],
+                     b->mb, b->nb, b->kb, b->trsm, b->trmm, b->threads, entries[i].model) < 0);
+  }
+  ERROR_CHECK(pthread_mutex_unlock(&mutex));
+
+  if (fclose(file) != 0 || error)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Reads a tuning database written by cuBLASTuningSave.  Entries replace those
+ * for the same routine and model and the engines pick up any for the host
+ * processor.  Nothing is changed unless the whole file can be read.
+ *
+ * @param path  the file to read.
+ * @return CUDA_SUCCESS, CUDA_ERROR_FILE_NOT_FOUND, CUDA_ERROR_INVALID_VALUE if
+ *         the file is malformed, CUDA_ERROR_OUT_OF_MEMORY,
+ *         CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuBLASTuningLoad(const char * path) {
+  FILE * file;
+  if ((file = fopen(path, "r")) == NULL)
+    return CUDA_ERROR_FILE_NOT_FOUND;
+
+  // Read everything before changing any of the entries
+  struct entry * loaded = NULL;
+  size_t n = 0, c = 0;
+
+  CUresult result = CUDA_SUCCESS;
+  char line[MODEL_LENGTH + 128];
+  while (result == CUDA_SUCCESS && fgets(line, (int)sizeof(line), file) != NULL) {
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+
+    char name[16];
+    struct entry e;
+    int offset = 0;
+    if (sscanf(line, "%15s %zu %zu %zu %zu %zu %d %n", name, &e.blocking.mb, &e.blocking.nb,
+               &e.blocking.kb, &e.blocking.trsm, &e.blocking.trmm, &e.blocking.threads, &offset) != 7 ||
+        offset == 0) {
+      result = CUDA_ERROR_INVALID_VALUE;
+      break;
+    }
+
+    // The model is the rest of the line
+    const size_t length = strcspn(&line[offset], "\n");
+    int routine = 0;
+    while (routine < CBLAS_TUNING_ROUTINES && strcmp(name, names[routine]) != 0)
+      routine++;
+    e.routine = (CBlasTuningRoutine)routine;
+    if (length == 0 || length >= MODEL_LENGTH || routine == CBLAS_TUNING_ROUTINES ||
+        !valid(e.routine, &e.blocking)) {
+      result = CUDA_ERROR_INVALID_VALUE;
+      break;
+    }
+    memcpy(e.model, &line[offset], length);
+    e.model[length] = '\0';
+
+    if (n == c) {
+      c = (c == 0) ? 16 : 2 * c;
+      struct entry * list;
+      if ((list = realloc(loaded, c * sizeof(struct entry))) == NULL) {
+        result = CUDA_ERROR_OUT_OF_MEMORY;
+        break;
+      }
+      loaded = list;
+    }
+    loaded[n++] = e;
+  }
+
+  if (ferror(file))
+    result = CUDA_ERROR_OPERATING_SYSTEM;
+  fclose(file);
+
+  if (result == CUDA_SUCCESS) {
+    if (pthread_mutex_lock(&mutex) != 0)
+      result = CUDA_ERROR_OPERATING_SYSTEM;
+    else {
+      for (size_t i = 0; i < n && result == CUDA_SUCCESS; i++)
+        result = insert(loaded[i].model, loaded[i].routine, &loaded[i].blocking);
+      if (pthread_mutex_unlock(&mutex) != 0)
+        result = CUDA_ERROR_OPERATING_SYSTEM;
+    }
+  }
+  free(loaded);
+
+  if (result == CUDA_SUCCESS)
+    engine_tune();
+
+  return result;
+}
+
+CUresult cuBLASTuningGet(const char * model, CBlasTuningRoutine routine, CBlasBlocking * blocking) {
+  if ((int)routine < 0 || routine >= CBLAS_TUNING_ROUTINES)
+    return CUDA_ERROR_INVALID_VALUE;
+  if (model == NULL)
+    model = hostModel;
+
+  ERROR_CHECK(pthread_mutex_lock(&mutex));
+  const struct entry * e = find(entries, nEntries, model, routine);
+  if (e != NULL)
+    *blocking = e->blocking;
+  ERROR_CHECK(pthread_mutex_unlock(&mutex));
+
+  return (e == NULL) ? CUDA_ERROR_NOT_FOUND : CUDA_SUCCESS;
+}
+
+CUresult cuBLASTuningSet(const char * model, CBlasTuningRoutine routine, const CBlasBlocking * blocking) {
+  if (!valid(routine, blocking))
+    return CUDA_ERROR_INVALID_VALUE;
+  if (model == NULL)
+    model = hostModel;
+  if (model[0] == '\0' || strlen(model) >= MODEL_LENGTH || strchr(model, '\n') != NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  ERROR_CHECK(pthread_mutex_lock(&mutex));
+  CUresult result = insert(model, routine, blocking);
+  ERROR_CHECK(pthread_mutex_unlock(&mutex));
+
+  if (result == CUDA_SUCCESS && isEngine(routine))
+    engine_tune();
+
+  return result;
+}
+
+CUresult cuBLASGetBlocking(CUBLAShandle handle, CBlasTuningRoutine routine, CBlasBlocking * blocking) {
+  if ((int)routine < 0 || routine >= CBLAS_TUNING_ROUTINES || isHost(routine))
+    return CUDA_ERROR_INVALID_VALUE;
+
+  // Handles on the host have no device to look up
+  CUresult result = CUDA_ERROR_NOT_FOUND;
+  if (handle->device[0] != '\0')
+    result = cuBLASTuningGet(handle->device, routine, blocking);
+  if (result == CUDA_ERROR_NOT_FOUND) {
+    *blocking = defaults[routine];
+    result = CUDA_SUCCESS;
+  }
+
+  return result;
+}
+
+CUresult cuMultiGPUBLASGetBlocking(CUmultiGPUBLAShandle handle, CBlasTuningRoutine routine,
+                                   CBlasBlocking * blocking) {
+  const int n = cuMultiGPUGetContextCount(handle->mGPU);
+  for (int i = 0; i < n; i++) {
+    if (!handle->handles[i].host)
+      return cuBLASGetBlocking(&handle->handles[i], routine, blocking);
+  }
+  return cuBLASGetBlocking(&handle->handles[0], routine, blocking);
+}
+
+/**
+ * Number of times each candidate is timed by the tuners.  The fastest time is
+ * kept.
+ */
+#define TUNING_RUNS 2
+
+static inline double elapsed(struct timeval start, struct timeval stop) {
+  return (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_usec - start.tv_usec) * 1.E-6;
+}
+
+/** Operations timed by the host tuner */
+enum operation { GEMM, TRSM, TRMM };
+
+/**
+ * Times an operation on n by n matrices with the current blocking of an
+ * engine.  A is kept diagonally dominant so that repeated solves stay finite.
+ */
+static CUresult time_engine(CBlasTuningRoutine routine, enum operation op, size_t n,
+                            void * A, void * B, void * C, double * time) {
+  *time = 0.0;
+  for (int run = 0; run < TUNING_RUNS; run++) {
+    struct timeval start, stop;
+    ERROR_CHECK(gettimeofday(&start, NULL));
+    switch (routine) {
+      case CBlasSengine:
+        if (op == GEMM)
+          sgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0f, A, n, B, n, 0.0f, C, n);
+        else if (op == TRSM)
+          strsm(CBlasLeft, CBlasLower, CBlasNoTrans, CBlasNonUnit, n, n, 1.0f, A, n, B, n);
+        else
+          strmm(CBlasLeft, CBlasUpper, CBlasNoTrans, CBlasUnit, n, n, 1.0f, A, n, B, n);
+        break;
+      case CBlasDengine:
+        if (op == GEMM)
+          dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, n, B, n, 0.0, C, n);
+        else if (op == TRSM)
+          dtrsm(CBlasLeft, CBlasLower, CBlasNoTrans, CBlasNonUnit, n, n, 1.0, A, n, B, n);
+        else
+          dtrmm(CBlasLeft, CBlasUpper, CBlasNoTrans, CBlasUnit, n, n, 1.0, A, n, B, n);
+        break;
+      case CBlasCengine:
+        if (op == GEMM)
+          cgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0f, A, n, B, n, 0.0f, C, n);
+        else if (op == TRSM)
+          ctrsm(CBlasLeft, CBlasLower, CBlasNoTrans, CBlasNonUnit, n, n, 1.0f, A, n, B, n);
+        else
+          ctrmm(CBlasLeft, CBlasUpper, CBlasNoTrans, CBlasUnit, n, n, 1.0f, A, n, B, n);
+        break;
+      default:
+        if (op == GEMM)
+          zgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, n, B, n, 0.0, C, n);
+        else if (op == TRSM)
+          ztrsm(CBlasLeft, CBlasLower, CBlasNoTrans, CBlasNonUnit, n, n, 1.0, A, n, B, n);
+        else
+          ztrmm(CBlasLeft, CBlasUpper, CBlasNoTrans, CBlasUnit, n, n, 1.0, A, n, B, n);
+        break;
+    }
+    ERROR_CHECK(gettimeofday(&stop, NULL));
+    const double t = elapsed(start, stop);
+    if (run == 0 || t < *time)
+      *time = t;
+  }
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Tries each candidate value for one of the parameters of an engine, keeping
+ * the others fixed, and leaves the fastest in the blocking.
+ */
+static CUresult search(CBlasTuningRoutine routine, enum operation op, size_t n,
+                       void * A, void * B, void * C, size_t * parameter, const size_t * candidates, int count) {
+  size_t best = *parameter;
+  double fastest;
+  CU_ERROR_CHECK(time_engine(routine, op, n, A, B, C, &fastest));
+
+  for (int i = 0; i < count; i++) {
+    if (candidates[i] == best)
+      continue;
+    *parameter = candidates[i];
+    double time;
+    CU_ERROR_CHECK(time_engine(routine, op, n, A, B, C, &time));
+    if (time < fastest) {
+      fastest = time;
+      best = candidates[i];
+    }
+  }
+
+  *parameter = best;
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Tunes the blocking of an engine on n by n matrices with a coordinate search:
+ * KC, MC and NC are tuned in turn on GEMM followed by the number of threads,
+ * then the TRSM and TRMM block sizes on their own routines.  The engine runs
+ * with each candidate blocking so nothing else may use it while it is tuned.
+ *
+ * @param routine  the engine to tune.
+ * @param n        the size of the matrices to time.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY,
+ *         CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuBLASTuneHost(CBlasTuningRoutine routine, size_t n) {
+  if (!isEngine(routine) || n == 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  CBlasBlocking * blockings[] = { &sblocking, &dblocking, &cblocking, &zblocking };
+  const size_t sizes[] = { sizeof(float), sizeof(double), sizeof(float complex), sizeof(double complex) };
+  CBlasBlocking * blocking = blockings[routine - CBlasSengine];
+  const size_t size = sizes[routine - CBlasSengine];
+  const CBlasBlocking saved = *blocking;
+
+  void * A, * B, * C;
+  if ((A = malloc(n * n * size)) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  if ((B = malloc(n * n * size)) == NULL) {
+    free(A);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+  if ((C = malloc(n * n * size)) == NULL) {
+    free(A);
+    free(B);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+
+  // Fill the matrices with small values and make A diagonally dominant.  The
+  // real and imaginary parts of complex elements are filled in the same way.
+  const size_t parts = (routine == CBlasCengine || routine == CBlasZengine) ? 2 : 1;
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < n * parts; i++) {
+      const double a = (i == j * parts) ? (double)n : 1.0 / (double)n;
+      const double b = (double)((i + j) % 8) / 8.0;
+      if (routine == CBlasSengine || routine == CBlasCengine) {
+        ((float *)A)[j * n * parts + i] = (float)a;
+        ((float *)B)[j * n * parts + i] = (float)b;
+      }
+      else {
+        ((double *)A)[j * n * parts + i] = a;
+        ((double *)B)[j * n * parts + i] = b;
+      }
+    }
+  }
+
+  const size_t kc[] = { 64, 128, 192, 256, 384, 512 };
+  const size_t mc[] = { 32, 64, 96, 128, 192, 256, 384, 512 };
+  const size_t nc[] = { 512, 1024, 2048, 4096, 8192 };
+  const size_t trsm[] = { 16, 32, 64, 128, 256 };
+  const size_t trmm[] = { 64, 128, 256, 512, 1024 };
+
+  CUresult result;
+  if ((result = search(routine, GEMM, n, A, B, C, &blocking->kb, kc, 6)) == CUDA_SUCCESS &&
+      (result = search(routine, GEMM, n, A, B, C, &blocking->mb, mc, 8)) == CUDA_SUCCESS &&
+      (result = search(routine, GEMM, n, A, B, C, &blocking->nb, nc, 5)) == CUDA_SUCCESS) {
+    // Halve the number of threads from the OpenMP default (zero) while it gets
+    // faster
+    double fastest;
+    int best = 0;
+    blocking->threads = 0;
+    result = time_engine(routine, GEMM, n, A, B, C, &fastest);
+    for (int threads = engine_threads(0) / 2; threads > 0 && result == CUDA_SUCCESS; threads /= 2) {
+      double time;
+      blocking->threads = threads;
+      if ((result = time_engine(routine, GEMM, n, A, B, C, &time)) != CUDA_SUCCESS || time >= fastest)
+        break;
+      fastest = time;
+      best = threads;
+    }
+    blocking->threads = best;
+  }
+  if (result == CUDA_SUCCESS &&
+      (result = search(routine, TRSM, n, A, B, C, &blocking->trsm, trsm, 5)) == CUDA_SUCCESS)
+    result = search(routine, TRMM, n, A, B, C, &blocking->trmm, trmm, 5);
+
+  free(A);
+  free(B);
+  free(C);
+
+  // Record the fastest blocking in the database (which also applies it)
+  const CBlasBlocking tuned = *blocking;
+  *blocking = saved;
+  if (result == CUDA_SUCCESS)
+    result = cuBLASTuningSet(NULL, routine, &tuned);
+
+  return result;
+}
+
+/**
+ * Times a multiGPU GEMM on n by n matrices.  The matrices are invalidated first
+ * so that every tile is copied onto the devices as in a first call.
+ */
+static CUresult time_multigpu(CUmultiGPUBLAShandle handle, CBlasTuningRoutine routine, size_t n,
+                              void * A, void * B, void * C, size_t size, double * time) {
+  const CBlasTranspose transA = (routine == CBlasSgemmN || routine == CBlasDgemmN ||
+                                 routine == CBlasCgemmN || routine == CBlasZgemmN) ? CBlasNoTrans
+                              : (routine == CBlasSgemmT || routine == CBlasDgemmT) ? CBlasTrans : CBlasConjTrans;
+  const CBlasTranspose transB = (routine == CBlasZgemmCC) ? CBlasConjTrans : CBlasNoTrans;
+
+  *time = 0.0;
+  for (int run = 0; run < TUNING_RUNS; run++) {
+    CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, A, n, n, n, size));
+    CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, B, n, n, n, size));
+
+    struct timeval start, stop;
+    ERROR_CHECK(gettimeofday(&start, NULL));
+    switch (routine) {
+      case CBlasSgemmN: case CBlasSgemmT:
+        CU_ERROR_CHECK(cuMultiGPUSgemm(handle, transA, transB, n, n, n, 1.0f, A, n, B, n, 0.0f, C, n));
+        break;
+      case CBlasDgemmN: case CBlasDgemmT:
+        CU_ERROR_CHECK(cuMultiGPUDgemm(handle, transA, transB, n, n, n, 1.0, A, n, B, n, 0.0, C, n));
+        break;
+      case CBlasCgemmN: case CBlasCgemmC:
+        CU_ERROR_CHECK(cuMultiGPUCgemm(handle, transA, transB, n, n, n, 1.0f, A, n, B, n, 0.0f, C, n));
+        break;
+      default:
+        CU_ERROR_CHECK(cuMultiGPUZgemm(handle, transA, transB, n, n, n, 1.0, A, n, B, n, 0.0, C, n));
+        break;
+    }
+    CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle));
+    ERROR_CHECK(gettimeofday(&stop, NULL));
+
+    const double t = elapsed(start, stop);
+    if (run == 0 || t < *time)
+      *time = t;
+  }
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Sets the entry for a routine on the device of every context.
+ */
+static CUresult setDevices(CUmultiGPUBLAShandle handle, CBlasTuningRoutine routine, const CBlasBlocking * blocking) {
+  const int n = cuMultiGPUGetContextCount(handle->mGPU);
+  for (int i = 0; i < n; i++) {
+    if (!handle->handles[i].host)
+      CU_ERROR_CHECK(cuBLASTuningSet(handle->handles[i].device, routine, blocking));
+  }
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Tunes the tiles of a multiGPU GEMM on n by n matrices.  Square tiles are
+ * tried first followed by the inner block size.  Every context is given the
+ * same block sizes as they share the tiles.
+ *
+ * @param handle   the multiGPU BLAS handle.
+ * @param routine  the GEMM to tune.
+ * @param n        the size of the matrices to time.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY or
+ *         any error from the GEMM.
+ */
+CUresult cuMultiGPUBLASTune(CUmultiGPUBLAShandle handle, CBlasTuningRoutine routine, size_t n) {
+  if ((int)routine < 0 || routine >= CBLAS_TUNING_ROUTINES || isHost(routine) || n == 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  const size_t size = (routine == CBlasSgemmN || routine == CBlasSgemmT) ? sizeof(float)
+                    : (routine == CBlasDgemmN || routine == CBlasDgemmT) ? sizeof(double)
+                    : (routine == CBlasCgemmN || routine == CBlasCgemmC) ? sizeof(float complex)
+                    : sizeof(double complex);
+
+  void * A, * B, * C;
+  if ((A = calloc(n * n, size)) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  if ((B = calloc(n * n, size)) == NULL) {
+    free(A);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+  if ((C = calloc(n * n, size)) == NULL) {
+    free(A);
+    free(B);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+
+  CBlasBlocking initial, best, blocking;
+  double fastest;
+  CUresult result;
+  if ((result = cuMultiGPUBLASGetBlocking(handle, routine, &initial)) != CUDA_SUCCESS) {
+    free(A);
+    free(B);
+    free(C);
+    return result;
+  }
+
+  best = initial;
+  if ((result = time_multigpu(handle, routine, n, A, B, C, size, &fastest)) == CUDA_SUCCESS) {
+    const size_t tiles[] = { 128, 256, 512, 1024, 2048, 4096 };
+    const size_t kb[] = { 32, 64, 128, 256, 512 };
+
+    for (int i = 0; i < 6 && tiles[i] <= n && result == CUDA_SUCCESS; i++) {
+      blocking = best;
+      blocking.mb = blocking.nb = tiles[i];
+      double time;
+      if ((result = setDevices(handle, routine, &blocking)) == CUDA_SUCCESS &&
+          (result = time_multigpu(handle, routine, n, A, B, C, size, &time)) == CUDA_SUCCESS &&
+          time < fastest) {
+        fastest = time;
+        best = blocking;
+      }
+    }
+
+    for (int i = 0; i < 5 && result == CUDA_SUCCESS; i++) {
+      blocking = best;
+      blocking.kb = kb[i];
+      double time;
+      if ((result = setDevices(handle, routine, &blocking)) == CUDA_SUCCESS &&
+          (result = time_multigpu(handle, routine, n, A, B, C, size, &time)) == CUDA_SUCCESS &&
+          time < fastest) {
+        fastest = time;
+        best = blocking;
+      }
+    }
+  }
+
+  free(A);
+  free(B);
+  free(C);
+
+  // Leave the fastest tiles (or the ones before tuning on failure) in place
+  CUresult set = setDevices(handle, routine, (result == CUDA_SUCCESS) ? &best : &initial);
+  return (result != CUDA_SUCCESS) ? result : set;
+}
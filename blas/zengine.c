@@ -0,0 +1,451 @@
+#include "blas.h"
+#include "engine.h"
+#include <stdlib.h>
+
+static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
+
+static const double zero = 0.0;
+static const double complex czero = 0.0 + 0.0 * I;
+
+void zgemm_pack_a(CBlasComplexGemm method, CBlasTranspose trans, size_t mb, size_t kb,
+                  const double complex * restrict A, size_t lda, double * restrict P) {
+  const size_t mr = dgemm_selected->mr;
+  const size_t np = (mb + mr - 1) / mr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t i0 = p * mr;
+    const size_t ib = min(mb - i0, mr);
+    double * restrict P0 = &P[3 * p * mr * kb];
+    double * restrict P1 = &P0[mr * kb];
+    double * restrict P2 = &P1[mr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t i = 0; i < ib; i++) {
+        const double complex a = (trans == CBlasNoTrans) ? A[l * lda + i0 + i] : A[(i0 + i) * lda + l];
+        const double re = creal(a);
+        const double im = (trans == CBlasConjTrans) ? -cimag(a) : cimag(a);
+        if (method == CBlasGemm3M) {
+          P0[l * mr + i] = re;
+          P1[l * mr + i] = im;
+          P2[l * mr + i] = re + im;
+        }
+        else {
+          P0[l * mr + i] = im;
+          P1[l * mr + i] = re;
+          P2[l * mr + i] = -im;
+        }
+      }
+      for (size_t i = ib; i < mr; i++)
+        P0[l * mr + i] = P1[l * mr + i] = P2[l * mr + i] = zero;
+    }
+  }
+}
+
+void zgemm_pack_b(CBlasComplexGemm method, CBlasTranspose trans, size_t kb, size_t nb,
+                  const double complex * restrict B, size_t ldb, double * restrict P) {
+  const size_t nr = dgemm_selected->nr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t j0 = p * nr;
+    const size_t jb = min(nb - j0, nr);
+    double * restrict P0 = &P[3 * p * nr * kb];
+    double * restrict P1 = &P0[nr * kb];
+    double * restrict P2 = &P1[nr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t j = 0; j < jb; j++) {
+        const double complex b = (trans == CBlasNoTrans) ? B[(j0 + j) * ldb + l] : B[l * ldb + j0 + j];
+        const double re = creal(b);
+        const double im = (trans == CBlasConjTrans) ? -cimag(b) : cimag(b);
+        P0[l * nr + j] = re;
+        P1[l * nr + j] = im;
+        if (method == CBlasGemm3M)
+          P2[l * nr + j] = re + im;
+      }
+      for (size_t j = jb; j < nr; j++) {
+        P0[l * nr + j] = P1[l * nr + j] = zero;
+        if (method == CBlasGemm3M)
+          P2[l * nr + j] = zero;
+      }
+    }
+  }
+}
+
+/**
+ * Computes the real and imaginary parts of an MR x NR tile of op(A) * op(B)
+ * from packed split panels.
+ */
+static inline void zgemm_tile(CBlasComplexGemm method, size_t kb,
+                              const double * restrict Ap, const double * restrict Bp,
+                              double * restrict Re, double * restrict Im) {
+  const size_t mr = dgemm_selected->mr, nr = dgemm_selected->nr;
+  const dgemm_micro_t micro = dgemm_selected->micro;
+
+  if (method == CBlasGemm3M) {
+    // Re = Ar * Br - Ai * Bi, Im = (Ar + Ai) * (Br + Bi) - Ar * Br - Ai * Bi
+    double T[DGEMM_MR_MAX * DGEMM_NR_MAX];
+    micro(kb, 1.0, Ap, Bp, zero, Re, mr);
+    micro(kb, 1.0, &Ap[mr * kb], &Bp[nr * kb], zero, T, mr);
+    micro(kb, 1.0, &Ap[2 * mr * kb], &Bp[2 * nr * kb], zero, Im, mr);
+    for (size_t ii = 0; ii < mr * nr; ii++) {
+      Im[ii] -= Re[ii] + T[ii];
+      Re[ii] -= T[ii];
+    }
+  }
+  else {
+    // The A panel holds [Ai Ar -Ai] and the B panel [Br; Bi] so each part is
+    // a single product of depth 2 * kb:
+    //   Re = [Ar -Ai] * [Br; Bi], Im = [Ai Ar] * [Br; Bi]
+    micro(2 * kb, 1.0, &Ap[mr * kb], Bp, zero, Re, mr);
+    micro(2 * kb, 1.0, Ap, Bp, zero, Im, mr);
+  }
+}
+
+void zgemm_kernel(CBlasComplexGemm method, size_t mb, size_t nb, size_t kb,
+                  double complex alpha, const double * restrict A, const double * restrict B,
+                  double complex beta, double complex * restrict C, size_t ldc) {
+  const size_t mr = dgemm_selected->mr, nr = dgemm_selected->nr;
+  const size_t mp = (mb + mr - 1) / mr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for collapse(2)
+  for (size_t q = 0; q < np; q++) {
+    for (size_t p = 0; p < mp; p++) {
+      const size_t i = p * mr, j = q * nr;
+      const size_t ib = min(mb - i, mr);
+      const size_t jb = min(nb - j, nr);
+
+      // Real and imaginary parts of the tile of op(A) * op(B)
+      double Re[DGEMM_MR_MAX * DGEMM_NR_MAX], Im[DGEMM_MR_MAX * DGEMM_NR_MAX];
+      zgemm_tile(method, kb, &A[3 * i * kb], &B[3 * j * kb], Re, Im);
+
+      if (beta == czero) {
+        for (size_t jj = 0; jj < jb; jj++) {
+          for (size_t ii = 0; ii < ib; ii++)
+            C[(j + jj) * ldc + i + ii] = alpha * (Re[jj * mr + ii] + Im[jj * mr + ii] * I);
+        }
+      }
+      else {
+        for (size_t jj = 0; jj < jb; jj++) {
+          for (size_t ii = 0; ii < ib; ii++)
+            C[(j + jj) * ldc + i + ii] = alpha * (Re[jj * mr + ii] + Im[jj * mr + ii] * I) +
+                                         beta * C[(j + jj) * ldc + i + ii];
+        }
+      }
+    }
+  }
+}
+
+bool zgemm_packed(CBlasTranspose transA, CBlasTranspose transB,
+                  size_t m, size_t n, size_t k,
+                  double complex alpha, const double complex * restrict A, size_t lda,
+                  const double complex * restrict B, size_t ldb,
+                  double complex beta, double complex * restrict C, size_t ldc) {
+  const size_t mr = dgemm_selected->mr, nr = dgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&zblocking);
+  // Read once so a concurrent change can't mix methods within a call
+  const CBlasComplexGemm method = complexGemm;
+
+  const size_t mc = ((min(m, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  // Three planes of each panel (see zgemm_pack_a/zgemm_pack_b)
+  double * Ap = malloc(3 * mc * kc * sizeof(double));
+  double * Bp = malloc(3 * kc * nc * sizeof(double));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+      // Only the first pass over k scales C by beta
+      const double complex b = (l == 0) ? beta : 1.0 + 0.0 * I;
+
+      zgemm_pack_b(method, transB, lb, jb,
+                   (transB == CBlasNoTrans) ? &B[j * ldb + l] : &B[l * ldb + j], ldb, Bp);
+
+      for (size_t i = 0; i < m; i += blocking.mb) {
+        const size_t ib = min(m - i, blocking.mb);
+
+        zgemm_pack_a(method, transA, ib, lb,
+                     (transA == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+        zgemm_kernel(method, ib, jb, lb, alpha, Ap, Bp, b, &C[j * ldc + i], ldc);
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
+
+void zherk_kernel(CBlasComplexGemm method, CBlasUplo uplo, ptrdiff_t offset,
+                  size_t mb, size_t nb, size_t kb,
+                  double alpha, const double * restrict A, const double * restrict B,
+                  double beta, double complex * restrict C, size_t ldc) {
+  const size_t mr = dgemm_selected->mr, nr = dgemm_selected->nr;
+  const size_t mp = (mb + mr - 1) / mr;
+  const size_t np = (nb + nr - 1) / nr;
+
+  // Tiles outside the triangle are skipped so share them out dynamically
+#pragma omp for collapse(2) schedule(dynamic)
+  for (size_t q = 0; q < np; q++) {
+    for (size_t p = 0; p < mp; p++) {
+      const size_t i = p * mr, j = q * nr;
+      const size_t ib = min(mb - i, mr);
+      const size_t jb = min(nb - j, nr);
+
+      // Position of the tile relative to the diagonal of C
+      const ptrdiff_t top = (ptrdiff_t)i + offset, bottom = top + (ptrdiff_t)ib - 1;
+      const ptrdiff_t left = (ptrdiff_t)j, right = left + (ptrdiff_t)jb - 1;
+      if ((uplo == CBlasUpper) ? top > right : bottom < left)
+        continue;
+
+      double Re[DGEMM_MR_MAX * DGEMM_NR_MAX], Im[DGEMM_MR_MAX * DGEMM_NR_MAX];
+      zgemm_tile(method, kb, &A[3 * i * kb], &B[3 * j * kb], Re, Im);
+
+      for (size_t jj = 0; jj < jb; jj++) {
+        for (size_t ii = 0; ii < ib; ii++) {
+          const ptrdiff_t r = top + (ptrdiff_t)ii, c = left + (ptrdiff_t)jj;
+          double complex * restrict x = &C[(j + jj) * ldc + i + ii];
+          if ((uplo == CBlasUpper) ? r > c : r < c)
+            continue;
+          // The imaginary parts of the diagonal are zero
+          if (r == c)
+            *x = (beta == zero) ? alpha * Re[jj * mr + ii]
+                                : alpha * Re[jj * mr + ii] + beta * creal(*x);
+          else
+            *x = (beta == zero) ? alpha * (Re[jj * mr + ii] + Im[jj * mr + ii] * I)
+                                : alpha * (Re[jj * mr + ii] + Im[jj * mr + ii] * I) + beta * *x;
+        }
+      }
+    }
+  }
+}
+
+bool zherk_packed(CBlasUplo uplo, CBlasTranspose trans, size_t n, size_t k,
+                  double alpha, const double complex * restrict A, size_t lda,
+                  double beta, double complex * restrict C, size_t ldc) {
+  const size_t mr = dgemm_selected->mr, nr = dgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&zblocking);
+  const CBlasComplexGemm method = complexGemm;
+  // C = alpha * op(A) * op(A)^H + beta * C is a GEMM with A as both operands
+  const CBlasTranspose transA = (trans == CBlasNoTrans) ? CBlasNoTrans : CBlasConjTrans;
+  const CBlasTranspose transB = (trans == CBlasNoTrans) ? CBlasConjTrans : CBlasNoTrans;
+
+  const size_t mc = ((min(n, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  double * Ap = malloc(3 * mc * kc * sizeof(double));
+  double * Bp = malloc(3 * kc * nc * sizeof(double));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+    // Only the row blocks that intersect the triangle are computed
+    const size_t i0 = (uplo == CBlasUpper) ? 0 : j;
+    const size_t i1 = (uplo == CBlasUpper) ? j + jb : n;
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+      const double b = (l == 0) ? beta : 1.0;
+
+      zgemm_pack_b(method, transB, lb, jb,
+                   (trans == CBlasNoTrans) ? &A[l * lda + j] : &A[j * lda + l], lda, Bp);
+
+      for (size_t i = i0; i < i1; i += blocking.mb) {
+        const size_t ib = min(i1 - i, blocking.mb);
+
+        zgemm_pack_a(method, transA, ib, lb,
+                     (trans == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+        zherk_kernel(method, uplo, (ptrdiff_t)i - (ptrdiff_t)j, ib, jb, lb,
+                     alpha, Ap, Bp, b, &C[j * ldc + i], ldc);
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
+
+void ztrmm_pack_a(CBlasComplexGemm method, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
+                  ptrdiff_t offset, size_t mb, size_t kb,
+                  const double complex * restrict A, size_t lda, double * restrict P) {
+  const size_t mr = dgemm_selected->mr;
+  const size_t np = (mb + mr - 1) / mr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t i0 = p * mr;
+    const size_t ib = min(mb - i0, mr);
+    double * restrict P0 = &P[3 * p * mr * kb];
+    double * restrict P1 = &P0[mr * kb];
+    double * restrict P2 = &P1[mr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t i = 0; i < ib; i++) {
+        const ptrdiff_t d = (ptrdiff_t)(i0 + i) - (ptrdiff_t)l + offset;
+        double re, im;
+        if ((uplo == CBlasUpper) ? d > 0 : d < 0)
+          re = im = zero;
+        else if (d == 0 && diag == CBlasUnit) {
+          re = 1.0;
+          im = zero;
+        }
+        else {
+          const double complex a = (trans == CBlasNoTrans) ? A[l * lda + i0 + i] : A[(i0 + i) * lda + l];
+          re = creal(a);
+          im = (trans == CBlasConjTrans) ? -cimag(a) : cimag(a);
+        }
+        if (method == CBlasGemm3M) {
+          P0[l * mr + i] = re;
+          P1[l * mr + i] = im;
+          P2[l * mr + i] = re + im;
+        }
+        else {
+          P0[l * mr + i] = im;
+          P1[l * mr + i] = re;
+          P2[l * mr + i] = -im;
+        }
+      }
+      for (size_t i = ib; i < mr; i++)
+        P0[l * mr + i] = P1[l * mr + i] = P2[l * mr + i] = zero;
+    }
+  }
+}
+
+void ztrmm_pack_b(CBlasComplexGemm method, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
+                  ptrdiff_t offset, size_t kb, size_t nb,
+                  const double complex * restrict B, size_t ldb, double * restrict P) {
+  const size_t nr = dgemm_selected->nr;
+  const size_t np = (nb + nr - 1) / nr;
+
+#pragma omp for
+  for (size_t p = 0; p < np; p++) {
+    const size_t j0 = p * nr;
+    const size_t jb = min(nb - j0, nr);
+    double * restrict P0 = &P[3 * p * nr * kb];
+    double * restrict P1 = &P0[nr * kb];
+    double * restrict P2 = &P1[nr * kb];
+
+    for (size_t l = 0; l < kb; l++) {
+      for (size_t j = 0; j < jb; j++) {
+        const ptrdiff_t d = (ptrdiff_t)l - (ptrdiff_t)(j0 + j) + offset;
+        double re, im;
+        if ((uplo == CBlasUpper) ? d > 0 : d < 0)
+          re = im = zero;
+        else if (d == 0 && diag == CBlasUnit) {
+          re = 1.0;
+          im = zero;
+        }
+        else {
+          const double complex b = (trans == CBlasNoTrans) ? B[(j0 + j) * ldb + l] : B[l * ldb + j0 + j];
+          re = creal(b);
+          im = (trans == CBlasConjTrans) ? -cimag(b) : cimag(b);
+        }
+        P0[l * nr + j] = re;
+        P1[l * nr + j] = im;
+        if (method == CBlasGemm3M)
+          P2[l * nr + j] = re + im;
+      }
+      for (size_t j = jb; j < nr; j++) {
+        P0[l * nr + j] = P1[l * nr + j] = zero;
+        if (method == CBlasGemm3M)
+          P2[l * nr + j] = zero;
+      }
+    }
+  }
+}
+
+bool ztrmm_packed(CBlasSide side, CBlasUplo uplo, CBlasTranspose trans, CBlasDiag diag,
+                  size_t m, size_t n,
+                  double complex alpha, const double complex * restrict A, size_t lda,
+                  const double complex * restrict B, size_t ldb,
+                  double complex * restrict X, size_t ldx) {
+  const size_t mr = dgemm_selected->mr, nr = dgemm_selected->nr;
+  const CBlasBlocking blocking = engine_blocking(&zblocking);
+  const CBlasComplexGemm method = complexGemm;
+  // The triangle of op(A) that is referenced
+  const CBlasUplo op = ((uplo == CBlasUpper) == (trans == CBlasNoTrans)) ? CBlasUpper : CBlasLower;
+  const size_t k = (side == CBlasLeft) ? m : n;
+
+  const size_t mc = ((min(m, blocking.mb) + mr - 1) / mr) * mr;
+  const size_t nc = ((min(n, blocking.nb) + nr - 1) / nr) * nr;
+  const size_t kc = min(k, blocking.kb);
+
+  double * Ap = malloc(3 * mc * kc * sizeof(double));
+  double * Bp = malloc(3 * kc * nc * sizeof(double));
+  if (Ap == NULL || Bp == NULL) {
+    free(Ap);
+    free(Bp);
+    return false;
+  }
+
+#pragma omp parallel num_threads(engine_threads(blocking.threads))
+  for (size_t j = 0; j < n; j += blocking.nb) {
+    const size_t jb = min(n - j, blocking.nb);
+
+    for (size_t l = 0; l < k; l += blocking.kb) {
+      const size_t lb = min(k - l, blocking.kb);
+
+      if (side == CBlasLeft) {
+        // X = alpha * op(A) * B
+        zgemm_pack_b(method, CBlasNoTrans, lb, jb, &B[j * ldb + l], ldb, Bp);
+
+        for (size_t i = 0; i < m; i += blocking.mb) {
+          const size_t ib = min(m - i, blocking.mb);
+
+          // Skip blocks of op(A) outside the triangle.  The first block inside
+          // it overwrites X.
+          if ((op == CBlasUpper) ? l + lb <= i : l >= i + ib)
+            continue;
+          const double complex b = (l == ((op == CBlasUpper) ? (i / blocking.kb) * blocking.kb : 0)) ? czero : 1.0 + 0.0 * I;
+
+          ztrmm_pack_a(method, op, trans, diag, (ptrdiff_t)i - (ptrdiff_t)l, ib, lb,
+                       (trans == CBlasNoTrans) ? &A[l * lda + i] : &A[i * lda + l], lda, Ap);
+          zgemm_kernel(method, ib, jb, lb, alpha, Ap, Bp, b, &X[j * ldx + i], ldx);
+        }
+      }
+      else {
+        // X = alpha * B * op(A)
+        if ((op == CBlasUpper) ? l >= j + jb : l + lb <= j)
+          continue;
+        const double complex b = (l == ((op == CBlasUpper) ? 0 : (j / blocking.kb) * blocking.kb)) ? czero : 1.0 + 0.0 * I;
+
+        ztrmm_pack_b(method, op, trans, diag, (ptrdiff_t)l - (ptrdiff_t)j, lb, jb,
+                     (trans == CBlasNoTrans) ? &A[j * lda + l] : &A[l * lda + j], lda, Bp);
+
+        for (size_t i = 0; i < m; i += blocking.mb) {
+          const size_t ib = min(m - i, blocking.mb);
+
+          zgemm_pack_a(method, CBlasNoTrans, ib, lb, &B[l * ldb + i], ldb, Ap);
+          zgemm_kernel(method, ib, jb, lb, alpha, Ap, Bp, b, &X[j * ldx + i], ldx);
+        }
+      }
+    }
+  }
+
+  free(Ap);
+  free(Bp);
+
+  return true;
+}
@@ -2,7 +2,7 @@
 #include "error.h"
 #include <stdio.h>
 #include "handle.h"
-#include "config.h"
+#include "engine.h"
 #include "zherk.fatbin.c"
 
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
@@ -53,7 +53,7 @@ void zherk(CBlasUplo uplo, CBlasTranspose trans,
   if (n == 0 || ((alpha == zero || k == 0) && beta == one))
     return;
 
-  if (alpha == zero) {
+  if (alpha == zero || k == 0) {
     if (uplo == CBlasUpper) {
       if (beta == zero) {
 #pragma omp parallel for
@@ -91,6 +91,10 @@ void zherk(CBlasUplo uplo, CBlasTranspose trans,
     return;
   }
 
+  if (zherk_packed(uplo, trans, n, k, alpha, A, lda, beta, C, ldc))
+    return;
+
+  // Fall back to unpacked loops if the packing buffers could not be allocated
   if (trans == CBlasNoTrans) {
     if (uplo == CBlasUpper) {
 #pragma omp parallel for
@@ -156,7 +160,7 @@ void zherk(CBlasUplo uplo, CBlasTranspose trans,
         }
         register double rtemp = zero;
         for (size_t l = 0; l < k; l++)
-          rtemp += conj(A[j * lda + l]) * A[j * lda + l];
+          rtemp += creal(conj(A[j * lda + l]) * A[j * lda + l]);
         if (beta == zero)
           C[j * ldc + j] = alpha * rtemp;
         else
@@ -168,7 +172,7 @@ void zherk(CBlasUplo uplo, CBlasTranspose trans,
       for (size_t j = 0; j < n; j++) {
         register double rtemp = zero;
         for (size_t l = 0; l < k; l++)
-          rtemp += conj(A[j * lda + l]) * A[j * lda + l];
+          rtemp += creal(conj(A[j * lda + l]) * A[j * lda + l]);
         if (beta == zero)
           C[j * ldc + j] = alpha * rtemp;
         else
@@ -187,6 +191,55 @@ void zherk(CBlasUplo uplo, CBlasTranspose trans,
   }
 }
 
+/**
+ * Looks up the kernel for one combination of options and the block sizes it was
+ * compiled for.
+ */
+static CUresult lookup(CUmodule module, CBlasUplo uplo, CBlasTranspose trans,
+                       struct cukernel * kernel) {
+  const unsigned int mb = (trans == CBlasNoTrans) ? 64 :  8;
+  const unsigned int nb = (trans == CBlasNoTrans) ?  4 :  8;
+  const unsigned int kb = (trans == CBlasNoTrans) ? 16 :  4;
+  const unsigned int bx = (trans == CBlasNoTrans) ?  4 :  4;
+  const unsigned int by = (trans == CBlasNoTrans) ? 16 :  8;
+
+  char name[71];
+  snprintf(name, 71,
+           "_Z6zherk%cIL9CBlasUplo%dELj%uELj%uELj%uELj%uELj%uEEvPK7double2PS1_ddiiii",
+           trans, uplo, mb, nb, kb, bx, by);
+
+  CU_ERROR_CHECK(cuModuleGetFunction(&kernel->function, module, name));
+  kernel->mb = mb;
+  kernel->nb = nb;
+  kernel->kb = kb;
+  kernel->bx = bx;
+  kernel->by = by;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Loads the ZHERK module and looks up the kernel for each uplo and trans so
+ * that a launch only has to index the handle's table.  The handle's context
+ * must be current.
+ */
+CUresult zherk_load(CUBLAShandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const CBlasTranspose transs[] = { CBlasNoTrans, CBlasConjTrans };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    for (int t = 0; t < 2; t++)
+      CU_ERROR_CHECK(lookup(module, uplos[u], transs[t], &handle->zherkKernels[u][t]));
+  }
+
+  handle->zherk = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuZherk(CUBLAShandle handle, CBlasUplo uplo, CBlasTranspose trans,
                  size_t n, size_t k,
                  double alpha, CUdeviceptr A, size_t lda,
@@ -211,25 +264,15 @@ CUresult cuZherk(CUBLAShandle handle, CBlasUplo uplo, CBlasTranspose trans,
   CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
 
   if (handle->zherk == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->zherk, imageBytes));
+    CU_ERROR_CHECK(zherk_load(handle));
 
-  const unsigned int mb = (trans == CBlasNoTrans) ? 64 :  8;
-  const unsigned int nb = (trans == CBlasNoTrans) ?  4 :  8;
-  const unsigned int kb = (trans == CBlasNoTrans) ? 16 :  4;
-  const unsigned int bx = (trans == CBlasNoTrans) ?  4 :  4;
-  const unsigned int by = (trans == CBlasNoTrans) ? 16 :  8;
-
-  char name[71];
-  snprintf(name, 71,
-           "_Z6zherk%cIL9CBlasUplo%dELj%uELj%uELj%uELj%uELj%uEEvPK7double2PS1_ddiiii",
-           trans, uplo, mb, nb, kb, bx, by);
-
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->zherk, name));
+  // trans is either CBlasNoTrans or CBlasConjTrans
+  const struct cukernel * kernel = &handle->zherkKernels[uploIndex(uplo)][(trans == CBlasNoTrans) ? 0 : 1];
+  const unsigned int mb = kernel->mb, nb = kernel->nb, bx = kernel->bx, by = kernel->by;
 
   void * params[] = { &A, &C, &alpha, &beta, &lda, &ldc, &n, &k };
 
-  CU_ERROR_CHECK(cuLaunchKernel(function, (unsigned int)(n + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
+  CU_ERROR_CHECK(cuLaunchKernel(kernel->function, (unsigned int)(n + mb - 1) / mb, (unsigned int)(n + nb - 1) / nb, 1,
                                 bx, by, 1, 0, stream, params, NULL));
 
   CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
@@ -259,6 +302,9 @@ CUresult cuMultiGPUZherk(CUmultiGPUBLAShandle handle,
   if (n == 0 || ((alpha == zero || k == 0) && beta == one))
     return CUDA_SUCCESS;
 
+  // Any copies of C cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, C, ldc, n, n, sizeof(double complex)));
+
   if (alpha == zero) {
     if (uplo == CBlasUpper) {
       if (beta == zero) {
@@ -295,7 +341,9 @@ CUresult cuMultiGPUZherk(CUmultiGPUBLAShandle handle,
     return CUDA_SUCCESS;
   }
 
-  const size_t nb = (trans == CBlasNoTrans) ? ZGEMM_N_MB : ZGEMM_CN_NB;
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, (trans == CBlasNoTrans) ? CBlasZgemmN : CBlasZgemmCN, &blocking));
+  const size_t nb = (trans == CBlasNoTrans) ? blocking.mb : blocking.nb;
 
   if (n < nb) {
     zherk(uplo, trans, n, k, alpha, A, lda, beta, C, ldc);
@@ -0,0 +1,49 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+/*
+ * Block sizes and transfer costs used when building against the host-memory
+ * emulation of the driver API (make EMULATION=1).  The emulated devices run
+ * the CPU BLAS so the tiles are sized for the caches rather than measured by
+ * blas/config, and copies are memcpys between host buffers.
+ */
+#define SGEMM_N_MB 128
+#define SGEMM_N_NB 128
+#define SGEMM_N_KB 128
+
+#define SGEMM_T_MB 128
+#define SGEMM_T_NB 128
+#define SGEMM_T_KB 128
+
+#define DGEMM_N_MB 128
+#define DGEMM_N_NB 128
+#define DGEMM_N_KB 128
+
+#define DGEMM_T_MB 128
+#define DGEMM_T_NB 128
+#define DGEMM_T_KB 128
+
+#define CGEMM_N_MB 128
+#define CGEMM_N_NB 128
+#define CGEMM_N_KB 128
+
+#define CGEMM_C_MB 128
+#define CGEMM_C_NB 128
+#define CGEMM_C_KB 128
+
+#define ZGEMM_N_MB 128
+#define ZGEMM_N_NB 128
+#define ZGEMM_N_KB 128
+
+#define ZGEMM_CN_MB 128
+#define ZGEMM_CN_NB 128
+#define ZGEMM_CN_KB 128
+
+#define ZGEMM_CC_MB 128
+#define ZGEMM_CC_NB 128
+#define ZGEMM_CC_KB 128
+
+#define BANDWIDTH_HTOD 2.0000000000e-10
+#define OVERHEAD_HTOD 1.0000000000e-05
+#define BANDWIDTH_DTOH 2.0000000000e-10
+#define OVERHEAD_DTOH 1.0000000000e-05
+#endif
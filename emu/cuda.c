@@ -0,0 +1,1198 @@
+#define _GNU_SOURCE
+#include <cuda.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Host-memory emulation of the CUDA driver API.
+
+/**
+ * Number of emulated devices when CUDA_EMULATION_DEVICES is not set.  More than
+ * one so that the multi-GPU code paths are exercised.
+ */
+#define CU_EMU_DEFAULT_DEVICES 2
+
+/**
+ * Maximum depth of each thread's context stack.
+ */
+#define CU_EMU_CONTEXT_STACK 64
+
+/**
+ * Alignment of device allocations and of the pitch returned by cuMemAllocPitch.
+ * Rows are aligned to the cache line rather than to the 256 bytes a GPU needs
+ * for coalescing.
+ */
+#define CU_EMU_ALIGNMENT 64
+
+/**
+ * Space reserved for each kernel parameter copied by cuLaunchKernel.
+ */
+#define CU_EMU_PARAM_SIZE 16
+
+static bool initialized = false;
+static int deviceCount = CU_EMU_DEFAULT_DEVICES;
+
+/**
+ * Each thread has its own stack of current contexts.
+ */
+static __thread CUcontext contextStack[CU_EMU_CONTEXT_STACK];
+static __thread int contextDepth = 0;
+
+/**
+ * The emulated devices have compute capability 1.3 and so do not run kernels
+ * concurrently: kernels launched in a context run one at a time in the order
+ * they were launched, whichever streams they were launched on, while copies
+ * overlap with them.  The library relies on this when it alternates streams
+ * between kernels that update the same matrix.
+ */
+struct CUctx_st {
+  CUdevice device;              /** The device the context was created on.    */
+  unsigned int flags;           /** Flags passed to cuCtxCreate.              */
+  pthread_mutex_t mutex;        /** Mutex protecting the list of streams.     */
+  CUstream streams;             /** Streams created in this context.          */
+  pthread_mutex_t order;        /** Mutex protecting the kernel counters.     */
+  pthread_cond_t turn;          /** Signalled when a kernel finishes.         */
+  unsigned long long launched;  /** Number of kernels launched.               */
+  unsigned long long finished;  /** Number of kernels finished.               */
+};
+
+/**
+ * Operations that can be queued on a stream.
+ */
+typedef enum { CUemuCopy, CUemuLaunch, CUemuRecord, CUemuWait } CUemuoptype;
+
+typedef struct __cuemuop_st {
+  CUemuoptype type;             /** Which member of the union is valid.       */
+  struct __cuemuop_st * next;   /** Next operation in the stream.             */
+  union {
+    CUDA_MEMCPY2D copy;         /** Parameters of a copy.                     */
+    struct {
+      CUfunction function;                  /** The kernel to run.            */
+      CUcontext context;                    /** The context it was launched in. */
+      unsigned long long ticket;            /** Position in the launch order. */
+      void * params[CU_EMU_MAX_PARAMS];     /** Pointers into data.           */
+      unsigned char data[CU_EMU_MAX_PARAMS * CU_EMU_PARAM_SIZE]
+          __attribute__((aligned(16)));     /** Copies of the parameters.     */
+    } launch;
+    struct {
+      CUevent event;                        /** The event to record.          */
+      unsigned long long sequence;          /** Which recording this is.      */
+    } record;
+    struct {
+      CUevent event;                        /** The event to wait for.        */
+      unsigned long long sequence;          /** Recording to wait for.        */
+    } wait;
+  } u;
+} CUemuop;
+
+/**
+ * A stream is a worker thread that executes a FIFO queue of operations.
+ */
+struct CUstream_st {
+  CUcontext context;            /** The context the stream was created in.    */
+  pthread_t thread;             /** Worker thread.                            */
+  pthread_mutex_t mutex;        /** Mutex protecting the queue.               */
+  pthread_cond_t work;          /** Signalled when operations are queued.     */
+  pthread_cond_t idle;          /** Signalled when the queue is drained.      */
+  CUemuop * head, * tail;       /** Queued operations.                        */
+  bool busy;                    /** Whether the worker is executing the head. */
+  bool stop;                    /** Whether the worker should exit when idle. */
+  CUstream next;                /** Next stream in the context.               */
+};
+
+struct CUevent_st {
+  pthread_mutex_t mutex;        /** Mutex protecting the event.               */
+  pthread_cond_t cond;          /** Signalled when a recording completes.     */
+  unsigned long long recorded;  /** Number of times the event was recorded.   */
+  unsigned long long completed; /** Last recording to be reached.             */
+  struct timespec time;         /** Time of the last recording reached.       */
+};
+
+struct CUfunc_st {
+  const CUemukernel * kernel;   /** The kernel implementation.                */
+  char * mangled;               /** The name passed to cuModuleGetFunction.   */
+  char name[64];                /** The unqualified kernel name.              */
+  int args[CU_EMU_MAX_TEMPLATE_ARGS]; /** Integral template arguments.        */
+  CUfunction next;              /** Next function in the module.              */
+};
+
+struct CUmod_st {
+  const CUemukernel * kernels;  /** NULL-terminated table of kernels.         */
+  pthread_mutex_t mutex;        /** Mutex protecting the list of functions.   */
+  CUfunction functions;         /** Functions found in this module.           */
+};
+
+static inline CUcontext currentContext() {
+  return (contextDepth > 0) ? contextStack[contextDepth - 1] : NULL;
+}
+
+CUresult cuInit(unsigned int flags) {
+  if (flags != 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  const char * devices = getenv("CUDA_EMULATION_DEVICES");
+  if (devices != NULL) {
+    char * end;
+    long count = strtol(devices, &end, 10);
+    if (end == devices || *end != '\0' || count < 0 || count > 64)
+      return CUDA_ERROR_INVALID_VALUE;
+    deviceCount = (int)count;
+  }
+
+  initialized = true;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGetCount(int * count) {
+  if (!initialized)
+    return CUDA_ERROR_NOT_INITIALIZED;
+  if (count == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  *count = deviceCount;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGet(CUdevice * device, int ordinal) {
+  if (!initialized)
+    return CUDA_ERROR_NOT_INITIALIZED;
+  if (device == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+  if (ordinal < 0 || ordinal >= deviceCount)
+    return CUDA_ERROR_INVALID_DEVICE;
+
+  *device = ordinal;
+
+  return CUDA_SUCCESS;
+}
+
+static inline CUresult checkDevice(CUdevice device) {
+  if (!initialized)
+    return CUDA_ERROR_NOT_INITIALIZED;
+  if (device < 0 || device >= deviceCount)
+    return CUDA_ERROR_INVALID_DEVICE;
+  return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGetName(char * name, int length, CUdevice device) {
+  CUresult error;
+  if ((error = checkDevice(device)) != CUDA_SUCCESS)
+    return error;
+  if (name == NULL || length <= 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  snprintf(name, (size_t)length, "Emulated CUDA Device %d", device);
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceComputeCapability(int * major, int * minor, CUdevice device) {
+  CUresult error;
+  if ((error = checkDevice(device)) != CUDA_SUCCESS)
+    return error;
+  if (major == NULL || minor == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  // The kernels are compiled for compute capability 1.3 (for double precision)
+  *major = 1;
+  *minor = 3;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceTotalMem(size_t * bytes, CUdevice device) {
+  CUresult error;
+  if ((error = checkDevice(device)) != CUDA_SUCCESS)
+    return error;
+  if (bytes == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  // Every device shares the host memory
+  long pages = sysconf(_SC_PHYS_PAGES), size = sysconf(_SC_PAGESIZE);
+  if (pages < 0 || size < 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  *bytes = (size_t)pages * (size_t)size;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuDeviceGetAttribute(int * value, CUdevice_attribute attribute, CUdevice device) {
+  CUresult error;
+  if ((error = checkDevice(device)) != CUDA_SUCCESS)
+    return error;
+  if (value == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  switch (attribute) {
+    case CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK:       *value = 512; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X:             *value = 512; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_Y:             *value = 512; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_Z:             *value = 64; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_X:              *value = 65535; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_Y:              *value = 65535; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_Z:              *value = 1; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK: *value = 16384; break;
+    case CU_DEVICE_ATTRIBUTE_TOTAL_CONSTANT_MEMORY:       *value = 65536; break;
+    case CU_DEVICE_ATTRIBUTE_WARP_SIZE:                   *value = 32; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_PITCH:                   *value = INT32_MAX; break;
+    case CU_DEVICE_ATTRIBUTE_MAX_REGISTERS_PER_BLOCK:     *value = 16384; break;
+    case CU_DEVICE_ATTRIBUTE_CLOCK_RATE:                  *value = 1000000; break;
+    case CU_DEVICE_ATTRIBUTE_TEXTURE_ALIGNMENT:           *value = 256; break;
+    case CU_DEVICE_ATTRIBUTE_GPU_OVERLAP:                 *value = 1; break;
+    case CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT: {
+      long processors = sysconf(_SC_NPROCESSORS_ONLN);
+      *value = (processors > 0) ? (int)processors : 1;
+      break;
+    }
+    case CU_DEVICE_ATTRIBUTE_KERNEL_EXEC_TIMEOUT:         *value = 0; break;
+    case CU_DEVICE_ATTRIBUTE_INTEGRATED:                  *value = 1; break;
+    case CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY:         *value = 0; break;
+    case CU_DEVICE_ATTRIBUTE_COMPUTE_MODE:                *value = 0; break;
+    case CU_DEVICE_ATTRIBUTE_CONCURRENT_KERNELS:          *value = 0; break;
+    case CU_DEVICE_ATTRIBUTE_ECC_ENABLED:                 *value = 0; break;
+    case CU_DEVICE_ATTRIBUTE_ASYNC_ENGINE_COUNT:          *value = 1; break;
+    case CU_DEVICE_ATTRIBUTE_UNIFIED_ADDRESSING:          *value = 0; break;
+    case CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR:    *value = 1; break;
+    case CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR:    *value = 3; break;
+    default: return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuCtxCreate(CUcontext * context, unsigned int flags, CUdevice device) {
+  CUresult error;
+  if ((error = checkDevice(device)) != CUDA_SUCCESS)
+    return error;
+  if (context == NULL || (flags & ~(unsigned int)CU_CTX_SCHED_MASK) != 0)
+    return CUDA_ERROR_INVALID_VALUE;
+  if (contextDepth == CU_EMU_CONTEXT_STACK)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  CUcontext ctx;
+  if ((ctx = malloc(sizeof(struct CUctx_st))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  if (pthread_mutex_init(&ctx->mutex, NULL) != 0) {
+    free(ctx);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  if (pthread_mutex_init(&ctx->order, NULL) != 0) {
+    pthread_mutex_destroy(&ctx->mutex);
+    free(ctx);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  if (pthread_cond_init(&ctx->turn, NULL) != 0) {
+    pthread_mutex_destroy(&ctx->order);
+    pthread_mutex_destroy(&ctx->mutex);
+    free(ctx);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+
+  ctx->device = device;
+  ctx->flags = flags;
+  ctx->streams = NULL;
+  ctx->launched = ctx->finished = 0;
+
+  // The new context is made current to the calling thread
+  contextStack[contextDepth++] = ctx;
+  *context = ctx;
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult cuStreamStop(CUstream);
+
+CUresult cuCtxDestroy(CUcontext context) {
+  if (context == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  // Wait for the streams to finish their work and free them
+  while (context->streams != NULL) {
+    CUstream stream = context->streams;
+    context->streams = stream->next;
+    CUresult error;
+    if ((error = cuStreamStop(stream)) != CUDA_SUCCESS)
+      return error;
+  }
+
+  // Remove the context from the calling thread's stack
+  int j = 0;
+  for (int i = 0; i < contextDepth; i++) {
+    if (contextStack[i] != context)
+      contextStack[j++] = contextStack[i];
+  }
+  contextDepth = j;
+
+  pthread_cond_destroy(&context->turn);
+  pthread_mutex_destroy(&context->order);
+  pthread_mutex_destroy(&context->mutex);
+  free(context);
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuCtxPushCurrent(CUcontext context) {
+  if (context == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+  if (contextDepth == CU_EMU_CONTEXT_STACK)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  contextStack[contextDepth++] = context;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuCtxPopCurrent(CUcontext * context) {
+  if (contextDepth == 0)
+    return CUDA_ERROR_INVALID_CONTEXT;
+
+  CUcontext ctx = contextStack[--contextDepth];
+  if (context != NULL)
+    *context = ctx;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuCtxGetCurrent(CUcontext * context) {
+  if (!initialized)
+    return CUDA_ERROR_NOT_INITIALIZED;
+  if (context == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  *context = currentContext();
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuCtxGetDevice(CUdevice * device) {
+  CUcontext context = currentContext();
+  if (context == NULL)
+    return CUDA_ERROR_INVALID_CONTEXT;
+  if (device == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  *device = context->device;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Waits for the stream's queue to drain.  The stream mutex must be held.
+ */
+static inline CUresult cuStreamWaitIdle(CUstream stream) {
+  while (stream->head != NULL || stream->busy) {
+    if (pthread_cond_wait(&stream->idle, &stream->mutex) != 0)
+      return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  return CUDA_SUCCESS;
+}
+
+CUresult cuCtxSynchronize() {
+  CUcontext context = currentContext();
+  if (context == NULL)
+    return CUDA_ERROR_INVALID_CONTEXT;
+
+  if (pthread_mutex_lock(&context->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  CUresult error = CUDA_SUCCESS;
+  for (CUstream stream = context->streams; stream != NULL && error == CUDA_SUCCESS; stream = stream->next) {
+    if (pthread_mutex_lock(&stream->mutex) != 0) {
+      error = CUDA_ERROR_OPERATING_SYSTEM;
+      break;
+    }
+    error = cuStreamWaitIdle(stream);
+    if (pthread_mutex_unlock(&stream->mutex) != 0)
+      error = CUDA_ERROR_OPERATING_SYSTEM;
+  }
+
+  if (pthread_mutex_unlock(&context->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return error;
+}
+
+CUresult cuModuleLoad(CUmodule * module, const char * fname) {
+  (void)fname;
+  if (module == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+  // There is no device code to load from a file
+  return CUDA_ERROR_INVALID_IMAGE;
+}
+
+CUresult cuModuleLoadData(CUmodule * module, const void * image) {
+  if (module == NULL || image == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+  if (currentContext() == NULL)
+    return CUDA_ERROR_INVALID_CONTEXT;
+
+  const CUemukernel * kernels = (const CUemukernel *)image;
+  for (const CUemukernel * kernel = kernels; kernel->name != NULL; kernel++) {
+    if (kernel->function == NULL || kernel->count > CU_EMU_MAX_PARAMS)
+      return CUDA_ERROR_INVALID_IMAGE;
+    for (unsigned int i = 0; i < kernel->count; i++) {
+      if (kernel->sizes[i] == 0 || kernel->sizes[i] > CU_EMU_PARAM_SIZE)
+        return CUDA_ERROR_INVALID_IMAGE;
+    }
+  }
+
+  CUmodule mod;
+  if ((mod = malloc(sizeof(struct CUmod_st))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  if (pthread_mutex_init(&mod->mutex, NULL) != 0) {
+    free(mod);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+
+  mod->kernels = kernels;
+  mod->functions = NULL;
+
+  *module = mod;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuModuleUnload(CUmodule module) {
+  if (module == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  // Kernels still queued on streams refer to the functions
+  CUresult error;
+  if (currentContext() != NULL && (error = cuCtxSynchronize()) != CUDA_SUCCESS)
+    return error;
+
+  while (module->functions != NULL) {
+    CUfunction function = module->functions;
+    module->functions = function->next;
+    free(function->mangled);
+    free(function);
+  }
+
+  pthread_mutex_destroy(&module->mutex);
+  free(module);
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Splits an Itanium C++ ABI mangled function template name into its unqualified
+ * name and integral template arguments.  Only the forms produced by the
+ * kernels in this library are understood: a global function name optionally
+ * followed by literal template arguments of builtin or enumeration type.
+ *
+ * @param mangled  the mangled name.
+ * @param name     the unqualified name is returned through this array.
+ * @param size     the size of the name array.
+ * @param args     the template arguments are returned through this array.
+ * @return true if the name was understood, false otherwise.
+ */
+static bool demangle(const char * mangled, char * name, size_t size, int * args) {
+  if (strncmp(mangled, "_Z", 2) != 0)
+    return false;
+
+  char * end;
+  unsigned long length = strtoul(mangled + 2, &end, 10);
+  if (end == mangled + 2 || length == 0 || length >= size || strlen(end) < length)
+    return false;
+  memcpy(name, end, length);
+  name[length] = '\0';
+
+  const char * p = end + length;
+  for (int i = 0; i < CU_EMU_MAX_TEMPLATE_ARGS; i++)
+    args[i] = 0;
+
+  if (*p != 'I')
+    return true;
+  p++;
+
+  for (int i = 0; *p != 'E'; i++) {
+    if (*p++ != 'L' || i == CU_EMU_MAX_TEMPLATE_ARGS)
+      return false;
+
+    // Skip the type: an enumeration name, a substitution or a builtin type
+    if (*p >= '0' && *p <= '9') {
+      unsigned long n = strtoul(p, &end, 10);
+      if (strlen(end) < n)
+        return false;
+      p = end + n;
+    }
+    else if (*p == 'S') {
+      if ((p = strchr(p, '_')) == NULL)
+        return false;
+      p++;
+    }
+    else if (*p != '\0')
+      p++;
+
+    // Literal value (negative values are prefixed with 'n')
+    bool negative = (*p == 'n');
+    if (negative)
+      p++;
+    long value = strtol(p, &end, 10);
+    if (end == p || *end != 'E')
+      return false;
+    args[i] = (int)((negative) ? -value : value);
+    p = end + 1;
+  }
+
+  return true;
+}
+
+CUresult cuModuleGetFunction(CUfunction * function, CUmodule module, const char * mangled) {
+  if (function == NULL || module == NULL || mangled == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  if (pthread_mutex_lock(&module->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  CUresult error = CUDA_SUCCESS;
+
+  // Return the same function for the same name
+  CUfunction f = module->functions;
+  while (f != NULL && strcmp(f->mangled, mangled) != 0)
+    f = f->next;
+
+  if (f == NULL) {
+    char name[sizeof(f->name)];
+    int args[CU_EMU_MAX_TEMPLATE_ARGS];
+    const CUemukernel * kernel = NULL;
+
+    if (demangle(mangled, name, sizeof(name), args)) {
+      for (kernel = module->kernels; kernel->name != NULL; kernel++) {
+        if (strncmp(name, kernel->name, strlen(kernel->name)) == 0)
+          break;
+      }
+    }
+
+    if (kernel == NULL || kernel->name == NULL)
+      error = CUDA_ERROR_NOT_FOUND;
+    else if ((f = malloc(sizeof(struct CUfunc_st))) == NULL)
+      error = CUDA_ERROR_OUT_OF_MEMORY;
+    else if ((f->mangled = strdup(mangled)) == NULL) {
+      free(f);
+      f = NULL;
+      error = CUDA_ERROR_OUT_OF_MEMORY;
+    }
+    else {
+      f->kernel = kernel;
+      strcpy(f->name, name);
+      memcpy(f->args, args, sizeof(args));
+      f->next = module->functions;
+      module->functions = f;
+    }
+  }
+
+  if (pthread_mutex_unlock(&module->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  if (error == CUDA_SUCCESS)
+    *function = f;
+
+  return error;
+}
+
+CUresult cuFuncGetAttribute(int * value, CUfunction_attribute attribute, CUfunction function) {
+  if (value == NULL || function == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  switch (attribute) {
+    case CU_FUNC_ATTRIBUTE_MAX_THREADS_PER_BLOCK: *value = 512; break;
+    case CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES:
+    case CU_FUNC_ATTRIBUTE_CONST_SIZE_BYTES:
+    case CU_FUNC_ATTRIBUTE_LOCAL_SIZE_BYTES:
+    case CU_FUNC_ATTRIBUTE_NUM_REGS:              *value = 0; break;
+    case CU_FUNC_ATTRIBUTE_PTX_VERSION:
+    case CU_FUNC_ATTRIBUTE_BINARY_VERSION:        *value = 13; break;
+    default: return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMemAlloc(CUdeviceptr * dptr, size_t bytes) {
+  if (currentContext() == NULL)
+    return CUDA_ERROR_INVALID_CONTEXT;
+  if (dptr == NULL || bytes == 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  void * ptr;
+  if (posix_memalign(&ptr, CU_EMU_ALIGNMENT, bytes) != 0)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  *dptr = (CUdeviceptr)(uintptr_t)ptr;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMemAllocPitch(CUdeviceptr * dptr, size_t * pitch, size_t width, size_t height, unsigned int elementSize) {
+  if (pitch == NULL || width == 0 || height == 0 ||
+      (elementSize != 4 && elementSize != 8 && elementSize != 16))
+    return CUDA_ERROR_INVALID_VALUE;
+
+  size_t p = (width + CU_EMU_ALIGNMENT - 1) & ~(size_t)(CU_EMU_ALIGNMENT - 1);
+
+  CUresult error;
+  if ((error = cuMemAlloc(dptr, p * height)) != CUDA_SUCCESS)
+    return error;
+
+  *pitch = p;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMemFree(CUdeviceptr dptr) {
+  // Like the driver, wait for outstanding work that may be using the memory
+  CUresult error;
+  if ((error = cuCtxSynchronize()) != CUDA_SUCCESS)
+    return error;
+
+  free((void *)(uintptr_t)dptr);
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMemAllocHost(void ** ptr, size_t bytes) {
+  if (currentContext() == NULL)
+    return CUDA_ERROR_INVALID_CONTEXT;
+  if (ptr == NULL || bytes == 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  if (posix_memalign(ptr, CU_EMU_ALIGNMENT, bytes) != 0)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMemFreeHost(void * ptr) {
+  CUresult error;
+  if ((error = cuCtxSynchronize()) != CUDA_SUCCESS)
+    return error;
+
+  free(ptr);
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Executes a queued operation.
+ */
+static void cuEmuExecute(CUemuop * op) {
+  switch (op->type) {
+    case CUemuCopy: {
+      const CUDA_MEMCPY2D * copy = &op->u.copy;
+      const char * src = (copy->srcMemoryType == CU_MEMORYTYPE_DEVICE)
+                       ? (const char *)(uintptr_t)copy->srcDevice
+                       : (const char *)copy->srcHost;
+      char * dst = (copy->dstMemoryType == CU_MEMORYTYPE_DEVICE)
+                 ? (char *)(uintptr_t)copy->dstDevice
+                 : (char *)copy->dstHost;
+      src += copy->srcY * copy->srcPitch + copy->srcXInBytes;
+      dst += copy->dstY * copy->dstPitch + copy->dstXInBytes;
+
+      if (copy->Height == 1 ||
+          (copy->srcPitch == copy->WidthInBytes && copy->dstPitch == copy->WidthInBytes))
+        memmove(dst, src, copy->WidthInBytes * copy->Height);
+      else {
+        for (size_t y = 0; y < copy->Height; y++)
+          memmove(dst + y * copy->dstPitch, src + y * copy->srcPitch, copy->WidthInBytes);
+      }
+      break;
+    }
+
+    case CUemuLaunch: {
+      // Wait for the kernels launched before this one in the context
+      CUcontext context = op->u.launch.context;
+      pthread_mutex_lock(&context->order);
+      while (context->finished != op->u.launch.ticket)
+        pthread_cond_wait(&context->turn, &context->order);
+      pthread_mutex_unlock(&context->order);
+
+      CUfunction function = op->u.launch.function;
+      function->kernel->function(function->name, function->args, op->u.launch.params);
+
+      pthread_mutex_lock(&context->order);
+      context->finished++;
+      pthread_cond_broadcast(&context->turn);
+      pthread_mutex_unlock(&context->order);
+      break;
+    }
+
+    case CUemuRecord: {
+      CUevent event = op->u.record.event;
+      pthread_mutex_lock(&event->mutex);
+      clock_gettime(CLOCK_MONOTONIC, &event->time);
+      if (op->u.record.sequence > event->completed)
+        event->completed = op->u.record.sequence;
+      pthread_cond_broadcast(&event->cond);
+      pthread_mutex_unlock(&event->mutex);
+      break;
+    }
+
+    case CUemuWait: {
+      CUevent event = op->u.wait.event;
+      pthread_mutex_lock(&event->mutex);
+      while (event->completed < op->u.wait.sequence)
+        pthread_cond_wait(&event->cond, &event->mutex);
+      pthread_mutex_unlock(&event->mutex);
+      break;
+    }
+  }
+}
+
+/**
+ * Stream worker thread.  Executes operations in the order they were queued
+ * until the stream is stopped and the queue is empty.
+ */
+static void * cuStreamMain(void * data) {
+  CUstream stream = (CUstream)data;
+
+  pthread_mutex_lock(&stream->mutex);
+  for (;;) {
+    while (stream->head == NULL && !stream->stop)
+      pthread_cond_wait(&stream->work, &stream->mutex);
+
+    if (stream->head == NULL)
+      break;
+
+    CUemuop * op = stream->head;
+    stream->busy = true;
+    pthread_mutex_unlock(&stream->mutex);
+
+    cuEmuExecute(op);
+
+    pthread_mutex_lock(&stream->mutex);
+    if ((stream->head = op->next) == NULL) {
+      stream->tail = NULL;
+      pthread_cond_broadcast(&stream->idle);
+    }
+    stream->busy = false;
+    free(op);
+  }
+  pthread_cond_broadcast(&stream->idle);
+  pthread_mutex_unlock(&stream->mutex);
+
+  return NULL;
+}
+
+/**
+ * Queues an operation on a stream.  Operations on the NULL stream wait for all
+ * the streams in the current context and are executed before returning.
+ *
+ * @param stream  the stream.
+ * @param op      the operation (ownership is passed to the stream).
+ */
+static CUresult cuStreamEnqueue(CUstream stream, CUemuop * op) {
+  op->next = NULL;
+  CUcontext context = (op->type == CUemuLaunch) ? op->u.launch.context : NULL;
+
+  if (stream == NULL) {
+    CUresult error;
+    if ((error = cuCtxSynchronize()) != CUDA_SUCCESS) {
+      free(op);
+      return error;
+    }
+    if (context != NULL) {
+      pthread_mutex_lock(&context->order);
+      op->u.launch.ticket = context->launched++;
+      pthread_mutex_unlock(&context->order);
+    }
+    cuEmuExecute(op);
+    free(op);
+    return CUDA_SUCCESS;
+  }
+
+  // Kernels take their place in the launch order while the context's order
+  // lock is held so that no stream queues them out of order
+  if (context != NULL && pthread_mutex_lock(&context->order) != 0) {
+    free(op);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  if (pthread_mutex_lock(&stream->mutex) != 0) {
+    if (context != NULL)
+      pthread_mutex_unlock(&context->order);
+    free(op);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  if (context != NULL)
+    op->u.launch.ticket = context->launched++;
+
+  if (stream->tail == NULL)
+    stream->head = op;
+  else
+    stream->tail->next = op;
+  stream->tail = op;
+
+  pthread_cond_signal(&stream->work);
+
+  if (pthread_mutex_unlock(&stream->mutex) != 0 ||
+      (context != NULL && pthread_mutex_unlock(&context->order) != 0))
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return CUDA_SUCCESS;
+}
+
+static inline CUresult checkCopy(const CUDA_MEMCPY2D * copy) {
+  if (copy == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+  if ((copy->srcMemoryType != CU_MEMORYTYPE_HOST && copy->srcMemoryType != CU_MEMORYTYPE_DEVICE) ||
+      (copy->dstMemoryType != CU_MEMORYTYPE_HOST && copy->dstMemoryType != CU_MEMORYTYPE_DEVICE))
+    return CUDA_ERROR_INVALID_VALUE;
+  if (copy->Height > 1 && (copy->srcPitch < copy->WidthInBytes || copy->dstPitch < copy->WidthInBytes))
+    return CUDA_ERROR_INVALID_VALUE;
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMemcpy2DAsync(const CUDA_MEMCPY2D * copy, CUstream stream) {
+  CUresult error;
+  if ((error = checkCopy(copy)) != CUDA_SUCCESS)
+    return error;
+  if (copy->WidthInBytes == 0 || copy->Height == 0)
+    return CUDA_SUCCESS;
+
+  CUemuop * op;
+  if ((op = malloc(sizeof(CUemuop))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  op->type = CUemuCopy;
+  op->u.copy = *copy;
+
+  return cuStreamEnqueue(stream, op);
+}
+
+CUresult cuMemcpy2D(const CUDA_MEMCPY2D * copy) {
+  return cuMemcpy2DAsync(copy, NULL);
+}
+
+CUresult cuMemcpyHtoDAsync(CUdeviceptr dst, const void * src, size_t bytes, CUstream stream) {
+  CUDA_MEMCPY2D copy = { 0, 0, CU_MEMORYTYPE_HOST, src, 0, NULL, bytes,
+                         0, 0, CU_MEMORYTYPE_DEVICE, NULL, dst, NULL, bytes,
+                         bytes, 1 };
+  return cuMemcpy2DAsync(&copy, stream);
+}
+
+CUresult cuMemcpyDtoHAsync(void * dst, CUdeviceptr src, size_t bytes, CUstream stream) {
+  CUDA_MEMCPY2D copy = { 0, 0, CU_MEMORYTYPE_DEVICE, NULL, src, NULL, bytes,
+                         0, 0, CU_MEMORYTYPE_HOST, dst, 0, NULL, bytes,
+                         bytes, 1 };
+  return cuMemcpy2DAsync(&copy, stream);
+}
+
+CUresult cuMemcpyHtoD(CUdeviceptr dst, const void * src, size_t bytes) {
+  return cuMemcpyHtoDAsync(dst, src, bytes, NULL);
+}
+
+CUresult cuMemcpyDtoH(void * dst, CUdeviceptr src, size_t bytes) {
+  return cuMemcpyDtoHAsync(dst, src, bytes, NULL);
+}
+
+CUresult cuStreamCreate(CUstream * stream, unsigned int flags) {
+  CUcontext context = currentContext();
+  if (context == NULL)
+    return CUDA_ERROR_INVALID_CONTEXT;
+  if (stream == NULL || (flags & ~(unsigned int)CU_STREAM_NON_BLOCKING) != 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  CUstream s;
+  if ((s = malloc(sizeof(struct CUstream_st))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  s->context = context;
+  s->head = s->tail = NULL;
+  s->busy = s->stop = false;
+
+  if (pthread_mutex_init(&s->mutex, NULL) != 0) {
+    free(s);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  if (pthread_cond_init(&s->work, NULL) != 0) {
+    pthread_mutex_destroy(&s->mutex);
+    free(s);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  if (pthread_cond_init(&s->idle, NULL) != 0) {
+    pthread_cond_destroy(&s->work);
+    pthread_mutex_destroy(&s->mutex);
+    free(s);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  if (pthread_create(&s->thread, NULL, cuStreamMain, s) != 0) {
+    pthread_cond_destroy(&s->idle);
+    pthread_cond_destroy(&s->work);
+    pthread_mutex_destroy(&s->mutex);
+    free(s);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+
+  if (pthread_mutex_lock(&context->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  s->next = context->streams;
+  context->streams = s;
+  if (pthread_mutex_unlock(&context->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  *stream = s;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuStreamQuery(CUstream stream) {
+  if (stream == NULL)
+    return CUDA_SUCCESS;
+
+  if (pthread_mutex_lock(&stream->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  bool ready = (stream->head == NULL && !stream->busy);
+  if (pthread_mutex_unlock(&stream->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return (ready) ? CUDA_SUCCESS : CUDA_ERROR_NOT_READY;
+}
+
+CUresult cuStreamSynchronize(CUstream stream) {
+  if (stream == NULL)
+    return cuCtxSynchronize();
+
+  if (pthread_mutex_lock(&stream->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  CUresult error = cuStreamWaitIdle(stream);
+  if (pthread_mutex_unlock(&stream->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return error;
+}
+
+/**
+ * Stops the worker thread once it has drained the queue and frees the stream.
+ * The stream must already have been removed from its context.
+ */
+static CUresult cuStreamStop(CUstream stream) {
+  if (pthread_mutex_lock(&stream->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  stream->stop = true;
+  pthread_cond_signal(&stream->work);
+  if (pthread_mutex_unlock(&stream->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  if (pthread_join(stream->thread, NULL) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  pthread_cond_destroy(&stream->idle);
+  pthread_cond_destroy(&stream->work);
+  pthread_mutex_destroy(&stream->mutex);
+  free(stream);
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuStreamDestroy(CUstream stream) {
+  if (stream == NULL)
+    return CUDA_ERROR_INVALID_HANDLE;
+
+  CUcontext context = stream->context;
+  if (pthread_mutex_lock(&context->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  CUstream * s = &context->streams;
+  while (*s != NULL && *s != stream)
+    s = &(*s)->next;
+  if (*s != NULL)
+    *s = stream->next;
+  if (pthread_mutex_unlock(&context->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return cuStreamStop(stream);
+}
+
+CUresult cuEventCreate(CUevent * event, unsigned int flags) {
+  if (currentContext() == NULL)
+    return CUDA_ERROR_INVALID_CONTEXT;
+  if (event == NULL || (flags & ~(unsigned int)(CU_EVENT_BLOCKING_SYNC | CU_EVENT_DISABLE_TIMING)) != 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  CUevent e;
+  if ((e = malloc(sizeof(struct CUevent_st))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  if (pthread_mutex_init(&e->mutex, NULL) != 0) {
+    free(e);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  if (pthread_cond_init(&e->cond, NULL) != 0) {
+    pthread_mutex_destroy(&e->mutex);
+    free(e);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+
+  e->recorded = e->completed = 0;
+  e->time.tv_sec = e->time.tv_nsec = 0;
+
+  *event = e;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuEventRecord(CUevent event, CUstream stream) {
+  if (event == NULL)
+    return CUDA_ERROR_INVALID_HANDLE;
+
+  CUemuop * op;
+  if ((op = malloc(sizeof(CUemuop))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    free(op);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  op->u.record.sequence = ++event->recorded;
+  if (pthread_mutex_unlock(&event->mutex) != 0) {
+    free(op);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+
+  op->type = CUemuRecord;
+  op->u.record.event = event;
+
+  return cuStreamEnqueue(stream, op);
+}
+
+CUresult cuStreamWaitEvent(CUstream stream, CUevent event, unsigned int flags) {
+  if (event == NULL)
+    return CUDA_ERROR_INVALID_HANDLE;
+  if (flags != 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  CUemuop * op;
+  if ((op = malloc(sizeof(CUemuop))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  // Later operations on the stream wait for the most recent recording at the
+  // time of the call, as on a device
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    free(op);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+  op->u.wait.sequence = event->recorded;
+  if (pthread_mutex_unlock(&event->mutex) != 0) {
+    free(op);
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  }
+
+  op->type = CUemuWait;
+  op->u.wait.event = event;
+
+  return cuStreamEnqueue(stream, op);
+}
+
+CUresult cuEventQuery(CUevent event) {
+  if (event == NULL)
+    return CUDA_ERROR_INVALID_HANDLE;
+
+  if (pthread_mutex_lock(&event->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  bool ready = (event->completed == event->recorded);
+  if (pthread_mutex_unlock(&event->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return (ready) ? CUDA_SUCCESS : CUDA_ERROR_NOT_READY;
+}
+
+CUresult cuEventSynchronize(CUevent event) {
+  if (event == NULL)
+    return CUDA_ERROR_INVALID_HANDLE;
+
+  if (pthread_mutex_lock(&event->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+  unsigned long long sequence = event->recorded;
+  while (event->completed < sequence) {
+    if (pthread_cond_wait(&event->cond, &event->mutex) != 0) {
+      pthread_mutex_unlock(&event->mutex);
+      return CUDA_ERROR_OPERATING_SYSTEM;
+    }
+  }
+  if (pthread_mutex_unlock(&event->mutex) != 0)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuEventDestroy(CUevent event) {
+  if (event == NULL)
+    return CUDA_ERROR_INVALID_HANDLE;
+
+  // The event may still be queued on a stream
+  CUresult error;
+  if ((error = cuEventSynchronize(event)) != CUDA_SUCCESS)
+    return error;
+
+  pthread_cond_destroy(&event->cond);
+  pthread_mutex_destroy(&event->mutex);
+  free(event);
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuEventElapsedTime(float * time, CUevent start, CUevent end) {
+  if (time == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+  if (start == NULL || end == NULL)
+    return CUDA_ERROR_INVALID_HANDLE;
+
+  CUresult error;
+  if ((error = cuEventQuery(start)) != CUDA_SUCCESS ||
+      (error = cuEventQuery(end)) != CUDA_SUCCESS)
+    return error;
+  if (start->recorded == 0 || end->recorded == 0)
+    return CUDA_ERROR_INVALID_HANDLE;
+
+  *time = (float)((double)(end->time.tv_sec - start->time.tv_sec) * 1.e3 +
+                  (double)(end->time.tv_nsec - start->time.tv_nsec) * 1.e-6);
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuLaunchKernel(CUfunction function,
+                        unsigned int gridDimX, unsigned int gridDimY, unsigned int gridDimZ,
+                        unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
+                        unsigned int sharedMemBytes, CUstream stream,
+                        void ** kernelParams, void ** extra) {
+  (void)sharedMemBytes;
+
+  if (function == NULL)
+    return CUDA_ERROR_INVALID_HANDLE;
+  // Parameters passed through extra would need their layout to be emulated
+  if (extra != NULL || gridDimX == 0 || gridDimY == 0 || gridDimZ == 0 ||
+      blockDimX == 0 || blockDimY == 0 || blockDimZ == 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  const CUemukernel * kernel = function->kernel;
+  if (kernel->count > 0 && kernelParams == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  CUcontext context = currentContext();
+  if (context == NULL)
+    return CUDA_ERROR_INVALID_CONTEXT;
+
+  CUemuop * op;
+  if ((op = malloc(sizeof(CUemuop))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  op->type = CUemuLaunch;
+  op->u.launch.function = function;
+  op->u.launch.context = context;
+
+  // Copy the parameters now as the caller's variables may go out of scope
+  for (unsigned int i = 0; i < kernel->count; i++) {
+    op->u.launch.params[i] = &op->u.launch.data[i * CU_EMU_PARAM_SIZE];
+    memcpy(op->u.launch.params[i], kernelParams[i], kernel->sizes[i]);
+  }
+
+  return cuStreamEnqueue(stream, op);
+}
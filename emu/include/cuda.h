@@ -0,0 +1,252 @@
+#ifndef CUDA_H
+#define CUDA_H
+
+/**
+ * Host-memory emulation of the subset of the CUDA 4.0 driver API used by this
+ * library.  Contexts are host threads, device memory is host memory and each
+ * stream is a worker thread that executes its copies and kernel launches in
+ * order.  Kernels are C functions registered in tables of CUemukernel which
+ * take the place of the device code images passed to cuModuleLoadData.
+ */
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CUDA_VERSION 4000
+
+typedef enum cudaError_enum {
+  CUDA_SUCCESS                              = 0,
+  CUDA_ERROR_INVALID_VALUE                  = 1,
+  CUDA_ERROR_OUT_OF_MEMORY                  = 2,
+  CUDA_ERROR_NOT_INITIALIZED                = 3,
+  CUDA_ERROR_DEINITIALIZED                  = 4,
+  CUDA_ERROR_PROFILER_DISABLED              = 5,
+  CUDA_ERROR_PROFILER_NOT_INITIALIZED       = 6,
+  CUDA_ERROR_PROFILER_ALREADY_STARTED       = 7,
+  CUDA_ERROR_PROFILER_ALREADY_STOPPED       = 8,
+  CUDA_ERROR_NO_DEVICE                      = 100,
+  CUDA_ERROR_INVALID_DEVICE                 = 101,
+  CUDA_ERROR_INVALID_IMAGE                  = 200,
+  CUDA_ERROR_INVALID_CONTEXT                = 201,
+  CUDA_ERROR_CONTEXT_ALREADY_CURRENT        = 202,
+  CUDA_ERROR_MAP_FAILED                     = 205,
+  CUDA_ERROR_UNMAP_FAILED                   = 206,
+  CUDA_ERROR_ARRAY_IS_MAPPED                = 207,
+  CUDA_ERROR_ALREADY_MAPPED                 = 208,
+  CUDA_ERROR_NO_BINARY_FOR_GPU              = 209,
+  CUDA_ERROR_ALREADY_ACQUIRED               = 210,
+  CUDA_ERROR_NOT_MAPPED                     = 211,
+  CUDA_ERROR_NOT_MAPPED_AS_ARRAY            = 212,
+  CUDA_ERROR_NOT_MAPPED_AS_POINTER          = 213,
+  CUDA_ERROR_ECC_UNCORRECTABLE              = 214,
+  CUDA_ERROR_UNSUPPORTED_LIMIT              = 215,
+  CUDA_ERROR_CONTEXT_ALREADY_IN_USE         = 216,
+  CUDA_ERROR_INVALID_SOURCE                 = 300,
+  CUDA_ERROR_FILE_NOT_FOUND                 = 301,
+  CUDA_ERROR_SHARED_OBJECT_SYMBOL_NOT_FOUND = 302,
+  CUDA_ERROR_SHARED_OBJECT_INIT_FAILED      = 303,
+  CUDA_ERROR_OPERATING_SYSTEM               = 304,
+  CUDA_ERROR_INVALID_HANDLE                 = 400,
+  CUDA_ERROR_NOT_FOUND                      = 500,
+  CUDA_ERROR_NOT_READY                      = 600,
+  CUDA_ERROR_LAUNCH_FAILED                  = 700,
+  CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES        = 701,
+  CUDA_ERROR_LAUNCH_TIMEOUT                 = 702,
+  CUDA_ERROR_LAUNCH_INCOMPATIBLE_TEXTURING  = 703,
+  CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED    = 704,
+  CUDA_ERROR_PEER_ACCESS_NOT_ENABLED        = 705,
+  CUDA_ERROR_PRIMARY_CONTEXT_ACTIVE         = 708,
+  CUDA_ERROR_CONTEXT_IS_DESTROYED           = 709,
+  CUDA_ERROR_ASSERT                         = 710,
+  CUDA_ERROR_TOO_MANY_PEERS                 = 711,
+  CUDA_ERROR_HOST_MEMORY_ALREADY_REGISTERED = 712,
+  CUDA_ERROR_HOST_MEMORY_NOT_REGISTERED     = 713,
+  CUDA_ERROR_UNKNOWN                        = 999
+} CUresult;
+
+typedef int CUdevice;
+typedef unsigned long long CUdeviceptr;
+
+typedef struct CUctx_st * CUcontext;
+typedef struct CUmod_st * CUmodule;
+typedef struct CUfunc_st * CUfunction;
+typedef struct CUstream_st * CUstream;
+typedef struct CUevent_st * CUevent;
+typedef struct CUarray_st * CUarray;
+
+typedef enum CUctx_flags_enum {
+  CU_CTX_SCHED_AUTO          = 0x00,
+  CU_CTX_SCHED_SPIN          = 0x01,
+  CU_CTX_SCHED_YIELD         = 0x02,
+  CU_CTX_SCHED_BLOCKING_SYNC = 0x04,
+  CU_CTX_SCHED_MASK          = 0x07
+} CUctx_flags;
+
+typedef enum CUstream_flags_enum {
+  CU_STREAM_DEFAULT      = 0x0,
+  CU_STREAM_NON_BLOCKING = 0x1
+} CUstream_flags;
+
+typedef enum CUevent_flags_enum {
+  CU_EVENT_DEFAULT        = 0x0,
+  CU_EVENT_BLOCKING_SYNC  = 0x1,
+  CU_EVENT_DISABLE_TIMING = 0x2
+} CUevent_flags;
+
+typedef enum CUlimit_enum {
+  CU_LIMIT_STACK_SIZE       = 0x00,
+  CU_LIMIT_PRINTF_FIFO_SIZE = 0x01,
+  CU_LIMIT_MALLOC_HEAP_SIZE = 0x02
+} CUlimit;
+
+typedef enum CUmemorytype_enum {
+  CU_MEMORYTYPE_HOST    = 0x01,
+  CU_MEMORYTYPE_DEVICE  = 0x02,
+  CU_MEMORYTYPE_ARRAY   = 0x03,
+  CU_MEMORYTYPE_UNIFIED = 0x04
+} CUmemorytype;
+
+typedef enum CUfunction_attribute_enum {
+  CU_FUNC_ATTRIBUTE_MAX_THREADS_PER_BLOCK = 0,
+  CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES     = 1,
+  CU_FUNC_ATTRIBUTE_CONST_SIZE_BYTES      = 2,
+  CU_FUNC_ATTRIBUTE_LOCAL_SIZE_BYTES      = 3,
+  CU_FUNC_ATTRIBUTE_NUM_REGS              = 4,
+  CU_FUNC_ATTRIBUTE_PTX_VERSION           = 5,
+  CU_FUNC_ATTRIBUTE_BINARY_VERSION        = 6
+} CUfunction_attribute;
+
+typedef enum CUdevice_attribute_enum {
+  CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK       = 1,
+  CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X             = 2,
+  CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_Y             = 3,
+  CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_Z             = 4,
+  CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_X              = 5,
+  CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_Y              = 6,
+  CU_DEVICE_ATTRIBUTE_MAX_GRID_DIM_Z              = 7,
+  CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK = 8,
+  CU_DEVICE_ATTRIBUTE_TOTAL_CONSTANT_MEMORY       = 9,
+  CU_DEVICE_ATTRIBUTE_WARP_SIZE                   = 10,
+  CU_DEVICE_ATTRIBUTE_MAX_PITCH                   = 11,
+  CU_DEVICE_ATTRIBUTE_MAX_REGISTERS_PER_BLOCK     = 12,
+  CU_DEVICE_ATTRIBUTE_CLOCK_RATE                  = 13,
+  CU_DEVICE_ATTRIBUTE_TEXTURE_ALIGNMENT           = 14,
+  CU_DEVICE_ATTRIBUTE_GPU_OVERLAP                 = 15,
+  CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT        = 16,
+  CU_DEVICE_ATTRIBUTE_KERNEL_EXEC_TIMEOUT         = 17,
+  CU_DEVICE_ATTRIBUTE_INTEGRATED                  = 18,
+  CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY         = 19,
+  CU_DEVICE_ATTRIBUTE_COMPUTE_MODE                = 20,
+  CU_DEVICE_ATTRIBUTE_CONCURRENT_KERNELS          = 31,
+  CU_DEVICE_ATTRIBUTE_ECC_ENABLED                 = 32,
+  CU_DEVICE_ATTRIBUTE_ASYNC_ENGINE_COUNT          = 40,
+  CU_DEVICE_ATTRIBUTE_UNIFIED_ADDRESSING          = 41,
+  CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR    = 75,
+  CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR    = 76
+} CUdevice_attribute;
+
+typedef struct CUDA_MEMCPY2D_st {
+  size_t srcXInBytes;           /**< Source X in bytes */
+  size_t srcY;                  /**< Source Y */
+  CUmemorytype srcMemoryType;   /**< Source memory type (host or device) */
+  const void * srcHost;         /**< Source host pointer */
+  CUdeviceptr srcDevice;        /**< Source device pointer */
+  CUarray srcArray;             /**< Source array reference (unsupported) */
+  size_t srcPitch;              /**< Source pitch (ignored when src is array) */
+
+  size_t dstXInBytes;           /**< Destination X in bytes */
+  size_t dstY;                  /**< Destination Y */
+  CUmemorytype dstMemoryType;   /**< Destination memory type (host or device) */
+  void * dstHost;               /**< Destination host pointer */
+  CUdeviceptr dstDevice;        /**< Destination device pointer */
+  CUarray dstArray;             /**< Destination array reference (unsupported) */
+  size_t dstPitch;              /**< Destination pitch (ignored when dst is array) */
+
+  size_t WidthInBytes;          /**< Width of 2D memory copy in bytes */
+  size_t Height;                /**< Height of 2D memory copy */
+} CUDA_MEMCPY2D;
+
+/**
+ * The maximum number of kernel parameters and template arguments supported by
+ * the emulation.
+ */
+#define CU_EMU_MAX_PARAMS 16
+#define CU_EMU_MAX_TEMPLATE_ARGS 8
+
+/**
+ * An emulated kernel.  Modules are loaded from NULL-terminated arrays of these
+ * in place of device code images.  A kernel is found by cuModuleGetFunction
+ * when <b>name</b> is a prefix of the unqualified name in the mangled function
+ * name requested.  When launched the function is called once for the whole
+ * grid, on the stream worker thread, with the unqualified kernel name, the
+ * integral template arguments parsed from the mangled name (enumerators as
+ * their values) and a copy of the kernel parameters made by cuLaunchKernel.
+ */
+typedef struct CUemukernel_st {
+  const char * name;                                    /**< Prefix of the kernel name */
+  void (*function)(const char *, const int *, void **); /**< Host implementation */
+  unsigned int count;                                   /**< Number of parameters */
+  unsigned int sizes[CU_EMU_MAX_PARAMS];                /**< Size of each parameter in bytes */
+} CUemukernel;
+
+CUresult cuInit(unsigned int);
+
+CUresult cuDeviceGet(CUdevice *, int);
+CUresult cuDeviceGetCount(int *);
+CUresult cuDeviceGetName(char *, int, CUdevice);
+CUresult cuDeviceComputeCapability(int *, int *, CUdevice);
+CUresult cuDeviceTotalMem(size_t *, CUdevice);
+CUresult cuDeviceGetAttribute(int *, CUdevice_attribute, CUdevice);
+
+CUresult cuCtxCreate(CUcontext *, unsigned int, CUdevice);
+CUresult cuCtxDestroy(CUcontext);
+CUresult cuCtxPushCurrent(CUcontext);
+CUresult cuCtxPopCurrent(CUcontext *);
+CUresult cuCtxGetCurrent(CUcontext *);
+CUresult cuCtxGetDevice(CUdevice *);
+CUresult cuCtxSynchronize(void);
+
+CUresult cuModuleLoad(CUmodule *, const char *);
+CUresult cuModuleLoadData(CUmodule *, const void *);
+CUresult cuModuleUnload(CUmodule);
+CUresult cuModuleGetFunction(CUfunction *, CUmodule, const char *);
+
+CUresult cuMemAlloc(CUdeviceptr *, size_t);
+CUresult cuMemAllocPitch(CUdeviceptr *, size_t *, size_t, size_t, unsigned int);
+CUresult cuMemFree(CUdeviceptr);
+CUresult cuMemAllocHost(void **, size_t);
+CUresult cuMemFreeHost(void *);
+
+CUresult cuMemcpyHtoD(CUdeviceptr, const void *, size_t);
+CUresult cuMemcpyDtoH(void *, CUdeviceptr, size_t);
+CUresult cuMemcpy2D(const CUDA_MEMCPY2D *);
+CUresult cuMemcpyHtoDAsync(CUdeviceptr, const void *, size_t, CUstream);
+CUresult cuMemcpyDtoHAsync(void *, CUdeviceptr, size_t, CUstream);
+CUresult cuMemcpy2DAsync(const CUDA_MEMCPY2D *, CUstream);
+
+CUresult cuStreamCreate(CUstream *, unsigned int);
+CUresult cuStreamQuery(CUstream);
+CUresult cuStreamSynchronize(CUstream);
+CUresult cuStreamDestroy(CUstream);
+CUresult cuStreamWaitEvent(CUstream, CUevent, unsigned int);
+
+CUresult cuEventCreate(CUevent *, unsigned int);
+CUresult cuEventRecord(CUevent, CUstream);
+CUresult cuEventQuery(CUevent);
+CUresult cuEventSynchronize(CUevent);
+CUresult cuEventDestroy(CUevent);
+CUresult cuEventElapsedTime(float *, CUevent, CUevent);
+
+CUresult cuFuncGetAttribute(int *, CUfunction_attribute, CUfunction);
+CUresult cuLaunchKernel(CUfunction, unsigned int, unsigned int, unsigned int,
+                        unsigned int, unsigned int, unsigned int, unsigned int,
+                        CUstream, void **, void **);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
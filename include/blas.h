@@ -42,6 +42,65 @@ extern xerbla_t xerbla;
       xerbla(__func__, info); \
   } while (false)
 
+/**
+ * Algorithm used by cgemm/zgemm on the CPU.  4M (the default) computes complex
+ * products with four real multiplies.  3M uses three at the cost of some
+ * accuracy in the imaginary part as Im = (Ar + Ai)(Br + Bi) - ArBr - AiBi
+ * cancels.  The initial value may be set with BLAS_COMPLEX_GEMM=3m|4m.
+ */
+typedef enum { CBlasGemm4M, CBlasGemm3M } CBlasComplexGemm;
+extern CBlasComplexGemm complexGemm;
+
+/**
+ * Routines with entries in the tuning database.  The GEMM entries hold the
+ * tiles the multiGPU routines split matrices into (config.h) and are looked up
+ * by the name of each device.  The engine entries hold the blocking of the
+ * packed CPU GEMM engine for each precision (engine.h) and are looked up by
+ * the model of the host processor, as are the tiles of the tiled CPU Cholesky
+ * decompositions (lapack.h).
+ */
+typedef enum {
+  CBlasSgemmN, CBlasSgemmT,                     // SGEMM with A not transposed (transposed)
+  CBlasDgemmN, CBlasDgemmT,                     // DGEMM with A not transposed (transposed)
+  CBlasCgemmN, CBlasCgemmC,                     // CGEMM with A not transposed (transposed)
+  CBlasZgemmN, CBlasZgemmCN, CBlasZgemmCC,      // ZGEMM with A not transposed (transposed
+                                                // and B not transposed or transposed)
+  CBlasSengine, CBlasDengine, CBlasCengine, CBlasZengine,
+  CBlasSpotrf, CBlasDpotrf, CBlasCpotrf, CBlasZpotrf
+} CBlasTuningRoutine;
+#define CBLAS_TUNING_ROUTINES 17
+
+/**
+ * Block sizes of a routine.  For the GEMM tiles only mb, nb and kb are used.
+ * For the engines mb, nb and kb are MC, NC and KC, trsm and trmm are the block
+ * sizes of the blocked TRSM and TRMM and threads is the number of OpenMP
+ * threads to use (zero for the OpenMP default).  For the Cholesky
+ * decompositions only mb, the size of the tiles, is used.
+ */
+typedef struct {
+  size_t mb, nb, kb;
+  size_t trsm, trmm;
+  int threads;
+} CBlasBlocking;
+
+/** Tuning database */
+// The database named by CUMULTIGPU_TUNING is loaded with the library.  Block
+// sizes missing from it keep the compiled-in defaults.  CPU routines that are
+// running when entries are loaded or set keep the block sizes they started with.
+// Reads a database written by cuBLASTuningSave, replacing entries for the same
+// routine and model
+CUresult cuBLASTuningLoad(const char *);
+CUresult cuBLASTuningSave(const char *);
+// Gets or sets the entry for a routine on a device or processor model (NULL for
+// the host processor).  Gets return CUDA_ERROR_NOT_FOUND if there is no entry.
+CUresult cuBLASTuningGet(const char *, CBlasTuningRoutine, CBlasBlocking *);
+CUresult cuBLASTuningSet(const char *, CBlasTuningRoutine, const CBlasBlocking *);
+// Gets the model name of the host processor used as the key for the engines
+const char * cuBLASTuningHostModel(void);
+// Tuner mode: times an engine on n by n matrices for a range of block sizes and
+// thread counts and sets the entry for the host processor to the fastest
+CUresult cuBLASTuneHost(CBlasTuningRoutine, size_t);
+
 /** My CPU implementations */
 // Single precision rank-K update
 void ssyrk(CBlasUplo, CBlasTranspose,
@@ -153,6 +212,30 @@ void ztrsm(CBlasSide, CBlasUplo, CBlasTranspose, CBlasDiag,
 typedef struct __cublashandle_st * CUBLAShandle;
 CUresult cuBLASCreate(CUBLAShandle *);
 CUresult cuBLASDestroy(CUBLAShandle);
+// Loads every module and looks up all of their kernels now rather than on first
+// use
+CUresult cuBLASPreload(CUBLAShandle);
+// Gets the block sizes for a GEMM on the handle's device from the tuning
+// database or the compiled-in defaults
+CUresult cuBLASGetBlocking(CUBLAShandle, CBlasTuningRoutine, CBlasBlocking *);
+
+// Device memory pool owned by each handle.  Blocks are returned to the pool
+// when freed and reused by later allocations on the same handle.  Must be called
+// with the handle's context current (except cuBLASMemTrim).
+CUresult cuBLASMemAlloc(CUBLAShandle, CUdeviceptr *, size_t);
+CUresult cuBLASMemAllocPitch(CUBLAShandle, CUdeviceptr *, size_t *, size_t, size_t, unsigned int);
+CUresult cuBLASMemFree(CUBLAShandle, CUdeviceptr);
+// Page-locked staging buffers and streams pooled the same way.  Streams are only
+// reused for requests with the same flags.
+CUresult cuBLASMemAllocHost(CUBLAShandle, void **, size_t);
+CUresult cuBLASMemFreeHost(CUBLAShandle, void *);
+CUresult cuBLASStreamAlloc(CUBLAShandle, CUstream *, unsigned int);
+CUresult cuBLASStreamFree(CUBLAShandle, CUstream);
+// Frees the device memory, staging buffers and streams cached by the pools
+CUresult cuBLASMemTrim(CUBLAShandle);
+// Gets the bytes lent out, the bytes cached and the most bytes ever held by the
+// pool (any may be NULL)
+CUresult cuBLASMemGetInfo(CUBLAShandle, size_t *, size_t *, size_t *);
 
 // Single precision rank-K update
 CUresult cuSsyrk(CUBLAShandle, CBlasUplo, CBlasTranspose,
@@ -255,9 +338,42 @@ CUresult cuZtrsm(CUBLAShandle, CBlasSide, CBlasUplo, CBlasTranspose, CBlasDiag,
 /** My MultiGPU/Hybrid implementations */
 // MultiGPU handle
 typedef struct __cumultigpublashandle_st * CUmultiGPUBLAShandle;
+// Also calibrates the performance model of each context that does not have one
 CUresult cuMultiGPUBLASCreate(CUmultiGPUBLAShandle *, CUmultiGPU);
 CUresult cuMultiGPUBLASDestroy(CUmultiGPUBLAShandle);
 CUresult cuMultiGPUBLASSynchronize(CUmultiGPUBLAShandle);
+// Gets the multiGPU context of a handle and the handle it uses on one of its
+// contexts (NULL for the host context).  The handle may only be used by tasks
+// running on that context.
+CUmultiGPU cuMultiGPUBLASGetMultiGPU(CUmultiGPUBLAShandle);
+CUBLAShandle cuMultiGPUBLASGetHandle(CUmultiGPUBLAShandle, int);
+// Loads the kernels on each context (see cuBLASPreload)
+CUresult cuMultiGPUBLASPreload(CUmultiGPUBLAShandle);
+// Memory pools of each context (the high-water marks are summed)
+CUresult cuMultiGPUBLASMemTrim(CUmultiGPUBLAShandle);
+CUresult cuMultiGPUBLASMemGetInfo(CUmultiGPUBLAShandle, size_t *, size_t *, size_t *);
+// Keeps the blocks of A and B copied onto each device for matrix multiplies in
+// a cache of up to the given number of bytes per context so that they are not
+// copied again by later tasks and calls (0, the default unless
+// CUMULTIGPU_TILE_CACHE is set in MiB, disables the cache and frees it).
+// Matrices written by the multiGPU routines are invalidated by them but after
+// writing to memory that may be cached the caller must invalidate it.
+// Resizing the cache waits for the tiles still in use on each context.
+CUresult cuMultiGPUBLASSetTileCache(CUmultiGPUBLAShandle, size_t);
+// Drops the cached blocks overlapping an m by n matrix with leading dimension
+// ld and elements of the given size.  The blocks are dropped by a task on each
+// context after the tasks already queued there.
+CUresult cuMultiGPUBLASInvalidate(CUmultiGPUBLAShandle, const void *, size_t, size_t, size_t, size_t);
+// Gets the number of lookups that found a cached block, the number that did not
+// and the bytes cached on all the contexts (any may be NULL)
+CUresult cuMultiGPUBLASTileCacheGetInfo(CUmultiGPUBLAShandle, size_t *, size_t *, size_t *);
+// Gets the block sizes for a GEMM.  Every context splits matrices into the same
+// tiles so the tiles are those of the first context with a device while each
+// context uses its own inner block size.
+CUresult cuMultiGPUBLASGetBlocking(CUmultiGPUBLAShandle, CBlasTuningRoutine, CBlasBlocking *);
+// Tuner mode: times a GEMM on n by n matrices for a range of tile sizes and
+// sets the entry for the device of every context to the fastest
+CUresult cuMultiGPUBLASTune(CUmultiGPUBLAShandle, CBlasTuningRoutine, size_t);
 
 // Single precision rank-K update
 CUresult cuMultiGPUSsyrk(CUmultiGPUBLAShandle,
@@ -25,6 +25,32 @@ typedef struct __cutask_st * CUtask;
  */
 CUresult cuTaskCreate(CUtask *, CUresult (*)(const void *), const void *, size_t);
 
+/**
+ * Makes a task wait for another task to finish before it is run.  Must be
+ * called before the task is submitted.  If the dependency is unsuccessful the
+ * task is not run and its result is set to the result of the dependency.
+ *
+ * @param task        the task.
+ * @param dependency  the task to wait for (which may already be submitted or
+ *                    finished but not destroyed).
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY,
+ *         CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuTaskAddDependency(CUtask, CUtask);
+
+/**
+ * Sets a function to be called when a task finishes.  The callback is called on
+ * the thread that ran the task, after the task function returns and before
+ * cuTaskDestroy returns.  Must be called before the task is submitted.
+ *
+ * @param task      the task.
+ * @param callback  the function to call with the result of the task and
+ *                  <b>data</b> (may be NULL to remove the callback).
+ * @param data      an argument for the callback.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE.
+ */
+CUresult cuTaskSetCallback(CUtask, void (*)(CUresult, void *), void *);
+
 /**
  * Destroys the the task.  If the task has not yet completed this will block
  * until it has.
@@ -35,6 +61,17 @@ CUresult cuTaskCreate(CUtask *, CUresult (*)(const void *), const void *, size_t
  */
 CUresult cuTaskDestroy(CUtask, CUresult *);
 
+/**
+ * Destroys an array of tasks, blocking until they have all completed.
+ *
+ * @param tasks   the tasks to destroy.
+ * @param n       the number of tasks.
+ * @param result  the first unsuccessful result returned by the tasks, or
+ *                CUDA_SUCCESS if they all succeeded (may be NULL).
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuTaskDestroyAll(const CUtask *, size_t, CUresult *);
+
 /**
  * Executes the task on the calling thread.
  *
@@ -43,17 +80,40 @@ CUresult cuTaskDestroy(CUtask, CUresult *);
  */
 CUresult cuTaskExecute(CUtask);
 
+/**
+ * How cuMultiGPURunTasks assigns tasks to contexts.  CUmultiGPUScheduleStatic
+ * runs each task on the context it was given.  CUmultiGPUScheduleSteal lets a
+ * context that has run out of work take tasks given to other contexts, which
+ * balances the load when devices run at different speeds.  Tasks submitted
+ * with cuMultiGPURunTasks must then use cuMultiGPUGetCurrentContext to find
+ * which context they are running on.  The sequential library always runs tasks
+ * on the context they were given.  The initial value may be set with
+ * CUMULTIGPU_SCHEDULE=static|steal.
+ */
+typedef enum { CUmultiGPUScheduleStatic, CUmultiGPUScheduleSteal } CUmultiGPUSchedule;
+extern CUmultiGPUSchedule multiGPUSchedule;
+
 /**
  * MultiGPU context.  May be single threaded or multi-threaded.
  */
 typedef struct __cumultigpu_st * CUmultiGPU;
 
+/**
+ * Device that stands for the host cores when passed to cuMultiGPUCreate.  No
+ * CUDA context is created for it: its tasks run with no current CUDA context on
+ * a background thread bound to a group of cores set aside for it and compute
+ * with the CPU BLAS.  The number of cores may be set with
+ * CUMULTIGPU_HOST_THREADS, otherwise it is every core not needed to drive the
+ * GPUs and the calling thread.  At most one may be given.
+ */
+#define CU_MULTIGPU_HOST ((CUdevice)-1)
+
 /**
  * Creates a multiGPU context with a single CUDA context created on each of the
  * devices given.
  *
  * @param mGPU     the newly created context is returned through this pointer.
- * @param devices  the CUDA devices to use.
+ * @param devices  the CUDA devices to use (may include CU_MULTIGPU_HOST).
  * @param n        the number of CUDA devices to use.
  * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY,
  *         CUDA_ERROR_OPERATING_SYSTEM.
@@ -76,6 +136,106 @@ CUresult cuMultiGPUDestroy(CUmultiGPU);
  */
 int cuMultiGPUGetContextCount(CUmultiGPU);
 
+/**
+ * Gets whether a context in the multiGPU context runs on the host cores.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param i     the index of the context.
+ * @return non-zero if the context was created for CU_MULTIGPU_HOST, zero
+ *         otherwise.
+ */
+int cuMultiGPUIsHost(CUmultiGPU, int);
+
+/**
+ * Performance model of a context.  The time a context takes to run a task is
+ * predicted to be the number of floating point operations divided by the
+ * throughput plus the number of bytes copied between host and device divided by
+ * the bandwidth.  The model is calibrated by cuMultiGPUBLASCreate for contexts
+ * that do not have one and the throughput is then refined from the time each
+ * task takes.
+ */
+typedef struct {
+  double throughput;    /** Compute throughput in FLOPs/s (zero if unknown)    */
+  double bandwidth;     /** Host to device copy bandwidth in bytes/s (zero if
+                            unknown or the context needs no copies)          */
+} CUmultiGPUModel;
+
+/**
+ * Records the time a task took to do some work on a context.  The throughput of
+ * each context is a running average of these measurements after the time
+ * expected for the copies has been taken off.
+ *
+ * @param mGPU     the multiGPU context.
+ * @param i        the index of the context the task ran on.
+ * @param flops    the number of floating point operations done by the task.
+ * @param bytes    the number of bytes copied between host and device by the
+ *                 task.
+ * @param seconds  the time the task took (including any copies).
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPURecordThroughput(CUmultiGPU, int, double, double, double);
+
+/**
+ * Gets the performance model of a context.
+ *
+ * @param mGPU   the multiGPU context.
+ * @param i      the index of the context.
+ * @param model  the model is returned through this pointer.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUGetModel(CUmultiGPU, int, CUmultiGPUModel *);
+
+/**
+ * Sets the performance model of a context.
+ *
+ * @param mGPU   the multiGPU context.
+ * @param i      the index of the context.
+ * @param model  the model.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUSetModel(CUmultiGPU, int, const CUmultiGPUModel *);
+
+/**
+ * Saves the performance models of all the contexts to a text file so that they
+ * can be loaded in a later run.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param path  the file to write.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUSaveModel(CUmultiGPU, const char *);
+
+/**
+ * Loads performance models saved by cuMultiGPUSaveModel.  Models are only
+ * loaded for contexts created on the same device as when they were saved.
+ * Loading models before calling cuMultiGPUBLASCreate skips calibration.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param path  the file to read.
+ * @return CUDA_SUCCESS, CUDA_ERROR_FILE_NOT_FOUND, CUDA_ERROR_INVALID_VALUE if
+ *         the file is malformed, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPULoadModel(CUmultiGPU, const char *);
+
+/**
+ * Assigns tiles of equal size to contexts in proportion to the rate each
+ * context's performance model predicts it will get through them so that they
+ * all finish at about the same time.  Contexts with no model are assumed to run
+ * at the average rate of the others and when there are no models the tiles are
+ * dealt out in turn.  The contexts are interleaved so that every context starts
+ * work early.
+ *
+ * @param mGPU      the multiGPU context.
+ * @param flops     the number of floating point operations in each tile.
+ * @param bytes     the number of bytes copied between host and device for each
+ *                  tile.
+ * @param contexts  the index of the context to use for each tile is returned
+ *                  through this array.
+ * @param n         the number of tiles.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUPartition(CUmultiGPU, double, double, int *, size_t);
+
 /**
  * Runs a task using a particular CUDA context.
  *
@@ -87,6 +247,29 @@ int cuMultiGPUGetContextCount(CUmultiGPU);
  */
 CUresult cuMultiGPURunTask(CUmultiGPU, int, CUtask);
 
+/**
+ * Runs an array of tasks, each using the CUDA context given by the
+ * corresponding element of <b>contexts</b>, or on any context if
+ * multiGPUSchedule is CUmultiGPUScheduleSteal.  Otherwise tasks using the same
+ * context are run in array order.  This is cheaper than calling
+ * cuMultiGPURunTask for each task as each context is notified at most once.
+ *
+ * @param mGPU      the multiGPU context.
+ * @param contexts  the index of the CUDA context to use for each task.
+ * @param tasks     the tasks to run.
+ * @param n         the number of tasks.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPURunTasks(CUmultiGPU, const int *, const CUtask *, size_t);
+
+/**
+ * Gets the index of the context the calling task is running on.
+ *
+ * @return the index of the context in its multiGPU context, or -1 if the caller
+ *         is not running on a context.
+ */
+int cuMultiGPUGetCurrentContext(void);
+
 /**
  * Synchronises all contexts in the multiGPU context.
  *
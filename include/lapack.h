@@ -13,6 +13,28 @@
 extern "C" {
 #endif
 
+/**
+ * Algorithm used by the CPU Cholesky decompositions.  CLapackPotrfBlocked
+ * factors fixed width column panels with the unblocked algorithm, updating the
+ * trailing panels with SYRK, GEMM and TRSM.  CLapackPotrfRecursive splits the
+ * matrix in half and recurses on each half with a TRSM and a SYRK (HERK)
+ * between them, which is faster for matrices of a few hundred to a few
+ * thousand.  CLapackPotrfTiled splits the matrix into square tiles and runs
+ * the operations on each tile as tasks ordered only by the tiles they share,
+ * which keeps many cores busy.  The initial value may be set with
+ * LAPACK_POTRF=blocked|recursive|tiled.
+ */
+typedef enum { CLapackPotrfBlocked, CLapackPotrfRecursive, CLapackPotrfTiled } CLapackPotrf;
+extern CLapackPotrf potrfAlgorithm;
+
+/**
+ * Size of the tiles of CLapackPotrfTiled for every precision.  When it is zero
+ * the entries for the host processor in the tuning database (CBlasSpotrf to
+ * CBlasZpotrf) are used, falling back to compiled-in sizes.  The initial value
+ * may be set with LAPACK_POTRF_NB.
+ */
+extern size_t potrfTile;
+
 /** My CPU implementations */
 // Single precision Cholesky decomposition
 void spotrf(CBlasUplo, size_t,  float * restrict, size_t, long * restrict);
@@ -59,10 +81,29 @@ void cpotri(CBlasUplo, size_t,  float complex * restrict, size_t, long * restric
 // Double precision complex inverse from Cholesky decomposition
 void zpotri(CBlasUplo, size_t, double complex * restrict, size_t, long * restrict);
 
+// Copies the triangle of a matrix into packed storage (columns of the triangle
+// stored one after another)
+void strttp(CBlasUplo, size_t, const  float * restrict, size_t,  float * restrict, long * restrict);
+void dtrttp(CBlasUplo, size_t, const double * restrict, size_t, double * restrict, long * restrict);
+void ctrttp(CBlasUplo, size_t, const  float complex * restrict, size_t,  float complex * restrict, long * restrict);
+void ztrttp(CBlasUplo, size_t, const double complex * restrict, size_t, double complex * restrict, long * restrict);
+// Copies the triangle of a matrix from packed storage
+void stpttr(CBlasUplo, size_t, const  float * restrict,  float * restrict, size_t, long * restrict);
+void dtpttr(CBlasUplo, size_t, const double * restrict, double * restrict, size_t, long * restrict);
+void ctpttr(CBlasUplo, size_t, const  float complex * restrict,  float complex * restrict, size_t, long * restrict);
+void ztpttr(CBlasUplo, size_t, const double complex * restrict, double complex * restrict, size_t, long * restrict);
+
 /** My Hybrid implementations */
 typedef struct __culapackhandle_st * CULAPACKhandle;
 CUresult cuLAPACKCreate(CULAPACKhandle *);
 CUresult cuLAPACKDestroy(CULAPACKhandle);
+// Loads every module used by the handle (and its BLAS handle) and looks up all of
+// their kernels now rather than on first use
+CUresult cuLAPACKPreload(CULAPACKhandle);
+// Device memory, staging buffer and stream pools shared with the handle's BLAS
+// handle (see cuBLASMemTrim and cuBLASMemGetInfo)
+CUresult cuLAPACKMemTrim(CULAPACKhandle);
+CUresult cuLAPACKMemGetInfo(CULAPACKhandle, size_t *, size_t *, size_t *);
 
 // Single precision Cholesky decomposition
 CUresult cuSpotrf(CULAPACKhandle, CBlasUplo, size_t, CUdeviceptr, size_t, long *);
@@ -120,6 +161,29 @@ typedef struct __cumultigpulapackhandle_st * CUmultiGPULAPACKhandle;
 CUresult cuMultiGPULAPACKCreate(CUmultiGPULAPACKhandle *, CUmultiGPU);
 CUresult cuMultiGPULAPACKDestroy(CUmultiGPULAPACKhandle);
 CUresult cuMultiGPULAPACKSynchronize(CUmultiGPULAPACKhandle);
+// Loads the kernels on each context (see cuMultiGPUBLASPreload)
+CUresult cuMultiGPULAPACKPreload(CUmultiGPULAPACKhandle);
+// Memory pools of each context (see cuMultiGPUBLASMemTrim)
+CUresult cuMultiGPULAPACKMemTrim(CUmultiGPULAPACKhandle);
+CUresult cuMultiGPULAPACKMemGetInfo(CUmultiGPULAPACKhandle, size_t *, size_t *, size_t *);
+// Tile cache of each context (see cuMultiGPUBLASSetTileCache)
+CUresult cuMultiGPULAPACKSetTileCache(CUmultiGPULAPACKhandle, size_t);
+CUresult cuMultiGPULAPACKInvalidate(CUmultiGPULAPACKhandle, const void *, size_t, size_t, size_t, size_t);
+CUresult cuMultiGPULAPACKTileCacheGetInfo(CUmultiGPULAPACKhandle, size_t *, size_t *, size_t *);
+
+// Matrix kept on the devices of a multiGPU handle between calls.  Block (i, j)
+// of nb by nb elements lives on device (i mod p) + (j mod q) p of a p by q grid
+// of the devices (any host context is left out) and only panels move between
+// devices in the factorisations below.
+typedef struct __cumultigpumatrix_st * CUmultiGPUMatrix;
+// Creates an m by n matrix in blocks of nb with elements of the given size
+CUresult cuMultiGPUMatrixCreate(CUmultiGPUMatrix *, CUmultiGPULAPACKhandle, size_t, size_t, size_t, size_t);
+CUresult cuMultiGPUMatrixDestroy(CUmultiGPUMatrix);
+// Gets the rows and columns of the grid of devices (either may be NULL)
+CUresult cuMultiGPUMatrixGetGrid(CUmultiGPUMatrix, int *, int *);
+// Copies the matrix from and to host memory with the given leading dimension
+CUresult cuMultiGPUMatrixScatter(CUmultiGPUMatrix, const void *, size_t);
+CUresult cuMultiGPUMatrixGather(CUmultiGPUMatrix, void *, size_t);
 
 // Single precision Cholesky decomposition
 CUresult cuMultiGPUSpotrf(CUmultiGPULAPACKhandle, CBlasUplo, size_t,  float * restrict, size_t, long * restrict);
@@ -129,6 +193,11 @@ CUresult cuMultiGPUDpotrf(CUmultiGPULAPACKhandle, CBlasUplo, size_t, double * re
 CUresult cuMultiGPUCpotrf(CUmultiGPULAPACKhandle, CBlasUplo, size_t,  float complex * restrict, size_t, long * restrict);
 // Double precision complex Cholesky decomposition
 CUresult cuMultiGPUZpotrf(CUmultiGPULAPACKhandle, CBlasUplo, size_t, double complex * restrict, size_t, long * restrict);
+// Distributed matrix versions
+CUresult cuMultiGPUSpotrfMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUDpotrfMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUCpotrfMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUZpotrfMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
 
 // Single precision triangular inverse from Cholesky decomposition
 CUresult cuMultiGPUStrtri(CUmultiGPULAPACKhandle, CBlasUplo, CBlasDiag, size_t,  float * restrict, size_t, long * restrict);
@@ -138,6 +207,11 @@ CUresult cuMultiGPUDtrtri(CUmultiGPULAPACKhandle, CBlasUplo, CBlasDiag, size_t,
 CUresult cuMultiGPUCtrtri(CUmultiGPULAPACKhandle, CBlasUplo, CBlasDiag, size_t,  float complex * restrict, size_t, long * restrict);
 // Double precision complex triangular inverse from Cholesky decomposition
 CUresult cuMultiGPUZtrtri(CUmultiGPULAPACKhandle, CBlasUplo, CBlasDiag, size_t, double complex * restrict, size_t, long * restrict);
+// Distributed matrix versions
+CUresult cuMultiGPUStrtriMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CBlasDiag, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUDtrtriMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CBlasDiag, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUCtrtriMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CBlasDiag, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUZtrtriMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CBlasDiag, CUmultiGPUMatrix, long *);
 
 // Single precision triangular square
 CUresult cuMultiGPUSlauum(CUmultiGPULAPACKhandle, CBlasUplo, size_t,  float * restrict, size_t, long * restrict);
@@ -147,6 +221,11 @@ CUresult cuMultiGPUDlauum(CUmultiGPULAPACKhandle, CBlasUplo, size_t, double * re
 CUresult cuMultiGPUClauum(CUmultiGPULAPACKhandle, CBlasUplo, size_t,  float complex * restrict, size_t, long * restrict);
 // Double precision complex triangular square
 CUresult cuMultiGPUZlauum(CUmultiGPULAPACKhandle, CBlasUplo, size_t, double complex * restrict, size_t, long * restrict);
+// Distributed matrix versions
+CUresult cuMultiGPUSlauumMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUDlauumMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUClauumMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUZlauumMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
 
 // Single precision inverse from Cholesky decomposition
 CUresult cuMultiGPUSpotri(CUmultiGPULAPACKhandle, CBlasUplo, size_t,  float * restrict, size_t, long * restrict);
@@ -156,6 +235,11 @@ CUresult cuMultiGPUDpotri(CUmultiGPULAPACKhandle, CBlasUplo, size_t, double * re
 CUresult cuMultiGPUCpotri(CUmultiGPULAPACKhandle, CBlasUplo, size_t,  float complex * restrict, size_t, long * restrict);
 // Double precision complex inverse from Cholesky decomposition
 CUresult cuMultiGPUZpotri(CUmultiGPULAPACKhandle, CBlasUplo, size_t, double complex * restrict, size_t, long * restrict);
+// Distributed matrix versions
+CUresult cuMultiGPUSpotriMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUDpotriMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUCpotriMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
+CUresult cuMultiGPUZpotriMatrix(CUmultiGPULAPACKhandle, CBlasUplo, CUmultiGPUMatrix, long *);
 
 /** Calculating log determinant - CPU and GPU only*/
 float slogdet(const float *, size_t, size_t);
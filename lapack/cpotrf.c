@@ -2,10 +2,16 @@
 #include "handle.h"
 #include "error.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
-#include "config.h"
 #include "cpotrf.fatbin.c"
 
+/**
+ * Number of threads used by the unblocked kernel (and so the largest matrix it
+ * can work on).
+ */
+#define CPOTF2_BX 32u
+
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
 
 static inline CUresult cuMemcpyHtoD2DAsync(CUdeviceptr A, size_t lda, size_t ai, size_t aj,
@@ -82,6 +88,193 @@ static inline void cpotf2(CBlasUplo uplo,
   }
 }
 
+/**
+ * Size below which the recursive Cholesky decomposition uses the unblocked
+ * algorithm.
+ */
+#define CPOTRF_RECURSIVE_NB 32
+
+/**
+ * Recursive Cholesky decomposition.  A is split into halves, the leading half
+ * is factored recursively, the off-diagonal block is solved for with TRSM and
+ * the trailing half is updated with HERK before being factored recursively.
+ * Every level does most of its work in a single large TRSM and HERK so the
+ * blocking adapts to the size of the matrix instead of being fixed.
+ */
+static void cpotrf_recursive(CBlasUplo uplo,
+                             size_t n,
+                             float complex * restrict A, size_t lda,
+                             long * restrict info) {
+  if (n <= CPOTRF_RECURSIVE_NB) {
+    cpotf2(uplo, n, A, lda, info);
+    return;
+  }
+
+  const size_t n1 = n / 2;
+  const size_t n2 = n - n1;
+
+  cpotrf_recursive(uplo, n1, A, lda, info);
+  if (*info != 0)
+    return;
+
+  if (uplo == CBlasUpper) {
+    ctrsm(CBlasLeft, CBlasUpper, CBlasConjTrans, CBlasNonUnit, n1, n2,
+          one, A, lda, &A[n1 * lda], lda);
+    cherk(CBlasUpper, CBlasConjTrans, n2, n1,
+          -one, &A[n1 * lda], lda, one, &A[n1 * lda + n1], lda);
+  }
+  else {
+    ctrsm(CBlasRight, CBlasLower, CBlasConjTrans, CBlasNonUnit, n2, n1,
+          one, A, lda, &A[n1], lda);
+    cherk(CBlasLower, CBlasNoTrans, n2, n1,
+          -one, &A[n1], lda, one, &A[n1 * lda + n1], lda);
+  }
+
+  cpotrf_recursive(uplo, n2, &A[n1 * lda + n1], lda, info);
+  if (*info != 0)
+    (*info) += (long)n1;
+}
+
+/** Size of the tiles in the tiled Cholesky decomposition unless it is tuned */
+#define CPOTRF_TILED_NB 192
+
+/**
+ * Tiled Cholesky decomposition.  Each tile operation (a recursive
+ * factorisation of a diagonal tile, a TRSM of an off-diagonal tile, a HERK
+ * of a diagonal tile or a GEMM of an off-diagonal tile) is an OpenMP task whose
+ * dependencies are the tiles it reads and writes.  The runtime schedules tasks
+ * as soon as their inputs are ready so the factorisation of the next diagonal
+ * tile overlaps the rest of the trailing update instead of waiting for it.
+ * Tasks run on a single thread each as nested parallel regions are inactive.
+ */
+static void cpotrf_tiled(CBlasUplo uplo,
+                         size_t n,
+                         float complex * restrict A, size_t lda,
+                         long * restrict info) {
+  // The tile size is taken from potrfTile, then the entry for the host in the
+  // tuning database, then the compiled-in size
+  size_t nb = potrfTile;
+  if (nb == 0) {
+    CBlasBlocking blocking;
+    nb = (cuBLASTuningGet(NULL, CBlasCpotrf, &blocking) == CUDA_SUCCESS) ? blocking.mb : CPOTRF_TILED_NB;
+  }
+
+  // Set by the first diagonal tile that is not positive definite.  Tasks that
+  // are already queued skip their work once it is set.
+  long failed = 0;
+
+#pragma omp parallel
+#pragma omp single
+  for (size_t k = 0; k < n; k += nb) {
+    const size_t kb = min(nb, n - k);
+
+#pragma omp task depend(inout: A[k * lda + k]) shared(failed)
+    {
+      long f;
+#pragma omp atomic read
+      f = failed;
+      if (f == 0) {
+        cpotrf_recursive(uplo, kb, &A[k * lda + k], lda, &f);
+        if (f != 0) {
+#pragma omp atomic write
+          failed = f + (long)k;
+        }
+      }
+    }
+
+    if (uplo == CBlasUpper) {
+      for (size_t j = k + kb; j < n; j += nb) {
+        const size_t jb = min(nb, n - j);
+
+#pragma omp task depend(in: A[k * lda + k]) depend(inout: A[j * lda + k]) shared(failed)
+        {
+          long f;
+#pragma omp atomic read
+          f = failed;
+          if (f == 0)
+            ctrsm(CBlasLeft, CBlasUpper, CBlasConjTrans, CBlasNonUnit, kb, jb,
+                  one, &A[k * lda + k], lda, &A[j * lda + k], lda);
+        }
+      }
+
+      for (size_t j = k + kb; j < n; j += nb) {
+        const size_t jb = min(nb, n - j);
+
+#pragma omp task depend(in: A[j * lda + k]) depend(inout: A[j * lda + j]) shared(failed)
+        {
+          long f;
+#pragma omp atomic read
+          f = failed;
+          if (f == 0)
+            cherk(CBlasUpper, CBlasConjTrans, jb, kb,
+                  -one, &A[j * lda + k], lda, one, &A[j * lda + j], lda);
+        }
+
+        for (size_t i = k + kb; i < j; i += nb) {
+          const size_t ib = min(nb, n - i);
+
+#pragma omp task depend(in: A[i * lda + k], A[j * lda + k]) depend(inout: A[j * lda + i]) shared(failed)
+          {
+            long f;
+#pragma omp atomic read
+            f = failed;
+            if (f == 0)
+              cgemm(CBlasConjTrans, CBlasNoTrans, ib, jb, kb,
+                    -one, &A[i * lda + k], lda, &A[j * lda + k], lda,
+                    one, &A[j * lda + i], lda);
+          }
+        }
+      }
+    }
+    else {
+      for (size_t i = k + kb; i < n; i += nb) {
+        const size_t ib = min(nb, n - i);
+
+#pragma omp task depend(in: A[k * lda + k]) depend(inout: A[k * lda + i]) shared(failed)
+        {
+          long f;
+#pragma omp atomic read
+          f = failed;
+          if (f == 0)
+            ctrsm(CBlasRight, CBlasLower, CBlasConjTrans, CBlasNonUnit, ib, kb,
+                  one, &A[k * lda + k], lda, &A[k * lda + i], lda);
+        }
+      }
+
+      for (size_t j = k + kb; j < n; j += nb) {
+        const size_t jb = min(nb, n - j);
+
+#pragma omp task depend(in: A[k * lda + j]) depend(inout: A[j * lda + j]) shared(failed)
+        {
+          long f;
+#pragma omp atomic read
+          f = failed;
+          if (f == 0)
+            cherk(CBlasLower, CBlasNoTrans, jb, kb,
+                  -one, &A[k * lda + j], lda, one, &A[j * lda + j], lda);
+        }
+
+        for (size_t i = j + jb; i < n; i += nb) {
+          const size_t ib = min(nb, n - i);
+
+#pragma omp task depend(in: A[k * lda + i], A[k * lda + j]) depend(inout: A[j * lda + i]) shared(failed)
+          {
+            long f;
+#pragma omp atomic read
+            f = failed;
+            if (f == 0)
+              cgemm(CBlasNoTrans, CBlasConjTrans, ib, jb, kb,
+                    -one, &A[k * lda + i], lda, &A[k * lda + j], lda,
+                    one, &A[j * lda + i], lda);
+          }
+        }
+      }
+    }
+  }
+
+  *info = failed;
+}
+
 void cpotrf(CBlasUplo uplo,
             size_t n,
             float complex * restrict A, size_t lda,
@@ -96,6 +289,15 @@ void cpotrf(CBlasUplo uplo,
 
   if (n == 0) return;
 
+  if (potrfAlgorithm == CLapackPotrfRecursive) {
+    cpotrf_recursive(uplo, n, A, lda, info);
+    return;
+  }
+  if (potrfAlgorithm == CLapackPotrfTiled) {
+    cpotrf_tiled(uplo, n, A, lda, info);
+    return;
+  }
+
   const size_t nb = (uplo == CBlasUpper) ? 16 : 32;
 
   if (n < nb) {
@@ -147,22 +349,41 @@ void cpotrf(CBlasUplo uplo,
   }
 }
 
+/**
+ * Loads the CPOTRF module and looks up the unblocked kernel for each uplo.  The
+ * handle's context must be current.
+ */
+CUresult cpotrf_load(CULAPACKhandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    char name[45];
+    snprintf(name, 45, "_Z6cpotf2IL9CBlasUplo%dELj%uEEvP6float2Piii", uplos[u], CPOTF2_BX);
+    CU_ERROR_CHECK(lookup(&handle->cpotf2[u], module, name));
+  }
+
+  handle->cpotrf = module;
+
+  return CUDA_SUCCESS;
+}
+
 static inline CUresult cuCpotf2(CULAPACKhandle handle, CBlasUplo uplo,
                                 size_t n,
                                 CUdeviceptr A, size_t lda,
                                 CUdeviceptr info, CUstream stream) {
-  const unsigned int bx = 32;
+  const unsigned int bx = CPOTF2_BX;
   if (n > bx)
     return CUDA_ERROR_INVALID_VALUE;
 
   if (handle->cpotrf == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->cpotrf, imageBytes));
-
-  char name[45];
-  snprintf(name, 45, "_Z6cpotf2IL9CBlasUplo%dELj%uEEvP6float2Piii", uplo, bx);
+    CU_ERROR_CHECK(cpotrf_load(handle));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->cpotrf, name));
+  CUfunction function = handle->cpotf2[(uplo == CBlasUpper) ? 0 : 1];
+  if (function == NULL)
+    return CUDA_ERROR_NOT_FOUND;
 
   void * params[] = { &A, &info, &lda, &n };
 
@@ -184,26 +405,32 @@ CUresult cuCpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
     return CUDA_SUCCESS;
 
   /**
-   * The SGEMM consumes most of the FLOPs in the Cholesky decomposition so the
+   * The CGEMM consumes most of the FLOPs in the Cholesky decomposition so the
    * block sizes are chosen to favour it.  In the upper triangular case it is
    * the row matrix to the right of the diagonal block that is updated via
-   * D = -A^T * C + D (i.e. the A argument to SGEMM is transposed) therefore the
-   * block size is SGEMM_T_MB.  For the lower triangular case it is the column
-   * matrix below the diagonal block that is updated via D = -C * A^T + D so the
-   * block size is SGEMM_N_NB.
+   * D = -A^T * C + D (i.e. the A argument to CGEMM is transposed) therefore the
+   * block size is the height of the tiles of the transposed CGEMM.  For the
+   * lower triangular case it is the column matrix below the diagonal block that
+   * is updated via D = -C * A^T + D so the block size is the width of the tiles
+   * of CGEMM.  Both are looked up for the device in the tuning database.
    */
-  const size_t nb = (uplo == CBlasUpper) ? CGEMM_C_MB : CGEMM_N_NB;
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuBLASGetBlocking(handle->blas_handle, (uplo == CBlasUpper) ? CBlasCgemmC : CBlasCgemmN, &blocking));
+  const size_t nb = (uplo == CBlasUpper) ? blocking.mb : blocking.nb;
 
   float complex * B;
+  struct packed P;
   size_t ldb;
   CUstream stream0, stream1;
 
   // Allocate page-locked host memory for diagonal block
-  CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(float complex)));
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(float complex)));
+  // Borrow staging memory for the packed triangle of the diagonal block
+  CU_ERROR_CHECK(packed_create(handle, &P, nb, sizeof(float complex)));
 
-  // Create two streams for asynchronous copy and compute
-  CU_ERROR_CHECK(cuStreamCreate(&stream0, 0));
-  CU_ERROR_CHECK(cuStreamCreate(&stream1, 0));
+  // Borrow two streams for asynchronous copy and compute
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream0, 0));
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream1, 0));
 
   if (uplo == CBlasUpper) {
     for (size_t j = 0; j < n; j += nb) {
@@ -218,13 +445,11 @@ CUresult cuCpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
                              -complex_one, A + j * lda * sizeof(float complex), lda,
                              A + (j + jb) * lda * sizeof(float complex), lda,
                              complex_one, A + ((j + jb) * lda + j) * sizeof(float complex), lda, stream1));
-      /* Start copying diagonal block onto host asynchronously on the same
+      /* Copy the triangle of the diagonal block onto the host on the same
        * stream as the CHERK above to ensure it has finised updating the block
        * before it is copied */
-      CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(B, ldb, 0, 0, A, lda, j, j,
-                                         jb, jb, sizeof(float complex), stream0));
-      /* Wait until the diagonal block has been copied */
-      CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+      CU_ERROR_CHECK(packed_download(handle, &P, CBlasUpper, jb, A + (j * lda + j) * sizeof(float complex), lda,
+                                     B, ldb, stream0));
       /* Perform the diagonal block decomposition using the CPU */
       cpotrf(CBlasUpper, jb, B, ldb, info);
       /* Check for positive definite matrix */
@@ -233,8 +458,8 @@ CUresult cuCpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
         break;
       }
       /* Copy the diagonal block back onto the device */
-      CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, j, j, B, ldb, 0, 0,
-                                         jb, jb, sizeof(float complex), stream0));
+      CU_ERROR_CHECK(packed_upload(handle, &P, CBlasUpper, jb, B, ldb,
+                                   A + (j * lda + j) * sizeof(float complex), lda, stream0));
       /* Wait until the CGEMM has finished updating the row to the right (this
        * is unnecessary on devices that cannot execute multiple kernels
        * simultaneously */
@@ -259,13 +484,11 @@ CUresult cuCpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
                              -complex_one, A + (j + jb) * sizeof(float complex), lda,
                              A + j * sizeof(float complex), lda,
                              complex_one, A + (j * lda + j + jb) * sizeof(float complex), lda, stream1));
-      /* Start copying diagonal block onto host asynchronously on the same
+      /* Copy the triangle of the diagonal block onto the host on the same
        * stream as the CHERK above to ensure it has finised updating the block
        * before it is copied */
-      CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(B, ldb, 0, 0, A, lda, j, j,
-                                         jb, jb, sizeof(float complex), stream0));
-      /* Wait until the diagonal block has been copied */
-      CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+      CU_ERROR_CHECK(packed_download(handle, &P, CBlasLower, jb, A + (j * lda + j) * sizeof(float complex), lda,
+                                     B, ldb, stream0));
       /* Perform the diagonal block decomposition using the CPU */
       cpotrf(CBlasLower, jb, B, ldb, info);
       /* Check for positive definite matrix */
@@ -274,8 +497,8 @@ CUresult cuCpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
         break;
       }
       /* Copy the diagonal block back onto the device */
-      CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, j, j, B, ldb, 0, 0,
-                                         jb, jb, sizeof(float complex), stream0));
+      CU_ERROR_CHECK(packed_upload(handle, &P, CBlasLower, jb, B, ldb,
+                                   A + (j * lda + j) * sizeof(float complex), lda, stream0));
       /* Wait until the CGEMM has finished updating the row to the right (this
        * is unnecessary on devices that cannot execute multiple kernels
        * simultaneously */
@@ -288,11 +511,264 @@ CUresult cuCpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
     }
   }
 
+  // Wait for the streams before the staging buffer goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+
   // Clean up resources
-  CU_ERROR_CHECK(cuMemFreeHost(B));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, B));
+  CU_ERROR_CHECK(packed_destroy(handle, &P));
+
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream0));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream1));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Arguments for the tile tasks of the multi-GPU Cholesky decomposition.  Tasks
+ * are described in terms of the lower triangle: tile (i, j) with i >= j is the
+ * ib by jb block of A at row i and column j (the block at row j and column i
+ * in the upper case).
+ */
+struct cpotrf_tile_args {
+  CUmultiGPULAPACKhandle handle;
+  CBlasUplo uplo;
+  size_t i, j, ib, jb;
+  float complex * A;
+  size_t lda;
+  long * info;                  /** Set by the task that finds A is not
+                                    positive definite                         */
+};
+
+/**
+ * Gets the handle to use for the context the calling task is running on, or
+ * NULL if it runs on the host.
+ */
+static inline CUBLAShandle cpotrfTileHandle(const struct cpotrf_tile_args * args) {
+  const int context = cuMultiGPUGetCurrentContext();
+  CUmultiGPUBLAShandle handle = args->handle->blas_handle;
+  if (context < 0 || cuMultiGPUIsHost(cuMultiGPUBLASGetMultiGPU(handle), context))
+    return NULL;
+  return cuMultiGPUBLASGetHandle(handle, context);
+}
+
+/**
+ * Factors diagonal tile (j, j) on the host.
+ */
+static CUresult cpotrfTileFactor(const void * a) {
+  const struct cpotrf_tile_args * args = (const struct cpotrf_tile_args *)a;
+  const size_t j = args->j, lda = args->lda;
+
+  long info;
+  cpotrf(args->uplo, args->jb, &args->A[j * lda + j], lda, &info);
+  if (info != 0) {
+    // Later diagonal tiles depend on this one so only one task can get here
+    *args->info = info + (long)j;
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Updates tile (i, j) with the factored tiles to the left of it (above it).
+ */
+static CUresult cpotrfTileUpdate(const void * a) {
+  const struct cpotrf_tile_args * args = (const struct cpotrf_tile_args *)a;
+  const size_t i = args->i, j = args->j, ib = args->ib, jb = args->jb, lda = args->lda;
+  float complex * A = args->A;
+
+  CUBLAShandle handle = cpotrfTileHandle(args);
+  if (handle == NULL) {
+    if (args->uplo == CBlasUpper) {
+      if (i == j)
+        cherk(CBlasUpper, CBlasConjTrans, jb, j, -one, &A[j * lda], lda, one, &A[j * lda + j], lda);
+      else
+        cgemm(CBlasConjTrans, CBlasNoTrans, jb, ib, j, -complex_one, &A[j * lda], lda, &A[i * lda], lda,
+              complex_one, &A[i * lda + j], lda);
+    }
+    else {
+      if (i == j)
+        cherk(CBlasLower, CBlasNoTrans, jb, j, -one, &A[j], lda, one, &A[j * lda + j], lda);
+      else
+        cgemm(CBlasNoTrans, CBlasConjTrans, ib, jb, j, -complex_one, &A[i], lda, &A[j], lda,
+              complex_one, &A[j * lda + i], lda);
+    }
+    return CUDA_SUCCESS;
+  }
+
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  // The panel of the diagonal tile (X) is needed by every update and the panel
+  // of the tile itself (Y) only off the diagonal
+  CUdeviceptr X, Y = 0, C;
+  size_t ldx, ldy = 0, ldc;
+  if (args->uplo == CBlasUpper) {
+    CU_ERROR_CHECK(matrix_upload(handle, &A[j * lda], lda, j, jb, sizeof(float complex), &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_upload(handle, &A[i * lda + j], lda, jb, ib, sizeof(float complex), &C, &ldc, stream));
+    if (i == j)
+      CU_ERROR_CHECK(cuCherk(handle, CBlasUpper, CBlasConjTrans, jb, j, -one, X, ldx, one, C, ldc, stream));
+    else {
+      CU_ERROR_CHECK(matrix_upload(handle, &A[i * lda], lda, j, ib, sizeof(float complex), &Y, &ldy, stream));
+      CU_ERROR_CHECK(cuCgemm(handle, CBlasConjTrans, CBlasNoTrans, jb, ib, j, -complex_one, X, ldx, Y, ldy,
+                             complex_one, C, ldc, stream));
+    }
+    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(A, lda, j, i, C, ldc, 0, 0, jb, ib, sizeof(float complex), stream));
+  }
+  else {
+    CU_ERROR_CHECK(matrix_upload(handle, &A[j], lda, jb, j, sizeof(float complex), &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_upload(handle, &A[j * lda + i], lda, ib, jb, sizeof(float complex), &C, &ldc, stream));
+    if (i == j)
+      CU_ERROR_CHECK(cuCherk(handle, CBlasLower, CBlasNoTrans, jb, j, -one, X, ldx, one, C, ldc, stream));
+    else {
+      CU_ERROR_CHECK(matrix_upload(handle, &A[i], lda, ib, j, sizeof(float complex), &Y, &ldy, stream));
+      CU_ERROR_CHECK(cuCgemm(handle, CBlasNoTrans, CBlasConjTrans, ib, jb, j, -complex_one, Y, ldy, X, ldx,
+                             complex_one, C, ldc, stream));
+    }
+    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(A, lda, i, j, C, ldc, 0, 0, ib, jb, sizeof(float complex), stream));
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  if (Y != 0)
+    CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, C));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Solves tile (i, j) below (to the right of) a factored diagonal tile.
+ */
+static CUresult cpotrfTileSolve(const void * a) {
+  const struct cpotrf_tile_args * args = (const struct cpotrf_tile_args *)a;
+  const size_t i = args->i, j = args->j, ib = args->ib, jb = args->jb, lda = args->lda;
+  float complex * A = args->A;
 
-  CU_ERROR_CHECK(cuStreamDestroy(stream0));
-  CU_ERROR_CHECK(cuStreamDestroy(stream1));
+  CUBLAShandle handle = cpotrfTileHandle(args);
+  if (handle == NULL) {
+    if (args->uplo == CBlasUpper)
+      ctrsm(CBlasLeft, CBlasUpper, CBlasConjTrans, CBlasNonUnit, jb, ib,
+            complex_one, &A[j * lda + j], lda, &A[i * lda + j], lda);
+    else
+      ctrsm(CBlasRight, CBlasLower, CBlasConjTrans, CBlasNonUnit, ib, jb,
+            complex_one, &A[j * lda + j], lda, &A[j * lda + i], lda);
+    return CUDA_SUCCESS;
+  }
+
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D, B;
+  size_t ldd, ldb;
+  CU_ERROR_CHECK(matrix_upload(handle, &A[j * lda + j], lda, jb, jb, sizeof(float complex), &D, &ldd, stream));
+  if (args->uplo == CBlasUpper) {
+    CU_ERROR_CHECK(matrix_upload(handle, &A[i * lda + j], lda, jb, ib, sizeof(float complex), &B, &ldb, stream));
+    CU_ERROR_CHECK(cuCtrsm(handle, CBlasLeft, CBlasUpper, CBlasConjTrans, CBlasNonUnit, jb, ib,
+                           complex_one, D, ldd, B, ldb, stream));
+    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(A, lda, j, i, B, ldb, 0, 0, jb, ib, sizeof(float complex), stream));
+  }
+  else {
+    CU_ERROR_CHECK(matrix_upload(handle, &A[j * lda + i], lda, ib, jb, sizeof(float complex), &B, &ldb, stream));
+    CU_ERROR_CHECK(cuCtrsm(handle, CBlasRight, CBlasLower, CBlasConjTrans, CBlasNonUnit, ib, jb,
+                           complex_one, D, ldd, B, ldb, stream));
+    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(A, lda, i, j, B, ldb, 0, 0, ib, jb, sizeof(float complex), stream));
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, B));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Builds the task graph of the left-looking tiled Cholesky decomposition and
+ * submits each task as soon as it is created.  Tile (j, j) is updated and
+ * factored on the host context (or the first context if there is none), then
+ * each tile below it is updated with the tiles to its left and solved on the
+ * context it is dealt to.  A task only waits for the tiles it reads and writes,
+ * so the update of the next diagonal tile and its factorisation overlap the
+ * rest of the block column.  Tile (i, k) is final once solved[k * nt + i] has
+ * finished and, as each solve waits for the one before it in the same row,
+ * depending on the last solved tile of a row covers the whole row.  Tasks are
+ * added to tasks once they have been submitted.
+ */
+static CUresult cpotrfGraph(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                            size_t n, size_t nb, float complex * A, size_t lda, long * info,
+                            CUtask * tasks, size_t * nTasks, CUtask * solved,
+                            CUtask * batch, int * contexts) {
+  CUmultiGPU mGPU = cuMultiGPUBLASGetMultiGPU(handle->blas_handle);
+  const size_t nt = (n + nb - 1) / nb;
+
+  int host = 0;
+  for (int c = cuMultiGPUGetContextCount(mGPU) - 1; c >= 0; c--) {
+    if (cuMultiGPUIsHost(mGPU, c))
+      host = c;
+  }
+
+  struct cpotrf_tile_args args = { .handle = handle, .uplo = uplo, .A = A, .lda = lda, .info = info };
+
+  for (size_t k = 0; k < nt; k++) {
+    args.i = args.j = k * nb;
+    args.ib = args.jb = min(nb, n - k * nb);
+
+    CUtask update = NULL, factor;
+    if (k > 0) {
+      CU_ERROR_CHECK(cuTaskCreate(&update, cpotrfTileUpdate, &args, sizeof(struct cpotrf_tile_args)));
+      CU_ERROR_CHECK(cuTaskAddDependency(update, solved[(k - 1) * nt + k]));
+      CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, host, update));
+      tasks[(*nTasks)++] = update;
+    }
+    CU_ERROR_CHECK(cuTaskCreate(&factor, cpotrfTileFactor, &args, sizeof(struct cpotrf_tile_args)));
+    if (update != NULL)
+      CU_ERROR_CHECK(cuTaskAddDependency(factor, update));
+    CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, host, factor));
+    tasks[(*nTasks)++] = factor;
+    solved[k * nt + k] = factor;
+
+    if (k + 1 == nt)
+      break;
+
+    // Deal the tiles below the diagonal out in proportion to the rate each
+    // context is predicted to update and solve them.  The update and solve of a
+    // tile go to the same context.
+    const double flops = 8.0 * (double)nb * (double)nb * (double)(k * nb) + 4.0 * (double)nb * (double)nb * (double)nb;
+    const double bytes = (double)((2 * k * nb + 4 * nb) * nb * sizeof(float complex));
+    CU_ERROR_CHECK(cuMultiGPUPartition(mGPU, flops, bytes, contexts, nt - k - 1));
+
+    size_t nBatch = 0;
+    for (size_t i = k + 1; i < nt; i++) {
+      const int context = contexts[i - k - 1];
+      args.i = i * nb;
+      args.ib = min(nb, n - i * nb);
+
+      if (k > 0) {
+        CU_ERROR_CHECK(cuTaskCreate(&update, cpotrfTileUpdate, &args, sizeof(struct cpotrf_tile_args)));
+        CU_ERROR_CHECK(cuTaskAddDependency(update, solved[(k - 1) * nt + i]));
+        CU_ERROR_CHECK(cuTaskAddDependency(update, solved[(k - 1) * nt + k]));
+        batch[nBatch] = update;
+        contexts[nt + nBatch++] = context;
+      }
+
+      CUtask solve;
+      CU_ERROR_CHECK(cuTaskCreate(&solve, cpotrfTileSolve, &args, sizeof(struct cpotrf_tile_args)));
+      CU_ERROR_CHECK(cuTaskAddDependency(solve, factor));
+      if (k > 0)
+        CU_ERROR_CHECK(cuTaskAddDependency(solve, update));
+      batch[nBatch] = solve;
+      contexts[nt + nBatch++] = context;
+      solved[k * nt + i] = solve;
+    }
+
+    CU_ERROR_CHECK(cuMultiGPURunTasks(mGPU, &contexts[nt], batch, nBatch));
+    for (size_t l = 0; l < nBatch; l++)
+      tasks[(*nTasks)++] = batch[l];
+  }
 
   return CUDA_SUCCESS;
 }
@@ -312,66 +788,255 @@ CUresult cuMultiGPUCpotrf(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
   if (n == 0)
     return CUDA_SUCCESS;
 
+  // Any copies of A cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float complex)));
+
   /**
    * The CGEMM consumes most of the FLOPs in the Cholesky decomposition so the
    * block sizes are chosen to favour it.  In the upper triangular case it is
    * the row matrix to the right of the diagonal block that is updated via
    * D = -A^T * C + D (i.e. the A argument to CGEMM is transposed) therefore the
-   * block size is CGEMM_C_MB.  For the lower triangular case it is the column
-   * matrix below the diagonal block that is updated via D = -C * A^T + D so the
-   * block size is CGEMM_N_NB.
+   * block size is the height of the tiles of the transposed CGEMM.  For the
+   * lower triangular case it is the column matrix below the diagonal block that
+   * is updated via D = -C * A^T + D so the block size is the width of the tiles
+   * of CGEMM.  Both are looked up for the device in the tuning database.
    */
-  const size_t nb = (uplo == CBlasUpper) ? CGEMM_C_MB : CGEMM_N_NB;
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, (uplo == CBlasUpper) ? CBlasCgemmC : CBlasCgemmN, &blocking));
+  const size_t nb = (uplo == CBlasUpper) ? blocking.mb : blocking.nb;
 
   if (n < nb) {
     cpotrf(uplo, n, A, lda, info);
     return CUDA_SUCCESS;
   }
 
-  if (uplo == CBlasUpper) {
-    for (size_t j = 0; j < n; j += nb) {
-      const size_t jb = min(nb, n - j);
+  // At most two tasks per tile of the lower triangle
+  const size_t nt = (n + nb - 1) / nb;
+  CUtask * tasks = malloc(nt * (nt + 1) * sizeof(CUtask));
+  CUtask * solved = malloc(nt * nt * sizeof(CUtask));
+  CUtask * batch = malloc(2 * nt * sizeof(CUtask));
+  int * contexts = malloc(3 * nt * sizeof(int));
+  if (tasks == NULL || solved == NULL || batch == NULL || contexts == NULL) {
+    free(tasks);
+    free(solved);
+    free(batch);
+    free(contexts);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
 
-      CU_ERROR_CHECK(cuMultiGPUCherk(handle->blas_handle, CBlasUpper, CBlasConjTrans, jb, j,
-                                     -one, &A[j * lda], lda, one, &A[j * lda + j], lda));
-      CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle->blas_handle));
-      cpotrf(CBlasUpper, jb, &A[j * lda + j], lda, info);
-      if (*info != 0) {
-        (*info) += (long)j;
-        return CUDA_ERROR_INVALID_VALUE;
-      }
+  size_t nTasks = 0;
+  CUresult error = cpotrfGraph(handle, uplo, n, nb, A, lda, info, tasks, &nTasks, solved, batch, contexts);
 
-      if (j + jb < n) {
-        CU_ERROR_CHECK(cuMultiGPUCgemm(handle->blas_handle, CBlasConjTrans, CBlasNoTrans, jb, n - j - jb, j,
-                                       -complex_one, &A[j * lda], lda, &A[(j + jb) * lda], lda,
-                                       complex_one, &A[(j + jb) * lda + j], lda));
-        CU_ERROR_CHECK(cuMultiGPUCtrsm(handle->blas_handle, CBlasLeft, CBlasUpper, CBlasConjTrans, CBlasNonUnit, jb, n - j - jb,
-                                       complex_one, &A[j * lda + j], lda, &A[(j + jb) * lda + j], lda));
+  // Wait for every task that was submitted, even if building the graph failed
+  CUresult result;
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, nTasks, &result));
+
+  free(tasks);
+  free(solved);
+  free(batch);
+  free(contexts);
+
+  // Blocks of A were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float complex)));
+
+  if (error != CUDA_SUCCESS)
+    return error;
+  if (*info != 0)
+    return CUDA_ERROR_INVALID_VALUE;
+  return result;
+}
+
+/**
+ * Solves for the rest of block row (column) k of a distributed matrix on the
+ * processes holding it.
+ */
+static CUresult cpotrfPanel(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  size_t i, j, m, n;
+  if (step->uplo == CBlasUpper) {
+    if (k % (size_t)A->p != (size_t)pr)
+      return CUDA_SUCCESS;
+    i = k / (size_t)A->p;
+    j = matrix_local(k + 1, pc, A->q);
+    m = kb;
+    n = matrix_extent(j, matrix_local(A->nt, pc, A->q), pc, A->q, nb, A->n);
+  }
+  else {
+    if (k % (size_t)A->q != (size_t)pc)
+      return CUDA_SUCCESS;
+    i = matrix_local(k + 1, pr, A->p);
+    j = k / (size_t)A->q;
+    m = matrix_extent(i, matrix_local(A->mt, pr, A->p), pr, A->p, nb, A->m);
+    n = kb;
+  }
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D;
+  size_t ldd;
+  CU_ERROR_CHECK(matrix_upload(handle, step->D, step->ldd, kb, kb, sizeof(float complex), &D, &ldd, stream));
+
+  if (step->uplo == CBlasUpper)
+    CU_ERROR_CHECK(cuCtrsm(handle, CBlasLeft, CBlasUpper, CBlasConjTrans, CBlasNonUnit, m, n,
+                           complex_one, D, ldd, matrix_block(A, r, i, j), A->ld[r], stream));
+  else
+    CU_ERROR_CHECK(cuCtrsm(handle, CBlasRight, CBlasLower, CBlasConjTrans, CBlasNonUnit, m, n,
+                           complex_one, D, ldd, matrix_block(A, r, i, j), A->ld[r], stream));
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Updates the blocks of the trailing matrix held by a process with block row
+ * (column) k.
+ */
+static CUresult cpotrfUpdate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  const size_t mt = matrix_local(A->mt, pr, A->p), nt = matrix_local(A->nt, pc, A->q);
+  const size_t i0 = matrix_local(k + 1, pr, A->p), j0 = matrix_local(k + 1, pc, A->q);
+  if (i0 == mt || j0 == nt)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  // The blocks of the panel are needed both down the rows and across the
+  // columns of the process
+  CUdeviceptr X, Y;
+  size_t ldx, ldy;
+  if (step->uplo == CBlasUpper) {
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pr, A->p, k + 1, A->mt, kb, step->G, step->ldg, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pc, A->q, k + 1, A->nt, kb, step->G, step->ldg, &Y, &ldy, stream));
+
+    for (size_t j = j0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i1 = matrix_local(J + 1, pr, A->p);
+      if (i1 > i0 && (i1 - 1) * (size_t)A->p + (size_t)pr == J) {
+        i1--;
+        CU_ERROR_CHECK(cuCherk(handle, CBlasUpper, CBlasConjTrans, jb, kb,
+                               -1.0f, matrix_panel(A, false, X, ldx, i1), ldx,
+                               1.0f, matrix_block(A, r, i1, j), A->ld[r], stream));
       }
+      if (i1 > i0)
+        CU_ERROR_CHECK(cuCgemm(handle, CBlasConjTrans, CBlasNoTrans,
+                               matrix_extent(i0, i1, pr, A->p, nb, A->m), jb, kb,
+                               -complex_one, matrix_panel(A, false, X, ldx, i0), ldx,
+                               matrix_panel(A, false, Y, ldy, j), ldy,
+                               complex_one, matrix_block(A, r, i0, j), A->ld[r], stream));
     }
   }
   else {
-    for (size_t j = 0; j < n; j += nb) {
-      const size_t jb = min(nb, n - j);
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pr, A->p, k + 1, A->mt, kb, step->H, step->ldh, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pc, A->q, k + 1, A->nt, kb, step->H, step->ldh, &Y, &ldy, stream));
 
-      CU_ERROR_CHECK(cuMultiGPUCherk(handle->blas_handle, CBlasLower, CBlasNoTrans, jb, j,
-                                     -one, &A[j], lda, one, &A[j * lda + j], lda));
-      CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle->blas_handle));
-      cpotrf(CBlasLower, jb, &A[j * lda + j], lda, info);
-      if (*info != 0) {
-        (*info) += (long)j;
-        return CUDA_ERROR_INVALID_VALUE;
-      }
+    for (size_t j = j0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
 
-      if (j + jb < n) {
-        CU_ERROR_CHECK(cuMultiGPUCgemm(handle->blas_handle, CBlasNoTrans, CBlasConjTrans, n - j - jb, jb, j,
-                                       -complex_one, &A[j + jb], lda, &A[j], lda,
-                                       complex_one, &A[j * lda + j + jb], lda));
-        CU_ERROR_CHECK(cuMultiGPUCtrsm(handle->blas_handle, CBlasRight, CBlasLower, CBlasConjTrans, CBlasNonUnit, n - j - jb, jb,
-                                       complex_one, &A[j * lda + j], lda, &A[j * lda + j + jb], lda));
+      size_t i = matrix_local(J, pr, A->p);
+      if (i < mt && i * (size_t)A->p + (size_t)pr == J) {
+        CU_ERROR_CHECK(cuCherk(handle, CBlasLower, CBlasNoTrans, jb, kb,
+                               -1.0f, matrix_panel(A, true, X, ldx, i), ldx,
+                               1.0f, matrix_block(A, r, i, j), A->ld[r], stream));
+        i++;
       }
+      if (i < mt)
+        CU_ERROR_CHECK(cuCgemm(handle, CBlasNoTrans, CBlasConjTrans,
+                               matrix_extent(i, mt, pr, A->p, nb, A->m), jb, kb,
+                               -complex_one, matrix_panel(A, true, X, ldx, i), ldx,
+                               matrix_panel(A, true, Y, ldy, j), ldy,
+                               complex_one, matrix_block(A, r, i, j), A->ld[r], stream));
+    }
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult cpotrfMatrix(CBlasUplo uplo, struct __cumultigpumatrix_st * A,
+                             float complex * D, float complex * H, long * info) {
+  const size_t n = A->n, nb = A->nb;
+
+  // Block columns are passed to the update as blocks of rows with leading
+  // dimension n and block rows as blocks of columns with leading dimension nb
+  struct matrix_step step = { .A = A, .uplo = uplo, .D = D, .ldd = nb,
+                              .H = H, .ldh = n, .G = H, .ldg = nb };
+
+  for (size_t k = 0; k < A->nt; k++) {
+    const size_t kb = min(nb, n - k * nb);
+    step.k = k;
+
+    // The diagonal block is factored on the host
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, nb, true));
+    cpotrf(uplo, kb, D, nb, info);
+    if (*info != 0) {
+      (*info) += (long)(k * nb);
+      return CUDA_ERROR_INVALID_VALUE;
     }
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, nb, false));
+
+    if (k + 1 == A->nt)
+      break;
+
+    // The rest of the block row (column) is solved on its own processes and
+    // then is the only part of the matrix sent to the others
+    CU_ERROR_CHECK(matrix_run(&step, cpotrfPanel));
+    if (uplo == CBlasUpper)
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k + 1, A->nt, &H[(k + 1) * nb * nb], nb, true));
+    else
+      CU_ERROR_CHECK(matrix_copy(A, k + 1, A->mt, k, k + 1, &H[(k + 1) * nb], n, true));
+    CU_ERROR_CHECK(matrix_run(&step, cpotrfUpdate));
   }
 
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPUCpotrfMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(float complex))
+    *info = -3;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  float complex * D = malloc(A->nb * A->nb * sizeof(float complex));
+  float complex * H = malloc(A->n * A->nb * sizeof(float complex));
+  if (D == NULL || H == NULL) {
+    free(D);
+    free(H);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+
+  CUresult result = cpotrfMatrix(uplo, A, D, H, info);
+
+  free(D);
+  free(H);
+
+  return result;
+}
@@ -1,4 +1,5 @@
 #include "lapack.h"
+#include "handle.h"
 #include "error.h"
 
 void cpotri(CBlasUplo uplo,
@@ -66,3 +67,23 @@ CUresult cuMultiGPUCpotri(CUmultiGPULAPACKhandle handle,
   CU_ERROR_CHECK(cuMultiGPUClauum(handle, uplo, n, A, lda, info));
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPUCpotriMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(float complex))
+    *info = -3;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  CU_ERROR_CHECK(cuMultiGPUCtrtriMatrix(handle, uplo, CBlasNonUnit, A, info));
+  if (*info != 0)
+    return CUDA_SUCCESS;
+  CU_ERROR_CHECK(cuMultiGPUClauumMatrix(handle, uplo, A, info));
+  return CUDA_SUCCESS;
+}
@@ -0,0 +1,33 @@
+#include "lapack.h"
+#include <stdlib.h>
+#include <string.h>
+
+CLapackPotrf potrfAlgorithm = CLapackPotrfBlocked;
+size_t potrfTile = 0;
+
+/**
+ * Selects the CPU algorithms when the library is loaded.
+ *
+ * LAPACK_POTRF may be set to "blocked", "recursive" or "tiled" to choose the
+ * Cholesky decomposition algorithm.  LAPACK_POTRF_NB may be set to the size of
+ * the tiles of the tiled algorithm.
+ */
+static void __attribute__((constructor)) cpu_init(void) {
+  const char * algorithm = getenv("LAPACK_POTRF");
+  if (algorithm != NULL) {
+    if (strcmp(algorithm, "blocked") == 0)
+      potrfAlgorithm = CLapackPotrfBlocked;
+    else if (strcmp(algorithm, "recursive") == 0)
+      potrfAlgorithm = CLapackPotrfRecursive;
+    else if (strcmp(algorithm, "tiled") == 0)
+      potrfAlgorithm = CLapackPotrfTiled;
+  }
+
+  const char * tile = getenv("LAPACK_POTRF_NB");
+  if (tile != NULL) {
+    char * end;
+    unsigned long long n = strtoull(tile, &end, 10);
+    if (end != tile && *end == '\0')
+      potrfTile = (size_t)n;
+  }
+}
@@ -2,9 +2,15 @@
 #include "handle.h"
 #include "error.h"
 #include <stdio.h>
-#include "config.h"
+#include <stdlib.h>
 #include "dlauum.fatbin.c"
 
+/**
+ * Number of threads used by the unblocked kernel (and so the largest matrix it
+ * can work on).
+ */
+#define DLAUU2_BX 32u
+
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
 
 static inline CUresult cuMemcpyHtoD2DAsync(CUdeviceptr A, size_t lda, size_t ai, size_t aj,
@@ -128,21 +134,40 @@ void dlauum(CBlasUplo uplo,
   }
 }
 
+/**
+ * Loads the DLAUUM module and looks up the unblocked kernel for each uplo.  The
+ * handle's context must be current.
+ */
+CUresult dlauum_load(CULAPACKhandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    char name[37];
+    snprintf(name, 37, "_Z6dlauu2IL9CBlasUplo%dELj%uEEvPdii", uplos[u], DLAUU2_BX);
+    CU_ERROR_CHECK(lookup(&handle->dlauu2[u], module, name));
+  }
+
+  handle->dlauum = module;
+
+  return CUDA_SUCCESS;
+}
+
 static inline CUresult cuDlauu2(CULAPACKhandle handle, CBlasUplo uplo,
                                 size_t n,
                                 CUdeviceptr A, size_t lda, CUstream stream) {
-  const unsigned int bx = 32;
+  const unsigned int bx = DLAUU2_BX;
   if (n > bx)
     return CUDA_ERROR_INVALID_VALUE;
 
   if (handle->dlauum == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->dlauum, imageBytes));
-
-  char name[37];
-  snprintf(name, 37, "_Z6dlauu2IL9CBlasUplo%dELj%uEEvPdii", uplo, bx);
+    CU_ERROR_CHECK(dlauum_load(handle));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->dlauum, name));
+  CUfunction function = handle->dlauu2[(uplo == CBlasUpper) ? 0 : 1];
+  if (function == NULL)
+    return CUDA_ERROR_NOT_FOUND;
 
   void * params[] = { &A, &lda, &n };
 
@@ -168,6 +193,7 @@ CUresult cuDlauum(CULAPACKhandle handle,
     return CUDA_SUCCESS;
 
   double * B;
+  struct packed P;
   CUdeviceptr X;
   size_t ldb, ldx;
   CUstream stream0, stream1;
@@ -181,19 +207,23 @@ CUresult cuDlauum(CULAPACKhandle handle,
    * between loops when A is lower triangular.
    */
 
-  // Create two streams for asynchronous copy and compute
-  CU_ERROR_CHECK(cuStreamCreate(&stream0, 0));
-  CU_ERROR_CHECK(cuStreamCreate(&stream1, 0));
+  // Borrow two streams for asynchronous copy and compute
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream0, 0));
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream1, 0));
 
   if (uplo == CBlasUpper) {
     // Block size for upper triangular DTRTRI and DLAUUM
-    const size_t nb = DGEMM_N_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuBLASGetBlocking(handle->blas_handle, CBlasDgemmN, &blocking));
+    const size_t nb = blocking.mb;
 
     // Allocate page-locked host memory for diagonal block
-    CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(double)));
+    // Borrow staging memory for the packed triangle of the diagonal block
+    CU_ERROR_CHECK(packed_create(handle, &P, nb, sizeof(double)));
 
     // Allocate temporary column for out of place DTRMM
-    CU_ERROR_CHECK(cuMemAllocPitch(&X, &ldx, n * sizeof(double), nb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &X, &ldx, n * sizeof(double), nb, sizeof(double)));
     ldx /= sizeof(double);
 
     // Loop for DLAUUM
@@ -211,17 +241,15 @@ CUresult cuDlauum(CULAPACKhandle handle,
                               one, X, ldx, A + i * lda * sizeof(double), lda, stream0));
       /* Overlap both the operations above with a copy of the diagonal block
        * onto the host. */
-      CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(B, ldb, 0, 0, A, lda, i, i,
-                                         ib, ib, sizeof(double), stream1));
-      /* Wait until the diagonal block has been copied */
-      CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+      CU_ERROR_CHECK(packed_download(handle, &P, CBlasUpper, ib, A + (i * lda + i) * sizeof(double), lda,
+                                     B, ldb, stream1));
       /* Form the multiplication of the diagonal block using the CPU */
       dlauum(CBlasUpper, ib, B, ldb, info);
       /* Ensure the DTRMM has finished before copying the block back */
       CU_ERROR_CHECK(cuStreamSynchronize(stream0));
       /* Copy the diagonal block back onto the device */
-      CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, i, i, B, ldb, 0, 0,
-                                         ib, ib, sizeof(double), stream1));
+      CU_ERROR_CHECK(packed_upload(handle, &P, CBlasUpper, ib, B, ldb,
+                                   A + (i * lda + i) * sizeof(double), lda, stream1));
       /* Perform the DSYRK on the same stream as the copy to ensure A has
        * finised copying back first. */
       CU_ERROR_CHECK(cuDsyrk(handle->blas_handle, CBlasUpper, CBlasNoTrans, ib, n - i - ib,
@@ -235,13 +263,18 @@ CUresult cuDlauum(CULAPACKhandle handle,
   }
   else {
     // Block size for lower triangular DLAUUM
-    const size_t mb = DGEMM_T_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuBLASGetBlocking(handle->blas_handle, CBlasDgemmT, &blocking));
+    const size_t mb = blocking.mb;
 
     // Allocate page-locked host memory for diagonal block
-    CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (mb + 1u) & ~1u) * mb * sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (mb + 1u) & ~1u) * mb * sizeof(double)));
+    // Borrow staging memory for the packed triangle of the diagonal block
+    CU_ERROR_CHECK(packed_create(handle, &P, mb, sizeof(double)));
 
     // Allocate temporary row for out of place DTRMM
-    CU_ERROR_CHECK(cuMemAllocPitch(&X, &ldx, mb * sizeof(double), n, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &X, &ldx, mb * sizeof(double), n, sizeof(double)));
+    ldx /= sizeof(double);
 
     // Loop for DLAUUM
     for (size_t i = 0; i < n; i += mb) {
@@ -258,17 +291,15 @@ CUresult cuDlauum(CULAPACKhandle handle,
                               one, X, ldx, A + i * sizeof(double), lda, stream0));
       /* Overlap both the operations above with a copy of the diagonal block
        * onto the host. */
-      CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(B, ldb, 0, 0, A, lda, i, i,
-                                         ib, ib, sizeof(double), stream1));
-      /* Wait until the diagonal block has been copied */
-      CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+      CU_ERROR_CHECK(packed_download(handle, &P, CBlasLower, ib, A + (i * lda + i) * sizeof(double), lda,
+                                     B, ldb, stream1));
       /* Form the multiplication of the diagonal block using the CPU */
-      dlauum(CBlasUpper, ib, B, ldb, info);
+      dlauum(CBlasLower, ib, B, ldb, info);
       /* Ensure the DTRMM has finished before copying the block back */
       CU_ERROR_CHECK(cuStreamSynchronize(stream0));
       /* Copy the diagonal block back onto the device */
-      CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, i, i, B, ldb, 0, 0,
-                                         ib, ib, sizeof(double), stream1));
+      CU_ERROR_CHECK(packed_upload(handle, &P, CBlasLower, ib, B, ldb,
+                                   A + (i * lda + i) * sizeof(double), lda, stream1));
       /* Perform the DSYRK on the same stream as the copy to ensure A has
        * finised copying back first. */
       CU_ERROR_CHECK(cuDsyrk(handle->blas_handle, CBlasLower, CBlasTrans, ib, n - i - ib,
@@ -281,16 +312,43 @@ CUresult cuDlauum(CULAPACKhandle handle,
     }
   }
 
+  // Wait for the streams before the temporary memory goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+
   // Clean up resources
-  CU_ERROR_CHECK(cuMemFreeHost(B));
-  CU_ERROR_CHECK(cuMemFree(X));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, B));
+  CU_ERROR_CHECK(packed_destroy(handle, &P));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, X));
 
-  CU_ERROR_CHECK(cuStreamDestroy(stream0));
-  CU_ERROR_CHECK(cuStreamDestroy(stream1));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream0));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream1));
 
   return CUDA_SUCCESS;
 }
 
+/**
+ * Arguments to the update of the off-diagonal block of a block row (column)
+ * with the trailing part of the matrix.
+ */
+struct dlauum_update_args {
+  CUmultiGPUBLAShandle handle;
+  CBlasTranspose transA, transB;
+  size_t m, n, k;
+  const double * A, * B;
+  double * C;
+  size_t lda, ldb, ldc;
+};
+
+/**
+ * Adds A B to C on the devices.  Runs on the lookahead thread.
+ */
+static CUresult cuMultiGPUDlauumUpdate(const void * a) {
+  const struct dlauum_update_args * args = (const struct dlauum_update_args *)a;
+  return cuMultiGPUDgemm(args->handle, args->transA, args->transB, args->m, args->n, args->k,
+                         one, args->A, args->lda, args->B, args->ldb, one, args->C, args->ldc);
+}
+
 CUresult cuMultiGPUDlauum(CUmultiGPULAPACKhandle handle,
                           CBlasUplo uplo,
                           size_t n,
@@ -307,8 +365,13 @@ CUresult cuMultiGPUDlauum(CUmultiGPULAPACKhandle handle,
   if (n == 0)
     return CUDA_SUCCESS;
 
+  // Any copies of A cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(double)));
+
   if (uplo == CBlasUpper) {
-    const size_t nb = DGEMM_N_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, CBlasDgemmN, &blocking));
+    const size_t nb = blocking.mb;
 
     // Upper triangular DLAUUM
     for (size_t i = 0; i < n; i += nb) {
@@ -316,19 +379,24 @@ CUresult cuMultiGPUDlauum(CUmultiGPULAPACKhandle handle,
 
       CU_ERROR_CHECK(cuMultiGPUDtrmm(handle->blas_handle, CBlasRight, CBlasUpper, CBlasTrans, CBlasNonUnit,
                                      i, ib, one, &A[i * lda + i], lda, &A[i * lda], lda));
+      // The diagonal block is multiplied on the host while the devices update
+      // the off-diagonal block with the trailing part of the matrix
+      const struct dlauum_update_args args = { handle->blas_handle, CBlasNoTrans, CBlasTrans, i, ib, n - i - ib,
+                                              &A[(i + ib) * lda], &A[(i + ib) * lda + i], &A[i * lda], lda, lda, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUDlauumUpdate, &args));
       dlauu2(CBlasUpper, ib, &A[i * lda + i], lda);
+      CU_ERROR_CHECK(lookahead_wait(&update));
 
-      if (i + ib < n) {
-        CU_ERROR_CHECK(cuMultiGPUDgemm(handle->blas_handle, CBlasNoTrans, CBlasTrans, i, ib, n - i - ib,
-                                       one, &A[(i + ib) * lda], lda, &A[(i + ib) * lda + i], lda,
-                                       one, &A[i * lda], lda));
+      if (i + ib < n)
         CU_ERROR_CHECK(cuMultiGPUDsyrk(handle->blas_handle, CBlasUpper, CBlasNoTrans, ib, n - i - ib,
                                        one, &A[(i + ib) * lda + i], lda, one, &A[i * lda + i], lda));
-      }
     }
   }
   else {
-    const size_t mb = DGEMM_T_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, CBlasDgemmT, &blocking));
+    const size_t mb = blocking.mb;
 
     // Lower triangular DLAUUM
     for (size_t i = 0; i < n; i += mb) {
@@ -336,17 +404,230 @@ CUresult cuMultiGPUDlauum(CUmultiGPULAPACKhandle handle,
 
       CU_ERROR_CHECK(cuMultiGPUDtrmm(handle->blas_handle, CBlasLeft, CBlasLower, CBlasTrans, CBlasNonUnit, ib, i,
                                      one, &A[i * lda + i], lda, &A[i], lda));
+      // The diagonal block is multiplied on the host while the devices update
+      // the off-diagonal block with the trailing part of the matrix
+      const struct dlauum_update_args args = { handle->blas_handle, CBlasTrans, CBlasNoTrans, ib, i, n - i - ib,
+                                              &A[i * lda + i + ib], &A[i + ib], &A[i], lda, lda, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUDlauumUpdate, &args));
       dlauu2(CBlasLower, ib, &A[i * lda + i], lda);
+      CU_ERROR_CHECK(lookahead_wait(&update));
 
-      if (i + ib < n) {
-        CU_ERROR_CHECK(cuMultiGPUDgemm(handle->blas_handle, CBlasTrans, CBlasNoTrans, ib, i, n - i - ib,
-                                       one, &A[i * lda + i + ib], lda, &A[i + ib], lda,
-                                       one, &A[i], lda));
+      if (i + ib < n)
         CU_ERROR_CHECK(cuMultiGPUDsyrk(handle->blas_handle, CBlasLower, CBlasTrans, ib, n - i - ib,
                                        one, &A[i * lda + i + ib], lda, one, &A[i * lda + i], lda));
+    }
+  }
+
+  // Blocks of A were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(double)));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Multiplies a block of a distributed matrix in place by a triangular matrix.
+ */
+static inline CUresult matrix_dtrmm(CUBLAShandle handle, CBlasSide side, CBlasUplo uplo,
+                                    CBlasTranspose trans, CBlasDiag diag, size_t m, size_t n,
+                                    double alpha, CUdeviceptr A, size_t lda,
+                                    CUdeviceptr B, size_t ldb, CUstream stream) {
+  CUdeviceptr T;
+  size_t ldt;
+  CU_ERROR_CHECK(matrix_duplicate(handle, B, ldb, m, n, sizeof(double), &T, &ldt, stream));
+  CU_ERROR_CHECK(cuDtrmm2(handle, side, uplo, trans, diag, m, n, alpha, A, lda, T, ldt, B, ldb, stream));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, T));
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Adds the product of block column (row) k of a distributed matrix with its
+ * transpose to the blocks before it held by a process.
+ */
+static CUresult dlauumUpdate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  const size_t mt = matrix_local(k, pr, A->p), nt = matrix_local(k, pc, A->q);
+  if (mt == 0 || nt == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr X, Y;
+  size_t ldx, ldy;
+  if (step->uplo == CBlasUpper) {
+    // A(0:k, 0:k) += A(0:k, k) A(0:k, k)^T
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pr, A->p, 0, k, kb, step->H, step->ldh, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pc, A->q, 0, k, kb, step->H, step->ldh, &Y, &ldy, stream));
+
+    for (size_t j = 0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i = matrix_local(J + 1, pr, A->p);
+      if (i > 0 && (i - 1) * (size_t)A->p + (size_t)pr == J) {
+        i--;
+        CU_ERROR_CHECK(cuDsyrk(handle, CBlasUpper, CBlasNoTrans, jb, kb,
+                               1.0, matrix_panel(A, true, X, ldx, i), ldx,
+                               1.0, matrix_block(A, r, i, j), A->ld[r], stream));
       }
+      if (i > 0)
+        CU_ERROR_CHECK(cuDgemm(handle, CBlasNoTrans, CBlasTrans,
+                               matrix_extent(0, i, pr, A->p, nb, A->m), jb, kb,
+                               one, X, ldx, matrix_panel(A, true, Y, ldy, j), ldy,
+                               one, matrix_block(A, r, 0, j), A->ld[r], stream));
+    }
+  }
+  else {
+    // A(0:k, 0:k) += A(k, 0:k)^T A(k, 0:k)
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pr, A->p, 0, k, kb, step->G, step->ldg, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pc, A->q, 0, k, kb, step->G, step->ldg, &Y, &ldy, stream));
+
+    for (size_t j = 0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i = matrix_local(J, pr, A->p);
+      if (i < mt && i * (size_t)A->p + (size_t)pr == J) {
+        CU_ERROR_CHECK(cuDsyrk(handle, CBlasLower, CBlasTrans, jb, kb,
+                               1.0, matrix_panel(A, false, X, ldx, i), ldx,
+                               1.0, matrix_block(A, r, i, j), A->ld[r], stream));
+        i++;
+      }
+      if (i < mt)
+        CU_ERROR_CHECK(cuDgemm(handle, CBlasTrans, CBlasNoTrans,
+                               matrix_extent(i, mt, pr, A->p, nb, A->m), jb, kb,
+                               one, matrix_panel(A, false, X, ldx, i), ldx,
+                               matrix_panel(A, false, Y, ldy, j), ldy,
+                               one, matrix_block(A, r, i, j), A->ld[r], stream));
+    }
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Multiplies block column (row) k of a distributed matrix by the transpose of
+ * the diagonal block on the processes holding it.
+ */
+static CUresult dlauumPanel(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  size_t m, n;
+  CUdeviceptr B;
+  if (step->uplo == CBlasUpper) {
+    // A(0:k, k) = A(0:k, k) A(k, k)^T
+    if (k % (size_t)A->q != (size_t)pc)
+      return CUDA_SUCCESS;
+    m = matrix_extent(0, matrix_local(k, pr, A->p), pr, A->p, nb, A->m);
+    n = kb;
+    B = matrix_block(A, r, 0, k / (size_t)A->q);
+  }
+  else {
+    // A(k, 0:k) = A(k, k)^T A(k, 0:k)
+    if (k % (size_t)A->p != (size_t)pr)
+      return CUDA_SUCCESS;
+    m = kb;
+    n = matrix_extent(0, matrix_local(k, pc, A->q), pc, A->q, nb, A->n);
+    B = matrix_block(A, r, k / (size_t)A->p, 0);
+  }
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D;
+  size_t ldd;
+  CU_ERROR_CHECK(matrix_upload(handle, step->D, step->ldd, kb, kb, sizeof(double), &D, &ldd, stream));
+
+  if (step->uplo == CBlasUpper)
+    CU_ERROR_CHECK(matrix_dtrmm(handle, CBlasRight, CBlasUpper, CBlasTrans, CBlasNonUnit, m, n,
+                                one, D, ldd, B, A->ld[r], stream));
+  else
+    CU_ERROR_CHECK(matrix_dtrmm(handle, CBlasLeft, CBlasLower, CBlasTrans, CBlasNonUnit, m, n,
+                                one, D, ldd, B, A->ld[r], stream));
+
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult dlauumStep(const void * args) {
+  CU_ERROR_CHECK(dlauumUpdate(args));
+  CU_ERROR_CHECK(dlauumPanel(args));
+  return CUDA_SUCCESS;
+}
+
+static CUresult dlauumMatrix(CBlasUplo uplo, struct __cumultigpumatrix_st * A,
+                             double * H, long * info) {
+  const size_t n = A->n, nb = A->nb;
+
+  struct matrix_step step = { .A = A, .uplo = uplo, .H = H, .ldh = n, .G = H, .ldg = nb };
+
+  // Each step adds the outer product of its block column (row) to the blocks
+  // before it, which only needs that block column (row) as the blocks after it
+  // have already been added.
+  for (size_t k = 0; k < A->nt; k++) {
+    const size_t kb = min(nb, n - k * nb);
+    step.k = k;
+
+    double * D;
+    if (uplo == CBlasUpper) {
+      CU_ERROR_CHECK(matrix_copy(A, 0, k + 1, k, k + 1, H, n, true));
+      D = &H[k * nb];
+      step.ldd = n;
     }
+    else {
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, 0, k + 1, H, nb, true));
+      D = &H[k * nb * nb];
+      step.ldd = nb;
+    }
+    step.D = D;
+
+    CU_ERROR_CHECK(matrix_run(&step, dlauumStep));
+
+    dlauum(uplo, kb, D, step.ldd, info);
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, step.ldd, false));
   }
 
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPUDlauumMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(double))
+    *info = -3;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  double * H;
+  if ((H = malloc(A->n * A->nb * sizeof(double))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  CUresult result = dlauumMatrix(uplo, A, H, info);
+
+  free(H);
+
+  return result;
+}
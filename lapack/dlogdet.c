@@ -34,6 +34,28 @@ static inline unsigned int nextPow2(unsigned int n) {
   return ++n;
 }
 
+/**
+ * Loads the DLOGDET module and looks up the reduction for each power of two
+ * number of threads up to 512 and whether n is a power of two.  The handle's
+ * context must be current.
+ */
+CUresult dlogdet_load(CULAPACKhandle handle) {
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int t = 0; t < 10; t++) {
+    for (int pow2 = 0; pow2 < 2; pow2++) {
+      char name[31];
+      snprintf(name, 31, "_Z6reduceILj%uELb%dEEvPKdPdii", 1u << t, pow2);
+      CU_ERROR_CHECK(lookup(&handle->dreduce[t][pow2], module, name));
+    }
+  }
+
+  handle->dlogdet = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuDlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n, double * result, CUstream stream) {
   if (n == 0) {
     *result = 0.0;
@@ -41,7 +63,7 @@ CUresult cuDlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
   }
 
   if (handle->dlogdet == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->dlogdet, imageBytes));
+    CU_ERROR_CHECK(dlogdet_load(handle));
 
   unsigned int threads, blocks;
   if (n == 1) {
@@ -54,13 +76,9 @@ CUresult cuDlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
   }
 
   CUdeviceptr temp;
-  CU_ERROR_CHECK(cuMemAlloc(&temp, blocks * sizeof(double)));
-
-  char name[31];
-  snprintf(name, 31, "_Z6reduceILj%uELb%dEEvPKdPdii", threads, (n & (n - 1)) == 0);
+  CU_ERROR_CHECK(cuBLASMemAlloc(handle->blas_handle, &temp, blocks * sizeof(double)));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->dlogdet, name));
+  CUfunction function = handle->dreduce[__builtin_ctz(threads)][(n & (n - 1)) == 0];
 
   void * params[] = { &x, &temp, &incx, &n };
 
@@ -68,7 +86,9 @@ CUresult cuDlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
 
   CU_ERROR_CHECK(cuMemcpyDtoHAsync(result, temp, sizeof(double), stream));
 
-  CU_ERROR_CHECK(cuMemFree(temp));
+  // Wait for the result before temp goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, temp));
 
   return CUDA_SUCCESS;
 }
@@ -2,9 +2,15 @@
 #include "handle.h"
 #include "error.h"
 #include <stdio.h>
-#include "config.h"
+#include <stdlib.h>
 #include "dtrtri.fatbin.c"
 
+/**
+ * Number of threads used by the unblocked kernel (and so the largest matrix it
+ * can work on).
+ */
+#define DTRTI2_BX 32u
+
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
 
 static inline CUresult cuMemcpyHtoD2DAsync(CUdeviceptr A, size_t lda, size_t ai, size_t aj,
@@ -254,7 +260,7 @@ void dtrtri2(CBlasUplo uplo, CBlasDiag diag,
       dtrmm2(CBlasLeft, CBlasUpper, CBlasNoTrans, diag,
              j, jb,
              one, B, ldb, &A[j * lda], lda,
-             &B[j * ldb], lda);
+             &B[j * ldb], ldb);
       dtrsm(CBlasRight, CBlasUpper, CBlasNoTrans, diag,
             j, jb,
             -one, &A[j * lda + j], lda,
@@ -298,23 +304,45 @@ void dtrtri2(CBlasUplo uplo, CBlasDiag diag,
   }
 }
 
+/**
+ * Loads the DTRTRI module and looks up the unblocked kernel for each uplo and
+ * diag.  The handle's context must be current.
+ */
+CUresult dtrtri_load(CULAPACKhandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const CBlasDiag diags[] = { CBlasNonUnit, CBlasUnit };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    for (int d = 0; d < 2; d++) {
+      char name[53];
+      snprintf(name, 53, "_Z6dtrti2IL9CBlasUplo%dEL9CBlasDiag%dELj%uEEvPdPiii", uplos[u], diags[d], DTRTI2_BX);
+      CU_ERROR_CHECK(lookup(&handle->dtrti2[u][d], module, name));
+    }
+  }
+
+  handle->dtrtri = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuDtrti22(CULAPACKhandle handle, CBlasUplo uplo, CBlasDiag diag,
                                 size_t n,
                                 CUdeviceptr A, size_t lda,
                                 CUdeviceptr B, size_t ldb,
                                 CUdeviceptr info, CUstream stream) {
-  const unsigned int bx = 32;
+  const unsigned int bx = DTRTI2_BX;
   if (n > bx)
     return CUDA_ERROR_INVALID_VALUE;
 
   if (handle->dtrtri == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->dtrtri, imageBytes));
-
-  char name[53];
-  snprintf(name, 53, "_Z6dtrti2IL9CBlasUplo%dEL9CBlasDiag%dELj%uEEvPdPiii", uplo, diag, bx);
+    CU_ERROR_CHECK(dtrtri_load(handle));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->dtrtri, name));
+  CUfunction function = handle->dtrti2[(uplo == CBlasUpper) ? 0 : 1][(diag == CBlasNonUnit) ? 0 : 1];
+  if (function == NULL)
+    return CUDA_ERROR_NOT_FOUND;
 
   void * params[] = { &A, &info, &lda, &n };
 
@@ -340,6 +368,7 @@ CUresult cuDtrtri(CULAPACKhandle handle,
     return CUDA_SUCCESS;
 
   double * B;
+  struct packed P;
   CUdeviceptr X;
   size_t ldb, ldx;
   CUstream stream0, stream1;
@@ -353,19 +382,23 @@ CUresult cuDtrtri(CULAPACKhandle handle,
    * between loops when A is lower triangular.
    */
 
-  // Create two streams for asynchronous copy and compute
-  CU_ERROR_CHECK(cuStreamCreate(&stream0, 0));
-  CU_ERROR_CHECK(cuStreamCreate(&stream1, 0));
+  // Borrow two streams for asynchronous copy and compute
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream0, 0));
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream1, 0));
 
   if (uplo == CBlasUpper) {
     // Block size for upper triangular DTRTRI and DLAUUM
-    const size_t nb = DGEMM_N_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuBLASGetBlocking(handle->blas_handle, CBlasDgemmN, &blocking));
+    const size_t nb = blocking.mb;
 
     // Allocate page-locked host memory for diagonal block
-    CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(double)));
+    // Borrow staging memory for the packed triangle of the diagonal block
+    CU_ERROR_CHECK(packed_create(handle, &P, nb, sizeof(double)));
 
     // Allocate temporary column for out of place DTRMM
-    CU_ERROR_CHECK(cuMemAllocPitch(&X, &ldx, n * sizeof(double), nb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &X, &ldx, n * sizeof(double), nb, sizeof(double)));
     ldx /= sizeof(double);
 
     // Loop for DTRTRI
@@ -382,14 +415,11 @@ CUresult cuDtrtri(CULAPACKhandle handle,
       CU_ERROR_CHECK(cuDtrsm(handle->blas_handle, CBlasRight, CBlasUpper, CBlasNoTrans, diag, j, jb,
                              -one, A + (j * lda + j) * sizeof(double), lda, A + j * lda * sizeof(double), lda, stream0));
       /* Overlap both the operations above with a copy of the diagonal block
-       * onto the host.  There is a possibility of overwriting the result of the
-       * previous iteration's block inverse in host memory before it has been
-       * copied back to the GPU if the GPU can do more than one copy at once (CC
-       * 2.x). */
-      CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(B, ldb, 0, 0, A, lda, j, j,
-                                         jb, jb, sizeof(double), stream1));
-      /* Wait until the diagonal block has been copied */
-      CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+       * onto the host.  The previous iteration's block inverse is packed into
+       * a separate staging buffer on its way back to the GPU so it cannot be
+       * overwritten before it has been copied. */
+      CU_ERROR_CHECK(packed_download(handle, &P, CBlasUpper, jb, A + (j * lda + j) * sizeof(double), lda,
+                                     B, ldb, stream1));
       /* Form the inverse of the diagonal block using the CPU */
       dtrtri(CBlasUpper, diag, jb, B, ldb, info);
       /* Check for singular matrix */
@@ -400,19 +430,23 @@ CUresult cuDtrtri(CULAPACKhandle handle,
       /* Copy the diagonal block back onto the device using the same stream as
        * the DTRSM to ensure it is finished reading the diagonal block before
        * the new one is copied */
-      CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, j, j, B, ldb, 0, 0,
-                                         jb, jb, sizeof(double), stream0));
+      CU_ERROR_CHECK(packed_upload(handle, &P, CBlasUpper, jb, B, ldb,
+                                   A + (j * lda + j) * sizeof(double), lda, stream0));
     }
   }
   else {
     // Block size for upper triangular DTRTRI
-    const size_t nb = DGEMM_N_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuBLASGetBlocking(handle->blas_handle, CBlasDgemmN, &blocking));
+    const size_t nb = blocking.mb;
 
     // Allocate page-locked host memory for diagonal block
-    CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(double)));
+    // Borrow staging memory for the packed triangle of the diagonal block
+    CU_ERROR_CHECK(packed_create(handle, &P, nb, sizeof(double)));
 
     // Allocate temporary column for out of place DTRMM in DTRTRI
-    CU_ERROR_CHECK(cuMemAllocPitch(&X, &ldx, n * sizeof(double), nb, sizeof(double)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &X, &ldx, n * sizeof(double), nb, sizeof(double)));
     ldx /= sizeof(double);
 
     // Loop for DTRTRI
@@ -428,20 +462,17 @@ CUresult cuDtrtri(CULAPACKhandle handle,
                               one, A + ((j + jb) * lda + j + jb) * sizeof(double), lda,
                               A + (j * lda + j + jb) * sizeof(double), lda, X, ldx, stream0));
       /* GPU DTRMM is out of place so copy back into place */
-      CU_ERROR_CHECK(cuMemcpyDtoD2DAsync(A, lda, j + jb, j, X, ldx, 0, 0, j, jb, sizeof(double), stream0));
+      CU_ERROR_CHECK(cuMemcpyDtoD2DAsync(A, lda, j + jb, j, X, ldx, 0, 0, n - j - jb, jb, sizeof(double), stream0));
       /* Then update the column again using the small square matrix on the
        * diagonal above (on the same stream) */
       CU_ERROR_CHECK(cuDtrsm(handle->blas_handle, CBlasRight, CBlasLower, CBlasNoTrans, diag, n - j - jb, jb,
                              -one, A + (j * lda + j) * sizeof(double), lda, A + (j * lda + j + jb) * sizeof(double), lda, stream0));
       /* Overlap both the operations above with a copy of the diagonal block
-       * onto the host.  There is a possibility of overwriting the result of the
-       * previous iteration's block inverse in host memory before it has been
-       * copied back to the GPU if the GPU can do more than one copy at once (CC
-       * 2.x). */
-      CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(B, ldb, 0, 0, A, lda, j, j,
-                                         jb, jb, sizeof(double), stream1));
-      /* Wait until the diagonal block has been copied */
-      CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+       * onto the host.  The previous iteration's block inverse is packed into
+       * a separate staging buffer on its way back to the GPU so it cannot be
+       * overwritten before it has been copied. */
+      CU_ERROR_CHECK(packed_download(handle, &P, CBlasLower, jb, A + (j * lda + j) * sizeof(double), lda,
+                                     B, ldb, stream1));
       /* Form the inverse of the diagonal block using the CPU */
       dtrtri(CBlasLower, diag, jb, B, ldb, info);
       /* Check for singular matrix */
@@ -452,17 +483,67 @@ CUresult cuDtrtri(CULAPACKhandle handle,
       /* Copy the diagonal block back onto the device using the same stream as
        * the DTRSM to ensure it is finished reading the diagonal block before
        * the new one is copied */
-      CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, j, j, B, ldb, 0, 0,
-                                         jb, jb, sizeof(double), stream0));
+      CU_ERROR_CHECK(packed_upload(handle, &P, CBlasLower, jb, B, ldb,
+                                   A + (j * lda + j) * sizeof(double), lda, stream0));
     } while (j > 0);
   }
 
+  // Wait for the streams before the temporary memory goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+
   // Clean up resources
-  CU_ERROR_CHECK(cuMemFreeHost(B));
-  CU_ERROR_CHECK(cuMemFree(X));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, B));
+  CU_ERROR_CHECK(packed_destroy(handle, &P));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, X));
 
-  CU_ERROR_CHECK(cuStreamDestroy(stream0));
-  CU_ERROR_CHECK(cuStreamDestroy(stream1));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream0));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream1));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Arguments to the update of a block column of the inverse.
+ */
+struct dtrtri_update_args {
+  CUmultiGPULAPACKhandle handle;
+  CBlasUplo uplo;
+  CBlasDiag diag;
+  size_t j, jb, n;
+  double * A;
+  size_t lda;
+};
+
+/**
+ * Updates block column j of width jb of the inverse.  The block above (upper)
+ * or below (lower) the diagonal block is multiplied by the inverted triangle
+ * before (after) it and by minus the inverted diagonal block.  Runs on the
+ * lookahead thread.
+ */
+static CUresult cuMultiGPUDtrtriUpdate(const void * a) {
+  const struct dtrtri_update_args * args = (const struct dtrtri_update_args *)a;
+  CUmultiGPULAPACKhandle handle = args->handle;
+  const CBlasDiag diag = args->diag;
+  const size_t j = args->j, jb = args->jb, n = args->n, lda = args->lda;
+  double * A = args->A;
+
+  if (args->uplo == CBlasUpper) {
+    CU_ERROR_CHECK(cuMultiGPUDtrmm(handle->blas_handle, CBlasLeft, CBlasUpper, CBlasNoTrans, diag,
+                                   j, jb, one, A, lda, &A[j * lda], lda));
+    CU_ERROR_CHECK(cuMultiGPUDtrmm(handle->blas_handle, CBlasRight, CBlasUpper, CBlasNoTrans, diag,
+                                   j, jb, -one, &A[j * lda + j], lda, &A[j * lda], lda));
+  }
+  else if (j + jb < n) {
+    CU_ERROR_CHECK(cuMultiGPUDtrmm(handle->blas_handle, CBlasLeft, CBlasLower, CBlasNoTrans, diag,
+                                   n - j - jb, jb,
+                                   one, &A[(j + jb) * lda + j + jb], lda,
+                                   &A[j * lda + j + jb], lda));
+    CU_ERROR_CHECK(cuMultiGPUDtrmm(handle->blas_handle, CBlasRight, CBlasLower, CBlasNoTrans, diag,
+                                   n - j - jb, jb,
+                                   -one, &A[j * lda + j], lda,
+                                   &A[j * lda + j + jb], lda));
+  }
 
   return CUDA_SUCCESS;
 }
@@ -483,48 +564,272 @@ CUresult cuMultiGPUDtrtri(CUmultiGPULAPACKhandle handle,
   if (n == 0)
     return CUDA_SUCCESS;
 
-  if (uplo == CBlasUpper) {
-    const size_t nb = DGEMM_N_MB;
+  // Any copies of A cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(double)));
+
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, CBlasDgemmN, &blocking));
+  const size_t nb = blocking.mb;
 
+  // Each diagonal block is inverted on the host one step ahead while the
+  // devices update the block column before it.  Block columns are multiplied
+  // by their inverted diagonal blocks instead of solved with the original ones
+  // so that the inversion does not have to wait for the update.
+  if (uplo == CBlasUpper) {
     // Upper triangular DTRTRI
+    dtrtri(CBlasUpper, diag, min(nb, n), A, lda, info);
+    if (*info != 0)
+      return CUDA_ERROR_INVALID_VALUE;
+
     for (size_t j = 0; j < n; j += nb) {
       const size_t jb = min(nb, n - j);
-      CU_ERROR_CHECK(cuMultiGPUDtrmm(handle->blas_handle, CBlasLeft, CBlasUpper, CBlasNoTrans, diag,
-                                     j, jb, one, A, lda, &A[j * lda], lda));
-      CU_ERROR_CHECK(cuMultiGPUDtrsm(handle->blas_handle, CBlasRight, CBlasUpper, CBlasNoTrans, diag,
-                                     j, jb, -one, &A[j * lda + j], lda, &A[j * lda], lda));
-      dtrtri(CBlasUpper, diag, jb, &A[j * lda + j], lda, info);
+      const size_t k = j + jb;
+
+      const struct dtrtri_update_args args = { handle, CBlasUpper, diag, j, jb, n, A, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUDtrtriUpdate, &args));
+      if (k < n)
+        dtrtri(CBlasUpper, diag, min(nb, n - k), &A[k * lda + k], lda, info);
+      CU_ERROR_CHECK(lookahead_wait(&update));
       if (*info != 0) {
-        *info += (long)j;
+        *info += (long)k;
+        CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(double)));
         return CUDA_ERROR_INVALID_VALUE;
       }
     }
   }
   else {
     // Lower triangular DTRTRI
-    const size_t nb = DGEMM_N_MB;
     const size_t r = n % nb;
-    size_t j = (r == 0) ? n : n + nb - r;
-    do {
-      j -= nb;
+    size_t j = (r == 0) ? n - nb : n - r;
+    dtrtri(CBlasLower, diag, n - j, &A[j * lda + j], lda, info);
+    if (*info != 0) {
+      *info += (long)j;
+      return CUDA_ERROR_INVALID_VALUE;
+    }
+
+    while (true) {
       const size_t jb = min(nb, n - j);
-      if (j + jb < n) {
-        CU_ERROR_CHECK(cuMultiGPUDtrmm(handle->blas_handle, CBlasLeft, CBlasLower, CBlasNoTrans, diag,
-                                       n - j - jb, jb,
-                                       one, &A[(j + jb) * lda + j + jb], lda,
-                                       &A[j * lda + j + jb], lda));
-        CU_ERROR_CHECK(cuMultiGPUDtrsm(handle->blas_handle, CBlasRight, CBlasLower, CBlasNoTrans, diag,
-                                       n - j - jb, jb,
-                                       -one, &A[j * lda + j], lda,
-                                       &A[j * lda + j + jb], lda));
-      }
-      dtrtri(CBlasLower, diag, jb, &A[j * lda + j], lda, info);
+
+      const struct dtrtri_update_args args = { handle, CBlasLower, diag, j, jb, n, A, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUDtrtriUpdate, &args));
+      if (j > 0)
+        dtrtri(CBlasLower, diag, nb, &A[(j - nb) * lda + j - nb], lda, info);
+      CU_ERROR_CHECK(lookahead_wait(&update));
       if (*info != 0) {
-        *info += (long)j;
+        *info += (long)(j - nb);
+        CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(double)));
         return CUDA_ERROR_INVALID_VALUE;
       }
-    } while (j > 0);
+
+      if (j == 0)
+        break;
+      j -= nb;
+    }
   }
 
+  // Blocks of A were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(double)));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Multiplies a block of a distributed matrix in place by a triangular matrix.
+ */
+static inline CUresult matrix_dtrmm(CUBLAShandle handle, CBlasSide side, CBlasUplo uplo,
+                                    CBlasTranspose trans, CBlasDiag diag, size_t m, size_t n,
+                                    double alpha, CUdeviceptr A, size_t lda,
+                                    CUdeviceptr B, size_t ldb, CUstream stream) {
+  CUdeviceptr T;
+  size_t ldt;
+  CU_ERROR_CHECK(matrix_duplicate(handle, B, ldb, m, n, sizeof(double), &T, &ldt, stream));
+  CU_ERROR_CHECK(cuDtrmm2(handle, side, uplo, trans, diag, m, n, alpha, A, lda, T, ldt, B, ldb, stream));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, T));
   return CUDA_SUCCESS;
 }
+
+/**
+ * Multiplies block row and block column k of a distributed matrix by the
+ * inverted diagonal block on the processes holding them.
+ */
+static CUresult dtrtriPanel(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  const bool row = (k % (size_t)A->p == (size_t)pr), column = (k % (size_t)A->q == (size_t)pc);
+  if (!row && !column)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D;
+  size_t ldd;
+  CU_ERROR_CHECK(matrix_upload(handle, step->D, step->ldd, kb, kb, sizeof(double), &D, &ldd, stream));
+
+  if (step->uplo == CBlasUpper) {
+    // A(0:k, k) = A(0:k, k) inv(A(k, k))
+    const size_t m = matrix_extent(0, matrix_local(k, pr, A->p), pr, A->p, nb, A->m);
+    if (column && m > 0)
+      CU_ERROR_CHECK(matrix_dtrmm(handle, CBlasRight, CBlasUpper, CBlasNoTrans, step->diag, m, kb,
+                                  one, D, ldd, matrix_block(A, r, 0, k / (size_t)A->q), A->ld[r], stream));
+
+    // A(k, k+1:n) = -inv(A(k, k)) A(k, k+1:n)
+    const size_t j = matrix_local(k + 1, pc, A->q);
+    const size_t n = matrix_extent(j, matrix_local(A->nt, pc, A->q), pc, A->q, nb, A->n);
+    if (row && n > 0)
+      CU_ERROR_CHECK(matrix_dtrmm(handle, CBlasLeft, CBlasUpper, CBlasNoTrans, step->diag, kb, n,
+                                  -one, D, ldd, matrix_block(A, r, k / (size_t)A->p, j), A->ld[r], stream));
+  }
+  else {
+    // A(k, 0:k) = inv(A(k, k)) A(k, 0:k)
+    const size_t n = matrix_extent(0, matrix_local(k, pc, A->q), pc, A->q, nb, A->n);
+    if (row && n > 0)
+      CU_ERROR_CHECK(matrix_dtrmm(handle, CBlasLeft, CBlasLower, CBlasNoTrans, step->diag, kb, n,
+                                  one, D, ldd, matrix_block(A, r, k / (size_t)A->p, 0), A->ld[r], stream));
+
+    // A(k+1:n, k) = -A(k+1:n, k) inv(A(k, k))
+    const size_t i = matrix_local(k + 1, pr, A->p);
+    const size_t m = matrix_extent(i, matrix_local(A->mt, pr, A->p), pr, A->p, nb, A->m);
+    if (column && m > 0)
+      CU_ERROR_CHECK(matrix_dtrmm(handle, CBlasRight, CBlasLower, CBlasNoTrans, step->diag, m, kb,
+                                  -one, D, ldd, matrix_block(A, r, i, k / (size_t)A->q), A->ld[r], stream));
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Updates the blocks held by a process that are off block row and column k
+ * with the multiplied block column and the original block row (or the other
+ * way round for lower triangular matrices).
+ */
+static CUresult dtrtriUpdate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  // A(0:k, k+1:n) -= A(0:k, k) A(k, k+1:n) or A(k+1:n, 0:k) -= A(k+1:n, k) A(k, 0:k)
+  size_t i0, i1, j0, j1, I0, I1, J0, J1;
+  if (step->uplo == CBlasUpper) {
+    I0 = 0; I1 = k;
+    J0 = k + 1; J1 = A->nt;
+  }
+  else {
+    I0 = k + 1; I1 = A->mt;
+    J0 = 0; J1 = k;
+  }
+  i0 = matrix_local(I0, pr, A->p);
+  i1 = matrix_local(I1, pr, A->p);
+  j0 = matrix_local(J0, pc, A->q);
+  j1 = matrix_local(J1, pc, A->q);
+
+  const size_t m = matrix_extent(i0, i1, pr, A->p, nb, A->m);
+  const size_t n = matrix_extent(j0, j1, pc, A->q, nb, A->n);
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr X, Y;
+  size_t ldx, ldy;
+  CU_ERROR_CHECK(matrix_stage(A, handle, true, pr, A->p, I0, I1, kb, step->H, step->ldh, &X, &ldx, stream));
+  CU_ERROR_CHECK(matrix_stage(A, handle, false, pc, A->q, J0, J1, kb, step->G, step->ldg, &Y, &ldy, stream));
+
+  CU_ERROR_CHECK(cuDgemm(handle, CBlasNoTrans, CBlasNoTrans, m, n, kb,
+                         -one, matrix_panel(A, true, X, ldx, i0), ldx,
+                         matrix_panel(A, false, Y, ldy, j0), ldy,
+                         one, matrix_block(A, r, i0, j0), A->ld[r], stream));
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult dtrtriMatrix(CBlasUplo uplo, CBlasDiag diag, struct __cumultigpumatrix_st * A,
+                             double * D, double * H, double * G, long * info) {
+  const size_t n = A->n, nb = A->nb;
+
+  struct matrix_step step = { .A = A, .uplo = uplo, .diag = diag, .D = D, .ldd = nb,
+                              .H = H, .ldh = n, .G = G, .ldg = nb };
+
+  // The inverse is built a block row (column) at a time by Gauss-Jordan
+  // elimination in place: each step only needs its diagonal block, its block
+  // row and its block column.
+  for (size_t k = 0; k < A->nt; k++) {
+    const size_t kb = min(nb, n - k * nb);
+    step.k = k;
+
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, nb, true));
+    dtrtri(uplo, diag, kb, D, nb, info);
+    if (*info != 0) {
+      (*info) += (long)(k * nb);
+      return CUDA_ERROR_INVALID_VALUE;
+    }
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, nb, false));
+
+    // The update needs block row (column) k before it is multiplied and block
+    // column (row) k after
+    if (uplo == CBlasUpper) {
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k + 1, A->nt, &G[(k + 1) * nb * nb], nb, true));
+      CU_ERROR_CHECK(matrix_run(&step, dtrtriPanel));
+      CU_ERROR_CHECK(matrix_copy(A, 0, k, k, k + 1, H, n, true));
+    }
+    else {
+      CU_ERROR_CHECK(matrix_copy(A, k + 1, A->mt, k, k + 1, &H[(k + 1) * nb], n, true));
+      CU_ERROR_CHECK(matrix_run(&step, dtrtriPanel));
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, 0, k, G, nb, true));
+    }
+    CU_ERROR_CHECK(matrix_run(&step, dtrtriUpdate));
+  }
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPUDtrtriMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo, CBlasDiag diag,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(double))
+    *info = -4;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  double * D = malloc(A->nb * A->nb * sizeof(double));
+  double * H = malloc(A->n * A->nb * sizeof(double));
+  double * G = malloc(A->nb * A->n * sizeof(double));
+  if (D == NULL || H == NULL || G == NULL) {
+    free(D);
+    free(H);
+    free(G);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+
+  CUresult result = dtrtriMatrix(uplo, diag, A, D, H, G, info);
+
+  free(D);
+  free(H);
+  free(G);
+
+  return result;
+}
@@ -0,0 +1,133 @@
+#include "lapack.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Host implementations of the LAPACK kernels for the emulated driver API
+ * (make EMULATION=1).  See blas/emulation.c.  Only the kernels launched by the
+ * library are implemented: the unblocked potf2, lauu2 and trti2 kernels are
+ * not used by the blocked routines so their modules are empty and
+ * cuModuleGetFunction returns CUDA_ERROR_NOT_FOUND for them.
+ */
+
+static inline void * pointer(void ** params, int i) {
+  CUdeviceptr ptr;
+  memcpy(&ptr, params[i], sizeof(CUdeviceptr));
+  return (void *)(uintptr_t)ptr;
+}
+
+static inline size_t integer(void ** params, int i) {
+  int n;
+  memcpy(&n, params[i], sizeof(int));
+  return (size_t)n;
+}
+
+/*
+ * reduce(x, temp, incx, n) writes 2 * sum(log(x)) to temp[0].  The sum is
+ * pairwise like the tree reduction on the GPU rather than the running sum used
+ * by the host [sdcz]logdet, which loses too much precision for the tests.
+ */
+static float slogsum(const float * x, size_t incx, size_t n) {
+  if (n <= 8) {
+    float total = 0.0f;
+    for (size_t i = 0; i < n; i++)
+      total += logf(x[i * incx]);
+    return total;
+  }
+  return slogsum(x, incx, n / 2) + slogsum(x + (n / 2) * incx, incx, n - n / 2);
+}
+
+static double dlogsum(const double * x, size_t incx, size_t n) {
+  if (n <= 8) {
+    double total = 0.0;
+    for (size_t i = 0; i < n; i++)
+      total += log(x[i * incx]);
+    return total;
+  }
+  return dlogsum(x, incx, n / 2) + dlogsum(x + (n / 2) * incx, incx, n - n / 2);
+}
+
+// The diagonal of a Cholesky factor is real so the complex versions read the
+// real parts by doubling the stride
+static void sreduce_kernel(const char * name, const int * args, void ** params) {
+  (void)name; (void)args;
+  float * temp = pointer(params, 1);
+  temp[0] = 2.0f * slogsum(pointer(params, 0), integer(params, 2), integer(params, 3));
+}
+
+static void dreduce_kernel(const char * name, const int * args, void ** params) {
+  (void)name; (void)args;
+  double * temp = pointer(params, 1);
+  temp[0] = 2.0 * dlogsum(pointer(params, 0), integer(params, 2), integer(params, 3));
+}
+
+static void creduce_kernel(const char * name, const int * args, void ** params) {
+  (void)name; (void)args;
+  float * temp = pointer(params, 1);
+  temp[0] = 2.0f * slogsum(pointer(params, 0), 2 * integer(params, 2), integer(params, 3));
+}
+
+static void zreduce_kernel(const char * name, const int * args, void ** params) {
+  (void)name; (void)args;
+  double * temp = pointer(params, 1);
+  temp[0] = 2.0 * dlogsum(pointer(params, 0), 2 * integer(params, 2), integer(params, 3));
+}
+
+/*
+ * trttp(A, AP, lda, n) and tpttr(AP, A, lda, n) move elements of w 32-bit
+ * words, which is the size of one of the precisions.
+ */
+static void trttp_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const CBlasUplo uplo = (CBlasUplo)args[0];
+  const size_t lda = integer(params, 2), n = integer(params, 3);
+  long info;
+  if (args[1] == 1)
+    strttp(uplo, n, pointer(params, 0), lda, pointer(params, 1), &info);
+  else if (args[1] == 2)
+    dtrttp(uplo, n, pointer(params, 0), lda, pointer(params, 1), &info);
+  else
+    ztrttp(uplo, n, pointer(params, 0), lda, pointer(params, 1), &info);
+}
+
+static void tpttr_kernel(const char * name, const int * args, void ** params) {
+  (void)name;
+  const CBlasUplo uplo = (CBlasUplo)args[0];
+  const size_t lda = integer(params, 2), n = integer(params, 3);
+  long info;
+  if (args[1] == 1)
+    stpttr(uplo, n, pointer(params, 0), pointer(params, 1), lda, &info);
+  else if (args[1] == 2)
+    dtpttr(uplo, n, pointer(params, 0), pointer(params, 1), lda, &info);
+  else
+    ztpttr(uplo, n, pointer(params, 0), pointer(params, 1), lda, &info);
+}
+
+// Parameter sizes
+#define PTR sizeof(CUdeviceptr)
+#define INT sizeof(int)
+
+const CUemukernel slogdet_emulation[] = { { "reduce", sreduce_kernel, 4, { PTR, PTR, INT, INT } }, { NULL } };
+const CUemukernel dlogdet_emulation[] = { { "reduce", dreduce_kernel, 4, { PTR, PTR, INT, INT } }, { NULL } };
+const CUemukernel clogdet_emulation[] = { { "reduce", creduce_kernel, 4, { PTR, PTR, INT, INT } }, { NULL } };
+const CUemukernel zlogdet_emulation[] = { { "reduce", zreduce_kernel, 4, { PTR, PTR, INT, INT } }, { NULL } };
+
+const CUemukernel packed_emulation[] = { { "trttp", trttp_kernel, 4, { PTR, PTR, INT, INT } },
+                                         { "tpttr", tpttr_kernel, 4, { PTR, PTR, INT, INT } }, { NULL } };
+
+const CUemukernel spotrf_emulation[] = { { NULL } };
+const CUemukernel slauum_emulation[] = { { NULL } };
+const CUemukernel strtri_emulation[] = { { NULL } };
+
+const CUemukernel dpotrf_emulation[] = { { NULL } };
+const CUemukernel dlauum_emulation[] = { { NULL } };
+const CUemukernel dtrtri_emulation[] = { { NULL } };
+
+const CUemukernel cpotrf_emulation[] = { { NULL } };
+const CUemukernel clauum_emulation[] = { { NULL } };
+const CUemukernel ctrtri_emulation[] = { { NULL } };
+
+const CUemukernel zpotrf_emulation[] = { { NULL } };
+const CUemukernel zlauum_emulation[] = { { NULL } };
+const CUemukernel ztrtri_emulation[] = { { NULL } };
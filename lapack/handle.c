@@ -26,6 +26,8 @@ static inline CUresult culapackhandle_init(struct __culapackhandle_st * handle)
   handle->zlauum = NULL;
   handle->zlogdet = NULL;
 
+  handle->packed = NULL;
+
   return CUDA_SUCCESS;
 }
 
@@ -68,6 +70,9 @@ static inline CUresult culapackhandle_cleanup(struct __culapackhandle_st * handl
   if (handle->zlogdet != NULL)
     CU_ERROR_CHECK(cuModuleUnload(handle->zlogdet));
 
+  if (handle->packed != NULL)
+    CU_ERROR_CHECK(cuModuleUnload(handle->packed));
+
   CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
   CU_ERROR_CHECK(cuBLASDestroy(handle->blas_handle));
 
@@ -87,6 +92,66 @@ CUresult cuLAPACKDestroy(CULAPACKhandle handle) {
   return CUDA_SUCCESS;
 }
 
+CUresult cuLAPACKPreload(CULAPACKhandle handle) {
+  CU_ERROR_CHECK(cuBLASPreload(handle->blas_handle));
+
+  CU_ERROR_CHECK(cuCtxPushCurrent(handle->context));
+
+  if (handle->spotrf == NULL)
+    CU_ERROR_CHECK(spotrf_load(handle));
+  if (handle->strtri == NULL)
+    CU_ERROR_CHECK(strtri_load(handle));
+  if (handle->slauum == NULL)
+    CU_ERROR_CHECK(slauum_load(handle));
+  if (handle->slogdet == NULL)
+    CU_ERROR_CHECK(slogdet_load(handle));
+
+  if (handle->cpotrf == NULL)
+    CU_ERROR_CHECK(cpotrf_load(handle));
+  if (handle->ctrtri == NULL)
+    CU_ERROR_CHECK(ctrtri_load(handle));
+  if (handle->clauum == NULL)
+    CU_ERROR_CHECK(clauum_load(handle));
+  if (handle->clogdet == NULL)
+    CU_ERROR_CHECK(clogdet_load(handle));
+
+  if (handle->dpotrf == NULL)
+    CU_ERROR_CHECK(dpotrf_load(handle));
+  if (handle->dtrtri == NULL)
+    CU_ERROR_CHECK(dtrtri_load(handle));
+  if (handle->dlauum == NULL)
+    CU_ERROR_CHECK(dlauum_load(handle));
+  if (handle->dlogdet == NULL)
+    CU_ERROR_CHECK(dlogdet_load(handle));
+
+  if (handle->zpotrf == NULL)
+    CU_ERROR_CHECK(zpotrf_load(handle));
+  if (handle->ztrtri == NULL)
+    CU_ERROR_CHECK(ztrtri_load(handle));
+  if (handle->zlauum == NULL)
+    CU_ERROR_CHECK(zlauum_load(handle));
+  if (handle->zlogdet == NULL)
+    CU_ERROR_CHECK(zlogdet_load(handle));
+
+  if (handle->packed == NULL)
+    CU_ERROR_CHECK(packed_load(handle));
+
+  CU_ERROR_CHECK(cuCtxPopCurrent(&handle->context));
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuLAPACKMemTrim(CULAPACKhandle handle) {
+  CU_ERROR_CHECK(cuBLASMemTrim(handle->blas_handle));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuLAPACKMemGetInfo(CULAPACKhandle handle, size_t * borrowed, size_t * cached,
+                            size_t * highWater) {
+  CU_ERROR_CHECK(cuBLASMemGetInfo(handle->blas_handle, borrowed, cached, highWater));
+  return CUDA_SUCCESS;
+}
+
 CUresult cuMultiGPULAPACKCreate(CUmultiGPULAPACKhandle * handle, CUmultiGPU mGPU) {
   if ((*handle = malloc(sizeof(struct __cumultigpulapackhandle_st))) == NULL)
     return CUDA_ERROR_OUT_OF_MEMORY;
@@ -106,3 +171,36 @@ CUresult cuMultiGPULAPACKSynchronize(CUmultiGPULAPACKhandle handle) {
   CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle->blas_handle));
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPULAPACKPreload(CUmultiGPULAPACKhandle handle) {
+  CU_ERROR_CHECK(cuMultiGPUBLASPreload(handle->blas_handle));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPULAPACKMemTrim(CUmultiGPULAPACKhandle handle) {
+  CU_ERROR_CHECK(cuMultiGPUBLASMemTrim(handle->blas_handle));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPULAPACKMemGetInfo(CUmultiGPULAPACKhandle handle, size_t * borrowed,
+                                    size_t * cached, size_t * highWater) {
+  CU_ERROR_CHECK(cuMultiGPUBLASMemGetInfo(handle->blas_handle, borrowed, cached, highWater));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPULAPACKSetTileCache(CUmultiGPULAPACKhandle handle, size_t bytes) {
+  CU_ERROR_CHECK(cuMultiGPUBLASSetTileCache(handle->blas_handle, bytes));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPULAPACKInvalidate(CUmultiGPULAPACKhandle handle, const void * ptr, size_t ld,
+                                    size_t m, size_t n, size_t elemSize) {
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, ptr, ld, m, n, elemSize));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPULAPACKTileCacheGetInfo(CUmultiGPULAPACKhandle handle, size_t * hits,
+                                          size_t * misses, size_t * bytes) {
+  CU_ERROR_CHECK(cuMultiGPUBLASTileCacheGetInfo(handle->blas_handle, hits, misses, bytes));
+  return CUDA_SUCCESS;
+}
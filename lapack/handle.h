@@ -1,6 +1,8 @@
 #ifndef HANDLE_H
 #define HANDLE_H
 
+#include <pthread.h>
+
 struct __culapackhandle_st {
   CUBLAShandle blas_handle;
   CUcontext context;
@@ -9,10 +11,231 @@ struct __culapackhandle_st {
   CUmodule dpotrf, dtrtri, dlauum;
   CUmodule zpotrf, ztrtri, zlauum;
   CUmodule slogdet, clogdet, dlogdet, zlogdet;
+  CUmodule packed;
+  // Kernels in each module indexed by [uplo] or [uplo][diag] and by
+  // [log2(threads)][n is a power of two] for the reductions.  Filled in when the
+  // module is loaded.
+  CUfunction spotf2[2], strti2[2][2], slauu2[2], sreduce[10][2];
+  CUfunction cpotf2[2], ctrti2[2][2], clauu2[2], creduce[10][2];
+  CUfunction dpotf2[2], dtrti2[2][2], dlauu2[2], dreduce[10][2];
+  CUfunction zpotf2[2], ztrti2[2][2], zlauu2[2], zreduce[10][2];
+  // Packing kernels indexed by [uplo][log2(element size / 4)]
+  CUfunction trttp[2][3], tpttr[2][3];
+};
+
+/**
+ * Staging memory for copying the triangle of a diagonal block between host and
+ * device memory in packed storage, which moves about half the bytes of the
+ * square block.  Downloads and uploads have their own buffers so that an
+ * upload still in flight is not overwritten by the next download.
+ */
+struct packed {
+  size_t elemSize;
+  void * download, * upload;    /** Page-locked packed triangles */
+  CUdeviceptr scratch[2];       /** Packed triangles on the device (download, upload) */
+  CUevent uploaded;             /** The last upload has finished with its buffers */
 };
 
+/**
+ * Borrows staging memory for packed copies of triangles of up to n by n
+ * elements (of 4, 8 or 16 bytes) from the pools of a handle.  The handle's
+ * context must be current.
+ */
+CUresult packed_create(CULAPACKhandle, struct packed *, size_t, size_t);
+
+/**
+ * Gives the staging memory back to the pools once the last upload is done.
+ */
+CUresult packed_destroy(CULAPACKhandle, struct packed *);
+
+/**
+ * Copies the uplo triangle of an n by n block of device memory into host
+ * memory, packing it on the device.  Waits for the copy to finish.  The other
+ * triangle of the host block is not referenced.
+ */
+CUresult packed_download(CULAPACKhandle, struct packed *, CBlasUplo, size_t,
+                         CUdeviceptr, size_t, void *, size_t, CUstream);
+
+/**
+ * Copies the uplo triangle of an n by n block of host memory into device
+ * memory asynchronously, unpacking it on the device.  The host block may be
+ * reused as soon as this returns.  The other triangle of the device block is
+ * not referenced.
+ */
+CUresult packed_upload(CULAPACKhandle, struct packed *, CBlasUplo, size_t,
+                       const void *, size_t, CUdeviceptr, size_t, CUstream);
+
 struct __cumultigpulapackhandle_st {
   CUmultiGPUBLAShandle blas_handle;
 };
 
+/**
+ * Matrix distributed over the devices of a multiGPU handle.  Block (i, j) of
+ * size nb by nb belongs to process (i mod p) + (j mod q) p of a p by q grid and
+ * is kept at local block (i / p, j / q) in that process's memory.
+ */
+struct __cumultigpumatrix_st {
+  CUmultiGPULAPACKhandle handle;
+  size_t m, n, nb, elemSize;
+  size_t mt, nt;                /** Number of block rows and columns */
+  int p, q;                     /** Rows and columns in the grid of processes */
+  int * contexts;               /** Context each process runs on */
+  CUBLAShandle * handles;       /** Handle each process uses on its context */
+  CUdeviceptr * ptr;            /** Local blocks of each process */
+  size_t * ld;                  /** Leading dimension of each process's local blocks */
+};
+
+/**
+ * Number of blocks before block i that belong to grid row (column) r of p.
+ * This is also the local index of the first block at or after block i.
+ */
+static inline size_t matrix_local(size_t i, int r, int p) {
+  return (i + (size_t)(p - 1 - r)) / (size_t)p;
+}
+
+/**
+ * Number of rows (columns) in the local blocks a to b of grid row (column) r
+ * of p, where the matrix has n rows (columns).  Only the last block of the
+ * matrix may be short.
+ */
+static inline size_t matrix_extent(size_t a, size_t b, int r, int p, size_t nb, size_t n) {
+  if (b <= a)
+    return 0;
+  size_t extent = (b - a) * nb;
+  const size_t last = (n - 1) / nb;
+  if (last % (size_t)p == (size_t)r && last / (size_t)p >= a && last / (size_t)p < b)
+    extent -= nb - (n - last * nb);
+  return extent;
+}
+
+/**
+ * Gets the address of local block (i, j) of process r.
+ */
+static inline CUdeviceptr matrix_block(const struct __cumultigpumatrix_st * A, int r, size_t i, size_t j) {
+  return A->ptr[r] + (j * A->nb * A->ld[r] + i * A->nb) * A->elemSize;
+}
+
+/**
+ * Gets the address of local block l of a panel staged by matrix_stage.
+ */
+static inline CUdeviceptr matrix_panel(const struct __cumultigpumatrix_st * A, bool rows,
+                                       CUdeviceptr W, size_t ldw, size_t l) {
+  return W + (rows ? l * A->nb : l * A->nb * ldw) * A->elemSize;
+}
+
+/**
+ * Arguments to the tasks run on every process for each step of the
+ * factorisations of a distributed matrix.  The diagonal block and the panels
+ * of the step are passed in host memory.
+ */
+struct matrix_step {
+  struct __cumultigpumatrix_st * A;
+  int r;                        /** Process running the task */
+  CBlasUplo uplo;
+  CBlasDiag diag;
+  size_t k;                     /** Block row and column of the step */
+  const void * D;               /** Diagonal block */
+  const void * H;               /** Block column (as blocks of rows) */
+  const void * G;               /** Block row (as blocks of columns) */
+  size_t ldd, ldh, ldg;
+};
+
+/**
+ * Copies blocks i0 to i1 of block columns j0 to j1 between a distributed
+ * matrix and host memory, one task for each process holding any of them.
+ */
+CUresult matrix_copy(const struct __cumultigpumatrix_st *, size_t, size_t, size_t, size_t,
+                     void *, size_t, bool);
+
+/**
+ * Runs a task on every process for a step and waits for them.
+ */
+CUresult matrix_run(struct matrix_step *, CUresult (*)(const void *));
+
+/**
+ * Copies the blocks of a panel held in host memory that belong to grid row
+ * (column) r of p into device memory allocated from the pool of handle, laid
+ * out like the local blocks of the process so that they line up with them.
+ * Only blocks first to last are copied.  Blocks are stacked as rows of H when
+ * rows is true and as columns otherwise.
+ */
+CUresult matrix_stage(const struct __cumultigpumatrix_st *, CUBLAShandle, bool, int, int,
+                      size_t, size_t, size_t, const void *, size_t,
+                      CUdeviceptr *, size_t *, CUstream);
+
+/**
+ * Copies an m by n block of host memory into device memory allocated from the
+ * pool of handle.
+ */
+CUresult matrix_upload(CUBLAShandle, const void *, size_t, size_t, size_t, size_t,
+                       CUdeviceptr *, size_t *, CUstream);
+
+/**
+ * Copies an m by n block of device memory into device memory allocated from the
+ * pool of handle.  The triangular matrix multiplies on the device are out of
+ * place so blocks multiplied in place are copied first.
+ */
+CUresult matrix_duplicate(CUBLAShandle, CUdeviceptr, size_t, size_t, size_t, size_t,
+                          CUdeviceptr *, size_t *, CUstream);
+
+/**
+ * Thread that runs the device update of a step of the multiGPU factorisations
+ * while the calling thread works on the next diagonal block on the host.  The
+ * host routines are not called inside a parallel region so they keep all of
+ * the OpenMP threads.  The update is not a task as the multiGPU BLAS it calls
+ * wait for tasks on the contexts themselves.
+ */
+struct lookahead {
+  pthread_t thread;
+  CUresult (*function)(const void *);
+  const void * args;
+  CUresult result;              /** Result of the update */
+};
+
+/**
+ * Starts running an update on a new thread.
+ */
+CUresult lookahead_start(struct lookahead *, CUresult (*)(const void *), const void *);
+
+/**
+ * Waits for an update to finish and returns its result.
+ */
+CUresult lookahead_wait(struct lookahead *);
+
+/**
+ * Looks up a kernel for a handle's kernel table.  Kernels missing from the
+ * module are left NULL so that only launching them fails (the emulated modules
+ * leave out the unblocked kernels as the blocked routines do not launch them).
+ */
+static inline CUresult lookup(CUfunction * function, CUmodule module, const char * name) {
+  CUresult error = cuModuleGetFunction(function, module, name);
+  if (error == CUDA_ERROR_NOT_FOUND) {
+    *function = NULL;
+    return CUDA_SUCCESS;
+  }
+  return error;
+}
+
+/**
+ * Loads a module and fills in its kernel table.  The handle's context must be
+ * current.
+ */
+CUresult spotrf_load(CULAPACKhandle);
+CUresult strtri_load(CULAPACKhandle);
+CUresult slauum_load(CULAPACKhandle);
+CUresult slogdet_load(CULAPACKhandle);
+CUresult cpotrf_load(CULAPACKhandle);
+CUresult ctrtri_load(CULAPACKhandle);
+CUresult clauum_load(CULAPACKhandle);
+CUresult clogdet_load(CULAPACKhandle);
+CUresult dpotrf_load(CULAPACKhandle);
+CUresult dtrtri_load(CULAPACKhandle);
+CUresult dlauum_load(CULAPACKhandle);
+CUresult dlogdet_load(CULAPACKhandle);
+CUresult zpotrf_load(CULAPACKhandle);
+CUresult ztrtri_load(CULAPACKhandle);
+CUresult zlauum_load(CULAPACKhandle);
+CUresult zlogdet_load(CULAPACKhandle);
+CUresult packed_load(CULAPACKhandle);
+
 #endif
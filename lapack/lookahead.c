@@ -0,0 +1,23 @@
+#include "lapack.h"
+#include "handle.h"
+#include "error.h"
+
+static void * run(void * args) {
+  struct lookahead * update = (struct lookahead *)args;
+  update->result = update->function(update->args);
+  return NULL;
+}
+
+CUresult lookahead_start(struct lookahead * update, CUresult (*function)(const void *),
+                         const void * args) {
+  update->function = function;
+  update->args = args;
+  update->result = CUDA_SUCCESS;
+  ERROR_CHECK(pthread_create(&update->thread, NULL, run, update));
+  return CUDA_SUCCESS;
+}
+
+CUresult lookahead_wait(struct lookahead * update) {
+  ERROR_CHECK(pthread_join(update->thread, NULL));
+  return update->result;
+}
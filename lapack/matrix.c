@@ -0,0 +1,298 @@
+#include "lapack.h"
+#include "handle.h"
+#include "error.h"
+#include <stdlib.h>
+
+static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
+
+static CUresult allocate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r;
+
+  const size_t rows = matrix_local(A->mt, r % A->p, A->p) * A->nb;
+  const size_t cols = matrix_local(A->nt, r / A->p, A->q) * A->nb;
+  if (rows == 0 || cols == 0)
+    return CUDA_SUCCESS;
+
+  size_t pitch;
+  CU_ERROR_CHECK(cuBLASMemAllocPitch(A->handles[r], &A->ptr[r], &pitch,
+                                     rows * A->elemSize, cols, (unsigned int)A->elemSize));
+  A->ld[r] = pitch / A->elemSize;
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult deallocate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r;
+
+  if (A->ptr[r] != 0)
+    CU_ERROR_CHECK(cuBLASMemFree(A->handles[r], A->ptr[r]));
+  A->ptr[r] = 0;
+
+  return CUDA_SUCCESS;
+}
+
+static void matrix_free(struct __cumultigpumatrix_st * A) {
+  free(A->contexts);
+  free(A->handles);
+  free(A->ptr);
+  free(A->ld);
+  free(A);
+}
+
+CUresult cuMultiGPUMatrixCreate(CUmultiGPUMatrix * matrix, CUmultiGPULAPACKhandle handle,
+                                size_t m, size_t n, size_t nb, size_t elemSize) {
+  if (nb == 0 || (elemSize != 4 && elemSize != 8 && elemSize != 16))
+    return CUDA_ERROR_INVALID_VALUE;
+
+  // Processes only run on the device contexts
+  CUmultiGPU mGPU = cuMultiGPUBLASGetMultiGPU(handle->blas_handle);
+  const int count = cuMultiGPUGetContextCount(mGPU);
+  int devices = 0;
+  for (int i = 0; i < count; i++) {
+    if (!cuMultiGPUIsHost(mGPU, i))
+      devices++;
+  }
+  if (devices == 0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  struct __cumultigpumatrix_st * A;
+  if ((A = malloc(sizeof(struct __cumultigpumatrix_st))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  A->handle = handle;
+  A->m = m;
+  A->n = n;
+  A->nb = nb;
+  A->elemSize = elemSize;
+  A->mt = (m + nb - 1) / nb;
+  A->nt = (n + nb - 1) / nb;
+
+  // Use the squarest grid with no more rows than columns
+  A->p = 1;
+  for (int i = 1; i * i <= devices; i++) {
+    if (devices % i == 0)
+      A->p = i;
+  }
+  A->q = devices / A->p;
+
+  A->contexts = malloc((size_t)devices * sizeof(int));
+  A->handles = malloc((size_t)devices * sizeof(CUBLAShandle));
+  A->ptr = calloc((size_t)devices, sizeof(CUdeviceptr));
+  A->ld = calloc((size_t)devices, sizeof(size_t));
+  if (A->contexts == NULL || A->handles == NULL || A->ptr == NULL || A->ld == NULL) {
+    matrix_free(A);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+
+  for (int i = 0, r = 0; i < count; i++) {
+    if (cuMultiGPUIsHost(mGPU, i))
+      continue;
+    A->contexts[r] = i;
+    A->handles[r] = cuMultiGPUBLASGetHandle(handle->blas_handle, i);
+    r++;
+  }
+
+  struct matrix_step step = { .A = A };
+  CUresult result = matrix_run(&step, allocate);
+  if (result != CUDA_SUCCESS) {
+    matrix_run(&step, deallocate);
+    matrix_free(A);
+    return result;
+  }
+
+  *matrix = A;
+
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPUMatrixDestroy(CUmultiGPUMatrix A) {
+  struct matrix_step step = { .A = A };
+  CU_ERROR_CHECK(matrix_run(&step, deallocate));
+  matrix_free(A);
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPUMatrixGetGrid(CUmultiGPUMatrix A, int * p, int * q) {
+  if (p != NULL)
+    *p = A->p;
+  if (q != NULL)
+    *q = A->q;
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPUMatrixScatter(CUmultiGPUMatrix A, const void * B, size_t ldb) {
+  if (ldb < A->m)
+    return CUDA_ERROR_INVALID_VALUE;
+  CU_ERROR_CHECK(matrix_copy(A, 0, A->mt, 0, A->nt, (void *)B, ldb, false));
+  return CUDA_SUCCESS;
+}
+
+CUresult cuMultiGPUMatrixGather(CUmultiGPUMatrix A, void * B, size_t ldb) {
+  if (ldb < A->m)
+    return CUDA_ERROR_INVALID_VALUE;
+  CU_ERROR_CHECK(matrix_copy(A, 0, A->mt, 0, A->nt, B, ldb, true));
+  return CUDA_SUCCESS;
+}
+
+CUresult matrix_run(struct matrix_step * step, CUresult (*function)(const void *)) {
+  const struct __cumultigpumatrix_st * A = step->A;
+  CUmultiGPU mGPU = cuMultiGPUBLASGetMultiGPU(A->handle->blas_handle);
+  const int n = A->p * A->q;
+
+  CUtask tasks[n];
+  for (int r = 0; r < n; r++) {
+    step->r = r;
+    CU_ERROR_CHECK(cuTaskCreate(&tasks[r], function, step, sizeof(struct matrix_step)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, A->contexts[r], tasks[r]));
+  }
+
+  CUresult result;
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, (size_t)n, &result));
+  return result;
+}
+
+struct matrix_copy_args {
+  const struct __cumultigpumatrix_st * A;
+  int r;
+  size_t i0, i1, j0, j1;
+  void * B;
+  size_t ldb;
+  bool gather;
+};
+
+static CUresult copy(const void * args) {
+  const struct matrix_copy_args * c = (const struct matrix_copy_args *)args;
+  const struct __cumultigpumatrix_st * A = c->A;
+  const int r = c->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, elemSize = A->elemSize;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  for (size_t lj = matrix_local(c->j0, pc, A->q); lj < matrix_local(c->j1, pc, A->q); lj++) {
+    const size_t j = lj * (size_t)A->q + (size_t)pc;
+    for (size_t li = matrix_local(c->i0, pr, A->p); li < matrix_local(c->i1, pr, A->p); li++) {
+      const size_t i = li * (size_t)A->p + (size_t)pr;
+      void * B = (char *)c->B + ((j - c->j0) * nb * c->ldb + (i - c->i0) * nb) * elemSize;
+
+      const CUdeviceptr block = matrix_block(A, r, li, lj);
+      const size_t ib = min(nb, A->m - i * nb), jb = min(nb, A->n - j * nb);
+
+      if (c->gather) {
+        CUDA_MEMCPY2D copy = {
+          0, 0, CU_MEMORYTYPE_DEVICE, NULL, block, 0, A->ld[r] * elemSize,
+          0, 0, CU_MEMORYTYPE_HOST, B, 0, 0, c->ldb * elemSize,
+          ib * elemSize, jb };
+        CU_ERROR_CHECK(cuMemcpy2DAsync(&copy, stream));
+      }
+      else {
+        CUDA_MEMCPY2D copy = {
+          0, 0, CU_MEMORYTYPE_HOST, B, 0, 0, c->ldb * elemSize,
+          0, 0, CU_MEMORYTYPE_DEVICE, NULL, block, 0, A->ld[r] * elemSize,
+          ib * elemSize, jb };
+        CU_ERROR_CHECK(cuMemcpy2DAsync(&copy, stream));
+      }
+    }
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+CUresult matrix_copy(const struct __cumultigpumatrix_st * A, size_t i0, size_t i1,
+                     size_t j0, size_t j1, void * B, size_t ldb, bool gather) {
+  if (i0 >= i1 || j0 >= j1)
+    return CUDA_SUCCESS;
+
+  CUmultiGPU mGPU = cuMultiGPUBLASGetMultiGPU(A->handle->blas_handle);
+  const int n = A->p * A->q;
+
+  // Only the processes holding some of the blocks are given a task
+  CUtask tasks[n];
+  size_t nTasks = 0;
+  for (int r = 0; r < n; r++) {
+    const int pr = r % A->p, pc = r / A->p;
+    if (matrix_local(i1, pr, A->p) == matrix_local(i0, pr, A->p) ||
+        matrix_local(j1, pc, A->q) == matrix_local(j0, pc, A->q))
+      continue;
+
+    struct matrix_copy_args args = { A, r, i0, i1, j0, j1, B, ldb, gather };
+    CU_ERROR_CHECK(cuTaskCreate(&tasks[nTasks], copy, &args, sizeof(struct matrix_copy_args)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, A->contexts[r], tasks[nTasks]));
+    nTasks++;
+  }
+
+  CUresult result;
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, nTasks, &result));
+  return result;
+}
+
+CUresult matrix_stage(const struct __cumultigpumatrix_st * A, CUBLAShandle handle, bool rows,
+                      int r, int p, size_t first, size_t last, size_t width,
+                      const void * H, size_t ldh, CUdeviceptr * W, size_t * ldw,
+                      CUstream stream) {
+  const size_t nb = A->nb, elemSize = A->elemSize;
+  const size_t n = (rows) ? A->m : A->n;
+  const size_t blocks = matrix_local((n + nb - 1) / nb, r, p);
+
+  // Space is left for every local block so that they line up with the matrix
+  size_t pitch;
+  if (rows)
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, W, &pitch, blocks * nb * elemSize, width,
+                                       (unsigned int)elemSize));
+  else
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, W, &pitch, width * elemSize, blocks * nb,
+                                       (unsigned int)elemSize));
+  *ldw = pitch / elemSize;
+
+  for (size_t l = matrix_local(first, r, p); l < matrix_local(last, r, p); l++) {
+    const size_t i = l * (size_t)p + (size_t)r;
+    const size_t ib = min(nb, n - i * nb);
+    const void * B = (const char *)H + ((rows) ? i * nb : i * nb * ldh) * elemSize;
+
+    CUDA_MEMCPY2D copy = {
+      0, 0, CU_MEMORYTYPE_HOST, B, 0, 0, ldh * elemSize,
+      0, 0, CU_MEMORYTYPE_DEVICE, NULL, matrix_panel(A, rows, *W, *ldw, l), 0, pitch,
+      ((rows) ? ib : width) * elemSize, (rows) ? width : ib };
+    CU_ERROR_CHECK(cuMemcpy2DAsync(&copy, stream));
+  }
+
+  return CUDA_SUCCESS;
+}
+
+CUresult matrix_upload(CUBLAShandle handle, const void * H, size_t ldh, size_t m, size_t n,
+                       size_t elemSize, CUdeviceptr * W, size_t * ldw, CUstream stream) {
+  size_t pitch;
+  CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, W, &pitch, m * elemSize, n, (unsigned int)elemSize));
+  *ldw = pitch / elemSize;
+
+  CUDA_MEMCPY2D copy = {
+    0, 0, CU_MEMORYTYPE_HOST, H, 0, 0, ldh * elemSize,
+    0, 0, CU_MEMORYTYPE_DEVICE, NULL, *W, 0, pitch,
+    m * elemSize, n };
+  CU_ERROR_CHECK(cuMemcpy2DAsync(&copy, stream));
+
+  return CUDA_SUCCESS;
+}
+
+CUresult matrix_duplicate(CUBLAShandle handle, CUdeviceptr B, size_t ldb, size_t m, size_t n,
+                          size_t elemSize, CUdeviceptr * W, size_t * ldw, CUstream stream) {
+  size_t pitch;
+  CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, W, &pitch, m * elemSize, n, (unsigned int)elemSize));
+  *ldw = pitch / elemSize;
+
+  CUDA_MEMCPY2D copy = {
+    0, 0, CU_MEMORYTYPE_DEVICE, NULL, B, 0, ldb * elemSize,
+    0, 0, CU_MEMORYTYPE_DEVICE, NULL, *W, 0, pitch,
+    m * elemSize, n };
+  CU_ERROR_CHECK(cuMemcpy2DAsync(&copy, stream));
+
+  return CUDA_SUCCESS;
+}
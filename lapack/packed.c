@@ -0,0 +1,268 @@
+#include "lapack.h"
+#include "handle.h"
+#include "error.h"
+#include <stdio.h>
+#include <string.h>
+#include "packed.fatbin.c"
+
+/**
+ * Number of threads in each block of the packing kernels.  Each block copies
+ * one column of the triangle.
+ */
+#define PACKED_BX 64u
+
+/**
+ * Copies the uplo triangle of an n by n matrix with elements of the given size
+ * to or from packed storage.  Columns of the triangle are contiguous in both
+ * so each is copied in one go.
+ */
+static void trttp(CBlasUplo uplo, size_t n, const void * restrict A, size_t lda,
+                  void * restrict AP, size_t size) {
+  const char * a = (const char *)A;
+  char * ap = (char *)AP;
+  if (uplo == CBlasUpper) {
+    for (size_t j = 0; j < n; j++) {
+      memcpy(ap, &a[j * lda * size], (j + 1) * size);
+      ap += (j + 1) * size;
+    }
+  }
+  else {
+    for (size_t j = 0; j < n; j++) {
+      memcpy(ap, &a[(j * lda + j) * size], (n - j) * size);
+      ap += (n - j) * size;
+    }
+  }
+}
+
+static void tpttr(CBlasUplo uplo, size_t n, const void * restrict AP,
+                  void * restrict A, size_t lda, size_t size) {
+  const char * ap = (const char *)AP;
+  char * a = (char *)A;
+  if (uplo == CBlasUpper) {
+    for (size_t j = 0; j < n; j++) {
+      memcpy(&a[j * lda * size], ap, (j + 1) * size);
+      ap += (j + 1) * size;
+    }
+  }
+  else {
+    for (size_t j = 0; j < n; j++) {
+      memcpy(&a[(j * lda + j) * size], ap, (n - j) * size);
+      ap += (n - j) * size;
+    }
+  }
+}
+
+void strttp(CBlasUplo uplo, size_t n, const float * restrict A, size_t lda,
+            float * restrict AP, long * restrict info) {
+  *info = 0;
+  if (lda < n)
+    *info = -4;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return;
+  }
+  trttp(uplo, n, A, lda, AP, sizeof(float));
+}
+
+void dtrttp(CBlasUplo uplo, size_t n, const double * restrict A, size_t lda,
+            double * restrict AP, long * restrict info) {
+  *info = 0;
+  if (lda < n)
+    *info = -4;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return;
+  }
+  trttp(uplo, n, A, lda, AP, sizeof(double));
+}
+
+void ctrttp(CBlasUplo uplo, size_t n, const float complex * restrict A, size_t lda,
+            float complex * restrict AP, long * restrict info) {
+  *info = 0;
+  if (lda < n)
+    *info = -4;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return;
+  }
+  trttp(uplo, n, A, lda, AP, sizeof(float complex));
+}
+
+void ztrttp(CBlasUplo uplo, size_t n, const double complex * restrict A, size_t lda,
+            double complex * restrict AP, long * restrict info) {
+  *info = 0;
+  if (lda < n)
+    *info = -4;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return;
+  }
+  trttp(uplo, n, A, lda, AP, sizeof(double complex));
+}
+
+void stpttr(CBlasUplo uplo, size_t n, const float * restrict AP,
+            float * restrict A, size_t lda, long * restrict info) {
+  *info = 0;
+  if (lda < n)
+    *info = -5;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return;
+  }
+  tpttr(uplo, n, AP, A, lda, sizeof(float));
+}
+
+void dtpttr(CBlasUplo uplo, size_t n, const double * restrict AP,
+            double * restrict A, size_t lda, long * restrict info) {
+  *info = 0;
+  if (lda < n)
+    *info = -5;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return;
+  }
+  tpttr(uplo, n, AP, A, lda, sizeof(double));
+}
+
+void ctpttr(CBlasUplo uplo, size_t n, const float complex * restrict AP,
+            float complex * restrict A, size_t lda, long * restrict info) {
+  *info = 0;
+  if (lda < n)
+    *info = -5;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return;
+  }
+  tpttr(uplo, n, AP, A, lda, sizeof(float complex));
+}
+
+void ztpttr(CBlasUplo uplo, size_t n, const double complex * restrict AP,
+            double complex * restrict A, size_t lda, long * restrict info) {
+  *info = 0;
+  if (lda < n)
+    *info = -5;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return;
+  }
+  tpttr(uplo, n, AP, A, lda, sizeof(double complex));
+}
+
+/**
+ * Loads the packing module and looks up the kernels for each uplo and element
+ * size.  The handle's context must be current.
+ */
+CUresult packed_load(CULAPACKhandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const unsigned int words[] = { 1, 2, 4 };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    for (int w = 0; w < 3; w++) {
+      char name[40];
+      snprintf(name, 40, "_Z5trttpIL9CBlasUplo%dELj%uEEvPKjPjii", uplos[u], words[w]);
+      CU_ERROR_CHECK(lookup(&handle->trttp[u][w], module, name));
+      snprintf(name, 40, "_Z5tpttrIL9CBlasUplo%dELj%uEEvPKjPjii", uplos[u], words[w]);
+      CU_ERROR_CHECK(lookup(&handle->tpttr[u][w], module, name));
+    }
+  }
+
+  handle->packed = module;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Index of an element size in the kernel tables.
+ */
+static inline int sizeIndex(size_t elemSize) {
+  return (elemSize == 4) ? 0 : (elemSize == 8) ? 1 : 2;
+}
+
+static inline CUresult launch(CUfunction function, size_t n,
+                              CUdeviceptr from, CUdeviceptr to, size_t ld, CUstream stream) {
+  if (function == NULL)
+    return CUDA_ERROR_NOT_FOUND;
+
+  void * params[] = { &from, &to, &ld, &n };
+
+  CU_ERROR_CHECK(cuLaunchKernel(function, (unsigned int)n, 1, 1, PACKED_BX, 1, 1, 0, stream, params, NULL));
+
+  return CUDA_SUCCESS;
+}
+
+CUresult packed_create(CULAPACKhandle handle, struct packed * packed, size_t n, size_t elemSize) {
+  if (elemSize != 4 && elemSize != 8 && elemSize != 16)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  const size_t size = ((n * (n + 1)) / 2) * elemSize;
+
+  packed->elemSize = elemSize;
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, &packed->download, size));
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, &packed->upload, size));
+  CU_ERROR_CHECK(cuBLASMemAlloc(handle->blas_handle, &packed->scratch[0], size));
+  CU_ERROR_CHECK(cuBLASMemAlloc(handle->blas_handle, &packed->scratch[1], size));
+  CU_ERROR_CHECK(cuEventCreate(&packed->uploaded, CU_EVENT_DISABLE_TIMING));
+
+  return CUDA_SUCCESS;
+}
+
+CUresult packed_destroy(CULAPACKhandle handle, struct packed * packed) {
+  // The last upload may still be reading the buffers
+  CU_ERROR_CHECK(cuEventSynchronize(packed->uploaded));
+  CU_ERROR_CHECK(cuEventDestroy(packed->uploaded));
+
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, packed->download));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, packed->upload));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, packed->scratch[0]));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, packed->scratch[1]));
+
+  return CUDA_SUCCESS;
+}
+
+CUresult packed_download(CULAPACKhandle handle, struct packed * packed, CBlasUplo uplo, size_t n,
+                         CUdeviceptr A, size_t lda, void * B, size_t ldb, CUstream stream) {
+  if (n == 0)
+    return CUDA_SUCCESS;
+
+  if (handle->packed == NULL)
+    CU_ERROR_CHECK(packed_load(handle));
+
+  const size_t size = ((n * (n + 1)) / 2) * packed->elemSize;
+  const int u = (uplo == CBlasUpper) ? 0 : 1;
+
+  // Pack the triangle on the device, copy it across and unpack it on the host
+  CU_ERROR_CHECK(launch(handle->trttp[u][sizeIndex(packed->elemSize)], n,
+                        A, packed->scratch[0], lda, stream));
+  CU_ERROR_CHECK(cuMemcpyDtoHAsync(packed->download, packed->scratch[0], size, stream));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  tpttr(uplo, n, packed->download, B, ldb, packed->elemSize);
+
+  return CUDA_SUCCESS;
+}
+
+CUresult packed_upload(CULAPACKhandle handle, struct packed * packed, CBlasUplo uplo, size_t n,
+                       const void * B, size_t ldb, CUdeviceptr A, size_t lda, CUstream stream) {
+  if (n == 0)
+    return CUDA_SUCCESS;
+
+  if (handle->packed == NULL)
+    CU_ERROR_CHECK(packed_load(handle));
+
+  const size_t size = ((n * (n + 1)) / 2) * packed->elemSize;
+  const int u = (uplo == CBlasUpper) ? 0 : 1;
+
+  // The previous upload may still be copying out of the staging buffer
+  CU_ERROR_CHECK(cuEventSynchronize(packed->uploaded));
+
+  // Pack the triangle on the host, copy it across and unpack it on the device
+  trttp(uplo, n, B, ldb, packed->upload, packed->elemSize);
+  CU_ERROR_CHECK(cuMemcpyHtoDAsync(packed->scratch[1], packed->upload, size, stream));
+  CU_ERROR_CHECK(launch(handle->tpttr[u][sizeIndex(packed->elemSize)], n,
+                        packed->scratch[1], A, lda, stream));
+  CU_ERROR_CHECK(cuEventRecord(packed->uploaded, stream));
+
+  return CUDA_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#include "blas.h"
+
+/*
+ * Copies the uplo triangle of an n by n matrix A into packed storage AP.  The
+ * kernels only move data so elements are copied as w 32-bit words and the same
+ * kernel serves every precision.  Each thread block copies one column of the
+ * triangle, which is contiguous in both A and AP, so the reads and writes are
+ * coalesced.
+ */
+template <CBlasUplo uplo, unsigned int w>
+__global__ void trttp(const unsigned int * A, unsigned int * AP, int lda, int n) {
+  const int j = blockIdx.x;
+
+  if (uplo == CBlasUpper) {
+    // Column j holds rows 0 to j and starts after j (j + 1) / 2 elements
+    A += j * lda * w;
+    AP += ((j * (j + 1)) / 2) * w;
+    for (int i = threadIdx.x; i < (j + 1) * w; i += blockDim.x)
+      AP[i] = A[i];
+  }
+  else {
+    // Column j holds rows j to n - 1 and starts after j (2n - j + 1) / 2 elements
+    A += (j * lda + j) * w;
+    AP += (((2 * n - j + 1) * j) / 2) * w;
+    for (int i = threadIdx.x; i < (n - j) * w; i += blockDim.x)
+      AP[i] = A[i];
+  }
+}
+
+/*
+ * Copies the uplo triangle of an n by n matrix from packed storage AP into A.
+ * The other triangle of A is not referenced.
+ */
+template <CBlasUplo uplo, unsigned int w>
+__global__ void tpttr(const unsigned int * AP, unsigned int * A, int lda, int n) {
+  const int j = blockIdx.x;
+
+  if (uplo == CBlasUpper) {
+    A += j * lda * w;
+    AP += ((j * (j + 1)) / 2) * w;
+    for (int i = threadIdx.x; i < (j + 1) * w; i += blockDim.x)
+      A[i] = AP[i];
+  }
+  else {
+    A += (j * lda + j) * w;
+    AP += (((2 * n - j + 1) * j) / 2) * w;
+    for (int i = threadIdx.x; i < (n - j) * w; i += blockDim.x)
+      A[i] = AP[i];
+  }
+}
+
+template __global__ void trttp<CBlasUpper, 1>(const unsigned int *, unsigned int *, int, int);
+template __global__ void trttp<CBlasUpper, 2>(const unsigned int *, unsigned int *, int, int);
+template __global__ void trttp<CBlasUpper, 4>(const unsigned int *, unsigned int *, int, int);
+template __global__ void trttp<CBlasLower, 1>(const unsigned int *, unsigned int *, int, int);
+template __global__ void trttp<CBlasLower, 2>(const unsigned int *, unsigned int *, int, int);
+template __global__ void trttp<CBlasLower, 4>(const unsigned int *, unsigned int *, int, int);
+
+template __global__ void tpttr<CBlasUpper, 1>(const unsigned int *, unsigned int *, int, int);
+template __global__ void tpttr<CBlasUpper, 2>(const unsigned int *, unsigned int *, int, int);
+template __global__ void tpttr<CBlasUpper, 4>(const unsigned int *, unsigned int *, int, int);
+template __global__ void tpttr<CBlasLower, 1>(const unsigned int *, unsigned int *, int, int);
+template __global__ void tpttr<CBlasLower, 2>(const unsigned int *, unsigned int *, int, int);
+template __global__ void tpttr<CBlasLower, 4>(const unsigned int *, unsigned int *, int, int);
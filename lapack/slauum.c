@@ -2,9 +2,16 @@
 #include "handle.h"
 #include "error.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include "config.h"
 #include "slauum.fatbin.c"
 
+/**
+ * Number of threads used by the unblocked kernel (and so the largest matrix it
+ * can work on).
+ */
+#define SLAUU2_BX 64u
+
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
 
 static inline CUresult cuMemcpyHtoD2DAsync(CUdeviceptr A, size_t lda, size_t ai, size_t aj,
@@ -128,21 +135,40 @@ void slauum(CBlasUplo uplo,
   }
 }
 
+/**
+ * Loads the SLAUUM module and looks up the unblocked kernel for each uplo.  The
+ * handle's context must be current.
+ */
+CUresult slauum_load(CULAPACKhandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    char name[37];
+    snprintf(name, 37, "_Z6slauu2IL9CBlasUplo%dELj%uEEvPfii", uplos[u], SLAUU2_BX);
+    CU_ERROR_CHECK(lookup(&handle->slauu2[u], module, name));
+  }
+
+  handle->slauum = module;
+
+  return CUDA_SUCCESS;
+}
+
 static inline CUresult cuSlauu2(CULAPACKhandle handle, CBlasUplo uplo,
                                 size_t n,
                                 CUdeviceptr A, size_t lda, CUstream stream) {
-  const unsigned int bx = 64;
+  const unsigned int bx = SLAUU2_BX;
   if (n > bx)
     return CUDA_ERROR_INVALID_VALUE;
 
   if (handle->slauum == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->slauum, imageBytes));
-
-  char name[37];
-  snprintf(name, 37, "_Z6slauu2IL9CBlasUplo%dELj%uEEvPfii", uplo, bx);
+    CU_ERROR_CHECK(slauum_load(handle));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->slauum, name));
+  CUfunction function = handle->slauu2[(uplo == CBlasUpper) ? 0 : 1];
+  if (function == NULL)
+    return CUDA_ERROR_NOT_FOUND;
 
   void * params[] = { &A, &lda, &n };
 
@@ -151,7 +177,7 @@ static inline CUresult cuSlauu2(CULAPACKhandle handle, CBlasUplo uplo,
   return CUDA_SUCCESS;
 }
 
-static CUresult hybridSlauum(CBlasUplo uplo,
+static CUresult hybridSlauum(CULAPACKhandle handle, struct packed * P, CBlasUplo uplo,
                              CUdeviceptr A, size_t lda, float * X, size_t ldb,
                              size_t i, size_t ib, size_t n, long * info, CUstream stream) {
 
@@ -173,9 +199,9 @@ static CUresult hybridSlauum(CBlasUplo uplo,
     B = &X[i];    // The diagonal block is half-way down
   }
   else {
-    // Copy each column of the diagonal block separately
-    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(X, ldb, 0, 0, A, lda, i, i,
-                                      ib, ib, sizeof(float), stream));
+    // Copy the triangle of the diagonal block packed into contiguous memory
+    CU_ERROR_CHECK(packed_download(handle, P, uplo, ib, A + (i * lda + i) * sizeof(float), lda,
+                                   X, ldb, stream));
     B = X;      // The diagonal block is at the top of the column
   }
 
@@ -188,8 +214,8 @@ static CUresult hybridSlauum(CBlasUplo uplo,
   if (uplo == CBlasLower && bcc_htod)   // Only works for lower triangular slauum
     CU_ERROR_CHECK(cuMemcpyHtoDAsync(A + i * lda * sizeof(float), X, n * ib * sizeof(float), stream));
   else
-    CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, i, i, B, ldb, 0, 0,
-                                      ib, ib, sizeof(float), stream));
+    CU_ERROR_CHECK(packed_upload(handle, P, uplo, ib, B, ldb,
+                                 A + (i * lda + i) * sizeof(float), lda, stream));
 
   return CUDA_SUCCESS;
 }
@@ -210,6 +236,7 @@ CUresult cuSlauum(CULAPACKhandle handle,
   if (n == 0)
     return CUDA_SUCCESS;
 
+  struct packed P;
   float * B;
   CUdeviceptr D;
   size_t ldb, ldd;
@@ -226,15 +253,17 @@ CUresult cuSlauum(CULAPACKhandle handle,
   const size_t nb = 512;
 
   // Allocate page-locked host memory for diagonal block column
-  CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (n + 3u) & ~3u) * nb * sizeof(float)));
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (n + 3u) & ~3u) * nb * sizeof(float)));
+  // Borrow staging memory for the packed triangle of the diagonal block
+  CU_ERROR_CHECK(packed_create(handle, &P, nb, sizeof(float)));
 
-  // Create two streams for asynchronous copy and compute
-  CU_ERROR_CHECK(cuStreamCreate(&stream0, 0));
-  CU_ERROR_CHECK(cuStreamCreate(&stream1, 0));
+  // Borrow two streams for asynchronous copy and compute
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream0, 0));
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream1, 0));
 
   if (uplo == CBlasUpper) {
     // Upper triangular requires a temporary column for out of place STRMM
-    CU_ERROR_CHECK(cuMemAllocPitch(&D, &ldd, n * sizeof(float), nb, sizeof(float)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &D, &ldd, n * sizeof(float), nb, sizeof(float)));
     ldd /= sizeof(float);
 
     for (size_t i = 0; i < n; i += nb) {
@@ -251,7 +280,7 @@ CUresult cuSlauum(CULAPACKhandle handle,
                               one, A + (i + ib) * lda * sizeof(float), lda,
                               A + ((i + ib) * lda + i) * sizeof(float), lda,
                               one, D, ldd, A + i * lda * sizeof(float), lda, stream1));
-      CU_ERROR_CHECK(hybridSlauum(uplo, A, lda, B, ldb, i, ib, n, info, stream0));
+      CU_ERROR_CHECK(hybridSlauum(handle, &P, uplo, A, lda, B, ldb, i, ib, n, info, stream0));
       /* Perform the SSYRK on the same stream as the copy to ensure A has
        * finised copying back first. */
       CU_ERROR_CHECK(cuSsyrk(handle->blas_handle, CBlasUpper, CBlasNoTrans, ib, n - i - ib,
@@ -265,7 +294,7 @@ CUresult cuSlauum(CULAPACKhandle handle,
   }
   else {
     // Lower triangular requires a temporary row for out of place STRMM
-    CU_ERROR_CHECK(cuMemAllocPitch(&D, &ldd, nb * sizeof(float), n, sizeof(float)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &D, &ldd, nb * sizeof(float), n, sizeof(float)));
     ldd /= sizeof(float);
 
     for (size_t i = 0; i < n; i += nb) {
@@ -282,7 +311,7 @@ CUresult cuSlauum(CULAPACKhandle handle,
                               one, A + (i * lda + i + ib) * sizeof(float), lda,
                               A + (i + ib) * sizeof(float), lda,
                               one, D, ldd, A + i * sizeof(float), lda, stream1));
-      CU_ERROR_CHECK(hybridSlauum(uplo, A, lda, B, ldb, i, ib, n, info, stream0));
+      CU_ERROR_CHECK(hybridSlauum(handle, &P, uplo, A, lda, B, ldb, i, ib, n, info, stream0));
       /* Perform the SSYRK on the same stream as the copy to ensure A has
        * finised copying back first. */
       CU_ERROR_CHECK(cuSsyrk(handle->blas_handle, CBlasLower, CBlasTrans, ib, n - i - ib,
@@ -295,16 +324,43 @@ CUresult cuSlauum(CULAPACKhandle handle,
     }
   }
 
+  // Wait for the streams before the temporary memory goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+
   // Clean up resources
-  CU_ERROR_CHECK(cuMemFreeHost(B));
-  CU_ERROR_CHECK(cuMemFree(D));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, B));
+  CU_ERROR_CHECK(packed_destroy(handle, &P));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, D));
 
-  CU_ERROR_CHECK(cuStreamDestroy(stream0));
-  CU_ERROR_CHECK(cuStreamDestroy(stream1));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream0));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream1));
 
   return CUDA_SUCCESS;
 }
 
+/**
+ * Arguments to the update of the off-diagonal block of a block row (column)
+ * with the trailing part of the matrix.
+ */
+struct slauum_update_args {
+  CUmultiGPUBLAShandle handle;
+  CBlasTranspose transA, transB;
+  size_t m, n, k;
+  const float * A, * B;
+  float * C;
+  size_t lda, ldb, ldc;
+};
+
+/**
+ * Adds A B to C on the devices.  Runs on the lookahead thread.
+ */
+static CUresult cuMultiGPUSlauumUpdate(const void * a) {
+  const struct slauum_update_args * args = (const struct slauum_update_args *)a;
+  return cuMultiGPUSgemm(args->handle, args->transA, args->transB, args->m, args->n, args->k,
+                         one, args->A, args->lda, args->B, args->ldb, one, args->C, args->ldc);
+}
+
 CUresult cuMultiGPUSlauum(CUmultiGPULAPACKhandle handle,
                           CBlasUplo uplo,
                           size_t n,
@@ -321,8 +377,13 @@ CUresult cuMultiGPUSlauum(CUmultiGPULAPACKhandle handle,
   if (n == 0)
     return CUDA_SUCCESS;
 
+  // Any copies of A cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float)));
+
   if (uplo == CBlasUpper) {
-    const size_t nb = SGEMM_N_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, CBlasSgemmN, &blocking));
+    const size_t nb = blocking.mb;
 
     // Upper triangular SLAUUM
     for (size_t i = 0; i < n; i += nb) {
@@ -330,19 +391,24 @@ CUresult cuMultiGPUSlauum(CUmultiGPULAPACKhandle handle,
 
       CU_ERROR_CHECK(cuMultiGPUStrmm(handle->blas_handle, CBlasRight, CBlasUpper, CBlasTrans, CBlasNonUnit,
                                      i, ib, one, &A[i * lda + i], lda, &A[i * lda], lda));
+      // The diagonal block is multiplied on the host while the devices update
+      // the off-diagonal block with the trailing part of the matrix
+      const struct slauum_update_args args = { handle->blas_handle, CBlasNoTrans, CBlasTrans, i, ib, n - i - ib,
+                                              &A[(i + ib) * lda], &A[(i + ib) * lda + i], &A[i * lda], lda, lda, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUSlauumUpdate, &args));
       slauu2(CBlasUpper, ib, &A[i * lda + i], lda);
+      CU_ERROR_CHECK(lookahead_wait(&update));
 
-      if (i + ib < n) {
-        CU_ERROR_CHECK(cuMultiGPUSgemm(handle->blas_handle, CBlasNoTrans, CBlasTrans, i, ib, n - i - ib,
-                                       one, &A[(i + ib) * lda], lda, &A[(i + ib) * lda + i], lda,
-                                       one, &A[i * lda], lda));
+      if (i + ib < n)
         CU_ERROR_CHECK(cuMultiGPUSsyrk(handle->blas_handle, CBlasUpper, CBlasNoTrans, ib, n - i - ib,
                                        one, &A[(i + ib) * lda + i], lda, one, &A[i * lda + i], lda));
-      }
     }
   }
   else {
-    const size_t mb = SGEMM_T_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, CBlasSgemmT, &blocking));
+    const size_t mb = blocking.mb;
 
     // Lower triangular SLAUUM
     for (size_t i = 0; i < n; i += mb) {
@@ -350,17 +416,230 @@ CUresult cuMultiGPUSlauum(CUmultiGPULAPACKhandle handle,
 
       CU_ERROR_CHECK(cuMultiGPUStrmm(handle->blas_handle, CBlasLeft, CBlasLower, CBlasTrans, CBlasNonUnit, ib, i,
                                      one, &A[i * lda + i], lda, &A[i], lda));
+      // The diagonal block is multiplied on the host while the devices update
+      // the off-diagonal block with the trailing part of the matrix
+      const struct slauum_update_args args = { handle->blas_handle, CBlasTrans, CBlasNoTrans, ib, i, n - i - ib,
+                                              &A[i * lda + i + ib], &A[i + ib], &A[i], lda, lda, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUSlauumUpdate, &args));
       slauu2(CBlasLower, ib, &A[i * lda + i], lda);
+      CU_ERROR_CHECK(lookahead_wait(&update));
 
-      if (i + ib < n) {
-        CU_ERROR_CHECK(cuMultiGPUSgemm(handle->blas_handle, CBlasTrans, CBlasNoTrans, ib, i, n - i - ib,
-                                       one, &A[i * lda + i + ib], lda, &A[i + ib], lda,
-                                       one, &A[i], lda));
+      if (i + ib < n)
         CU_ERROR_CHECK(cuMultiGPUSsyrk(handle->blas_handle, CBlasLower, CBlasTrans, ib, n - i - ib,
                                        one, &A[i * lda + i + ib], lda, one, &A[i * lda + i], lda));
+    }
+  }
+
+  // Blocks of A were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float)));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Multiplies a block of a distributed matrix in place by a triangular matrix.
+ */
+static inline CUresult matrix_strmm(CUBLAShandle handle, CBlasSide side, CBlasUplo uplo,
+                                    CBlasTranspose trans, CBlasDiag diag, size_t m, size_t n,
+                                    float alpha, CUdeviceptr A, size_t lda,
+                                    CUdeviceptr B, size_t ldb, CUstream stream) {
+  CUdeviceptr T;
+  size_t ldt;
+  CU_ERROR_CHECK(matrix_duplicate(handle, B, ldb, m, n, sizeof(float), &T, &ldt, stream));
+  CU_ERROR_CHECK(cuStrmm2(handle, side, uplo, trans, diag, m, n, alpha, A, lda, T, ldt, B, ldb, stream));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, T));
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Adds the product of block column (row) k of a distributed matrix with its
+ * transpose to the blocks before it held by a process.
+ */
+static CUresult slauumUpdate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  const size_t mt = matrix_local(k, pr, A->p), nt = matrix_local(k, pc, A->q);
+  if (mt == 0 || nt == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr X, Y;
+  size_t ldx, ldy;
+  if (step->uplo == CBlasUpper) {
+    // A(0:k, 0:k) += A(0:k, k) A(0:k, k)^T
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pr, A->p, 0, k, kb, step->H, step->ldh, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pc, A->q, 0, k, kb, step->H, step->ldh, &Y, &ldy, stream));
+
+    for (size_t j = 0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i = matrix_local(J + 1, pr, A->p);
+      if (i > 0 && (i - 1) * (size_t)A->p + (size_t)pr == J) {
+        i--;
+        CU_ERROR_CHECK(cuSsyrk(handle, CBlasUpper, CBlasNoTrans, jb, kb,
+                               1.0f, matrix_panel(A, true, X, ldx, i), ldx,
+                               1.0f, matrix_block(A, r, i, j), A->ld[r], stream));
       }
+      if (i > 0)
+        CU_ERROR_CHECK(cuSgemm(handle, CBlasNoTrans, CBlasTrans,
+                               matrix_extent(0, i, pr, A->p, nb, A->m), jb, kb,
+                               one, X, ldx, matrix_panel(A, true, Y, ldy, j), ldy,
+                               one, matrix_block(A, r, 0, j), A->ld[r], stream));
+    }
+  }
+  else {
+    // A(0:k, 0:k) += A(k, 0:k)^T A(k, 0:k)
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pr, A->p, 0, k, kb, step->G, step->ldg, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pc, A->q, 0, k, kb, step->G, step->ldg, &Y, &ldy, stream));
+
+    for (size_t j = 0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i = matrix_local(J, pr, A->p);
+      if (i < mt && i * (size_t)A->p + (size_t)pr == J) {
+        CU_ERROR_CHECK(cuSsyrk(handle, CBlasLower, CBlasTrans, jb, kb,
+                               1.0f, matrix_panel(A, false, X, ldx, i), ldx,
+                               1.0f, matrix_block(A, r, i, j), A->ld[r], stream));
+        i++;
+      }
+      if (i < mt)
+        CU_ERROR_CHECK(cuSgemm(handle, CBlasTrans, CBlasNoTrans,
+                               matrix_extent(i, mt, pr, A->p, nb, A->m), jb, kb,
+                               one, matrix_panel(A, false, X, ldx, i), ldx,
+                               matrix_panel(A, false, Y, ldy, j), ldy,
+                               one, matrix_block(A, r, i, j), A->ld[r], stream));
+    }
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Multiplies block column (row) k of a distributed matrix by the transpose of
+ * the diagonal block on the processes holding it.
+ */
+static CUresult slauumPanel(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  size_t m, n;
+  CUdeviceptr B;
+  if (step->uplo == CBlasUpper) {
+    // A(0:k, k) = A(0:k, k) A(k, k)^T
+    if (k % (size_t)A->q != (size_t)pc)
+      return CUDA_SUCCESS;
+    m = matrix_extent(0, matrix_local(k, pr, A->p), pr, A->p, nb, A->m);
+    n = kb;
+    B = matrix_block(A, r, 0, k / (size_t)A->q);
+  }
+  else {
+    // A(k, 0:k) = A(k, k)^T A(k, 0:k)
+    if (k % (size_t)A->p != (size_t)pr)
+      return CUDA_SUCCESS;
+    m = kb;
+    n = matrix_extent(0, matrix_local(k, pc, A->q), pc, A->q, nb, A->n);
+    B = matrix_block(A, r, k / (size_t)A->p, 0);
+  }
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D;
+  size_t ldd;
+  CU_ERROR_CHECK(matrix_upload(handle, step->D, step->ldd, kb, kb, sizeof(float), &D, &ldd, stream));
+
+  if (step->uplo == CBlasUpper)
+    CU_ERROR_CHECK(matrix_strmm(handle, CBlasRight, CBlasUpper, CBlasTrans, CBlasNonUnit, m, n,
+                                one, D, ldd, B, A->ld[r], stream));
+  else
+    CU_ERROR_CHECK(matrix_strmm(handle, CBlasLeft, CBlasLower, CBlasTrans, CBlasNonUnit, m, n,
+                                one, D, ldd, B, A->ld[r], stream));
+
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult slauumStep(const void * args) {
+  CU_ERROR_CHECK(slauumUpdate(args));
+  CU_ERROR_CHECK(slauumPanel(args));
+  return CUDA_SUCCESS;
+}
+
+static CUresult slauumMatrix(CBlasUplo uplo, struct __cumultigpumatrix_st * A,
+                             float * H, long * info) {
+  const size_t n = A->n, nb = A->nb;
+
+  struct matrix_step step = { .A = A, .uplo = uplo, .H = H, .ldh = n, .G = H, .ldg = nb };
+
+  // Each step adds the outer product of its block column (row) to the blocks
+  // before it, which only needs that block column (row) as the blocks after it
+  // have already been added.
+  for (size_t k = 0; k < A->nt; k++) {
+    const size_t kb = min(nb, n - k * nb);
+    step.k = k;
+
+    float * D;
+    if (uplo == CBlasUpper) {
+      CU_ERROR_CHECK(matrix_copy(A, 0, k + 1, k, k + 1, H, n, true));
+      D = &H[k * nb];
+      step.ldd = n;
     }
+    else {
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, 0, k + 1, H, nb, true));
+      D = &H[k * nb * nb];
+      step.ldd = nb;
+    }
+    step.D = D;
+
+    CU_ERROR_CHECK(matrix_run(&step, slauumStep));
+
+    slauum(uplo, kb, D, step.ldd, info);
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, step.ldd, false));
   }
 
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPUSlauumMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(float))
+    *info = -3;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  float * H;
+  if ((H = malloc(A->n * A->nb * sizeof(float))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  CUresult result = slauumMatrix(uplo, A, H, info);
+
+  free(H);
+
+  return result;
+}
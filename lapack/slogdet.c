@@ -34,6 +34,28 @@ static inline unsigned int nextPow2(unsigned int n) {
   return ++n;
 }
 
+/**
+ * Loads the SLOGDET module and looks up the reduction for each power of two
+ * number of threads up to 512 and whether n is a power of two.  The handle's
+ * context must be current.
+ */
+CUresult slogdet_load(CULAPACKhandle handle) {
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int t = 0; t < 10; t++) {
+    for (int pow2 = 0; pow2 < 2; pow2++) {
+      char name[31];
+      snprintf(name, 31, "_Z6reduceILj%uELb%dEEvPKfPfii", 1u << t, pow2);
+      CU_ERROR_CHECK(lookup(&handle->sreduce[t][pow2], module, name));
+    }
+  }
+
+  handle->slogdet = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuSlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n, float * result, CUstream stream) {
   if (n == 0) {
     *result = 0.0f;
@@ -41,7 +63,7 @@ CUresult cuSlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
   }
 
   if (handle->slogdet == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->slogdet, imageBytes));
+    CU_ERROR_CHECK(slogdet_load(handle));
 
   unsigned int threads, blocks;
   if (n == 1) {
@@ -54,13 +76,9 @@ CUresult cuSlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
   }
 
   CUdeviceptr temp;
-  CU_ERROR_CHECK(cuMemAlloc(&temp, blocks * sizeof(float)));
-
-  char name[31];
-  snprintf(name, 31, "_Z6reduceILj%uELb%dEEvPKfPfii", threads, (n & (n - 1)) == 0);
+  CU_ERROR_CHECK(cuBLASMemAlloc(handle->blas_handle, &temp, blocks * sizeof(float)));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->slogdet, name));
+  CUfunction function = handle->sreduce[__builtin_ctz(threads)][(n & (n - 1)) == 0];
 
   void * params[] = { &x, &temp, &incx, &n };
 
@@ -68,7 +86,9 @@ CUresult cuSlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
 
   CU_ERROR_CHECK(cuMemcpyDtoHAsync(result, temp, sizeof(float), stream));
 
-  CU_ERROR_CHECK(cuMemFree(temp));
+  // Wait for the result before temp goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, temp));
 
   return CUDA_SUCCESS;
 }
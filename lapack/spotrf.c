@@ -2,10 +2,17 @@
 #include "handle.h"
 #include "error.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "config.h"
 #include "spotrf.fatbin.c"
 
+/**
+ * Number of threads used by the unblocked kernel (and so the largest matrix it
+ * can work on).
+ */
+#define SPOTF2_BX 64u
+
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
 static inline size_t max(size_t a, size_t b) { return (a > b) ? a : b; }
 
@@ -81,6 +88,193 @@ static inline void spotf2(CBlasUplo uplo,
   }
 }
 
+/**
+ * Size below which the recursive Cholesky decomposition uses the unblocked
+ * algorithm.
+ */
+#define SPOTRF_RECURSIVE_NB 64
+
+/**
+ * Recursive Cholesky decomposition.  A is split into halves, the leading half
+ * is factored recursively, the off-diagonal block is solved for with TRSM and
+ * the trailing half is updated with SYRK before being factored recursively.
+ * Every level does most of its work in a single large TRSM and SYRK so the
+ * blocking adapts to the size of the matrix instead of being fixed.
+ */
+static void spotrf_recursive(CBlasUplo uplo,
+                             size_t n,
+                             float * restrict A, size_t lda,
+                             long * restrict info) {
+  if (n <= SPOTRF_RECURSIVE_NB) {
+    spotf2(uplo, n, A, lda, info);
+    return;
+  }
+
+  const size_t n1 = n / 2;
+  const size_t n2 = n - n1;
+
+  spotrf_recursive(uplo, n1, A, lda, info);
+  if (*info != 0)
+    return;
+
+  if (uplo == CBlasUpper) {
+    strsm(CBlasLeft, CBlasUpper, CBlasTrans, CBlasNonUnit, n1, n2,
+          one, A, lda, &A[n1 * lda], lda);
+    ssyrk(CBlasUpper, CBlasTrans, n2, n1,
+          -one, &A[n1 * lda], lda, one, &A[n1 * lda + n1], lda);
+  }
+  else {
+    strsm(CBlasRight, CBlasLower, CBlasTrans, CBlasNonUnit, n2, n1,
+          one, A, lda, &A[n1], lda);
+    ssyrk(CBlasLower, CBlasNoTrans, n2, n1,
+          -one, &A[n1], lda, one, &A[n1 * lda + n1], lda);
+  }
+
+  spotrf_recursive(uplo, n2, &A[n1 * lda + n1], lda, info);
+  if (*info != 0)
+    (*info) += (long)n1;
+}
+
+/** Size of the tiles in the tiled Cholesky decomposition unless it is tuned */
+#define SPOTRF_TILED_NB 256
+
+/**
+ * Tiled Cholesky decomposition.  Each tile operation (a recursive
+ * factorisation of a diagonal tile, a TRSM of an off-diagonal tile, a SYRK
+ * of a diagonal tile or a GEMM of an off-diagonal tile) is an OpenMP task whose
+ * dependencies are the tiles it reads and writes.  The runtime schedules tasks
+ * as soon as their inputs are ready so the factorisation of the next diagonal
+ * tile overlaps the rest of the trailing update instead of waiting for it.
+ * Tasks run on a single thread each as nested parallel regions are inactive.
+ */
+static void spotrf_tiled(CBlasUplo uplo,
+                         size_t n,
+                         float * restrict A, size_t lda,
+                         long * restrict info) {
+  // The tile size is taken from potrfTile, then the entry for the host in the
+  // tuning database, then the compiled-in size
+  size_t nb = potrfTile;
+  if (nb == 0) {
+    CBlasBlocking blocking;
+    nb = (cuBLASTuningGet(NULL, CBlasSpotrf, &blocking) == CUDA_SUCCESS) ? blocking.mb : SPOTRF_TILED_NB;
+  }
+
+  // Set by the first diagonal tile that is not positive definite.  Tasks that
+  // are already queued skip their work once it is set.
+  long failed = 0;
+
+#pragma omp parallel
+#pragma omp single
+  for (size_t k = 0; k < n; k += nb) {
+    const size_t kb = min(nb, n - k);
+
+#pragma omp task depend(inout: A[k * lda + k]) shared(failed)
+    {
+      long f;
+#pragma omp atomic read
+      f = failed;
+      if (f == 0) {
+        spotrf_recursive(uplo, kb, &A[k * lda + k], lda, &f);
+        if (f != 0) {
+#pragma omp atomic write
+          failed = f + (long)k;
+        }
+      }
+    }
+
+    if (uplo == CBlasUpper) {
+      for (size_t j = k + kb; j < n; j += nb) {
+        const size_t jb = min(nb, n - j);
+
+#pragma omp task depend(in: A[k * lda + k]) depend(inout: A[j * lda + k]) shared(failed)
+        {
+          long f;
+#pragma omp atomic read
+          f = failed;
+          if (f == 0)
+            strsm(CBlasLeft, CBlasUpper, CBlasTrans, CBlasNonUnit, kb, jb,
+                  one, &A[k * lda + k], lda, &A[j * lda + k], lda);
+        }
+      }
+
+      for (size_t j = k + kb; j < n; j += nb) {
+        const size_t jb = min(nb, n - j);
+
+#pragma omp task depend(in: A[j * lda + k]) depend(inout: A[j * lda + j]) shared(failed)
+        {
+          long f;
+#pragma omp atomic read
+          f = failed;
+          if (f == 0)
+            ssyrk(CBlasUpper, CBlasTrans, jb, kb,
+                  -one, &A[j * lda + k], lda, one, &A[j * lda + j], lda);
+        }
+
+        for (size_t i = k + kb; i < j; i += nb) {
+          const size_t ib = min(nb, n - i);
+
+#pragma omp task depend(in: A[i * lda + k], A[j * lda + k]) depend(inout: A[j * lda + i]) shared(failed)
+          {
+            long f;
+#pragma omp atomic read
+            f = failed;
+            if (f == 0)
+              sgemm(CBlasTrans, CBlasNoTrans, ib, jb, kb,
+                    -one, &A[i * lda + k], lda, &A[j * lda + k], lda,
+                    one, &A[j * lda + i], lda);
+          }
+        }
+      }
+    }
+    else {
+      for (size_t i = k + kb; i < n; i += nb) {
+        const size_t ib = min(nb, n - i);
+
+#pragma omp task depend(in: A[k * lda + k]) depend(inout: A[k * lda + i]) shared(failed)
+        {
+          long f;
+#pragma omp atomic read
+          f = failed;
+          if (f == 0)
+            strsm(CBlasRight, CBlasLower, CBlasTrans, CBlasNonUnit, ib, kb,
+                  one, &A[k * lda + k], lda, &A[k * lda + i], lda);
+        }
+      }
+
+      for (size_t j = k + kb; j < n; j += nb) {
+        const size_t jb = min(nb, n - j);
+
+#pragma omp task depend(in: A[k * lda + j]) depend(inout: A[j * lda + j]) shared(failed)
+        {
+          long f;
+#pragma omp atomic read
+          f = failed;
+          if (f == 0)
+            ssyrk(CBlasLower, CBlasNoTrans, jb, kb,
+                  -one, &A[k * lda + j], lda, one, &A[j * lda + j], lda);
+        }
+
+        for (size_t i = j + jb; i < n; i += nb) {
+          const size_t ib = min(nb, n - i);
+
+#pragma omp task depend(in: A[k * lda + i], A[k * lda + j]) depend(inout: A[j * lda + i]) shared(failed)
+          {
+            long f;
+#pragma omp atomic read
+            f = failed;
+            if (f == 0)
+              sgemm(CBlasNoTrans, CBlasTrans, ib, jb, kb,
+                    -one, &A[k * lda + i], lda, &A[k * lda + j], lda,
+                    one, &A[j * lda + i], lda);
+          }
+        }
+      }
+    }
+  }
+
+  *info = failed;
+}
+
 void spotrf(CBlasUplo uplo,
             size_t n,
             float * restrict A, size_t lda,
@@ -95,6 +289,15 @@ void spotrf(CBlasUplo uplo,
 
   if (n == 0) return;
 
+  if (potrfAlgorithm == CLapackPotrfRecursive) {
+    spotrf_recursive(uplo, n, A, lda, info);
+    return;
+  }
+  if (potrfAlgorithm == CLapackPotrfTiled) {
+    spotrf_tiled(uplo, n, A, lda, info);
+    return;
+  }
+
   const size_t nb = (uplo == CBlasUpper) ? 16 : 32;
 
   if (nb > n) {
@@ -146,22 +349,41 @@ void spotrf(CBlasUplo uplo,
   }
 }
 
+/**
+ * Loads the SPOTRF module and looks up the unblocked kernel for each uplo.  The
+ * handle's context must be current.
+ */
+CUresult spotrf_load(CULAPACKhandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    char name[39];
+    snprintf(name, 39, "_Z6spotf2IL9CBlasUplo%dELj%uEEvPfPiii", uplos[u], SPOTF2_BX);
+    CU_ERROR_CHECK(lookup(&handle->spotf2[u], module, name));
+  }
+
+  handle->spotrf = module;
+
+  return CUDA_SUCCESS;
+}
+
 static inline CUresult cuSpotf2(CULAPACKhandle handle, CBlasUplo uplo,
                                 size_t n,
                                 CUdeviceptr A, size_t lda,
                                 CUdeviceptr info, CUstream stream) {
-  const unsigned int bx = 64;
+  const unsigned int bx = SPOTF2_BX;
   if (n > bx)
     return CUDA_ERROR_INVALID_VALUE;
 
   if (handle->spotrf == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->spotrf, imageBytes));
+    CU_ERROR_CHECK(spotrf_load(handle));
 
-  char name[39];
-  snprintf(name, 39, "_Z6spotf2IL9CBlasUplo%dELj%uEEvPfPiii", uplo, bx);
-
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->spotrf, name));
+  CUfunction function = handle->spotf2[(uplo == CBlasUpper) ? 0 : 1];
+  if (function == NULL)
+    return CUDA_ERROR_NOT_FOUND;
 
   void * params[] = { &A, &info, &lda, &n };
 
@@ -176,7 +398,7 @@ static inline CUresult cuSpotfimm2(CULAPACKhandle handle, CBlasUplo uplo,
                                    CUdeviceptr B, size_t ldb,
                                    CUdeviceptr info, CUstream stream) {
   if (handle->spotrf == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->spotrf, imageBytes));
+    CU_ERROR_CHECK(spotrf_load(handle));
 
   /* For uplo == CBlasUpper m = jb, n = n - j - jb, k = j and an extra column
    * of blocks is needed to compute the cholesky
@@ -204,7 +426,7 @@ static inline CUresult cuSpotfimm2(CULAPACKhandle handle, CBlasUplo uplo,
   return CUDA_SUCCESS;
 }
 
-static CUresult hybridSpotrf(CBlasUplo uplo,
+static CUresult hybridSpotrf(CULAPACKhandle handle, struct packed * P, CBlasUplo uplo,
                              CUdeviceptr A, size_t lda, float * X, size_t ldb,
                              float * C, size_t ldc, CUdeviceptr D, size_t ldd,
                              size_t j, size_t jb, size_t n, long * info, CUstream stream) {
@@ -227,9 +449,9 @@ static CUresult hybridSpotrf(CBlasUplo uplo,
     B = &X[j];    // The diagonal block is half-way down
   }
   else {
-    // Copy each column of the diagonal block separately
-    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(X, ldb, 0, 0, A, lda, j, j,
-                                      jb, jb, sizeof(float), stream));
+    // Copy the triangle of the diagonal block packed into contiguous memory
+    CU_ERROR_CHECK(packed_download(handle, P, uplo, jb, A + (j * lda + j) * sizeof(float), lda,
+                                   X, ldb, stream));
     B = X;      // The diagonal block is at the top of the column
   }
 
@@ -242,8 +464,8 @@ static CUresult hybridSpotrf(CBlasUplo uplo,
   if (bcc_htod)
     CU_ERROR_CHECK(cuMemcpyHtoDAsync(A + j * lda * sizeof(float), X, n * jb * sizeof(float), stream));
   else
-    CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, j, j, B, ldb, 0, 0,
-                                      jb, jb, sizeof(float), stream));
+    CU_ERROR_CHECK(packed_upload(handle, P, uplo, jb, B, ldb,
+                                 A + (j * lda + j) * sizeof(float), lda, stream));
 
   /* If the matrix is not positive definite don't bother with the inverse */
   if (*info != 0)
@@ -297,6 +519,7 @@ CUresult cuSpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
   // dynamic block sizing
 //   size_t nb = n / 4;
 
+  struct packed P;
   float * B, * C;
   size_t ldb, ldc;
   CUdeviceptr D;
@@ -304,17 +527,19 @@ CUresult cuSpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
   CUstream stream0, stream1;
 
   // Allocate memory for the block column
-  CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (n + 3u) & ~3u) * nb * sizeof(float)));
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (n + 3u) & ~3u) * nb * sizeof(float)));
+  // Borrow staging memory for the packed triangle of the diagonal block
+  CU_ERROR_CHECK(packed_create(handle, &P, nb, sizeof(float)));
   // Allocate memory on host for out of place inverse
-  CU_ERROR_CHECK(cuMemAllocHost((void **)&C, (ldc = (nb + 3u) & ~3u) * nb * sizeof(float)));
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&C, (ldc = (nb + 3u) & ~3u) * nb * sizeof(float)));
 
-  // Create two streams for asynchronous copy and compute
-  CU_ERROR_CHECK(cuStreamCreate(&stream0, 0));
-  CU_ERROR_CHECK(cuStreamCreate(&stream1, 0));
+  // Borrow two streams for asynchronous copy and compute
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream0, 0));
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream1, 0));
 
   if (uplo == CBlasUpper) {
     // Allocate a temporary row matrix for out of place STRTRI, SGEMM and STRMM */
-    CU_ERROR_CHECK(cuMemAllocPitch(&D, &ldd, nb * sizeof(float), n, sizeof(float)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &D, &ldd, nb * sizeof(float), n, sizeof(float)));
     ldd /= sizeof(float);
 
     // Static block sizing
@@ -335,7 +560,7 @@ CUresult cuSpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
                               A + (j + jb) * lda * sizeof(float), lda,
                               one, A + ((j + jb) * lda + j) * sizeof(float), lda,
                               D + nb * ldd * sizeof(float), ldd, stream1));
-      CU_ERROR_CHECK(hybridSpotrf(uplo, A, lda, B, ldb, C, ldc, D, ldd, j, jb, n, info, stream0));
+      CU_ERROR_CHECK(hybridSpotrf(handle, &P, uplo, A, lda, B, ldb, C, ldc, D, ldd, j, jb, n, info, stream0));
       /* Check for positive definite matrix */
       if (*info != 0) {
         *info += (long)j;
@@ -349,7 +574,7 @@ CUresult cuSpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
   }
   else {
     // Allocate a temporary column matrix for out of place STRTRI, SGEMM and STRMM */
-    CU_ERROR_CHECK(cuMemAllocPitch(&D, &ldd, n * sizeof(float), nb, sizeof(float)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &D, &ldd, n * sizeof(float), nb, sizeof(float)));
     ldd /= sizeof(float);
 
     // Static block sizing
@@ -369,7 +594,7 @@ CUresult cuSpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
                               A + j * sizeof(float), lda,
                               one, A + (j * lda + j + jb) * sizeof(float), lda,
                               D + nb * sizeof(float), ldd, stream1));
-      CU_ERROR_CHECK(hybridSpotrf(uplo, A, lda, B, ldb, C, ldc, D, ldd, j, jb, n, info, stream0));
+      CU_ERROR_CHECK(hybridSpotrf(handle, &P, uplo, A, lda, B, ldb, C, ldc, D, ldd, j, jb, n, info, stream0));
       /* Check for positive definite matrix */
       if (*info != 0) {
         *info += (long)j;
@@ -385,14 +610,267 @@ CUresult cuSpotrf(CULAPACKhandle handle, CBlasUplo uplo, size_t n, CUdeviceptr A
     }
   }
 
+  // Wait for the streams before the temporary memory goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+
   // Clean up resources
-  CU_ERROR_CHECK(cuMemFreeHost(B));
-  CU_ERROR_CHECK(cuMemFreeHost(C));
-  CU_ERROR_CHECK(cuMemFree(D));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, B));
+  CU_ERROR_CHECK(packed_destroy(handle, &P));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, C));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, D));
 //   CU_ERROR_CHECK(cuMemFree(dinfo));
 
-  CU_ERROR_CHECK(cuStreamDestroy(stream0));
-  CU_ERROR_CHECK(cuStreamDestroy(stream1));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream0));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream1));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Arguments for the tile tasks of the multi-GPU Cholesky decomposition.  Tasks
+ * are described in terms of the lower triangle: tile (i, j) with i >= j is the
+ * ib by jb block of A at row i and column j (the block at row j and column i
+ * in the upper case).
+ */
+struct spotrf_tile_args {
+  CUmultiGPULAPACKhandle handle;
+  CBlasUplo uplo;
+  size_t i, j, ib, jb;
+  float * A;
+  size_t lda;
+  long * info;                  /** Set by the task that finds A is not
+                                    positive definite                         */
+};
+
+/**
+ * Gets the handle to use for the context the calling task is running on, or
+ * NULL if it runs on the host.
+ */
+static inline CUBLAShandle spotrfTileHandle(const struct spotrf_tile_args * args) {
+  const int context = cuMultiGPUGetCurrentContext();
+  CUmultiGPUBLAShandle handle = args->handle->blas_handle;
+  if (context < 0 || cuMultiGPUIsHost(cuMultiGPUBLASGetMultiGPU(handle), context))
+    return NULL;
+  return cuMultiGPUBLASGetHandle(handle, context);
+}
+
+/**
+ * Factors diagonal tile (j, j) on the host.
+ */
+static CUresult spotrfTileFactor(const void * a) {
+  const struct spotrf_tile_args * args = (const struct spotrf_tile_args *)a;
+  const size_t j = args->j, lda = args->lda;
+
+  long info;
+  spotrf(args->uplo, args->jb, &args->A[j * lda + j], lda, &info);
+  if (info != 0) {
+    // Later diagonal tiles depend on this one so only one task can get here
+    *args->info = info + (long)j;
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Updates tile (i, j) with the factored tiles to the left of it (above it).
+ */
+static CUresult spotrfTileUpdate(const void * a) {
+  const struct spotrf_tile_args * args = (const struct spotrf_tile_args *)a;
+  const size_t i = args->i, j = args->j, ib = args->ib, jb = args->jb, lda = args->lda;
+  float * A = args->A;
+
+  CUBLAShandle handle = spotrfTileHandle(args);
+  if (handle == NULL) {
+    if (args->uplo == CBlasUpper) {
+      if (i == j)
+        ssyrk(CBlasUpper, CBlasTrans, jb, j, -one, &A[j * lda], lda, one, &A[j * lda + j], lda);
+      else
+        sgemm(CBlasTrans, CBlasNoTrans, jb, ib, j, -one, &A[j * lda], lda, &A[i * lda], lda,
+              one, &A[i * lda + j], lda);
+    }
+    else {
+      if (i == j)
+        ssyrk(CBlasLower, CBlasNoTrans, jb, j, -one, &A[j], lda, one, &A[j * lda + j], lda);
+      else
+        sgemm(CBlasNoTrans, CBlasTrans, ib, jb, j, -one, &A[i], lda, &A[j], lda,
+              one, &A[j * lda + i], lda);
+    }
+    return CUDA_SUCCESS;
+  }
+
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  // The panel of the diagonal tile (X) is needed by every update and the panel
+  // of the tile itself (Y) only off the diagonal
+  CUdeviceptr X, Y = 0, C;
+  size_t ldx, ldy = 0, ldc;
+  if (args->uplo == CBlasUpper) {
+    CU_ERROR_CHECK(matrix_upload(handle, &A[j * lda], lda, j, jb, sizeof(float), &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_upload(handle, &A[i * lda + j], lda, jb, ib, sizeof(float), &C, &ldc, stream));
+    if (i == j)
+      CU_ERROR_CHECK(cuSsyrk(handle, CBlasUpper, CBlasTrans, jb, j, -one, X, ldx, one, C, ldc, stream));
+    else {
+      CU_ERROR_CHECK(matrix_upload(handle, &A[i * lda], lda, j, ib, sizeof(float), &Y, &ldy, stream));
+      CU_ERROR_CHECK(cuSgemm(handle, CBlasTrans, CBlasNoTrans, jb, ib, j, -one, X, ldx, Y, ldy,
+                             one, C, ldc, stream));
+    }
+    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(A, lda, j, i, C, ldc, 0, 0, jb, ib, sizeof(float), stream));
+  }
+  else {
+    CU_ERROR_CHECK(matrix_upload(handle, &A[j], lda, jb, j, sizeof(float), &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_upload(handle, &A[j * lda + i], lda, ib, jb, sizeof(float), &C, &ldc, stream));
+    if (i == j)
+      CU_ERROR_CHECK(cuSsyrk(handle, CBlasLower, CBlasNoTrans, jb, j, -one, X, ldx, one, C, ldc, stream));
+    else {
+      CU_ERROR_CHECK(matrix_upload(handle, &A[i], lda, ib, j, sizeof(float), &Y, &ldy, stream));
+      CU_ERROR_CHECK(cuSgemm(handle, CBlasNoTrans, CBlasTrans, ib, jb, j, -one, Y, ldy, X, ldx,
+                             one, C, ldc, stream));
+    }
+    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(A, lda, i, j, C, ldc, 0, 0, ib, jb, sizeof(float), stream));
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  if (Y != 0)
+    CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, C));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Solves tile (i, j) below (to the right of) a factored diagonal tile.
+ */
+static CUresult spotrfTileSolve(const void * a) {
+  const struct spotrf_tile_args * args = (const struct spotrf_tile_args *)a;
+  const size_t i = args->i, j = args->j, ib = args->ib, jb = args->jb, lda = args->lda;
+  float * A = args->A;
+
+  CUBLAShandle handle = spotrfTileHandle(args);
+  if (handle == NULL) {
+    if (args->uplo == CBlasUpper)
+      strsm(CBlasLeft, CBlasUpper, CBlasTrans, CBlasNonUnit, jb, ib,
+            one, &A[j * lda + j], lda, &A[i * lda + j], lda);
+    else
+      strsm(CBlasRight, CBlasLower, CBlasTrans, CBlasNonUnit, ib, jb,
+            one, &A[j * lda + j], lda, &A[j * lda + i], lda);
+    return CUDA_SUCCESS;
+  }
+
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D, B;
+  size_t ldd, ldb;
+  CU_ERROR_CHECK(matrix_upload(handle, &A[j * lda + j], lda, jb, jb, sizeof(float), &D, &ldd, stream));
+  if (args->uplo == CBlasUpper) {
+    CU_ERROR_CHECK(matrix_upload(handle, &A[i * lda + j], lda, jb, ib, sizeof(float), &B, &ldb, stream));
+    CU_ERROR_CHECK(cuStrsm(handle, CBlasLeft, CBlasUpper, CBlasTrans, CBlasNonUnit, jb, ib,
+                           one, D, ldd, B, ldb, stream));
+    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(A, lda, j, i, B, ldb, 0, 0, jb, ib, sizeof(float), stream));
+  }
+  else {
+    CU_ERROR_CHECK(matrix_upload(handle, &A[j * lda + i], lda, ib, jb, sizeof(float), &B, &ldb, stream));
+    CU_ERROR_CHECK(cuStrsm(handle, CBlasRight, CBlasLower, CBlasTrans, CBlasNonUnit, ib, jb,
+                           one, D, ldd, B, ldb, stream));
+    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(A, lda, i, j, B, ldb, 0, 0, ib, jb, sizeof(float), stream));
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, B));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Builds the task graph of the left-looking tiled Cholesky decomposition and
+ * submits each task as soon as it is created.  Tile (j, j) is updated and
+ * factored on the host context (or the first context if there is none), then
+ * each tile below it is updated with the tiles to its left and solved on the
+ * context it is dealt to.  A task only waits for the tiles it reads and writes,
+ * so the update of the next diagonal tile and its factorisation overlap the
+ * rest of the block column.  Tile (i, k) is final once solved[k * nt + i] has
+ * finished and, as each solve waits for the one before it in the same row,
+ * depending on the last solved tile of a row covers the whole row.  Tasks are
+ * added to tasks once they have been submitted.
+ */
+static CUresult spotrfGraph(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                            size_t n, size_t nb, float * A, size_t lda, long * info,
+                            CUtask * tasks, size_t * nTasks, CUtask * solved,
+                            CUtask * batch, int * contexts) {
+  CUmultiGPU mGPU = cuMultiGPUBLASGetMultiGPU(handle->blas_handle);
+  const size_t nt = (n + nb - 1) / nb;
+
+  int host = 0;
+  for (int c = cuMultiGPUGetContextCount(mGPU) - 1; c >= 0; c--) {
+    if (cuMultiGPUIsHost(mGPU, c))
+      host = c;
+  }
+
+  struct spotrf_tile_args args = { .handle = handle, .uplo = uplo, .A = A, .lda = lda, .info = info };
+
+  for (size_t k = 0; k < nt; k++) {
+    args.i = args.j = k * nb;
+    args.ib = args.jb = min(nb, n - k * nb);
+
+    CUtask update = NULL, factor;
+    if (k > 0) {
+      CU_ERROR_CHECK(cuTaskCreate(&update, spotrfTileUpdate, &args, sizeof(struct spotrf_tile_args)));
+      CU_ERROR_CHECK(cuTaskAddDependency(update, solved[(k - 1) * nt + k]));
+      CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, host, update));
+      tasks[(*nTasks)++] = update;
+    }
+    CU_ERROR_CHECK(cuTaskCreate(&factor, spotrfTileFactor, &args, sizeof(struct spotrf_tile_args)));
+    if (update != NULL)
+      CU_ERROR_CHECK(cuTaskAddDependency(factor, update));
+    CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, host, factor));
+    tasks[(*nTasks)++] = factor;
+    solved[k * nt + k] = factor;
+
+    if (k + 1 == nt)
+      break;
+
+    // Deal the tiles below the diagonal out in proportion to the rate each
+    // context is predicted to update and solve them.  The update and solve of a
+    // tile go to the same context.
+    const double flops = 2.0 * (double)nb * (double)nb * (double)(k * nb) + (double)nb * (double)nb * (double)nb;
+    const double bytes = (double)((2 * k * nb + 4 * nb) * nb * sizeof(float));
+    CU_ERROR_CHECK(cuMultiGPUPartition(mGPU, flops, bytes, contexts, nt - k - 1));
+
+    size_t nBatch = 0;
+    for (size_t i = k + 1; i < nt; i++) {
+      const int context = contexts[i - k - 1];
+      args.i = i * nb;
+      args.ib = min(nb, n - i * nb);
+
+      if (k > 0) {
+        CU_ERROR_CHECK(cuTaskCreate(&update, spotrfTileUpdate, &args, sizeof(struct spotrf_tile_args)));
+        CU_ERROR_CHECK(cuTaskAddDependency(update, solved[(k - 1) * nt + i]));
+        CU_ERROR_CHECK(cuTaskAddDependency(update, solved[(k - 1) * nt + k]));
+        batch[nBatch] = update;
+        contexts[nt + nBatch++] = context;
+      }
+
+      CUtask solve;
+      CU_ERROR_CHECK(cuTaskCreate(&solve, spotrfTileSolve, &args, sizeof(struct spotrf_tile_args)));
+      CU_ERROR_CHECK(cuTaskAddDependency(solve, factor));
+      if (k > 0)
+        CU_ERROR_CHECK(cuTaskAddDependency(solve, update));
+      batch[nBatch] = solve;
+      contexts[nt + nBatch++] = context;
+      solved[k * nt + i] = solve;
+    }
+
+    CU_ERROR_CHECK(cuMultiGPURunTasks(mGPU, &contexts[nt], batch, nBatch));
+    for (size_t l = 0; l < nBatch; l++)
+      tasks[(*nTasks)++] = batch[l];
+  }
 
   return CUDA_SUCCESS;
 }
@@ -412,57 +890,245 @@ CUresult cuMultiGPUSpotrf(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
   if (n == 0)
     return CUDA_SUCCESS;
 
-  const size_t nb = (uplo == CBlasUpper) ? SGEMM_T_MB : SGEMM_N_NB;
+  // Any copies of A cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float)));
+
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, (uplo == CBlasUpper) ? CBlasSgemmT : CBlasSgemmN, &blocking));
+  const size_t nb = (uplo == CBlasUpper) ? blocking.mb : blocking.nb;
 
   if (n < nb) {
     spotrf(uplo, n, A, lda, info);
     return CUDA_SUCCESS;
   }
 
-  if (uplo == CBlasUpper) {
-    for (size_t j = 0; j < n; j += nb) {
-      const size_t jb = min(nb, n - j);
+  // At most two tasks per tile of the lower triangle
+  const size_t nt = (n + nb - 1) / nb;
+  CUtask * tasks = malloc(nt * (nt + 1) * sizeof(CUtask));
+  CUtask * solved = malloc(nt * nt * sizeof(CUtask));
+  CUtask * batch = malloc(2 * nt * sizeof(CUtask));
+  int * contexts = malloc(3 * nt * sizeof(int));
+  if (tasks == NULL || solved == NULL || batch == NULL || contexts == NULL) {
+    free(tasks);
+    free(solved);
+    free(batch);
+    free(contexts);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
 
-      CU_ERROR_CHECK(cuMultiGPUSsyrk(handle->blas_handle, CBlasUpper, CBlasTrans, jb, j,
-                                     -one, &A[j * lda], lda, one, &A[j * lda + j], lda));
-      CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle->blas_handle));
-      spotrf(CBlasUpper, jb, &A[j * lda + j], lda, info);
-      if (*info != 0) {
-        (*info) += (long)j;
-        return CUDA_ERROR_INVALID_VALUE;
-      }
+  size_t nTasks = 0;
+  CUresult error = spotrfGraph(handle, uplo, n, nb, A, lda, info, tasks, &nTasks, solved, batch, contexts);
 
-      if (j + jb < n) {
-        CU_ERROR_CHECK(cuMultiGPUSgemm(handle->blas_handle, CBlasTrans, CBlasNoTrans, jb, n - j - jb, j,
-                                       -one, &A[j * lda], lda, &A[(j + jb) * lda], lda,
-                                       one, &A[(j + jb) * lda + j], lda));
-        CU_ERROR_CHECK(cuMultiGPUStrsm(handle->blas_handle, CBlasLeft, CBlasUpper, CBlasTrans, CBlasNonUnit, jb, n - j - jb,
-                                       one, &A[j * lda + j], lda, &A[(j + jb) * lda + j], lda));
+  // Wait for every task that was submitted, even if building the graph failed
+  CUresult result;
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, nTasks, &result));
+
+  free(tasks);
+  free(solved);
+  free(batch);
+  free(contexts);
+
+  // Blocks of A were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float)));
+
+  if (error != CUDA_SUCCESS)
+    return error;
+  if (*info != 0)
+    return CUDA_ERROR_INVALID_VALUE;
+  return result;
+}
+
+/**
+ * Solves for the rest of block row (column) k of a distributed matrix on the
+ * processes holding it.
+ */
+static CUresult spotrfPanel(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  size_t i, j, m, n;
+  if (step->uplo == CBlasUpper) {
+    if (k % (size_t)A->p != (size_t)pr)
+      return CUDA_SUCCESS;
+    i = k / (size_t)A->p;
+    j = matrix_local(k + 1, pc, A->q);
+    m = kb;
+    n = matrix_extent(j, matrix_local(A->nt, pc, A->q), pc, A->q, nb, A->n);
+  }
+  else {
+    if (k % (size_t)A->q != (size_t)pc)
+      return CUDA_SUCCESS;
+    i = matrix_local(k + 1, pr, A->p);
+    j = k / (size_t)A->q;
+    m = matrix_extent(i, matrix_local(A->mt, pr, A->p), pr, A->p, nb, A->m);
+    n = kb;
+  }
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D;
+  size_t ldd;
+  CU_ERROR_CHECK(matrix_upload(handle, step->D, step->ldd, kb, kb, sizeof(float), &D, &ldd, stream));
+
+  if (step->uplo == CBlasUpper)
+    CU_ERROR_CHECK(cuStrsm(handle, CBlasLeft, CBlasUpper, CBlasTrans, CBlasNonUnit, m, n,
+                           one, D, ldd, matrix_block(A, r, i, j), A->ld[r], stream));
+  else
+    CU_ERROR_CHECK(cuStrsm(handle, CBlasRight, CBlasLower, CBlasTrans, CBlasNonUnit, m, n,
+                           one, D, ldd, matrix_block(A, r, i, j), A->ld[r], stream));
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Updates the blocks of the trailing matrix held by a process with block row
+ * (column) k.
+ */
+static CUresult spotrfUpdate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  const size_t mt = matrix_local(A->mt, pr, A->p), nt = matrix_local(A->nt, pc, A->q);
+  const size_t i0 = matrix_local(k + 1, pr, A->p), j0 = matrix_local(k + 1, pc, A->q);
+  if (i0 == mt || j0 == nt)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  // The blocks of the panel are needed both down the rows and across the
+  // columns of the process
+  CUdeviceptr X, Y;
+  size_t ldx, ldy;
+  if (step->uplo == CBlasUpper) {
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pr, A->p, k + 1, A->mt, kb, step->G, step->ldg, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pc, A->q, k + 1, A->nt, kb, step->G, step->ldg, &Y, &ldy, stream));
+
+    for (size_t j = j0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i1 = matrix_local(J + 1, pr, A->p);
+      if (i1 > i0 && (i1 - 1) * (size_t)A->p + (size_t)pr == J) {
+        i1--;
+        CU_ERROR_CHECK(cuSsyrk(handle, CBlasUpper, CBlasTrans, jb, kb,
+                               -1.0f, matrix_panel(A, false, X, ldx, i1), ldx,
+                               1.0f, matrix_block(A, r, i1, j), A->ld[r], stream));
       }
+      if (i1 > i0)
+        CU_ERROR_CHECK(cuSgemm(handle, CBlasTrans, CBlasNoTrans,
+                               matrix_extent(i0, i1, pr, A->p, nb, A->m), jb, kb,
+                               -one, matrix_panel(A, false, X, ldx, i0), ldx,
+                               matrix_panel(A, false, Y, ldy, j), ldy,
+                               one, matrix_block(A, r, i0, j), A->ld[r], stream));
     }
   }
   else {
-    for (size_t j = 0; j < n; j += nb) {
-      const size_t jb = min(nb, n - j);
-
-      CU_ERROR_CHECK(cuMultiGPUSsyrk(handle->blas_handle, CBlasLower, CBlasNoTrans, jb, j,
-                                     -one, &A[j], lda, one, &A[j * lda + j], lda));
-      CU_ERROR_CHECK(cuMultiGPUBLASSynchronize(handle->blas_handle));
-      spotrf(CBlasLower, jb, &A[j * lda + j], lda, info);
-      if (*info != 0) {
-        (*info) += (long)j;
-        return CUDA_ERROR_INVALID_VALUE;
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pr, A->p, k + 1, A->mt, kb, step->H, step->ldh, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pc, A->q, k + 1, A->nt, kb, step->H, step->ldh, &Y, &ldy, stream));
+
+    for (size_t j = j0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i = matrix_local(J, pr, A->p);
+      if (i < mt && i * (size_t)A->p + (size_t)pr == J) {
+        CU_ERROR_CHECK(cuSsyrk(handle, CBlasLower, CBlasNoTrans, jb, kb,
+                               -1.0f, matrix_panel(A, true, X, ldx, i), ldx,
+                               1.0f, matrix_block(A, r, i, j), A->ld[r], stream));
+        i++;
       }
+      if (i < mt)
+        CU_ERROR_CHECK(cuSgemm(handle, CBlasNoTrans, CBlasTrans,
+                               matrix_extent(i, mt, pr, A->p, nb, A->m), jb, kb,
+                               -one, matrix_panel(A, true, X, ldx, i), ldx,
+                               matrix_panel(A, true, Y, ldy, j), ldy,
+                               one, matrix_block(A, r, i, j), A->ld[r], stream));
+    }
+  }
 
-      if (j + jb < n) {
-        CU_ERROR_CHECK(cuMultiGPUSgemm(handle->blas_handle, CBlasNoTrans, CBlasTrans, n - j - jb, jb, j,
-                                       -one, &A[j + jb], lda, &A[j], lda,
-                                       one, &A[j * lda + j + jb], lda));
-        CU_ERROR_CHECK(cuMultiGPUStrsm(handle->blas_handle, CBlasRight, CBlasLower, CBlasTrans, CBlasNonUnit, n - j - jb, jb,
-                                       one, &A[j * lda + j], lda, &A[j * lda + j + jb], lda));
-      }
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult spotrfMatrix(CBlasUplo uplo, struct __cumultigpumatrix_st * A,
+                             float * D, float * H, long * info) {
+  const size_t n = A->n, nb = A->nb;
+
+  // Block columns are passed to the update as blocks of rows with leading
+  // dimension n and block rows as blocks of columns with leading dimension nb
+  struct matrix_step step = { .A = A, .uplo = uplo, .D = D, .ldd = nb,
+                              .H = H, .ldh = n, .G = H, .ldg = nb };
+
+  for (size_t k = 0; k < A->nt; k++) {
+    const size_t kb = min(nb, n - k * nb);
+    step.k = k;
+
+    // The diagonal block is factored on the host
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, nb, true));
+    spotrf(uplo, kb, D, nb, info);
+    if (*info != 0) {
+      (*info) += (long)(k * nb);
+      return CUDA_ERROR_INVALID_VALUE;
     }
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, nb, false));
+
+    if (k + 1 == A->nt)
+      break;
+
+    // The rest of the block row (column) is solved on its own processes and
+    // then is the only part of the matrix sent to the others
+    CU_ERROR_CHECK(matrix_run(&step, spotrfPanel));
+    if (uplo == CBlasUpper)
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k + 1, A->nt, &H[(k + 1) * nb * nb], nb, true));
+    else
+      CU_ERROR_CHECK(matrix_copy(A, k + 1, A->mt, k, k + 1, &H[(k + 1) * nb], n, true));
+    CU_ERROR_CHECK(matrix_run(&step, spotrfUpdate));
   }
 
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPUSpotrfMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(float))
+    *info = -3;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  float * D = malloc(A->nb * A->nb * sizeof(float));
+  float * H = malloc(A->n * A->nb * sizeof(float));
+  if (D == NULL || H == NULL) {
+    free(D);
+    free(H);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+
+  CUresult result = spotrfMatrix(uplo, A, D, H, info);
+
+  free(D);
+  free(H);
+
+  return result;
+}
@@ -1,4 +1,5 @@
 #include "lapack.h"
+#include "handle.h"
 #include "error.h"
 
 void spotri(CBlasUplo uplo,
@@ -67,3 +68,23 @@ CUresult cuMultiGPUSpotri(CUmultiGPULAPACKhandle handle,
   CU_ERROR_CHECK(cuMultiGPUSlauum(handle, uplo, n, A, lda, info));
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPUSpotriMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(float))
+    *info = -3;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  CU_ERROR_CHECK(cuMultiGPUStrtriMatrix(handle, uplo, CBlasNonUnit, A, info));
+  if (*info != 0)
+    return CUDA_SUCCESS;
+  CU_ERROR_CHECK(cuMultiGPUSlauumMatrix(handle, uplo, A, info));
+  return CUDA_SUCCESS;
+}
@@ -2,9 +2,16 @@
 #include "handle.h"
 #include "error.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include "config.h"
 #include "strtri.fatbin.c"
 
+/**
+ * Number of threads used by the unblocked kernel (and so the largest matrix it
+ * can work on).
+ */
+#define STRTI2_BX 64u
+
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
 
 static inline CUresult cuMemcpyHtoD2DAsync(CUdeviceptr A, size_t lda, size_t ai, size_t aj,
@@ -254,7 +261,7 @@ void strtri2(CBlasUplo uplo, CBlasDiag diag,
       strmm2(CBlasLeft, CBlasUpper, CBlasNoTrans, diag,
              j, jb,
              one, B, ldb, &A[j * lda], lda,
-             &B[j * ldb], lda);
+             &B[j * ldb], ldb);
       strsm(CBlasRight, CBlasUpper, CBlasNoTrans, diag,
             j, jb,
             -one, &A[j * lda + j], lda,
@@ -298,24 +305,46 @@ void strtri2(CBlasUplo uplo, CBlasDiag diag,
   }
 }
 
+/**
+ * Loads the STRTRI module and looks up the unblocked kernel for each uplo and
+ * diag.  The handle's context must be current.
+ */
+CUresult strtri_load(CULAPACKhandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const CBlasDiag diags[] = { CBlasNonUnit, CBlasUnit };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    for (int d = 0; d < 2; d++) {
+      char name[57];
+      snprintf(name, 57, "_Z6strti2IL9CBlasUplo%dEL9CBlasDiag%dELj%uEEvPKfPfPiiii", uplos[u], diags[d], STRTI2_BX);
+      CU_ERROR_CHECK(lookup(&handle->strti2[u][d], module, name));
+    }
+  }
+
+  handle->strtri = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuStrti22(CULAPACKhandle handle, CBlasUplo uplo, CBlasDiag diag,
                    size_t n,
                    CUdeviceptr A, size_t lda,
                    CUdeviceptr B, size_t ldb,
                    CUdeviceptr info, CUstream stream) {
-  const unsigned int bx = 64;
+  const unsigned int bx = STRTI2_BX;
 
   if (n > bx || lda < n)
     return CUDA_ERROR_INVALID_VALUE;
 
   if (handle->strtri == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->strtri, imageBytes));
-
-  char name[57];
-  snprintf(name, 57, "_Z6strti2IL9CBlasUplo%dEL9CBlasDiag%dELj%uEEvPKfPfPiiii", uplo, diag, bx);
+    CU_ERROR_CHECK(strtri_load(handle));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->strtri, name));
+  CUfunction function = handle->strti2[(uplo == CBlasUpper) ? 0 : 1][(diag == CBlasNonUnit) ? 0 : 1];
+  if (function == NULL)
+    return CUDA_ERROR_NOT_FOUND;
 
   void * params[] = { &A, &B, &info, &lda, &ldb, &n };
 
@@ -324,7 +353,7 @@ CUresult cuStrti22(CULAPACKhandle handle, CBlasUplo uplo, CBlasDiag diag,
   return CUDA_SUCCESS;
 }
 
-static CUresult hybridStrtri(CBlasUplo uplo, CBlasDiag diag,
+static CUresult hybridStrtri(CULAPACKhandle handle, struct packed * P, CBlasUplo uplo, CBlasDiag diag,
                              CUdeviceptr A, size_t lda, float * X, size_t ldb,
                              size_t j, size_t jb, size_t n, long * info, CUstream stream) {
 
@@ -346,9 +375,9 @@ static CUresult hybridStrtri(CBlasUplo uplo, CBlasDiag diag,
     B = &X[j];    // The diagonal block is half-way down
   }
   else {
-    // Copy each column of the diagonal block separately
-    CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(X, ldb, 0, 0, A, lda, j, j,
-                                      jb, jb, sizeof(float), stream));
+    // Copy the triangle of the diagonal block packed into contiguous memory
+    CU_ERROR_CHECK(packed_download(handle, P, uplo, jb, A + (j * lda + j) * sizeof(float), lda,
+                                   X, ldb, stream));
     B = X;      // The diagonal block is at the top of the column
   }
 
@@ -361,8 +390,8 @@ static CUresult hybridStrtri(CBlasUplo uplo, CBlasDiag diag,
   if (bcc_htod)
     CU_ERROR_CHECK(cuMemcpyHtoDAsync(A + j * lda * sizeof(float), X, n * jb * sizeof(float), stream));
   else
-    CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, j, j, B, ldb, 0, 0,
-                                      jb, jb, sizeof(float), stream));
+    CU_ERROR_CHECK(packed_upload(handle, P, uplo, jb, B, ldb,
+                                 A + (j * lda + j) * sizeof(float), lda, stream));
   return CUDA_SUCCESS;
 }
 
@@ -382,6 +411,7 @@ CUresult cuStrtri(CULAPACKhandle handle,
   if (n == 0)
     return CUDA_SUCCESS;
 
+  struct packed P;
   float * B;
   CUdeviceptr D;
   size_t ldb, ldd;
@@ -390,18 +420,20 @@ CUresult cuStrtri(CULAPACKhandle handle,
   const size_t nb = 512;
 
   // Allocate page-locked host memory for diagonal block column
-  CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (n + 3u) & ~3u) * nb * sizeof(float)));
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (n + 3u) & ~3u) * nb * sizeof(float)));
+  // Borrow staging memory for the packed triangle of the diagonal block
+  CU_ERROR_CHECK(packed_create(handle, &P, nb, sizeof(float)));
 
   // Allocate temporary column for out of place STRMM in STRTRI
-  CU_ERROR_CHECK(cuMemAllocPitch(&D, &ldd, n * sizeof(float), nb, sizeof(float)));
+  CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &D, &ldd, n * sizeof(float), nb, sizeof(float)));
   ldd /= sizeof(float);
 
-  // Create two streams for asynchronous copy and compute
-  CU_ERROR_CHECK(cuStreamCreate(&stream0, 0));
-  CU_ERROR_CHECK(cuStreamCreate(&stream1, 0));
+  // Borrow two streams for asynchronous copy and compute
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream0, 0));
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream1, 0));
 
   if (uplo == CBlasUpper) {
-    CU_ERROR_CHECK(hybridStrtri(uplo, diag, A, lda, B, ldb,  0, min(nb, n), n, info, stream1));
+    CU_ERROR_CHECK(hybridStrtri(handle, &P, uplo, diag, A, lda, B, ldb,  0, min(nb, n), n, info, stream1));
     /* Wait until the diagonal block has been copied back */
     CU_ERROR_CHECK(cuStreamSynchronize(stream1));
     if (*info == 0) {
@@ -411,7 +443,7 @@ CUresult cuStrtri(CULAPACKhandle handle,
         /* Update the current column using the big square matrix to the left */
         CU_ERROR_CHECK(cuStrmm2(handle->blas_handle, CBlasLeft, CBlasUpper, CBlasNoTrans, diag, j, jb,
                                 one, A, lda, A + j * lda * sizeof(float), lda, D, ldd, stream0));
-        CU_ERROR_CHECK(hybridStrtri(uplo, diag, A, lda, B, ldb, j + jb, min(nb, n - j - jb), n, info, stream1));
+        CU_ERROR_CHECK(hybridStrtri(handle, &P, uplo, diag, A, lda, B, ldb, j + jb, min(nb, n - j - jb), n, info, stream1));
         if (*info != 0) {
           *info += (long)(j + jb);
           break;
@@ -429,7 +461,7 @@ CUresult cuStrtri(CULAPACKhandle handle,
     const size_t r = n % nb;
     size_t j = (r == 0) ? n - nb : n - r;
     size_t jb = min(nb, n - j);
-    CU_ERROR_CHECK(hybridStrtri(uplo, diag, A, lda, B, ldb, j, jb, n, info, stream1));
+    CU_ERROR_CHECK(hybridStrtri(handle, &P, uplo, diag, A, lda, B, ldb, j, jb, n, info, stream1));
     /* Wait until the diagonal block has been copied back */
     CU_ERROR_CHECK(cuStreamSynchronize(stream1));
     if (*info == 0) {
@@ -439,7 +471,7 @@ CUresult cuStrtri(CULAPACKhandle handle,
                                 one, A + ((j + jb) * lda + j + jb) * sizeof(float), lda,
                                 A + (j * lda + j + jb) * sizeof(float), lda, D, ldd, stream0));
         if (j >= nb) {
-          CU_ERROR_CHECK(hybridStrtri(uplo, diag, A, lda, B, ldb, j - nb, nb, n, info, stream1));
+          CU_ERROR_CHECK(hybridStrtri(handle, &P, uplo, diag, A, lda, B, ldb, j - nb, nb, n, info, stream1));
           if (*info != 0) {
             *info += (long)(j - nb);
             break;
@@ -461,12 +493,62 @@ CUresult cuStrtri(CULAPACKhandle handle,
       *info += (long)j;
   }
 
+  // Wait for the streams before the temporary memory goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+
   // Clean up resources
-  CU_ERROR_CHECK(cuMemFreeHost(B));
-  CU_ERROR_CHECK(cuMemFree(D));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, B));
+  CU_ERROR_CHECK(packed_destroy(handle, &P));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, D));
+
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream0));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream1));
 
-  CU_ERROR_CHECK(cuStreamDestroy(stream0));
-  CU_ERROR_CHECK(cuStreamDestroy(stream1));
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Arguments to the update of a block column of the inverse.
+ */
+struct strtri_update_args {
+  CUmultiGPULAPACKhandle handle;
+  CBlasUplo uplo;
+  CBlasDiag diag;
+  size_t j, jb, n;
+  float * A;
+  size_t lda;
+};
+
+/**
+ * Updates block column j of width jb of the inverse.  The block above (upper)
+ * or below (lower) the diagonal block is multiplied by the inverted triangle
+ * before (after) it and by minus the inverted diagonal block.  Runs on the
+ * lookahead thread.
+ */
+static CUresult cuMultiGPUStrtriUpdate(const void * a) {
+  const struct strtri_update_args * args = (const struct strtri_update_args *)a;
+  CUmultiGPULAPACKhandle handle = args->handle;
+  const CBlasDiag diag = args->diag;
+  const size_t j = args->j, jb = args->jb, n = args->n, lda = args->lda;
+  float * A = args->A;
+
+  if (args->uplo == CBlasUpper) {
+    CU_ERROR_CHECK(cuMultiGPUStrmm(handle->blas_handle, CBlasLeft, CBlasUpper, CBlasNoTrans, diag,
+                                   j, jb, one, A, lda, &A[j * lda], lda));
+    CU_ERROR_CHECK(cuMultiGPUStrmm(handle->blas_handle, CBlasRight, CBlasUpper, CBlasNoTrans, diag,
+                                   j, jb, -one, &A[j * lda + j], lda, &A[j * lda], lda));
+  }
+  else if (j + jb < n) {
+    CU_ERROR_CHECK(cuMultiGPUStrmm(handle->blas_handle, CBlasLeft, CBlasLower, CBlasNoTrans, diag,
+                                   n - j - jb, jb,
+                                   one, &A[(j + jb) * lda + j + jb], lda,
+                                   &A[j * lda + j + jb], lda));
+    CU_ERROR_CHECK(cuMultiGPUStrmm(handle->blas_handle, CBlasRight, CBlasLower, CBlasNoTrans, diag,
+                                   n - j - jb, jb,
+                                   -one, &A[j * lda + j], lda,
+                                   &A[j * lda + j + jb], lda));
+  }
 
   return CUDA_SUCCESS;
 }
@@ -487,49 +569,273 @@ CUresult cuMultiGPUStrtri(CUmultiGPULAPACKhandle handle,
   if (n == 0)
     return CUDA_SUCCESS;
 
-  if (uplo == CBlasUpper) {
-    const size_t nb = SGEMM_N_MB;
+  // Any copies of A cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float)));
 
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, CBlasSgemmN, &blocking));
+  const size_t nb = blocking.mb;
+
+  // Each diagonal block is inverted on the host one step ahead while the
+  // devices update the block column before it.  Block columns are multiplied
+  // by their inverted diagonal blocks instead of solved with the original ones
+  // so that the inversion does not have to wait for the update.
+  if (uplo == CBlasUpper) {
     // Upper triangular STRTRI
+    strtri(CBlasUpper, diag, min(nb, n), A, lda, info);
+    if (*info != 0)
+      return CUDA_ERROR_INVALID_VALUE;
+
     for (size_t j = 0; j < n; j += nb) {
       const size_t jb = min(nb, n - j);
-      CU_ERROR_CHECK(cuMultiGPUStrmm(handle->blas_handle, CBlasLeft, CBlasUpper, CBlasNoTrans, diag,
-                                     j, jb, one, A, lda, &A[j * lda], lda));
-      CU_ERROR_CHECK(cuMultiGPUStrsm(handle->blas_handle, CBlasRight, CBlasUpper, CBlasNoTrans, diag,
-                                     j, jb, -one, &A[j * lda + j], lda, &A[j * lda], lda));
-      strtri(CBlasUpper, diag, jb, &A[j * lda + j], lda, info);
+      const size_t k = j + jb;
+
+      const struct strtri_update_args args = { handle, CBlasUpper, diag, j, jb, n, A, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUStrtriUpdate, &args));
+      if (k < n)
+        strtri(CBlasUpper, diag, min(nb, n - k), &A[k * lda + k], lda, info);
+      CU_ERROR_CHECK(lookahead_wait(&update));
       if (*info != 0) {
-        *info += (long)j;
+        *info += (long)k;
+        CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float)));
         return CUDA_ERROR_INVALID_VALUE;
       }
     }
   }
   else {
     // Lower triangular STRTRI
-    const size_t nb = SGEMM_N_MB;
     const size_t r = n % nb;
-    size_t j = (r == 0) ? n : n + nb - r;
-    do {
-      j -= nb;
+    size_t j = (r == 0) ? n - nb : n - r;
+    strtri(CBlasLower, diag, n - j, &A[j * lda + j], lda, info);
+    if (*info != 0) {
+      *info += (long)j;
+      return CUDA_ERROR_INVALID_VALUE;
+    }
+
+    while (true) {
       const size_t jb = min(nb, n - j);
-      if (j + jb < n) {
-        CU_ERROR_CHECK(cuMultiGPUStrmm(handle->blas_handle, CBlasLeft, CBlasLower, CBlasNoTrans, diag,
-                                       n - j - jb, jb,
-                                       one, &A[(j + jb) * lda + j + jb], lda,
-                                       &A[j * lda + j + jb], lda));
-        CU_ERROR_CHECK(cuMultiGPUStrsm(handle->blas_handle, CBlasRight, CBlasLower, CBlasNoTrans, diag,
-                                       n - j - jb, jb,
-                                       -one, &A[j * lda + j], lda,
-                                       &A[j * lda + j + jb], lda));
-      }
-      strtri(CBlasLower, diag, jb, &A[j * lda + j], lda, info);
+
+      const struct strtri_update_args args = { handle, CBlasLower, diag, j, jb, n, A, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUStrtriUpdate, &args));
+      if (j > 0)
+        strtri(CBlasLower, diag, nb, &A[(j - nb) * lda + j - nb], lda, info);
+      CU_ERROR_CHECK(lookahead_wait(&update));
       if (*info != 0) {
-        *info += (long)j;
+        *info += (long)(j - nb);
+        CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float)));
         return CUDA_ERROR_INVALID_VALUE;
       }
-    } while (j > 0);
+
+      if (j == 0)
+        break;
+      j -= nb;
+    }
+  }
+
+  // Blocks of A were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(float)));
+
+  return CUDA_SUCCESS;
+}
+
+
+/**
+ * Multiplies a block of a distributed matrix in place by a triangular matrix.
+ */
+static inline CUresult matrix_strmm(CUBLAShandle handle, CBlasSide side, CBlasUplo uplo,
+                                    CBlasTranspose trans, CBlasDiag diag, size_t m, size_t n,
+                                    float alpha, CUdeviceptr A, size_t lda,
+                                    CUdeviceptr B, size_t ldb, CUstream stream) {
+  CUdeviceptr T;
+  size_t ldt;
+  CU_ERROR_CHECK(matrix_duplicate(handle, B, ldb, m, n, sizeof(float), &T, &ldt, stream));
+  CU_ERROR_CHECK(cuStrmm2(handle, side, uplo, trans, diag, m, n, alpha, A, lda, T, ldt, B, ldb, stream));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, T));
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Multiplies block row and block column k of a distributed matrix by the
+ * inverted diagonal block on the processes holding them.
+ */
+static CUresult strtriPanel(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  const bool row = (k % (size_t)A->p == (size_t)pr), column = (k % (size_t)A->q == (size_t)pc);
+  if (!row && !column)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D;
+  size_t ldd;
+  CU_ERROR_CHECK(matrix_upload(handle, step->D, step->ldd, kb, kb, sizeof(float), &D, &ldd, stream));
+
+  if (step->uplo == CBlasUpper) {
+    // A(0:k, k) = A(0:k, k) inv(A(k, k))
+    const size_t m = matrix_extent(0, matrix_local(k, pr, A->p), pr, A->p, nb, A->m);
+    if (column && m > 0)
+      CU_ERROR_CHECK(matrix_strmm(handle, CBlasRight, CBlasUpper, CBlasNoTrans, step->diag, m, kb,
+                                  one, D, ldd, matrix_block(A, r, 0, k / (size_t)A->q), A->ld[r], stream));
+
+    // A(k, k+1:n) = -inv(A(k, k)) A(k, k+1:n)
+    const size_t j = matrix_local(k + 1, pc, A->q);
+    const size_t n = matrix_extent(j, matrix_local(A->nt, pc, A->q), pc, A->q, nb, A->n);
+    if (row && n > 0)
+      CU_ERROR_CHECK(matrix_strmm(handle, CBlasLeft, CBlasUpper, CBlasNoTrans, step->diag, kb, n,
+                                  -one, D, ldd, matrix_block(A, r, k / (size_t)A->p, j), A->ld[r], stream));
+  }
+  else {
+    // A(k, 0:k) = inv(A(k, k)) A(k, 0:k)
+    const size_t n = matrix_extent(0, matrix_local(k, pc, A->q), pc, A->q, nb, A->n);
+    if (row && n > 0)
+      CU_ERROR_CHECK(matrix_strmm(handle, CBlasLeft, CBlasLower, CBlasNoTrans, step->diag, kb, n,
+                                  one, D, ldd, matrix_block(A, r, k / (size_t)A->p, 0), A->ld[r], stream));
+
+    // A(k+1:n, k) = -A(k+1:n, k) inv(A(k, k))
+    const size_t i = matrix_local(k + 1, pr, A->p);
+    const size_t m = matrix_extent(i, matrix_local(A->mt, pr, A->p), pr, A->p, nb, A->m);
+    if (column && m > 0)
+      CU_ERROR_CHECK(matrix_strmm(handle, CBlasRight, CBlasLower, CBlasNoTrans, step->diag, m, kb,
+                                  -one, D, ldd, matrix_block(A, r, i, k / (size_t)A->q), A->ld[r], stream));
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Updates the blocks held by a process that are off block row and column k
+ * with the multiplied block column and the original block row (or the other
+ * way round for lower triangular matrices).
+ */
+static CUresult strtriUpdate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  // A(0:k, k+1:n) -= A(0:k, k) A(k, k+1:n) or A(k+1:n, 0:k) -= A(k+1:n, k) A(k, 0:k)
+  size_t i0, i1, j0, j1, I0, I1, J0, J1;
+  if (step->uplo == CBlasUpper) {
+    I0 = 0; I1 = k;
+    J0 = k + 1; J1 = A->nt;
+  }
+  else {
+    I0 = k + 1; I1 = A->mt;
+    J0 = 0; J1 = k;
+  }
+  i0 = matrix_local(I0, pr, A->p);
+  i1 = matrix_local(I1, pr, A->p);
+  j0 = matrix_local(J0, pc, A->q);
+  j1 = matrix_local(J1, pc, A->q);
+
+  const size_t m = matrix_extent(i0, i1, pr, A->p, nb, A->m);
+  const size_t n = matrix_extent(j0, j1, pc, A->q, nb, A->n);
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr X, Y;
+  size_t ldx, ldy;
+  CU_ERROR_CHECK(matrix_stage(A, handle, true, pr, A->p, I0, I1, kb, step->H, step->ldh, &X, &ldx, stream));
+  CU_ERROR_CHECK(matrix_stage(A, handle, false, pc, A->q, J0, J1, kb, step->G, step->ldg, &Y, &ldy, stream));
+
+  CU_ERROR_CHECK(cuSgemm(handle, CBlasNoTrans, CBlasNoTrans, m, n, kb,
+                         -one, matrix_panel(A, true, X, ldx, i0), ldx,
+                         matrix_panel(A, false, Y, ldy, j0), ldy,
+                         one, matrix_block(A, r, i0, j0), A->ld[r], stream));
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult strtriMatrix(CBlasUplo uplo, CBlasDiag diag, struct __cumultigpumatrix_st * A,
+                             float * D, float * H, float * G, long * info) {
+  const size_t n = A->n, nb = A->nb;
+
+  struct matrix_step step = { .A = A, .uplo = uplo, .diag = diag, .D = D, .ldd = nb,
+                              .H = H, .ldh = n, .G = G, .ldg = nb };
+
+  // The inverse is built a block row (column) at a time by Gauss-Jordan
+  // elimination in place: each step only needs its diagonal block, its block
+  // row and its block column.
+  for (size_t k = 0; k < A->nt; k++) {
+    const size_t kb = min(nb, n - k * nb);
+    step.k = k;
+
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, nb, true));
+    strtri(uplo, diag, kb, D, nb, info);
+    if (*info != 0) {
+      (*info) += (long)(k * nb);
+      return CUDA_ERROR_INVALID_VALUE;
+    }
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, nb, false));
+
+    // The update needs block row (column) k before it is multiplied and block
+    // column (row) k after
+    if (uplo == CBlasUpper) {
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k + 1, A->nt, &G[(k + 1) * nb * nb], nb, true));
+      CU_ERROR_CHECK(matrix_run(&step, strtriPanel));
+      CU_ERROR_CHECK(matrix_copy(A, 0, k, k, k + 1, H, n, true));
+    }
+    else {
+      CU_ERROR_CHECK(matrix_copy(A, k + 1, A->mt, k, k + 1, &H[(k + 1) * nb], n, true));
+      CU_ERROR_CHECK(matrix_run(&step, strtriPanel));
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, 0, k, G, nb, true));
+    }
+    CU_ERROR_CHECK(matrix_run(&step, strtriUpdate));
   }
 
   return CUDA_SUCCESS;
 }
 
+CUresult cuMultiGPUStrtriMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo, CBlasDiag diag,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(float))
+    *info = -4;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  float * D = malloc(A->nb * A->nb * sizeof(float));
+  float * H = malloc(A->n * A->nb * sizeof(float));
+  float * G = malloc(A->nb * A->n * sizeof(float));
+  if (D == NULL || H == NULL || G == NULL) {
+    free(D);
+    free(H);
+    free(G);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+
+  CUresult result = strtriMatrix(uplo, diag, A, D, H, G, info);
+
+  free(D);
+  free(H);
+  free(G);
+
+  return result;
+}
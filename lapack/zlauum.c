@@ -2,9 +2,15 @@
 #include "handle.h"
 #include "error.h"
 #include <stdio.h>
-#include "config.h"
+#include <stdlib.h>
 #include "zlauum.fatbin.c"
 
+/**
+ * Number of threads used by the unblocked kernel (and so the largest matrix it
+ * can work on).
+ */
+#define ZLAUU2_BX 16u
+
 static inline size_t min(size_t a, size_t b) { return (a < b) ? a : b; }
 
 static inline CUresult cuMemcpyHtoD2DAsync(CUdeviceptr A, size_t lda, size_t ai, size_t aj,
@@ -127,21 +133,40 @@ void zlauum(CBlasUplo uplo,
   }
 }
 
+/**
+ * Loads the ZLAUUM module and looks up the unblocked kernel for each uplo.  The
+ * handle's context must be current.
+ */
+CUresult zlauum_load(CULAPACKhandle handle) {
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int u = 0; u < 2; u++) {
+    char name[44];
+    snprintf(name, 44, "_Z6zlauu2IL9CBlasUplo%dELj%uEEvP7double2ii", uplos[u], ZLAUU2_BX);
+    CU_ERROR_CHECK(lookup(&handle->zlauu2[u], module, name));
+  }
+
+  handle->zlauum = module;
+
+  return CUDA_SUCCESS;
+}
+
 static inline CUresult cuZlauu2(CULAPACKhandle handle, CBlasUplo uplo,
                                 size_t n,
                                 CUdeviceptr A, size_t lda, CUstream stream) {
-  const unsigned int bx = 16;
+  const unsigned int bx = ZLAUU2_BX;
   if (n > bx)
     return CUDA_ERROR_INVALID_VALUE;
 
   if (handle->zlauum == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->zlauum, imageBytes));
-
-  char name[44];
-  snprintf(name, 44, "_Z6zlauu2IL9CBlasUplo%dELj%uEEvP7double2ii", uplo, bx);
+    CU_ERROR_CHECK(zlauum_load(handle));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->zlauum, name));
+  CUfunction function = handle->zlauu2[(uplo == CBlasUpper) ? 0 : 1];
+  if (function == NULL)
+    return CUDA_ERROR_NOT_FOUND;
 
   void * params[] = { &A, &lda, &n };
 
@@ -167,6 +192,7 @@ CUresult cuZlauum(CULAPACKhandle handle,
     return CUDA_SUCCESS;
 
   double complex * B;
+  struct packed P;
   CUdeviceptr X;
   size_t ldb, ldx;
   CUstream stream0, stream1;
@@ -180,19 +206,23 @@ CUresult cuZlauum(CULAPACKhandle handle,
    * between loops when A is lower triangular.
    */
 
-  // Create two streams for asynchronous copy and compute
-  CU_ERROR_CHECK(cuStreamCreate(&stream0, 0));
-  CU_ERROR_CHECK(cuStreamCreate(&stream1, 0));
+  // Borrow two streams for asynchronous copy and compute
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream0, 0));
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle->blas_handle, &stream1, 0));
 
   if (uplo == CBlasUpper) {
     // Block size for upper triangular ZTRTRI and ZLAUUM
-    const size_t nb = ZGEMM_N_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuBLASGetBlocking(handle->blas_handle, CBlasZgemmN, &blocking));
+    const size_t nb = blocking.mb;
 
     // Allocate page-locked host memory for diagonal block
-    CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(double complex)));
+    CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (nb + 1u) & ~1u) * nb * sizeof(double complex)));
+    // Borrow staging memory for the packed triangle of the diagonal block
+    CU_ERROR_CHECK(packed_create(handle, &P, nb, sizeof(double complex)));
 
     // Allocate temporary column for out of place ZTRMM
-    CU_ERROR_CHECK(cuMemAllocPitch(&X, &ldx, n * sizeof(double complex), nb, sizeof(double complex)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &X, &ldx, n * sizeof(double complex), nb, sizeof(double complex)));
     ldx /= sizeof(double complex);
 
     // Loop for ZLAUUM
@@ -210,17 +240,15 @@ CUresult cuZlauum(CULAPACKhandle handle,
                               one, X, ldx, A + i * lda * sizeof(double complex), lda, stream0));
       /* Overlap both the operations above with a copy of the diagonal block
        * onto the host. */
-      CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(B, ldb, 0, 0, A, lda, i, i,
-                                         ib, ib, sizeof(double complex), stream1));
-      /* Wait until the diagonal block has been copied */
-      CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+      CU_ERROR_CHECK(packed_download(handle, &P, CBlasUpper, ib, A + (i * lda + i) * sizeof(double complex), lda,
+                                     B, ldb, stream1));
       /* Form the multiplication of the diagonal block using the CPU */
       zlauum(CBlasUpper, ib, B, ldb, info);
       /* Ensure the ZTRMM has finished before copying the block back */
       CU_ERROR_CHECK(cuStreamSynchronize(stream0));
       /* Copy the diagonal block back onto the device */
-      CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, i, i, B, ldb, 0, 0,
-                                         ib, ib, sizeof(double complex), stream1));
+      CU_ERROR_CHECK(packed_upload(handle, &P, CBlasUpper, ib, B, ldb,
+                                   A + (i * lda + i) * sizeof(double complex), lda, stream1));
       /* Perform the ZHERK on the same stream as the copy to ensure A has
        * finised copying back first. */
       CU_ERROR_CHECK(cuZherk(handle->blas_handle, CBlasUpper, CBlasNoTrans, ib, n - i - ib,
@@ -234,13 +262,18 @@ CUresult cuZlauum(CULAPACKhandle handle,
   }
   else {
     // Block size for lower triangular ZLAUUM
-    const size_t mb = ZGEMM_CN_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuBLASGetBlocking(handle->blas_handle, CBlasZgemmCN, &blocking));
+    const size_t mb = blocking.mb;
 
     // Allocate page-locked host memory for diagonal block
-    CU_ERROR_CHECK(cuMemAllocHost((void **)&B, (ldb = (mb + 1u) & ~1u) * mb * sizeof(double complex)));
+    CU_ERROR_CHECK(cuBLASMemAllocHost(handle->blas_handle, (void **)&B, (ldb = (mb + 1u) & ~1u) * mb * sizeof(double complex)));
+    // Borrow staging memory for the packed triangle of the diagonal block
+    CU_ERROR_CHECK(packed_create(handle, &P, mb, sizeof(double complex)));
 
     // Allocate temporary row for out of place ZTRMM in ZTRTRI
-    CU_ERROR_CHECK(cuMemAllocPitch(&X, &ldx, mb * sizeof(double complex), n, sizeof(double complex)));
+    CU_ERROR_CHECK(cuBLASMemAllocPitch(handle->blas_handle, &X, &ldx, mb * sizeof(double complex), n, sizeof(double complex)));
+    ldx /= sizeof(double complex);
 
     // Loop for ZLAUUM
     for (size_t i = 0; i < n; i += mb) {
@@ -257,17 +290,15 @@ CUresult cuZlauum(CULAPACKhandle handle,
                               one, X, ldx, A + i * sizeof(double complex), lda, stream0));
       /* Overlap both the operations above with a copy of the diagonal block
        * onto the host. */
-      CU_ERROR_CHECK(cuMemcpyDtoH2DAsync(B, ldb, 0, 0, A, lda, i, i,
-                                         ib, ib, sizeof(double complex), stream1));
-      /* Wait until the diagonal block has been copied */
-      CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+      CU_ERROR_CHECK(packed_download(handle, &P, CBlasLower, ib, A + (i * lda + i) * sizeof(double complex), lda,
+                                     B, ldb, stream1));
       /* Form the multiplication of the diagonal block using the CPU */
-      zlauum(CBlasUpper, ib, B, ldb, info);
+      zlauum(CBlasLower, ib, B, ldb, info);
       /* Ensure the ZTRMM has finished before copying the block back */
       CU_ERROR_CHECK(cuStreamSynchronize(stream0));
       /* Copy the diagonal block back onto the device */
-      CU_ERROR_CHECK(cuMemcpyHtoD2DAsync(A, lda, i, i, B, ldb, 0, 0,
-                                         ib, ib, sizeof(double complex), stream1));
+      CU_ERROR_CHECK(packed_upload(handle, &P, CBlasLower, ib, B, ldb,
+                                   A + (i * lda + i) * sizeof(double complex), lda, stream1));
       /* Perform the ZHERK on the same stream as the copy to ensure A has
        * finised copying back first. */
       CU_ERROR_CHECK(cuZherk(handle->blas_handle, CBlasLower, CBlasConjTrans, ib, n - i - ib,
@@ -280,16 +311,43 @@ CUresult cuZlauum(CULAPACKhandle handle,
     }
   }
 
+  // Wait for the streams before the temporary memory goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream0));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream1));
+
   // Clean up resources
-  CU_ERROR_CHECK(cuMemFreeHost(B));
-  CU_ERROR_CHECK(cuMemFree(X));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle->blas_handle, B));
+  CU_ERROR_CHECK(packed_destroy(handle, &P));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, X));
 
-  CU_ERROR_CHECK(cuStreamDestroy(stream0));
-  CU_ERROR_CHECK(cuStreamDestroy(stream1));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream0));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle->blas_handle, stream1));
 
   return CUDA_SUCCESS;
 }
 
+/**
+ * Arguments to the update of the off-diagonal block of a block row (column)
+ * with the trailing part of the matrix.
+ */
+struct zlauum_update_args {
+  CUmultiGPUBLAShandle handle;
+  CBlasTranspose transA, transB;
+  size_t m, n, k;
+  const double complex * A, * B;
+  double complex * C;
+  size_t lda, ldb, ldc;
+};
+
+/**
+ * Adds A B to C on the devices.  Runs on the lookahead thread.
+ */
+static CUresult cuMultiGPUZlauumUpdate(const void * a) {
+  const struct zlauum_update_args * args = (const struct zlauum_update_args *)a;
+  return cuMultiGPUZgemm(args->handle, args->transA, args->transB, args->m, args->n, args->k,
+                         one, args->A, args->lda, args->B, args->ldb, one, args->C, args->ldc);
+}
+
 CUresult cuMultiGPUZlauum(CUmultiGPULAPACKhandle handle,
                           CBlasUplo uplo,
                           size_t n,
@@ -306,8 +364,13 @@ CUresult cuMultiGPUZlauum(CUmultiGPULAPACKhandle handle,
   if (n == 0)
     return CUDA_SUCCESS;
 
+  // Any copies of A cached on the devices are about to be out of date
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(double complex)));
+
   if (uplo == CBlasUpper) {
-    const size_t nb = ZGEMM_N_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, CBlasZgemmN, &blocking));
+    const size_t nb = blocking.mb;
 
     // Upper triangular ZLAUUM
     for (size_t i = 0; i < n; i += nb) {
@@ -315,19 +378,24 @@ CUresult cuMultiGPUZlauum(CUmultiGPULAPACKhandle handle,
 
       CU_ERROR_CHECK(cuMultiGPUZtrmm(handle->blas_handle, CBlasRight, CBlasUpper, CBlasConjTrans, CBlasNonUnit,
                                      i, ib, one, &A[i * lda + i], lda, &A[i * lda], lda));
+      // The diagonal block is multiplied on the host while the devices update
+      // the off-diagonal block with the trailing part of the matrix
+      const struct zlauum_update_args args = { handle->blas_handle, CBlasNoTrans, CBlasConjTrans, i, ib, n - i - ib,
+                                              &A[(i + ib) * lda], &A[(i + ib) * lda + i], &A[i * lda], lda, lda, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUZlauumUpdate, &args));
       zlauu2(CBlasUpper, ib, &A[i * lda + i], lda);
+      CU_ERROR_CHECK(lookahead_wait(&update));
 
-      if (i + ib < n) {
-        CU_ERROR_CHECK(cuMultiGPUZgemm(handle->blas_handle, CBlasNoTrans, CBlasConjTrans, i, ib, n - i - ib,
-                                       one, &A[(i + ib) * lda], lda, &A[(i + ib) * lda + i], lda,
-                                       one, &A[i * lda], lda));
+      if (i + ib < n)
         CU_ERROR_CHECK(cuMultiGPUZherk(handle->blas_handle, CBlasUpper, CBlasNoTrans, ib, n - i - ib,
                                        one, &A[(i + ib) * lda + i], lda, one, &A[i * lda + i], lda));
-      }
     }
   }
   else {
-    const size_t mb = ZGEMM_CN_MB;
+    CBlasBlocking blocking;
+    CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle->blas_handle, CBlasZgemmCN, &blocking));
+    const size_t mb = blocking.mb;
 
     // Lower triangular ZLAUUM
     for (size_t i = 0; i < n; i += mb) {
@@ -335,17 +403,230 @@ CUresult cuMultiGPUZlauum(CUmultiGPULAPACKhandle handle,
 
       CU_ERROR_CHECK(cuMultiGPUZtrmm(handle->blas_handle, CBlasLeft, CBlasLower, CBlasConjTrans, CBlasNonUnit, ib, i,
                                      one, &A[i * lda + i], lda, &A[i], lda));
+      // The diagonal block is multiplied on the host while the devices update
+      // the off-diagonal block with the trailing part of the matrix
+      const struct zlauum_update_args args = { handle->blas_handle, CBlasConjTrans, CBlasNoTrans, ib, i, n - i - ib,
+                                              &A[i * lda + i + ib], &A[i + ib], &A[i], lda, lda, lda };
+      struct lookahead update;
+      CU_ERROR_CHECK(lookahead_start(&update, cuMultiGPUZlauumUpdate, &args));
       zlauu2(CBlasLower, ib, &A[i * lda + i], lda);
+      CU_ERROR_CHECK(lookahead_wait(&update));
 
-      if (i + ib < n) {
-        CU_ERROR_CHECK(cuMultiGPUZgemm(handle->blas_handle, CBlasConjTrans, CBlasNoTrans, ib, i, n - i - ib,
-                                       one, &A[i * lda + i + ib], lda, &A[i + ib], lda,
-                                       one, &A[i], lda));
+      if (i + ib < n)
         CU_ERROR_CHECK(cuMultiGPUZherk(handle->blas_handle, CBlasLower, CBlasConjTrans, ib, n - i - ib,
                                        one, &A[i * lda + i + ib], lda, one, &A[i * lda + i], lda));
+    }
+  }
+
+  // Blocks of A were written on the host after being copied onto the devices
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle->blas_handle, A, lda, n, n, sizeof(double complex)));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Multiplies a block of a distributed matrix in place by a triangular matrix.
+ */
+static inline CUresult matrix_ztrmm(CUBLAShandle handle, CBlasSide side, CBlasUplo uplo,
+                                    CBlasTranspose trans, CBlasDiag diag, size_t m, size_t n,
+                                    double complex alpha, CUdeviceptr A, size_t lda,
+                                    CUdeviceptr B, size_t ldb, CUstream stream) {
+  CUdeviceptr T;
+  size_t ldt;
+  CU_ERROR_CHECK(matrix_duplicate(handle, B, ldb, m, n, sizeof(double complex), &T, &ldt, stream));
+  CU_ERROR_CHECK(cuZtrmm2(handle, side, uplo, trans, diag, m, n, alpha, A, lda, T, ldt, B, ldb, stream));
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, T));
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Adds the product of block column (row) k of a distributed matrix with its
+ * transpose to the blocks before it held by a process.
+ */
+static CUresult zlauumUpdate(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  const size_t mt = matrix_local(k, pr, A->p), nt = matrix_local(k, pc, A->q);
+  if (mt == 0 || nt == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr X, Y;
+  size_t ldx, ldy;
+  if (step->uplo == CBlasUpper) {
+    // A(0:k, 0:k) += A(0:k, k) A(0:k, k)^T
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pr, A->p, 0, k, kb, step->H, step->ldh, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, true, pc, A->q, 0, k, kb, step->H, step->ldh, &Y, &ldy, stream));
+
+    for (size_t j = 0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i = matrix_local(J + 1, pr, A->p);
+      if (i > 0 && (i - 1) * (size_t)A->p + (size_t)pr == J) {
+        i--;
+        CU_ERROR_CHECK(cuZherk(handle, CBlasUpper, CBlasNoTrans, jb, kb,
+                               1.0, matrix_panel(A, true, X, ldx, i), ldx,
+                               1.0, matrix_block(A, r, i, j), A->ld[r], stream));
       }
+      if (i > 0)
+        CU_ERROR_CHECK(cuZgemm(handle, CBlasNoTrans, CBlasConjTrans,
+                               matrix_extent(0, i, pr, A->p, nb, A->m), jb, kb,
+                               one, X, ldx, matrix_panel(A, true, Y, ldy, j), ldy,
+                               one, matrix_block(A, r, 0, j), A->ld[r], stream));
+    }
+  }
+  else {
+    // A(0:k, 0:k) += A(k, 0:k)^T A(k, 0:k)
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pr, A->p, 0, k, kb, step->G, step->ldg, &X, &ldx, stream));
+    CU_ERROR_CHECK(matrix_stage(A, handle, false, pc, A->q, 0, k, kb, step->G, step->ldg, &Y, &ldy, stream));
+
+    for (size_t j = 0; j < nt; j++) {
+      const size_t J = j * (size_t)A->q + (size_t)pc, jb = min(nb, A->n - J * nb);
+
+      size_t i = matrix_local(J, pr, A->p);
+      if (i < mt && i * (size_t)A->p + (size_t)pr == J) {
+        CU_ERROR_CHECK(cuZherk(handle, CBlasLower, CBlasConjTrans, jb, kb,
+                               1.0, matrix_panel(A, false, X, ldx, i), ldx,
+                               1.0, matrix_block(A, r, i, j), A->ld[r], stream));
+        i++;
+      }
+      if (i < mt)
+        CU_ERROR_CHECK(cuZgemm(handle, CBlasConjTrans, CBlasNoTrans,
+                               matrix_extent(i, mt, pr, A->p, nb, A->m), jb, kb,
+                               one, matrix_panel(A, false, X, ldx, i), ldx,
+                               matrix_panel(A, false, Y, ldy, j), ldy,
+                               one, matrix_block(A, r, i, j), A->ld[r], stream));
+    }
+  }
+
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, X));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, Y));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Multiplies block column (row) k of a distributed matrix by the transpose of
+ * the diagonal block on the processes holding it.
+ */
+static CUresult zlauumPanel(const void * args) {
+  const struct matrix_step * step = (const struct matrix_step *)args;
+  const struct __cumultigpumatrix_st * A = step->A;
+  const int r = step->r, pr = r % A->p, pc = r / A->p;
+  const size_t nb = A->nb, k = step->k, kb = min(nb, A->n - k * nb);
+
+  size_t m, n;
+  CUdeviceptr B;
+  if (step->uplo == CBlasUpper) {
+    // A(0:k, k) = A(0:k, k) A(k, k)^T
+    if (k % (size_t)A->q != (size_t)pc)
+      return CUDA_SUCCESS;
+    m = matrix_extent(0, matrix_local(k, pr, A->p), pr, A->p, nb, A->m);
+    n = kb;
+    B = matrix_block(A, r, 0, k / (size_t)A->q);
+  }
+  else {
+    // A(k, 0:k) = A(k, k)^T A(k, 0:k)
+    if (k % (size_t)A->p != (size_t)pr)
+      return CUDA_SUCCESS;
+    m = kb;
+    n = matrix_extent(0, matrix_local(k, pc, A->q), pc, A->q, nb, A->n);
+    B = matrix_block(A, r, k / (size_t)A->p, 0);
+  }
+  if (m == 0 || n == 0)
+    return CUDA_SUCCESS;
+
+  CUBLAShandle handle = A->handles[r];
+  CUstream stream;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &stream, 0));
+
+  CUdeviceptr D;
+  size_t ldd;
+  CU_ERROR_CHECK(matrix_upload(handle, step->D, step->ldd, kb, kb, sizeof(double complex), &D, &ldd, stream));
+
+  if (step->uplo == CBlasUpper)
+    CU_ERROR_CHECK(matrix_ztrmm(handle, CBlasRight, CBlasUpper, CBlasConjTrans, CBlasNonUnit, m, n,
+                                one, D, ldd, B, A->ld[r], stream));
+  else
+    CU_ERROR_CHECK(matrix_ztrmm(handle, CBlasLeft, CBlasLower, CBlasConjTrans, CBlasNonUnit, m, n,
+                                one, D, ldd, B, A->ld[r], stream));
+
+  CU_ERROR_CHECK(cuBLASMemFree(handle, D));
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, stream));
+
+  return CUDA_SUCCESS;
+}
+
+static CUresult zlauumStep(const void * args) {
+  CU_ERROR_CHECK(zlauumUpdate(args));
+  CU_ERROR_CHECK(zlauumPanel(args));
+  return CUDA_SUCCESS;
+}
+
+static CUresult zlauumMatrix(CBlasUplo uplo, struct __cumultigpumatrix_st * A,
+                             double complex * H, long * info) {
+  const size_t n = A->n, nb = A->nb;
+
+  struct matrix_step step = { .A = A, .uplo = uplo, .H = H, .ldh = n, .G = H, .ldg = nb };
+
+  // Each step adds the outer product of its block column (row) to the blocks
+  // before it, which only needs that block column (row) as the blocks after it
+  // have already been added.
+  for (size_t k = 0; k < A->nt; k++) {
+    const size_t kb = min(nb, n - k * nb);
+    step.k = k;
+
+    double complex * D;
+    if (uplo == CBlasUpper) {
+      CU_ERROR_CHECK(matrix_copy(A, 0, k + 1, k, k + 1, H, n, true));
+      D = &H[k * nb];
+      step.ldd = n;
     }
+    else {
+      CU_ERROR_CHECK(matrix_copy(A, k, k + 1, 0, k + 1, H, nb, true));
+      D = &H[k * nb * nb];
+      step.ldd = nb;
+    }
+    step.D = D;
+
+    CU_ERROR_CHECK(matrix_run(&step, zlauumStep));
+
+    zlauum(uplo, kb, D, step.ldd, info);
+    CU_ERROR_CHECK(matrix_copy(A, k, k + 1, k, k + 1, D, step.ldd, false));
   }
 
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPUZlauumMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(double complex))
+    *info = -3;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  double complex * H;
+  if ((H = malloc(A->n * A->nb * sizeof(double complex))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  CUresult result = zlauumMatrix(uplo, A, H, info);
+
+  free(H);
+
+  return result;
+}
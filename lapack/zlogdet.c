@@ -35,6 +35,28 @@ static inline unsigned int nextPow2(unsigned int n) {
   return ++n;
 }
 
+/**
+ * Loads the ZLOGDET module and looks up the reduction for each power of two
+ * number of threads up to 512 and whether n is a power of two.  The handle's
+ * context must be current.
+ */
+CUresult zlogdet_load(CULAPACKhandle handle) {
+  CUmodule module;
+  CU_ERROR_CHECK(cuModuleLoadData(&module, imageBytes));
+
+  for (int t = 0; t < 10; t++) {
+    for (int pow2 = 0; pow2 < 2; pow2++) {
+      char name[38];
+      snprintf(name, 38, "_Z6reduceILj%uELb%dEEvPK7double2Pdii", 1u << t, pow2);
+      CU_ERROR_CHECK(lookup(&handle->zreduce[t][pow2], module, name));
+    }
+  }
+
+  handle->zlogdet = module;
+
+  return CUDA_SUCCESS;
+}
+
 CUresult cuZlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n, double * result, CUstream stream) {
   if (n == 0) {
     *result = 0.0;
@@ -42,7 +64,7 @@ CUresult cuZlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
   }
 
   if (handle->zlogdet == NULL)
-    CU_ERROR_CHECK(cuModuleLoadData(&handle->zlogdet, imageBytes));
+    CU_ERROR_CHECK(zlogdet_load(handle));
 
   unsigned int threads, blocks;
   if (n == 1) {
@@ -55,13 +77,9 @@ CUresult cuZlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
   }
 
   CUdeviceptr temp;
-  CU_ERROR_CHECK(cuMemAlloc(&temp, blocks * sizeof(double)));
-
-  char name[38];
-  snprintf(name, 38, "_Z6reduceILj%uELb%dEEvPK7double2Pdii", threads, (n & (n - 1)) == 0);
+  CU_ERROR_CHECK(cuBLASMemAlloc(handle->blas_handle, &temp, blocks * sizeof(double)));
 
-  CUfunction function;
-  CU_ERROR_CHECK(cuModuleGetFunction(&function, handle->zlogdet, name));
+  CUfunction function = handle->zreduce[__builtin_ctz(threads)][(n & (n - 1)) == 0];
 
   void * params[] = { &x, &temp, &incx, &n };
 
@@ -69,7 +87,9 @@ CUresult cuZlogdet(CULAPACKhandle handle, CUdeviceptr x, size_t incx, size_t n,
 
   CU_ERROR_CHECK(cuMemcpyDtoHAsync(result, temp, sizeof(double), stream));
 
-  CU_ERROR_CHECK(cuMemFree(temp));
+  // Wait for the result before temp goes back to the pool
+  CU_ERROR_CHECK(cuStreamSynchronize(stream));
+  CU_ERROR_CHECK(cuBLASMemFree(handle->blas_handle, temp));
 
   return CUDA_SUCCESS;
 }
@@ -1,4 +1,5 @@
 #include "lapack.h"
+#include "handle.h"
 #include "error.h"
 
 void zpotri(CBlasUplo uplo,
@@ -67,3 +68,23 @@ CUresult cuMultiGPUZpotri(CUmultiGPULAPACKhandle handle,
   CU_ERROR_CHECK(cuMultiGPUZlauum(handle, uplo, n, A, lda, info));
   return CUDA_SUCCESS;
 }
+
+CUresult cuMultiGPUZpotriMatrix(CUmultiGPULAPACKhandle handle, CBlasUplo uplo,
+                                CUmultiGPUMatrix A, long * info) {
+  *info = 0;
+  if (A->handle != handle || A->m != A->n || A->elemSize != sizeof(double complex))
+    *info = -3;
+  if (*info != 0) {
+    XERBLA(-(*info));
+    return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  if (A->n == 0)
+    return CUDA_SUCCESS;
+
+  CU_ERROR_CHECK(cuMultiGPUZtrtriMatrix(handle, uplo, CBlasNonUnit, A, info));
+  if (*info != 0)
+    return CUDA_SUCCESS;
+  CU_ERROR_CHECK(cuMultiGPUZlauumMatrix(handle, uplo, A, info));
+  return CUDA_SUCCESS;
+}
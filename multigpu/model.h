@@ -0,0 +1,186 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <stdio.h>
+
+// Performance models shared by the multi-threaded and single threaded
+// versions of CUmultiGPU.  The callers do any locking needed.
+
+/**
+ * Weight given to the newest measurement in the running average of each
+ * context's throughput.
+ */
+#define CU_MODEL_WEIGHT 0.25
+
+/**
+ * Predicts the time a context will take to run a task.
+ *
+ * @param model  the performance model of the context.
+ * @param flops  the number of floating point operations done by the task.
+ * @param bytes  the number of bytes the task copies between host and device.
+ * @return the predicted time in seconds, or zero if the throughput of the
+ *         context is unknown.
+ */
+static inline double model_time(const CUmultiGPUModel * model, double flops, double bytes) {
+  if (model->throughput <= 0.0)
+    return 0.0;
+  double time = flops / model->throughput;
+  if (model->bandwidth > 0.0)
+    time += bytes / model->bandwidth;
+  return time;
+}
+
+/**
+ * Updates the throughput of a context from the time a task took.  The time the
+ * copies should have taken is taken off first, but by no more than half as they
+ * overlap with computation.
+ *
+ * @param model    the performance model of the context.
+ * @param flops    the number of floating point operations done by the task.
+ * @param bytes    the number of bytes the task copied between host and device.
+ * @param seconds  the time the task took.
+ */
+static inline void model_record(CUmultiGPUModel * model, double flops, double bytes, double seconds) {
+  double compute = seconds;
+  if (model->bandwidth > 0.0) {
+    compute -= bytes / model->bandwidth;
+    if (compute < 0.5 * seconds)
+      compute = 0.5 * seconds;
+  }
+
+  const double rate = flops / compute;
+  model->throughput = (model->throughput <= 0.0) ? rate
+                    : (1.0 - CU_MODEL_WEIGHT) * model->throughput + CU_MODEL_WEIGHT * rate;
+}
+
+/**
+ * Assigns tiles to contexts so that the number given to each is in proportion
+ * to the rate the context is predicted to get through them.
+ *
+ * @param models    the performance model of each context.
+ * @param n         the number of contexts.
+ * @param flops     the number of floating point operations in each tile.
+ * @param bytes     the number of bytes copied for each tile.
+ * @param contexts  the context to use for each tile is returned through this
+ *                  array.
+ * @param count     the number of tiles.
+ */
+static inline void model_partition(const CUmultiGPUModel * models, int n, double flops, double bytes,
+                                   int * contexts, size_t count) {
+  double weight[n];
+
+  double total = 0.0;
+  int measured = 0;
+  for (int i = 0; i < n; i++) {
+    const double time = model_time(&models[i], flops, bytes);
+    weight[i] = (time > 0.0) ? 1.0 / time : 0.0;
+    if (weight[i] > 0.0) {
+      total += weight[i];
+      measured++;
+    }
+  }
+
+  // Contexts with no model run at the average rate of the others
+  const double average = (measured == 0) ? 1.0 : total / measured;
+  total = 0.0;
+  for (int i = 0; i < n; i++) {
+    if (weight[i] <= 0.0)
+      weight[i] = average;
+    total += weight[i];
+  }
+
+  // Smooth weighted round-robin: each tile goes to the context that is furthest
+  // behind its share
+  double credit[n];
+  for (int i = 0; i < n; i++)
+    credit[i] = 0.0;
+
+  for (size_t j = 0; j < count; j++) {
+    int best = 0;
+    for (int i = 0; i < n; i++) {
+      credit[i] += weight[i];
+      if (credit[i] > credit[best])
+        best = i;
+    }
+    credit[best] -= total;
+    contexts[j] = best;
+  }
+}
+
+/**
+ * Writes the performance models to a file.  Each line holds the index of a
+ * context, its device, its throughput in FLOPs/s and its bandwidth in bytes/s.
+ *
+ * @param path     the file to write.
+ * @param models   the performance model of each context.
+ * @param devices  the device of each context.
+ * @param n        the number of contexts.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+static inline CUresult model_save(const char * path, const CUmultiGPUModel * models,
+                                  const CUdevice * devices, int n) {
+  FILE * file;
+  if ((file = fopen(path, "w")) == NULL)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  int error = (fputs("# context device throughput bandwidth\n", file) < 0);
+  for (int i = 0; i < n && !error; i++)
+    error = (fprintf(file, "%d %d %.17g %.17g\n", i, (int)devices[i],
+                     models[i].throughput, models[i].bandwidth) < 0);
+
+  if (fclose(file) != 0 || error)
+    return CUDA_ERROR_OPERATING_SYSTEM;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Reads performance models written by model_save.  Lines for contexts that are
+ * out of range or were created on a different device are ignored.
+ *
+ * @param path     the file to read.
+ * @param models   the performance model of each context.
+ * @param devices  the device of each context.
+ * @param n        the number of contexts.
+ * @return CUDA_SUCCESS, CUDA_ERROR_FILE_NOT_FOUND, CUDA_ERROR_INVALID_VALUE if
+ *         the file is malformed.
+ */
+static inline CUresult model_load(const char * path, CUmultiGPUModel * models,
+                                  const CUdevice * devices, int n) {
+  FILE * file;
+  if ((file = fopen(path, "r")) == NULL)
+    return CUDA_ERROR_FILE_NOT_FOUND;
+
+  // Read everything before changing any of the models
+  CUmultiGPUModel loaded[n];
+  for (int i = 0; i < n; i++)
+    loaded[i] = models[i];
+
+  CUresult result = CUDA_SUCCESS;
+  char line[256];
+  while (result == CUDA_SUCCESS && fgets(line, (int)sizeof(line), file) != NULL) {
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+
+    int i, device;
+    CUmultiGPUModel model;
+    if (sscanf(line, "%d %d %lf %lf", &i, &device, &model.throughput, &model.bandwidth) != 4 ||
+        model.throughput < 0.0 || model.bandwidth < 0.0)
+      result = CUDA_ERROR_INVALID_VALUE;
+    else if (i >= 0 && i < n && device == (int)devices[i])
+      loaded[i] = model;
+  }
+
+  if (ferror(file))
+    result = CUDA_ERROR_OPERATING_SYSTEM;
+  fclose(file);
+
+  if (result == CUDA_SUCCESS) {
+    for (int i = 0; i < n; i++)
+      models[i] = loaded[i];
+  }
+
+  return result;
+}
+
+#endif
@@ -1,38 +1,126 @@
+#define _GNU_SOURCE
 #include "cumultigpu.h"
 #include "error.h"
+#include "model.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // Multi-threaded versions of CUtask and CUmultiGPU.
 
+CUmultiGPUSchedule multiGPUSchedule = CUmultiGPUScheduleStatic;
+
+/**
+ * Selects the scheduling policy when the library is loaded.
+ *
+ * CUMULTIGPU_SCHEDULE may be set to "static" or "steal".
+ */
+static void __attribute__((constructor)) schedule_init(void) {
+  const char * schedule = getenv("CUMULTIGPU_SCHEDULE");
+  if (schedule != NULL) {
+    if (strcmp(schedule, "static") == 0)
+      multiGPUSchedule = CUmultiGPUScheduleStatic;
+    else if (strcmp(schedule, "steal") == 0)
+      multiGPUSchedule = CUmultiGPUScheduleSteal;
+  }
+}
+
+/**
+ * Number of slots in each background thread's task queue (must be a power of
+ * two).  Submitting threads wait for a free slot when the queue is full.
+ */
+#define CU_TASK_QUEUE_CAPACITY 1024
+
+/**
+ * Number of times the background thread polls an empty queue before parking on
+ * the futex.  Spinning is skipped on uniprocessors where it would only delay the
+ * submitting thread.
+ */
+#define CU_THREAD_SPIN_COUNT 256
+
+/**
+ * Hints to the processor that the calling thread is in a spin-wait loop.
+ */
+static inline void cpu_relax() {
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * Blocks on the futex while it holds the expected value.
+ *
+ * @param futex  the futex word.
+ * @param value  the expected value.
+ * @return 0 on success or if the value had already changed or a signal was
+ *         received, an errno value otherwise.
+ */
+static inline int futex_wait(int * futex, int value) {
+  if (syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0) == 0 ||
+      errno == EAGAIN || errno == EINTR)
+    return 0;
+  return errno;
+}
+
+/**
+ * Wakes one thread blocked on the futex.
+ *
+ * @param futex  the futex word.
+ * @return 0 on success, an errno value otherwise.
+ */
+static inline int futex_wake(int * futex) {
+  return (syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0) < 0) ? errno : 0;
+}
+
+/**
+ * A slot in the task queue.  The sequence number records which lap of the ring
+ * the slot is on so that producers and consumers can tell whether it is free or
+ * full without taking a lock.
+ */
+typedef struct {
+  CUtask task;                  /** The task stored in the slot.              */
+  size_t sequence;              /** Slot sequence number.                     */
+} CUtaskslot;
+
 /**
- * An implementation of a queue of CUtasks backed by a resizable array.
+ * A bounded lock-free queue of CUtasks with many producers and many consumers.
+ * Producers claim slots by advancing the tail with compare-and-swap and
+ * consumers do the same with the head.
  */
 typedef struct {
-  CUtask * data;                /** Array of pointers to tasks in the queue.  */
-  size_t head, tail, capacity;  /** Indices to head and tail of queue and queue
-                                    capacity. */
+  CUtaskslot * slots;           /** Ring of task slots.                       */
+  size_t head;                  /** Next slot to pop.                         */
+  size_t tail;                  /** Next slot to push.                        */
 } CUtaskqueue;
 
 /**
- * Creates a new queue with at least the specified capacity.
+ * Creates a new queue with room for CU_TASK_QUEUE_CAPACITY tasks.
  *
- * @param queue     the newly created queue is returned through this pointer.
- * @param capacity  the initial capacity of the queue.
+ * @param queue  the newly created queue is returned through this pointer.
  * @return CUDA_SUCCESS if the queue was created successfully,
  *         CUDA_ERROR_OUT_OF_MEMORY if there isn't enough memory.
  */
-static inline CUresult cuTaskQueueCreate(CUtaskqueue * queue, size_t capacity) {
-  // Initialise head, tail and capacity
+static inline CUresult cuTaskQueueCreate(CUtaskqueue * queue) {
+  // Allocate space for the slots
+  if ((queue->slots = malloc(CU_TASK_QUEUE_CAPACITY * sizeof(CUtaskslot))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  // Each slot starts out free for the first lap
+  for (size_t i = 0; i < CU_TASK_QUEUE_CAPACITY; i++)
+    queue->slots[i].sequence = i;
+
   queue->head = 0;
   queue->tail = 0;
-  queue->capacity = capacity;
-
-  // Allocate space for objects
-  if ((queue->data = malloc(queue->capacity * sizeof(CUtask))) == NULL)
-    return CUDA_ERROR_OUT_OF_MEMORY;
 
   return CUDA_SUCCESS;
 }
@@ -44,95 +132,287 @@ static inline CUresult cuTaskQueueCreate(CUtaskqueue * queue, size_t capacity) {
  */
 static inline void cuTaskQueueDestroy(CUtaskqueue * queue) {
   // Free the data
-  free(queue->data);
+  free(queue->slots);
 }
 
 /**
- * Checks whether the queue is empty.
+ * Places a task at the back of the queue without blocking.
  *
  * @param queue  the queue.
- * @return <b>true</b> if the queue is empty, <b>false</b> otherwise.
+ * @param task   the task to place in the queue.
+ * @return <b>true</b> if the task was placed in the queue, <b>false</b> if the
+ *         queue was full.
  */
-static inline bool cuTaskQueueIsEmpty(const CUtaskqueue * queue) {
-  return (queue->head == queue->tail);
+static inline bool cuTaskQueuePush(CUtaskqueue * queue, CUtask task) {
+  size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  CUtaskslot * slot;
+
+  // Claim the slot at the tail
+  while (true) {
+    slot = &queue->slots[tail & (CU_TASK_QUEUE_CAPACITY - 1)];
+    ptrdiff_t diff = (ptrdiff_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - tail);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->tail, &tail, tail + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }
+    else if (diff < 0)
+      return false;
+    else
+      tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  }
+
+  // Fill the slot and publish it to the consumers
+  slot->task = task;
+  __atomic_store_n(&slot->sequence, tail + 1, __ATOMIC_SEQ_CST);
+
+  return true;
 }
 
 /**
- * Places a task at the back of the queue, expanding the queue if necessary.
+ * Removes a task from the front of the queue without blocking.
  *
  * @param queue  the queue.
- * @param task   the task to place in the queue.
- * @return CUDA_SUCCESS on success,
- *         CUDA_ERROR_OUT_OF_MEMORY if the queue needs to be expanded and there
- *         isn't enough memory.
+ * @param task   the task at the front of the queue is returned through this
+ *               pointer.
+ * @return <b>true</b> if a task was removed, <b>false</b> if the queue was
+ *         empty.
  */
-static inline CUresult cuTaskQueuePush(CUtaskqueue * queue, CUtask task) {
-  // Place the object at the back of the queue
-  queue->data[queue->tail++] = task;
+static inline bool cuTaskQueuePop(CUtaskqueue * queue, CUtask * task) {
+  size_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+  CUtaskslot * slot;
 
-  // Wrap the tail around
-  if (queue->tail == queue->capacity)
-    queue->tail = 0;
-
-  // Expand the array if needed
-  if (queue->tail == queue->head) {
-    size_t capacity = queue->capacity + 10;
-
-    // Allocate new data array
-    CUtask * ptr = malloc(capacity * sizeof(CUtask));
-    if (ptr == NULL)
-      return CUDA_ERROR_OUT_OF_MEMORY;
+  // Claim the slot at the head
+  while (true) {
+    slot = &queue->slots[head & (CU_TASK_QUEUE_CAPACITY - 1)];
+    ptrdiff_t diff = (ptrdiff_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (head + 1));
 
-    // Copy objects into new array
-    if (queue->head < queue->tail)
-      memcpy(ptr, &queue->data[queue->head],
-             (queue->tail - queue->head) * sizeof(CUtask));
-    else {
-      memcpy(ptr, &queue->data[queue->head],
-             (queue->capacity - queue->head) * sizeof(CUtask));
-      memcpy(&ptr[queue->capacity - queue->head],
-             queue->data, queue->tail * sizeof(CUtask));
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->head, &head, head + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
     }
+    else if (diff < 0)
+      return false;
+    else
+      head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+  }
 
-    // Free old data
-    free(queue->data);
+  *task = slot->task;
 
-    // Update queue
-    queue->data = ptr;
-    queue->head = 0;
-    queue->tail = queue->capacity;      // New tail is old capacity
-    queue->capacity = capacity;
-  }
+  // Free the slot for the next lap around the ring
+  __atomic_store_n(&slot->sequence, head + CU_TASK_QUEUE_CAPACITY,
+                   __ATOMIC_RELEASE);
 
-  return CUDA_SUCCESS;
+  return true;
 }
 
 /**
- * Removes a task from the front of the queue.
- *
- * @param queue  the queue.
- * @param task   the task at the front of the queue is returned through this
- *               pointer.
+ * Number of bytes of task arguments stored inline in the task.  Larger argument
+ * structures are copied to the heap.
  */
-static inline void cuTaskQueuePop(CUtaskqueue * queue, CUtask * task) {
-  *task = queue->data[queue->head++];
+#define CU_TASK_INLINE_ARGS 128
 
-  // Wrap the head around
-  if (queue->head == queue->capacity)
-    queue->head = 0;
-}
+/**
+ * Maximum number of completed tasks kept for reuse by each host thread.
+ */
+#define CU_TASK_POOL_SIZE 4096
 
 /**
- * Background thread type.
+ * Task structure.
+ */
+struct __cutask_st {
+  CUresult (*function)(const void *);  /** The function to run                */
+  void * args;                         /** Arguments for the function         */
+  CUresult result;                     /** Result of the function             */
+  bool complete;                       /** Flag set when function is finished */
+  pthread_mutex_t mutex;               /** Mutex to protect access to result and
+                                           flag                               */
+  pthread_cond_t cond;                 /** Condition to wait on function
+                                           completion                         */
+  bool finished;                       /** Flag set when function has returned
+                                           and no more dependents may be added */
+  CUresult dependencyResult;           /** First unsuccessful result of a
+                                           dependency                         */
+  int pending;                         /** Number of unfinished dependencies
+                                           plus one until the task is
+                                           submitted                          */
+  struct __cutask_st ** dependents;    /** Tasks waiting for this one         */
+  size_t nDependents, maxDependents;   /** Number of dependents and capacity  */
+  struct __cuthread_st * thread;       /** Thread to run the task on          */
+  CUtaskqueue * queue;                 /** Queue to place the task in when its
+                                           dependencies have finished         */
+  void (*callback)(CUresult, void *);  /** Completion callback                */
+  void * callbackData;                 /** Argument for the callback          */
+  struct __cutask_st * next;           /** Next task in the pool or overflow
+                                           list                               */
+  union {
+    char data[CU_TASK_INLINE_ARGS];
+    long double align;
+    void * ptr;
+  } inlineArgs;                        /** Storage for small arguments        */
+};
+
+/**
+ * Background thread type.  Each thread has a private queue of tasks that must
+ * run on its CUDA context and a shared queue of tasks that other threads in the
+ * same multiGPU context may steal when they are idle.
  */
 typedef struct __cuthread_st {
   CUtaskqueue queue;            /** Queue of tasks                            */
+  CUtaskqueue shared;           /** Queue of tasks that may be stolen         */
+  struct __cuthread_st ** peers;/** Threads to steal tasks from               */
+  int nPeers;                   /** Number of threads to steal from (set once
+                                    all threads have started)                 */
+  int index;                    /** Index of this thread's context            */
+  int sleeping;                 /** Futex word set while the thread is
+                                    parked                                    */
+  int spin;                     /** Number of polls before parking            */
+  CUtask overflow;              /** Stack of released tasks that did not fit
+                                    in a queue                                */
+  CUtask ready;                 /** Tasks taken from the overflow stack
+                                    (background thread only)                  */
   pthread_t thread;             /** Background thread                         */
-  pthread_mutex_t mutex;        /** Mutex to protect queue                    */
-  pthread_cond_t nonEmpty;      /** Condition to wait on non-empty queue      */
   CUresult error;               /** Thread error status                       */
 } * CUthread;
 
+/**
+ * Index of the context of the background thread running on the calling thread.
+ */
+static __thread int currentContext = -1;
+
+/**
+ * The background thread running on the calling thread.
+ */
+static __thread CUthread currentThread = NULL;
+
+/**
+ * Wakes the background thread if it has parked.
+ *
+ * @param thread  the background thread.
+ * @return CUDA_SUCCESS on success,
+ *         CUDA_ERROR_OPERATING_SYSTEM if the thread could not be woken.
+ */
+static inline CUresult cuThreadWake(CUthread thread) {
+  if (__atomic_exchange_n(&thread->sleeping, 0, __ATOMIC_SEQ_CST) != 0)
+    ERROR_CHECK(futex_wake(&thread->sleeping));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Places a task in one of the background thread's queues without waking it,
+ * waiting for a free slot if the queue is full.
+ *
+ * @param thread  the background thread.
+ * @param queue   the queue (either the private or shared queue of the thread).
+ * @param task    the task to place in the queue.
+ * @return CUDA_SUCCESS on success,
+ *         CUDA_ERROR_OPERATING_SYSTEM if the thread could not be woken to
+ *         drain a full queue.
+ */
+static inline CUresult cuThreadEnqueue(CUthread thread, CUtaskqueue * queue,
+                                       CUtask task) {
+  // If the queue is full make sure the thread is awake and let it catch up
+  while (!cuTaskQueuePush(queue, task)) {
+    CU_ERROR_CHECK(cuThreadWake(thread));
+    sched_yield();
+  }
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Places a released task on the background thread's overflow stack.  Used
+ * instead of waiting for room in a full queue when the releasing thread is a
+ * background thread, which could otherwise end up waiting for itself.
+ *
+ * @param thread  the background thread.
+ * @param task    the task.
+ */
+static inline void cuThreadPushOverflow(CUthread thread, CUtask task) {
+  task->next = __atomic_load_n(&thread->overflow, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&thread->overflow, &task->next, task, true,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+/**
+ * Takes a task from the overflow stack.  Must only be called by the background
+ * thread.  The whole stack is taken at once so the stack is not subject to ABA
+ * problems.
+ *
+ * @param this  the background thread.
+ * @param task  the task is returned through this pointer.
+ * @return <b>true</b> if a task was found, <b>false</b> otherwise.
+ */
+static inline bool cuThreadPopOverflow(CUthread this, CUtask * task) {
+  if (this->ready == NULL) {
+    if (__atomic_load_n(&this->overflow, __ATOMIC_RELAXED) == NULL)
+      return false;
+    this->ready = __atomic_exchange_n(&this->overflow, NULL, __ATOMIC_ACQUIRE);
+  }
+
+  *task = this->ready;
+  this->ready = (*task)->next;
+  return true;
+}
+
+/**
+ * Tries to take a task without blocking.  The private queue is checked first,
+ * then the overflow stack and the shared queue, then the shared queues of the
+ * other threads.
+ *
+ * @param this  the background thread.
+ * @param task  the task is returned through this pointer.
+ * @return <b>true</b> if a task was found, <b>false</b> otherwise.
+ */
+static inline bool cuThreadPoll(CUthread this, CUtask * task) {
+  if (cuTaskQueuePop(&this->queue, task) || cuThreadPopOverflow(this, task) ||
+      cuTaskQueuePop(&this->shared, task))
+    return true;
+
+  const int n = __atomic_load_n(&this->nPeers, __ATOMIC_ACQUIRE);
+  for (int i = 1; i < n; i++) {
+    if (cuTaskQueuePop(&this->peers[(this->index + i) % n]->shared, task))
+      return true;
+  }
+
+  return false;
+}
+
+/**
+ * Takes the next task for the background thread, spinning for a while and then
+ * parking on the futex until one arrives.
+ *
+ * @param this  the background thread.
+ * @param task  the task is returned through this pointer.
+ * @return 0 on success, an errno value if waiting on the futex failed.
+ */
+static inline int cuThreadWait(CUthread this, CUtask * task) {
+  while (true) {
+    for (int i = 0; i < this->spin; i++) {
+      if (cuThreadPoll(this, task))
+        return 0;
+      cpu_relax();
+    }
+
+    // Announce that the thread is about to park then check its own queues
+    // again so that a task pushed in between is not missed
+    __atomic_store_n(&this->sleeping, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (cuTaskQueuePop(&this->queue, task) || cuThreadPopOverflow(this, task) ||
+        cuTaskQueuePop(&this->shared, task)) {
+      __atomic_store_n(&this->sleeping, 0, __ATOMIC_RELAXED);
+      return 0;
+    }
+
+    int error;
+    if ((error = futex_wait(&this->sleeping, 1)) != 0)
+      return error;
+  }
+}
+
 /**
  * Background thread error handling macros.
  */
@@ -168,21 +448,14 @@ typedef struct __cuthread_st {
 static void * cu_thread_main(void * args) {
   CUthread this = (CUthread)args;
 
+  currentContext = this->index;
+  currentThread = this;
+
   // Enter main loop
   while (true) {
-    // Lock the mutex for the task queue
-    THREAD_ERROR_CHECK(pthread_mutex_lock(&this->mutex));
-
-    // Wait until there are tasks in the queue
-    while (cuTaskQueueIsEmpty(&this->queue))
-      THREAD_ERROR_CHECK(pthread_cond_wait(&this->nonEmpty, &this->mutex));
-
-    // Remove a task from the head of the queue
+    // Take a task, waiting for one if necessary
     CUtask task;
-    cuTaskQueuePop(&this->queue, &task);
-
-    // Unlock the mutex for the task queue
-    THREAD_ERROR_CHECK(pthread_mutex_unlock(&this->mutex));
+    THREAD_ERROR_CHECK(cuThreadWait(this, &task));
 
     // A NULL task is the signal to exit
     if (task == NULL)
@@ -200,24 +473,37 @@ static void * cu_thread_main(void * args) {
  *
  * @param thread  a handle to the background thread is returned through this
  *                pointer.
+ * @param index   the index of the thread's context in the multiGPU context.
  * @return CUDA_SUCCESS on success,
  *         CUDA_ERROR_OUT_OF_MEMORY if there is not enough memory,
  *         CUDA_ERROR_OPERATING_SYSTEM if the thread could not be started.
  */
-static inline CUresult cuThreadCreate(CUthread * thread) {
+static inline CUresult cuThreadCreate(CUthread * thread, int index) {
   // Allocate space on the heap for the thread object
   if ((*thread = malloc(sizeof(struct __cuthread_st))) == NULL)
     return CUDA_ERROR_OUT_OF_MEMORY;
 
-  // Create the task queue for the thread
-  if (cuTaskQueueCreate(&(*thread)->queue, 1) != CUDA_SUCCESS) {
+  // Create the task queues for the thread
+  if (cuTaskQueueCreate(&(*thread)->queue) != CUDA_SUCCESS) {
+    free(*thread);
+    return CUDA_ERROR_OUT_OF_MEMORY;
+  }
+  if (cuTaskQueueCreate(&(*thread)->shared) != CUDA_SUCCESS) {
+    cuTaskQueueDestroy(&(*thread)->queue);
     free(*thread);
     return CUDA_ERROR_OUT_OF_MEMORY;
   }
 
-  // Set up the mutex and condition variable
-  (*thread)->mutex = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
-  (*thread)->nonEmpty = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+  // Stealing is enabled once all the threads have started
+  (*thread)->peers = NULL;
+  (*thread)->nPeers = 0;
+  (*thread)->index = index;
+
+  (*thread)->overflow = NULL;
+  (*thread)->ready = NULL;
+
+  (*thread)->sleeping = 0;
+  (*thread)->spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? CU_THREAD_SPIN_COUNT : 1;
 
   // Initialise thread error status to zero
   (*thread)->error = CUDA_SUCCESS;
@@ -229,31 +515,35 @@ static inline CUresult cuThreadCreate(CUthread * thread) {
 }
 
 /**
- * Destroys the background thread.  This function will block until all tasks are
- * completed.
+ * Signals the background thread to exit once it has finished the tasks in its
+ * private queue.
+ *
+ * @param thread  the thread to stop.
+ * @return CUDA_SUCCESS on success,
+ *         CUDA_ERROR_OPERATING_SYSTEM if the thread could not be woken.
+ */
+static inline CUresult cuThreadStop(CUthread thread) {
+  // Place a NULL task on the queue to signal the thread to exit the main loop
+  CU_ERROR_CHECK(cuThreadEnqueue(thread, &thread->queue, NULL));
+  CU_ERROR_CHECK(cuThreadWake(thread));
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Destroys a background thread that has been stopped.  This function will block
+ * until the thread exits.  Other threads must no longer be stealing from it.
  *
  * @param thread  the thread to destroy.
  * @return CUDA_SUCCESS on success,
  *         CUDA_ERROR_OPERATING_SYSTEM if the thread could not be stopped.
  */
 static inline CUresult cuThreadDestroy(CUthread thread) {
-  // Lock the queue
-  ERROR_CHECK(pthread_mutex_lock(&thread->mutex));
-
-  // Place a NULL task on the queue to signal the thread to exit the main loop
-  CU_ERROR_CHECK(cuTaskQueuePush(&thread->queue, NULL));
-
-  // Unlock the queue
-  ERROR_CHECK(pthread_mutex_unlock(&thread->mutex));
-
-  // Signal to the thread that there are tasks waiting
-  ERROR_CHECK(pthread_cond_signal(&thread->nonEmpty));
-
   // Wait for the thread to exit
   ERROR_CHECK(pthread_join(thread->thread, (void **)&thread));
 
-  // Destroy the queue
+  // Destroy the queues
   cuTaskQueueDestroy(&thread->queue);
+  cuTaskQueueDestroy(&thread->shared);
 
   // Copy the thread error status
   CUresult error = thread->error;
@@ -265,45 +555,124 @@ static inline CUresult cuThreadDestroy(CUthread thread) {
   return error;
 }
 
+/**
+ * Places a task whose dependencies have finished in the queue it was submitted
+ * to without waking the thread.  Background threads releasing the dependents of
+ * a task they have just run use the overflow stack if the queue is full rather
+ * than waiting.
+ *
+ * @param task  the task.
+ * @return CUDA_SUCCESS on success,
+ *         CUDA_ERROR_OPERATING_SYSTEM if the thread could not be woken to
+ *         drain a full queue.
+ */
+static inline CUresult cuTaskEnqueue(CUtask task) {
+  if (currentThread == NULL)
+    CU_ERROR_CHECK(cuThreadEnqueue(task->thread, task->queue, task));
+  else if (!cuTaskQueuePush(task->queue, task))
+    cuThreadPushOverflow(task->thread, task);
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Submits a task to a queue on a background thread without waking the thread.
+ * The task is placed in the queue now if it has no unfinished dependencies,
+ * otherwise by the thread that runs the last of them.
+ *
+ * @param task    the task.
+ * @param thread  the background thread to run the task on.
+ * @param queue   the queue (either the private or shared queue of the thread).
+ * @return CUDA_SUCCESS on success,
+ *         CUDA_ERROR_OPERATING_SYSTEM if there was a problem communicating the
+ *         task to the thread.
+ */
+static inline CUresult cuTaskSubmit(CUtask task, CUthread thread,
+                                    CUtaskqueue * queue) {
+  task->thread = thread;
+  task->queue = queue;
+
+  // Drop the reference held until submission
+  if (__atomic_sub_fetch(&task->pending, 1, __ATOMIC_ACQ_REL) == 0)
+    CU_ERROR_CHECK(cuTaskEnqueue(task));
+
+  return CUDA_SUCCESS;
+}
+
 /**
  * Schedules a task to run on a background thread.
  *
  * @param thread  the background thread to run the task on.
  * @param task    the task to run.
  * @return CUDA_SUCCESS on success,
- *         CUDA_ERROR_OUT_OF_MEMORY if there is not enough memory,
  *         CUDA_ERROR_OPERATING_SYSTEM if there was a problem communicating the
  *         task to the thread.
  */
 static inline CUresult cuThreadRunTask(CUthread thread, CUtask task) {
-  // Lock the mutex for the queue
-  ERROR_CHECK(pthread_mutex_lock(&thread->mutex));
+  // Place the task in the queue and wake the background thread
+  CU_ERROR_CHECK(cuTaskSubmit(task, thread, &thread->queue));
+  CU_ERROR_CHECK(cuThreadWake(thread));
 
-  // Place the task in the queue
-  CU_ERROR_CHECK(cuTaskQueuePush(&thread->queue, task));
+  return CUDA_SUCCESS;
+}
 
-  // Unlock the queue mutex
-  ERROR_CHECK(pthread_mutex_unlock(&thread->mutex));
+/**
+ * Per-thread pool of completed tasks.  Tasks are returned to the pool of the
+ * thread that destroys them and taken from the pool of the thread that creates
+ * them so no locking is required.
+ */
+typedef struct {
+  CUtask head;                  /** First task in the pool                    */
+  size_t count;                 /** Number of tasks in the pool               */
+} CUtaskpool;
 
-  // Signal to background thread that there are now tasks available
-  ERROR_CHECK(pthread_cond_signal(&thread->nonEmpty));
+static pthread_key_t poolKey;
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+static bool poolKeyValid = false;
 
-  return CUDA_SUCCESS;
+/**
+ * Frees the tasks in a thread's pool when the thread exits.
+ *
+ * @param p  the pool.
+ */
+static void cuTaskPoolDestroy(void * p) {
+  CUtaskpool * pool = (CUtaskpool *)p;
+  while (pool->head != NULL) {
+    CUtask task = pool->head;
+    pool->head = task->next;
+    free(task->dependents);
+    free(task);
+  }
+  free(pool);
+}
+
+static void cuTaskPoolKeyCreate() {
+  poolKeyValid = (pthread_key_create(&poolKey, cuTaskPoolDestroy) == 0);
 }
 
 /**
- * Task structure.
+ * Gets the calling thread's task pool, creating it if necessary.
+ *
+ * @return the pool, or NULL if it could not be created.
  */
-struct __cutask_st {
-  CUresult (*function)(const void *);  /** The function to run                */
-  void * args;                         /** Arguments for the function         */
-  CUresult result;                     /** Result of the function             */
-  bool complete;                       /** Flag set when function is finished */
-  pthread_mutex_t mutex;               /** Mutex to protect access to result and
-                                           flag                               */
-  pthread_cond_t cond;                 /** Condition to wait on function
-                                           completion                         */
-};
+static inline CUtaskpool * cuTaskPoolGet() {
+  if (pthread_once(&poolOnce, cuTaskPoolKeyCreate) != 0 || !poolKeyValid)
+    return NULL;
+
+  CUtaskpool * pool = pthread_getspecific(poolKey);
+  if (pool == NULL) {
+    if ((pool = malloc(sizeof(CUtaskpool))) == NULL)
+      return NULL;
+    pool->head = NULL;
+    pool->count = 0;
+    if (pthread_setspecific(poolKey, pool) != 0) {
+      free(pool);
+      return NULL;
+    }
+  }
+
+  return pool;
+}
 
 /**
  * Creates a task.
@@ -323,23 +692,113 @@ CUresult cuTaskCreate(CUtask * task, CUresult (*function)(const void *),
   if (function == NULL || (args == NULL && size > 0))
     return CUDA_ERROR_INVALID_VALUE;
 
-  if (((*task) = malloc(sizeof(struct __cutask_st))) == NULL)
-    return CUDA_ERROR_OUT_OF_MEMORY;
+  // Reuse a task from the pool if there is one.  Its mutex and condition
+  // variable are still initialised from when it was first created.
+  CUtaskpool * pool = cuTaskPoolGet();
+  if (pool != NULL && pool->head != NULL) {
+    *task = pool->head;
+    pool->head = (*task)->next;
+    pool->count--;
+  }
+  else {
+    if (((*task) = malloc(sizeof(struct __cutask_st))) == NULL)
+      return CUDA_ERROR_OUT_OF_MEMORY;
+
+    (*task)->mutex = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+    (*task)->cond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+    (*task)->dependents = NULL;
+    (*task)->maxDependents = 0;
+  }
 
   (*task)->function = function;
   (*task)->complete = false;
-  (*task)->mutex = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
-  (*task)->cond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
-
-  // Allocate space on heap for arguments so that they can be accessed by other
-  // threads
-  if (((*task)->args = malloc(size)) == NULL) {
+  (*task)->finished = false;
+  (*task)->dependencyResult = CUDA_SUCCESS;
+  (*task)->pending = 1;
+  (*task)->nDependents = 0;
+  (*task)->callback = NULL;
+
+  // Store small arguments in the task and copy larger ones onto the heap so
+  // that they can be accessed by other threads
+  if (size <= CU_TASK_INLINE_ARGS)
+    (*task)->args = (*task)->inlineArgs.data;
+  else if (((*task)->args = malloc(size)) == NULL) {
+    free((*task)->dependents);
     free(*task);
     return CUDA_ERROR_OUT_OF_MEMORY;
   }
 
-  // Copy arguments onto heap
-  (*task)->args = memcpy((*task)->args, args, size);
+  if (size > 0)
+    (*task)->args = memcpy((*task)->args, args, size);
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Makes a task wait for another task to finish before it is run.  Must be
+ * called before the task is submitted.  If the dependency is unsuccessful the
+ * task is not run and its result is set to the result of the dependency.
+ *
+ * @param task        the task.
+ * @param dependency  the task to wait for (which may already be submitted or
+ *                    finished but not destroyed).
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY,
+ *         CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuTaskAddDependency(CUtask task, CUtask dependency) {
+  if (task == NULL || dependency == NULL || task == dependency)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  ERROR_CHECK(pthread_mutex_lock(&dependency->mutex));
+
+  if (dependency->finished) {
+    // Nothing to wait for but a failure still has to be passed on
+    if (dependency->result != CUDA_SUCCESS) {
+      CUresult success = CUDA_SUCCESS;
+      __atomic_compare_exchange_n(&task->dependencyResult, &success,
+                                  dependency->result, false,
+                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+  }
+  else {
+    // Record the task so that it is released when the dependency finishes
+    if (dependency->nDependents == dependency->maxDependents) {
+      size_t capacity = (dependency->maxDependents == 0) ? 4 : 2 * dependency->maxDependents;
+      CUtask * ptr = realloc(dependency->dependents, capacity * sizeof(CUtask));
+      if (ptr == NULL) {
+        ERROR_CHECK(pthread_mutex_unlock(&dependency->mutex));
+        return CUDA_ERROR_OUT_OF_MEMORY;
+      }
+      dependency->dependents = ptr;
+      dependency->maxDependents = capacity;
+    }
+    dependency->dependents[dependency->nDependents++] = task;
+    __atomic_add_fetch(&task->pending, 1, __ATOMIC_RELAXED);
+  }
+
+  ERROR_CHECK(pthread_mutex_unlock(&dependency->mutex));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Sets a function to be called when a task finishes.  The callback is called on
+ * the thread that ran the task, after the task function returns and before
+ * cuTaskDestroy returns.  Must be called before the task is submitted.
+ *
+ * @param task      the task.
+ * @param callback  the function to call with the result of the task and
+ *                  <b>data</b> (may be NULL to remove the callback).
+ * @param data      an argument for the callback.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE.
+ */
+CUresult cuTaskSetCallback(CUtask task, void (*callback)(CUresult, void *),
+                           void * data) {
+  if (task == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  task->callback = callback;
+  task->callbackData = data;
 
   return CUDA_SUCCESS;
 }
@@ -367,9 +826,46 @@ CUresult cuTaskDestroy(CUtask task, CUresult * result) {
   // Unlock the task mutex
   ERROR_CHECK(pthread_mutex_unlock(&task->mutex));
 
-  // Free the task and arguments
-  free(task->args);
-  free(task);
+  // Free arguments that did not fit in the task
+  if (task->args != task->inlineArgs.data)
+    free(task->args);
+
+  // Return the task to the pool or free it if the pool is full
+  CUtaskpool * pool = cuTaskPoolGet();
+  if (pool != NULL && pool->count < CU_TASK_POOL_SIZE) {
+    task->next = pool->head;
+    pool->head = task;
+    pool->count++;
+  }
+  else {
+    free(task->dependents);
+    free(task);
+  }
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Destroys an array of tasks, blocking until they have all completed.
+ *
+ * @param tasks   the tasks to destroy.
+ * @param n       the number of tasks.
+ * @param result  the first unsuccessful result returned by the tasks, or
+ *                CUDA_SUCCESS if they all succeeded (may be NULL).
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuTaskDestroyAll(const CUtask * tasks, size_t n, CUresult * result) {
+  CUresult first = CUDA_SUCCESS;
+
+  for (size_t j = 0; j < n; j++) {
+    CUresult r;
+    CU_ERROR_CHECK(cuTaskDestroy(tasks[j], &r));
+    if (first == CUDA_SUCCESS)
+      first = r;
+  }
+
+  if (result != NULL)
+    *result = first;
 
   return CUDA_SUCCESS;
 }
@@ -381,21 +877,62 @@ CUresult cuTaskDestroy(CUtask task, CUresult * result) {
  * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
  */
 CUresult cuTaskExecute(CUtask task) {
+  // Run the task function using the arguments unless a dependency failed.  The
+  // function and callback run without the task mutex held so that dependents
+  // can be added while the task is running, including by the task itself.
+  CUresult result;
+  if (task->dependencyResult == CUDA_SUCCESS)
+    result = task->function(task->args);
+  else
+    result = task->dependencyResult;
+
+  if (task->callback != NULL)
+    task->callback(result, task->callbackData);
+
   // Lock the mutex for the task
   ERROR_CHECK(pthread_mutex_lock(&task->mutex));
 
-  // Run the task function using the arguments and assign the result
-  task->result = task->function(task->args);
+  // Publish the result.  No more dependents may be added once the task has
+  // finished.
+  task->result = result;
+  task->finished = true;
+
+  // Unlock the task mutex
+  ERROR_CHECK(pthread_mutex_unlock(&task->mutex));
+
+  // Release the dependents, passing on any failure.  The task cannot be
+  // destroyed until it is marked as completed below.
+  for (size_t i = 0; i < task->nDependents; i++) {
+    CUtask dependent = task->dependents[i];
+    if (task->result != CUDA_SUCCESS) {
+      CUresult success = CUDA_SUCCESS;
+      __atomic_compare_exchange_n(&dependent->dependencyResult, &success,
+                                  task->result, false,
+                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    if (__atomic_sub_fetch(&dependent->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+      // The dependent may run and be recycled as soon as it is in a queue so
+      // read its thread first
+      CUthread thread = dependent->thread;
+      CU_ERROR_CHECK(cuTaskEnqueue(dependent));
+      CU_ERROR_CHECK(cuThreadWake(thread));
+    }
+  }
+
+  // Lock the mutex for the task
+  ERROR_CHECK(pthread_mutex_lock(&task->mutex));
 
   // Set the task as completed
   task->complete = true;
 
+  // Signal to waiting threads that the task has now completed.  This is done
+  // before unlocking as the waiting thread may recycle the task as soon as the
+  // mutex is released.
+  ERROR_CHECK(pthread_cond_signal(&task->cond));
+
   // Unlock the task mutex
   ERROR_CHECK(pthread_mutex_unlock(&task->mutex));
 
-  // Signal to waiting threads that the task has now completed
-  ERROR_CHECK(pthread_cond_signal(&task->cond));
-
   return CUDA_SUCCESS;
 }
 
@@ -405,12 +942,40 @@ CUresult cuTaskExecute(CUtask task) {
 struct __cumultigpu_st {
   CUthread * threads;
   int n;
+  int host;                     /** Index of the host context or -1           */
+  CUdevice * devices;           /** Device each context was created on        */
+  CUmultiGPUModel * models;     /** Performance model of each context         */
+  pthread_mutex_t mutex;        /** Mutex protecting the models               */
+};
+
+/**
+ * Arguments for createContext.  GPU contexts are bound to the cores left over
+ * by the host context, if there is one.
+ */
+struct context_args {
+  CUdevice device;              /** Device to create the context on           */
+  int threads;                  /** Number of OpenMP threads (host only)      */
+  bool bind;                    /** Whether to bind the thread to cpus        */
+  cpu_set_t cpus;               /** Cores to bind the thread to               */
 };
 
 static CUresult createContext(const void * args) {
-  CUdevice * device = (CUdevice *)args;
+  const struct context_args * a = (const struct context_args *)args;
+
+  if (a->bind)
+    ERROR_CHECK(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &a->cpus));
+
+  // The host context has no CUDA context.  The OpenMP threads it starts
+  // inherit its affinity.
+  if (a->device == CU_MULTIGPU_HOST) {
+#ifdef _OPENMP
+    omp_set_num_threads(a->threads);
+#endif
+    return CUDA_SUCCESS;
+  }
+
   CUcontext context;
-  CU_ERROR_CHECK(cuCtxCreate(&context, CU_CTX_SCHED_YIELD, *device));
+  CU_ERROR_CHECK(cuCtxCreate(&context, CU_CTX_SCHED_YIELD, a->device));
   return CUDA_SUCCESS;
 }
 
@@ -424,12 +989,33 @@ static CUresult destroyContext(const void * args) {
   return CUDA_SUCCESS;
 }
 
+/**
+ * Works out how many cores to give the host context.
+ *
+ * @param available  the number of cores the process may run on.
+ * @param nGPUs      the number of GPU contexts.
+ * @return the number of cores.
+ */
+static int hostThreads(int available, int nGPUs) {
+  const char * threads = getenv("CUMULTIGPU_HOST_THREADS");
+  if (threads != NULL) {
+    char * end;
+    long n = strtol(threads, &end, 10);
+    if (end != threads && *end == '\0' && n > 0)
+      return (n < available) ? (int)n : available;
+  }
+
+  // Leave a core for each GPU and one for the calling thread
+  const int n = available - nGPUs - 1;
+  return (n < 1) ? 1 : n;
+}
+
 /**
  * Creates a multiGPU context with a single CUDA context created on each of the
  * devices given.
  *
  * @param mGPU     the newly created context is returned through this pointer.
- * @param devices  the CUDA devices to use.
+ * @param devices  the CUDA devices to use (may include CU_MULTIGPU_HOST).
  * @param n        the number of CUDA devices to use.
  * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY,
  *         CUDA_ERROR_OPERATING_SYSTEM.
@@ -438,18 +1024,63 @@ CUresult cuMultiGPUCreate(CUmultiGPU * mGPU, CUdevice * devices, int n) {
   if (n <= 0)
     return CUDA_ERROR_INVALID_VALUE;
 
+  int host = -1;
+  for (int i = 0; i < n; i++) {
+    if (devices[i] == CU_MULTIGPU_HOST) {
+      if (host >= 0)
+        return CUDA_ERROR_INVALID_VALUE;
+      host = i;
+    }
+  }
+
+  // Set aside the last cores the process may run on for the host context and
+  // bind the GPU contexts to the rest
+  struct context_args gpu = { .bind = false }, cpu = { .device = CU_MULTIGPU_HOST, .bind = false };
+  if (host >= 0) {
+    cpu_set_t available;
+    ERROR_CHECK((sched_getaffinity(0, sizeof(cpu_set_t), &available) == 0) ? 0 : errno);
+
+    cpu.threads = hostThreads(CPU_COUNT(&available), n - 1);
+    CPU_ZERO(&cpu.cpus);
+    gpu.cpus = available;
+    int k = 0;
+    for (size_t c = CPU_SETSIZE; c-- > 0 && k < cpu.threads;) {
+      if (CPU_ISSET(c, &available)) {
+        CPU_SET(c, &cpu.cpus);
+        CPU_CLR(c, &gpu.cpus);
+        k++;
+      }
+    }
+    cpu.bind = true;
+    gpu.bind = (CPU_COUNT(&gpu.cpus) > 0);
+  }
+
   if ((*mGPU = malloc(sizeof(struct __cumultigpu_st))) == NULL)
     return CUDA_ERROR_OUT_OF_MEMORY;
 
   if (((*mGPU)->threads = malloc((size_t)n * sizeof(CUthread))) == NULL)
     return CUDA_ERROR_OUT_OF_MEMORY;
 
+  if (((*mGPU)->devices = malloc((size_t)n * sizeof(CUdevice))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  if (((*mGPU)->models = calloc((size_t)n, sizeof(CUmultiGPUModel))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  ERROR_CHECK(pthread_mutex_init(&(*mGPU)->mutex, NULL));
+
   (*mGPU)->n = n;
+  (*mGPU)->host = host;
   for (int i = 0; i < n; i++) {
+    (*mGPU)->devices[i] = devices[i];
+
+    struct context_args * args = (i == host) ? &cpu : &gpu;
+    args->device = devices[i];
+
     CUtask task;
-    CU_ERROR_CHECK(cuTaskCreate(&task, createContext, &devices[i], sizeof(CUdevice)));
+    CU_ERROR_CHECK(cuTaskCreate(&task, createContext, args, sizeof(struct context_args)));
 
-    CU_ERROR_CHECK(cuThreadCreate(&(*mGPU)->threads[i]));
+    CU_ERROR_CHECK(cuThreadCreate(&(*mGPU)->threads[i], i));
     CU_ERROR_CHECK(cuThreadRunTask((*mGPU)->threads[i], task));
 
     CUresult result;
@@ -458,6 +1089,12 @@ CUresult cuMultiGPUCreate(CUmultiGPU * mGPU, CUdevice * devices, int n) {
       return (int)result;
   }
 
+  // Let the threads steal from each other now that they have all started
+  for (int i = 0; i < n; i++) {
+    (*mGPU)->threads[i]->peers = (*mGPU)->threads;
+    __atomic_store_n(&(*mGPU)->threads[i]->nPeers, n, __ATOMIC_RELEASE);
+  }
+
   return CUDA_SUCCESS;
 }
 
@@ -469,6 +1106,9 @@ CUresult cuMultiGPUCreate(CUmultiGPU * mGPU, CUdevice * devices, int n) {
  */
 CUresult cuMultiGPUDestroy(CUmultiGPU mGPU) {
   for (int i = 0; i < mGPU->n; i++) {
+    if (i == mGPU->host)
+      continue;
+
     CUtask task;
     CU_ERROR_CHECK(cuTaskCreate(&task, destroyContext, NULL, 0));
     CU_ERROR_CHECK(cuThreadRunTask(mGPU->threads[i], task));
@@ -477,9 +1117,17 @@ CUresult cuMultiGPUDestroy(CUmultiGPU mGPU) {
     CU_ERROR_CHECK(cuTaskDestroy(task, &result));
     if (result != CUDA_SUCCESS)
       return result;
+  }
 
+  // Stop all the threads before freeing any of them as they may be looking in
+  // each other's queues for tasks to steal
+  for (int i = 0; i < mGPU->n; i++)
+    CU_ERROR_CHECK(cuThreadStop(mGPU->threads[i]));
+  for (int i = 0; i < mGPU->n; i++)
     CU_ERROR_CHECK(cuThreadDestroy(mGPU->threads[i]));
-  }
+  ERROR_CHECK(pthread_mutex_destroy(&mGPU->mutex));
+  free(mGPU->models);
+  free(mGPU->devices);
   free(mGPU->threads);
   free(mGPU);
   return CUDA_SUCCESS;
@@ -501,6 +1149,47 @@ CUresult cuMultiGPURunTask(CUmultiGPU mGPU, int i, CUtask task) {
   return CUDA_SUCCESS;
 }
 
+/**
+ * Runs an array of tasks, each using the CUDA context given by the
+ * corresponding element of <b>contexts</b>.  Each background thread is woken at
+ * most once.  With CUmultiGPUScheduleStatic tasks using the same context are
+ * run in array order.  With CUmultiGPUScheduleSteal the tasks are placed in the
+ * shared queues and every thread is woken so that idle threads can steal them.
+ *
+ * @param mGPU      the multiGPU context.
+ * @param contexts  the index of the CUDA context to use for each task.
+ * @param tasks     the tasks to run.
+ * @param n         the number of tasks.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPURunTasks(CUmultiGPU mGPU, const int * contexts,
+                            const CUtask * tasks, size_t n) {
+  for (size_t j = 0; j < n; j++) {
+    if (contexts[j] < 0 || contexts[j] >= mGPU->n)
+      return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  const bool steal = (multiGPUSchedule == CUmultiGPUScheduleSteal);
+
+  bool used[mGPU->n];
+  for (int i = 0; i < mGPU->n; i++)
+    used[i] = steal;
+
+  // Queue all the tasks then wake each background thread that was given one
+  for (size_t j = 0; j < n; j++) {
+    CUthread thread = mGPU->threads[contexts[j]];
+    CU_ERROR_CHECK(cuTaskSubmit(tasks[j], thread, (steal) ? &thread->shared : &thread->queue));
+    used[contexts[j]] = true;
+  }
+
+  for (int i = 0; i < mGPU->n; i++) {
+    if (used[i])
+      CU_ERROR_CHECK(cuThreadWake(mGPU->threads[i]));
+  }
+
+  return CUDA_SUCCESS;
+}
+
 static CUresult synchronize() {
   CU_ERROR_CHECK(cuCtxSynchronize());
   return CUDA_SUCCESS;
@@ -516,7 +1205,10 @@ CUresult cuMultiGPUSynchronize(CUmultiGPU mGPU) {
   CUtask task;
   CUresult result;
 
+  // Tasks on the host context have finished their work when they return
   for (int i = 0; i < mGPU->n; i++) {
+    if (i == mGPU->host)
+      continue;
     CU_ERROR_CHECK(cuTaskCreate(&task, synchronize, NULL, 0));
     CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, i, task));
     CU_ERROR_CHECK(cuTaskDestroy(task, &result));
@@ -527,6 +1219,16 @@ CUresult cuMultiGPUSynchronize(CUmultiGPU mGPU) {
   return CUDA_SUCCESS;
 }
 
+/**
+ * Gets the index of the context the calling task is running on.
+ *
+ * @return the index of the context in its multiGPU context, or -1 if the caller
+ *         is not running on a context.
+ */
+int cuMultiGPUGetCurrentContext(void) {
+  return currentContext;
+}
+
 /**
  * Gets the number of contexts available in the multiGPU context.
  *
@@ -536,3 +1238,144 @@ CUresult cuMultiGPUSynchronize(CUmultiGPU mGPU) {
 int cuMultiGPUGetContextCount(CUmultiGPU mGPU) {
   return mGPU->n;
 }
+
+/**
+ * Gets whether a context in the multiGPU context runs on the host cores.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param i     the index of the context.
+ * @return non-zero if the context was created for CU_MULTIGPU_HOST, zero
+ *         otherwise.
+ */
+int cuMultiGPUIsHost(CUmultiGPU mGPU, int i) {
+  return i == mGPU->host;
+}
+
+/**
+ * Records the time a task took to do some work on a context.  The throughput of
+ * each context is a running average of these measurements after the time
+ * expected for the copies has been taken off.
+ *
+ * @param mGPU     the multiGPU context.
+ * @param i        the index of the context the task ran on.
+ * @param flops    the number of floating point operations done by the task.
+ * @param bytes    the number of bytes copied between host and device by the
+ *                 task.
+ * @param seconds  the time the task took (including any copies).
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPURecordThroughput(CUmultiGPU mGPU, int i, double flops, double bytes,
+                                    double seconds) {
+  if (i < 0 || i >= mGPU->n || flops <= 0.0 || bytes < 0.0 || seconds <= 0.0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  ERROR_CHECK(pthread_mutex_lock(&mGPU->mutex));
+  model_record(&mGPU->models[i], flops, bytes, seconds);
+  ERROR_CHECK(pthread_mutex_unlock(&mGPU->mutex));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Gets the performance model of a context.
+ *
+ * @param mGPU   the multiGPU context.
+ * @param i      the index of the context.
+ * @param model  the model is returned through this pointer.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUGetModel(CUmultiGPU mGPU, int i, CUmultiGPUModel * model) {
+  if (i < 0 || i >= mGPU->n || model == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  ERROR_CHECK(pthread_mutex_lock(&mGPU->mutex));
+  *model = mGPU->models[i];
+  ERROR_CHECK(pthread_mutex_unlock(&mGPU->mutex));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Sets the performance model of a context.
+ *
+ * @param mGPU   the multiGPU context.
+ * @param i      the index of the context.
+ * @param model  the model.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUSetModel(CUmultiGPU mGPU, int i, const CUmultiGPUModel * model) {
+  if (i < 0 || i >= mGPU->n || model == NULL ||
+      model->throughput < 0.0 || model->bandwidth < 0.0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  ERROR_CHECK(pthread_mutex_lock(&mGPU->mutex));
+  mGPU->models[i] = *model;
+  ERROR_CHECK(pthread_mutex_unlock(&mGPU->mutex));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Saves the performance models of all the contexts to a text file so that they
+ * can be loaded in a later run.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param path  the file to write.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUSaveModel(CUmultiGPU mGPU, const char * path) {
+  CUmultiGPUModel models[mGPU->n];
+
+  ERROR_CHECK(pthread_mutex_lock(&mGPU->mutex));
+  for (int i = 0; i < mGPU->n; i++)
+    models[i] = mGPU->models[i];
+  ERROR_CHECK(pthread_mutex_unlock(&mGPU->mutex));
+
+  return model_save(path, models, mGPU->devices, mGPU->n);
+}
+
+/**
+ * Loads performance models saved by cuMultiGPUSaveModel.  Models are only
+ * loaded for contexts created on the same device as when they were saved.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param path  the file to read.
+ * @return CUDA_SUCCESS, CUDA_ERROR_FILE_NOT_FOUND, CUDA_ERROR_INVALID_VALUE if
+ *         the file is malformed, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPULoadModel(CUmultiGPU mGPU, const char * path) {
+  CUresult result;
+
+  ERROR_CHECK(pthread_mutex_lock(&mGPU->mutex));
+  result = model_load(path, mGPU->models, mGPU->devices, mGPU->n);
+  ERROR_CHECK(pthread_mutex_unlock(&mGPU->mutex));
+
+  return result;
+}
+
+/**
+ * Assigns tiles of equal size to contexts in proportion to the rate each
+ * context's performance model predicts it will get through them.
+ *
+ * @param mGPU      the multiGPU context.
+ * @param flops     the number of floating point operations in each tile.
+ * @param bytes     the number of bytes copied between host and device for each
+ *                  tile.
+ * @param contexts  the index of the context to use for each tile is returned
+ *                  through this array.
+ * @param n         the number of tiles.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUPartition(CUmultiGPU mGPU, double flops, double bytes,
+                             int * contexts, size_t n) {
+  CUmultiGPUModel models[mGPU->n];
+
+  ERROR_CHECK(pthread_mutex_lock(&mGPU->mutex));
+  for (int i = 0; i < mGPU->n; i++)
+    models[i] = mGPU->models[i];
+  ERROR_CHECK(pthread_mutex_unlock(&mGPU->mutex));
+
+  model_partition(models, mGPU->n, flops, bytes, contexts, n);
+
+  return CUDA_SUCCESS;
+}
@@ -1,8 +1,21 @@
 #include "cumultigpu.h"
 #include "error.h"
+#include "model.h"
 
 // Single threaded versions of CUtask and CUmultiGPU.
 
+/**
+ * Tasks always run on the context they were given in the single threaded
+ * version so this has no effect.
+ */
+CUmultiGPUSchedule multiGPUSchedule = CUmultiGPUScheduleStatic;
+
+/**
+ * Number of bytes of task arguments stored inline in the task.  Larger argument
+ * structures are copied to the heap.
+ */
+#define CU_TASK_INLINE_ARGS 128
+
 /**
  * Task structure.
  */
@@ -10,8 +23,29 @@ struct __cutask_st {
   CUresult (*function)(const void *);  /** The function to run                */
   void * args;                         /** Arguments for the function         */
   CUresult result;                     /** Result of the function             */
+  bool finished;                       /** Flag set when function has returned */
+  CUresult dependencyResult;           /** First unsuccessful result of a
+                                           dependency                         */
+  int pending;                         /** Number of unfinished dependencies
+                                           plus one until the task is
+                                           submitted                          */
+  struct __cutask_st ** dependents;    /** Tasks waiting for this one         */
+  size_t nDependents, maxDependents;   /** Number of dependents and capacity  */
+  CUmultiGPU mGPU;                     /** MultiGPU context to run the task on
+                                           when its dependencies have
+                                           finished                           */
+  int context;                         /** Index of the context to use        */
+  void (*callback)(CUresult, void *);  /** Completion callback                */
+  void * callbackData;                 /** Argument for the callback          */
+  union {
+    char data[CU_TASK_INLINE_ARGS];
+    long double align;
+    void * ptr;
+  } inlineArgs;                        /** Storage for small arguments        */
 };
 
+static CUresult cuTaskRun(CUtask);
+
 /**
  * Creates a task.
  *
@@ -34,16 +68,83 @@ CUresult cuTaskCreate(CUtask * task, CUresult (*function)(const void *),
     return CUDA_ERROR_OUT_OF_MEMORY;
 
   (*task)->function = function;
+  (*task)->finished = false;
+  (*task)->dependencyResult = CUDA_SUCCESS;
+  (*task)->pending = 1;
+  (*task)->dependents = NULL;
+  (*task)->nDependents = 0;
+  (*task)->maxDependents = 0;
+  (*task)->callback = NULL;
 
-  // Allocate space on heap for arguments so that they can be accessed by other
-  // threads
-  if (((*task)->args = malloc(size)) == NULL) {
+  // Store small arguments in the task and copy larger ones onto the heap
+  if (size <= CU_TASK_INLINE_ARGS)
+    (*task)->args = (*task)->inlineArgs.data;
+  else if (((*task)->args = malloc(size)) == NULL) {
     free(*task);
     return CUDA_ERROR_OUT_OF_MEMORY;
   }
 
-  // Copy arguments onto heap
-  (*task)->args = memcpy((*task)->args, args, size);
+  if (size > 0)
+    (*task)->args = memcpy((*task)->args, args, size);
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Makes a task wait for another task to finish before it is run.  Must be
+ * called before the task is submitted.  If the dependency is unsuccessful the
+ * task is not run and its result is set to the result of the dependency.
+ *
+ * @param task        the task.
+ * @param dependency  the task to wait for (which may already be submitted or
+ *                    finished but not destroyed).
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY,
+ *         CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuTaskAddDependency(CUtask task, CUtask dependency) {
+  if (task == NULL || dependency == NULL || task == dependency)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  if (dependency->finished) {
+    // Nothing to wait for but a failure still has to be passed on
+    if (dependency->result != CUDA_SUCCESS && task->dependencyResult == CUDA_SUCCESS)
+      task->dependencyResult = dependency->result;
+    return CUDA_SUCCESS;
+  }
+
+  // Record the task so that it is run when the dependency finishes
+  if (dependency->nDependents == dependency->maxDependents) {
+    size_t capacity = (dependency->maxDependents == 0) ? 4 : 2 * dependency->maxDependents;
+    CUtask * ptr = realloc(dependency->dependents, capacity * sizeof(CUtask));
+    if (ptr == NULL)
+      return CUDA_ERROR_OUT_OF_MEMORY;
+    dependency->dependents = ptr;
+    dependency->maxDependents = capacity;
+  }
+  dependency->dependents[dependency->nDependents++] = task;
+  task->pending++;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Sets a function to be called when a task finishes.  The callback is called on
+ * the thread that ran the task, after the task function returns and before
+ * cuTaskDestroy returns.  Must be called before the task is submitted.
+ *
+ * @param task      the task.
+ * @param callback  the function to call with the result of the task and
+ *                  <b>data</b> (may be NULL to remove the callback).
+ * @param data      an argument for the callback.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE.
+ */
+CUresult cuTaskSetCallback(CUtask task, void (*callback)(CUresult, void *),
+                           void * data) {
+  if (task == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  task->callback = callback;
+  task->callbackData = data;
 
   return CUDA_SUCCESS;
 }
@@ -61,13 +162,40 @@ CUresult cuTaskDestroy(CUtask task, CUresult * result) {
   if (result != NULL)
     *result = task->result;
 
-  // Free the task and arguments
-  free(task->args);
+  // Free the task and any arguments that did not fit in it
+  if (task->args != task->inlineArgs.data)
+    free(task->args);
+  free(task->dependents);
   free(task);
 
   return CUDA_SUCCESS;
 }
 
+/**
+ * Destroys an array of tasks, blocking until they have all completed.
+ *
+ * @param tasks   the tasks to destroy.
+ * @param n       the number of tasks.
+ * @param result  the first unsuccessful result returned by the tasks, or
+ *                CUDA_SUCCESS if they all succeeded (may be NULL).
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuTaskDestroyAll(const CUtask * tasks, size_t n, CUresult * result) {
+  CUresult first = CUDA_SUCCESS;
+
+  for (size_t j = 0; j < n; j++) {
+    CUresult r;
+    CU_ERROR_CHECK(cuTaskDestroy(tasks[j], &r));
+    if (first == CUDA_SUCCESS)
+      first = r;
+  }
+
+  if (result != NULL)
+    *result = first;
+
+  return CUDA_SUCCESS;
+}
+
 /**
  * Executes the task on the calling thread.
  *
@@ -75,11 +203,36 @@ CUresult cuTaskDestroy(CUtask task, CUresult * result) {
  * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
  */
 CUresult cuTaskExecute(CUtask task) {
-  // Run the task function using the arguments and assign the result
-  task->result = task->function(task->args);
+  // Run the task function using the arguments and assign the result unless a
+  // dependency failed
+  if (task->dependencyResult == CUDA_SUCCESS)
+    task->result = task->function(task->args);
+  else
+    task->result = task->dependencyResult;
+
+  if (task->callback != NULL)
+    task->callback(task->result, task->callbackData);
+
+  task->finished = true;
+
+  // Run the dependents that were only waiting for this task, passing on any
+  // failure
+  for (size_t i = 0; i < task->nDependents; i++) {
+    CUtask dependent = task->dependents[i];
+    if (task->result != CUDA_SUCCESS && dependent->dependencyResult == CUDA_SUCCESS)
+      dependent->dependencyResult = task->result;
+    if (--dependent->pending == 0)
+      CU_ERROR_CHECK(cuTaskRun(dependent));
+  }
+
   return CUDA_SUCCESS;
 }
 
+/**
+ * Index of the context of the task running on the calling thread.
+ */
+static __thread int currentContext = -1;
+
 /**
  * MultiGPU context.  Single threaded version is simply an array of CUDA
  * contexts.
@@ -87,6 +240,9 @@ CUresult cuTaskExecute(CUtask task) {
 struct __cumultigpu_st {
   CUcontext * contexts;
   int n;
+  int host;                     /** Index of the host context or -1           */
+  CUdevice * devices;           /** Device each context was created on        */
+  CUmultiGPUModel * models;     /** Performance model of each context         */
 };
 
 /**
@@ -94,7 +250,7 @@ struct __cumultigpu_st {
  * devices given.
  *
  * @param mGPU     the newly created context is returned through this pointer.
- * @param devices  the CUDA devices to use.
+ * @param devices  the CUDA devices to use (may include CU_MULTIGPU_HOST).
  * @param n        the number of CUDA devices to use.
  * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OUT_OF_MEMORY,
  *         CUDA_ERROR_OPERATING_SYSTEM.
@@ -103,14 +259,37 @@ CUresult cuMultiGPUCreate(CUmultiGPU * mGPU, CUdevice * devices, int n) {
   if (n <= 0)
     return CUDA_ERROR_INVALID_VALUE;
 
+  int host = -1;
+  for (int i = 0; i < n; i++) {
+    if (devices[i] == CU_MULTIGPU_HOST) {
+      if (host >= 0)
+        return CUDA_ERROR_INVALID_VALUE;
+      host = i;
+    }
+  }
+
   if ((*mGPU = malloc(sizeof(struct __cumultigpu_st))) == NULL)
     return CUDA_ERROR_OUT_OF_MEMORY;
 
   if (((*mGPU)->contexts = malloc((size_t)n * sizeof(CUcontext))) == NULL)
     return CUDA_ERROR_OUT_OF_MEMORY;
 
+  if (((*mGPU)->devices = malloc((size_t)n * sizeof(CUdevice))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  if (((*mGPU)->models = calloc((size_t)n, sizeof(CUmultiGPUModel))) == NULL)
+    return CUDA_ERROR_OUT_OF_MEMORY;
+
+  // Tasks on the host context run with no current CUDA context on the calling
+  // thread
   (*mGPU)->n = n;
+  (*mGPU)->host = host;
   for (int i = 0; i < n; i++) {
+    (*mGPU)->devices[i] = devices[i];
+    if (i == host) {
+      (*mGPU)->contexts[i] = NULL;
+      continue;
+    }
     CU_ERROR_CHECK(cuCtxCreate(&(*mGPU)->contexts[i], CU_CTX_SCHED_AUTO, devices[i]));
     CU_ERROR_CHECK(cuCtxPopCurrent(&(*mGPU)->contexts[i]));
   }
@@ -125,8 +304,12 @@ CUresult cuMultiGPUCreate(CUmultiGPU * mGPU, CUdevice * devices, int n) {
  * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
  */
 CUresult cuMultiGPUDestroy(CUmultiGPU mGPU) {
-  for (int i = 0; i < mGPU->n; i++)
-    CU_ERROR_CHECK(cuCtxDestroy(mGPU->contexts[i]));
+  for (int i = 0; i < mGPU->n; i++) {
+    if (i != mGPU->host)
+      CU_ERROR_CHECK(cuCtxDestroy(mGPU->contexts[i]));
+  }
+  free(mGPU->models);
+  free(mGPU->devices);
   free(mGPU->contexts);
   free(mGPU);
   return CUDA_SUCCESS;
@@ -145,9 +328,58 @@ CUresult cuMultiGPURunTask(CUmultiGPU mGPU, int i, CUtask task) {
   if (i < 0 || i >= mGPU->n)
     return CUDA_ERROR_INVALID_VALUE;
 
-  CU_ERROR_CHECK(cuCtxPushCurrent(mGPU->contexts[i]));
-  CU_ERROR_CHECK(cuTaskExecute(task));
-  CU_ERROR_CHECK(cuCtxPopCurrent(&mGPU->contexts[i]));
+  task->mGPU = mGPU;
+  task->context = i;
+
+  // Run the task now unless it is waiting for other tasks
+  if (--task->pending == 0)
+    CU_ERROR_CHECK(cuTaskRun(task));
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Runs a task on the context it was submitted to.
+ *
+ * @param task  the task to run.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+static CUresult cuTaskRun(CUtask task) {
+  const int previous = currentContext;
+  currentContext = task->context;
+
+  if (task->context == task->mGPU->host)
+    CU_ERROR_CHECK(cuTaskExecute(task));
+  else {
+    CU_ERROR_CHECK(cuCtxPushCurrent(task->mGPU->contexts[task->context]));
+    CU_ERROR_CHECK(cuTaskExecute(task));
+    CU_ERROR_CHECK(cuCtxPopCurrent(&task->mGPU->contexts[task->context]));
+  }
+
+  currentContext = previous;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Runs an array of tasks, each using the CUDA context given by the
+ * corresponding element of <b>contexts</b>.  Tasks are run in array order.
+ *
+ * @param mGPU      the multiGPU context.
+ * @param contexts  the index of the CUDA context to use for each task.
+ * @param tasks     the tasks to run.
+ * @param n         the number of tasks.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPURunTasks(CUmultiGPU mGPU, const int * contexts,
+                            const CUtask * tasks, size_t n) {
+  for (size_t j = 0; j < n; j++) {
+    if (contexts[j] < 0 || contexts[j] >= mGPU->n)
+      return CUDA_ERROR_INVALID_VALUE;
+  }
+
+  for (size_t j = 0; j < n; j++)
+    CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, contexts[j], tasks[j]));
 
   return CUDA_SUCCESS;
 }
@@ -160,6 +392,8 @@ CUresult cuMultiGPURunTask(CUmultiGPU mGPU, int i, CUtask task) {
  */
 CUresult cuMultiGPUSynchronize(CUmultiGPU mGPU) {
   for (int i = 0; i < mGPU->n; i++) {
+    if (i == mGPU->host)
+      continue;
     CU_ERROR_CHECK(cuCtxPushCurrent(mGPU->contexts[i]));
     CU_ERROR_CHECK(cuCtxSynchronize());
     CU_ERROR_CHECK(cuCtxPopCurrent(&mGPU->contexts[i]));
@@ -167,6 +401,16 @@ CUresult cuMultiGPUSynchronize(CUmultiGPU mGPU) {
   return CUDA_SUCCESS;
 }
 
+/**
+ * Gets the index of the context the calling task is running on.
+ *
+ * @return the index of the context in its multiGPU context, or -1 if the caller
+ *         is not running on a context.
+ */
+int cuMultiGPUGetCurrentContext(void) {
+  return currentContext;
+}
+
 /**
  * Gets the number of contexts available in the multiGPU context.
  *
@@ -176,3 +420,117 @@ CUresult cuMultiGPUSynchronize(CUmultiGPU mGPU) {
 int cuMultiGPUGetContextCount(CUmultiGPU mGPU) {
   return mGPU->n;
 }
+
+/**
+ * Gets whether a context in the multiGPU context runs on the host cores.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param i     the index of the context.
+ * @return non-zero if the context was created for CU_MULTIGPU_HOST, zero
+ *         otherwise.
+ */
+int cuMultiGPUIsHost(CUmultiGPU mGPU, int i) {
+  return i == mGPU->host;
+}
+
+/**
+ * Records the time a task took to do some work on a context.  The throughput of
+ * each context is a running average of these measurements after the time
+ * expected for the copies has been taken off.
+ *
+ * @param mGPU     the multiGPU context.
+ * @param i        the index of the context the task ran on.
+ * @param flops    the number of floating point operations done by the task.
+ * @param bytes    the number of bytes copied between host and device by the
+ *                 task.
+ * @param seconds  the time the task took (including any copies).
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE.
+ */
+CUresult cuMultiGPURecordThroughput(CUmultiGPU mGPU, int i, double flops, double bytes,
+                                    double seconds) {
+  if (i < 0 || i >= mGPU->n || flops <= 0.0 || bytes < 0.0 || seconds <= 0.0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  model_record(&mGPU->models[i], flops, bytes, seconds);
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Gets the performance model of a context.
+ *
+ * @param mGPU   the multiGPU context.
+ * @param i      the index of the context.
+ * @param model  the model is returned through this pointer.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE.
+ */
+CUresult cuMultiGPUGetModel(CUmultiGPU mGPU, int i, CUmultiGPUModel * model) {
+  if (i < 0 || i >= mGPU->n || model == NULL)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  *model = mGPU->models[i];
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Sets the performance model of a context.
+ *
+ * @param mGPU   the multiGPU context.
+ * @param i      the index of the context.
+ * @param model  the model.
+ * @return CUDA_SUCCESS, CUDA_ERROR_INVALID_VALUE.
+ */
+CUresult cuMultiGPUSetModel(CUmultiGPU mGPU, int i, const CUmultiGPUModel * model) {
+  if (i < 0 || i >= mGPU->n || model == NULL ||
+      model->throughput < 0.0 || model->bandwidth < 0.0)
+    return CUDA_ERROR_INVALID_VALUE;
+
+  mGPU->models[i] = *model;
+
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Saves the performance models of all the contexts to a text file so that they
+ * can be loaded in a later run.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param path  the file to write.
+ * @return CUDA_SUCCESS, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPUSaveModel(CUmultiGPU mGPU, const char * path) {
+  return model_save(path, mGPU->models, mGPU->devices, mGPU->n);
+}
+
+/**
+ * Loads performance models saved by cuMultiGPUSaveModel.  Models are only
+ * loaded for contexts created on the same device as when they were saved.
+ *
+ * @param mGPU  the multiGPU context.
+ * @param path  the file to read.
+ * @return CUDA_SUCCESS, CUDA_ERROR_FILE_NOT_FOUND, CUDA_ERROR_INVALID_VALUE if
+ *         the file is malformed, CUDA_ERROR_OPERATING_SYSTEM.
+ */
+CUresult cuMultiGPULoadModel(CUmultiGPU mGPU, const char * path) {
+  return model_load(path, mGPU->models, mGPU->devices, mGPU->n);
+}
+
+/**
+ * Assigns tiles of equal size to contexts in proportion to the rate each
+ * context's performance model predicts it will get through them.
+ *
+ * @param mGPU      the multiGPU context.
+ * @param flops     the number of floating point operations in each tile.
+ * @param bytes     the number of bytes copied between host and device for each
+ *                  tile.
+ * @param contexts  the index of the context to use for each tile is returned
+ *                  through this array.
+ * @param n         the number of tiles.
+ * @return CUDA_SUCCESS.
+ */
+CUresult cuMultiGPUPartition(CUmultiGPU mGPU, double flops, double bytes,
+                             int * contexts, size_t n) {
+  model_partition(mGPU->models, mGPU->n, flops, bytes, contexts, n);
+  return CUDA_SUCCESS;
+}
@@ -143,11 +143,13 @@ int main(int argc, char * argv[]) {
       if (c > idiff)
         idiff = c;
 
+      // Number of terms in the dot product depends on the triangle of op(A)
+      const bool upper = (uplo == CBlasUpper) == (trans == CBlasNoTrans);
       size_t flops;
       if (side == CBlasLeft)
-        flops = 2 * i + 1;
+        flops = 2 * ((upper) ? m - i : i + 1) - 1;
       else
-        flops = 2 * j + 1;
+        flops = 2 * ((upper) ? j + 1 : n - j) - 1;
       if (diag == CBlasNonUnit)
         flops++;
       flops *= 3;
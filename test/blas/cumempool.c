@@ -0,0 +1,106 @@
+#include "blas.h"
+#include "error.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+int main(int argc, char * argv[]) {
+  int d = 0;
+
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [device]\n"
+                    "where:\n"
+                    "  device  is the GPU to use (default 0)\n", argv[0]);
+    return 1;
+  }
+
+  if (argc > 1 && sscanf(argv[1], "%d", &d) != 1) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[1]);
+    return 1;
+  }
+
+  CU_ERROR_CHECK(cuInit(0));
+
+  CUdevice device;
+  CU_ERROR_CHECK(cuDeviceGet(&device, d));
+
+  CUcontext context;
+  CU_ERROR_CHECK(cuCtxCreate(&context, CU_CTX_SCHED_BLOCKING_SYNC, device));
+
+  CUBLAShandle handle;
+  CU_ERROR_CHECK(cuBLASCreate(&handle));
+
+  size_t borrowed, cached, highWater;
+  CU_ERROR_CHECK(cuBLASMemGetInfo(handle, &borrowed, &cached, &highWater));
+  assert(borrowed == 0 && cached == 0 && highWater == 0);
+
+  /* Arguments are checked */
+  CUdeviceptr A, B, C;
+  size_t pitch;
+  assert(cuBLASMemAlloc(handle, &A, 0) == CUDA_ERROR_INVALID_VALUE);
+  assert(cuBLASMemAllocPitch(handle, &A, &pitch, 100, 100, 3) == CUDA_ERROR_INVALID_VALUE);
+
+  /* Pitches are aligned and hold a row */
+  CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &A, &pitch, 1000 * sizeof(double), 64, sizeof(double)));
+  assert(pitch >= 1000 * sizeof(double) && pitch % 512 == 0);
+  CU_ERROR_CHECK(cuBLASMemGetInfo(handle, &borrowed, &cached, NULL));
+  assert(borrowed >= pitch * 64 && borrowed <= pitch * 64 + pitch * 64 / 4 && cached == 0);
+
+  /* A freed block is reused for a request in the same size class */
+  CU_ERROR_CHECK(cuBLASMemFree(handle, A));
+  assert(cuBLASMemFree(handle, A) == CUDA_ERROR_INVALID_VALUE);
+  CU_ERROR_CHECK(cuBLASMemAllocPitch(handle, &B, &pitch, 999 * sizeof(double), 64, sizeof(double)));
+  assert(B == A);
+
+  /* Two blocks are held at once and a small one comes from the minimum class */
+  CU_ERROR_CHECK(cuBLASMemAlloc(handle, &C, 8));
+  assert(C != B);
+  CU_ERROR_CHECK(cuBLASMemGetInfo(handle, &borrowed, &cached, &highWater));
+  assert(cached == 0 && highWater == borrowed);
+
+  CU_ERROR_CHECK(cuBLASMemFree(handle, B));
+  CU_ERROR_CHECK(cuBLASMemFree(handle, C));
+  CU_ERROR_CHECK(cuBLASMemGetInfo(handle, &borrowed, &cached, &highWater));
+  assert(borrowed == 0 && cached == highWater);
+
+  /* Trimming gives the cache back but keeps the high-water mark */
+  CU_ERROR_CHECK(cuBLASMemTrim(handle));
+  CU_ERROR_CHECK(cuBLASMemGetInfo(handle, &borrowed, &cached, &highWater));
+  assert(borrowed == 0 && cached == 0 && highWater > 0);
+
+  /* Staging buffers are reused the same way */
+  void * H, * G;
+  assert(cuBLASMemAllocHost(handle, &H, 0) == CUDA_ERROR_INVALID_VALUE);
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle, &H, 100000));
+  CU_ERROR_CHECK(cuBLASMemFreeHost(handle, H));
+  assert(cuBLASMemFreeHost(handle, H) == CUDA_ERROR_INVALID_VALUE);
+  CU_ERROR_CHECK(cuBLASMemAllocHost(handle, &G, 99000));
+  assert(G == H);
+
+  /* Streams are only reused for requests with the same flags */
+  CUstream s0, s1, s2;
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &s0, 0));
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &s1, 0));
+  assert(s0 != s1);
+  CU_ERROR_CHECK(cuBLASStreamFree(handle, s0));
+  assert(cuBLASStreamFree(handle, s0) == CUDA_ERROR_INVALID_VALUE);
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &s2, CU_STREAM_NON_BLOCKING));
+  assert(s2 != s0);
+  CU_ERROR_CHECK(cuBLASStreamAlloc(handle, &s2, 0));
+  assert(s2 == s0);
+
+  /* Trimming leaves borrowed streams and buffers usable */
+  CU_ERROR_CHECK(cuBLASMemTrim(handle));
+  CU_ERROR_CHECK(cuStreamSynchronize(s1));
+  memset(G, 0, 99000);
+
+  /* Blocks, buffers and streams still borrowed are freed with the handle */
+  CU_ERROR_CHECK(cuBLASMemAlloc(handle, &A, 1 << 20));
+
+  CU_ERROR_CHECK(cuBLASDestroy(handle));
+  CU_ERROR_CHECK(cuCtxDestroy(context));
+
+  fprintf(stdout, "Memory pool reused blocks (high-water mark %zu bytes)\n", highWater);
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+#include "blas.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <float.h>
+#include <math.h>
+#include "ref/dtrmm_ref.c"
+
+/**
+ * Checks cuMultiGPUDtrmm against the reference for every side, uplo, trans and
+ * diag combination using matrices that span several blocks in each dimension
+ * so that every branch of the blocked recurrence is exercised.
+ */
+int main(int argc, char * argv[]) {
+  size_t m = 611, n = 593;
+
+  if (argc != 1 && argc != 3) {
+    fprintf(stderr, "Usage: %s [m n]\n"
+                    "where:\n"
+                    "  m and n  are the sizes of the matrices (default %zu and %zu)\n",
+            argv[0], m, n);
+    return 1;
+  }
+
+  if (argc == 3) {
+    if (sscanf(argv[1], "%zu", &m) != 1) {
+      fprintf(stderr, "Unable to parse number from '%s'\n", argv[1]);
+      return 1;
+    }
+
+    if (sscanf(argv[2], "%zu", &n) != 1) {
+      fprintf(stderr, "Unable to parse number from '%s'\n", argv[2]);
+      return 2;
+    }
+  }
+
+  srand(0);
+
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  CUmultiGPUBLAShandle handle;
+  CU_ERROR_CHECK(cuMultiGPUBLASCreate(&handle, mGPU));
+
+  const size_t k = (m > n) ? m : n;
+  const size_t lda = (k + 1u) & ~1u, ldb = (m + 1u) & ~1u;
+  double * A, * B, * refB;
+  if ((A = malloc(lda * k * sizeof(double))) == NULL) {
+    fputs("Unable to allocate A\n", stderr);
+    return -1;
+  }
+  if ((B = malloc(ldb * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate B\n", stderr);
+    return -2;
+  }
+  if ((refB = malloc(ldb * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate refB\n", stderr);
+    return -3;
+  }
+
+  for (size_t j = 0; j < k; j++) {
+    for (size_t i = 0; i < k; i++)
+      A[j * lda + i] = (double)rand() / (double)RAND_MAX;
+  }
+
+  const double alpha = (double)rand() / (double)RAND_MAX;
+
+  const CBlasSide sides[] = { CBlasLeft, CBlasRight };
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const CBlasTranspose transes[] = { CBlasNoTrans, CBlasTrans };
+  const CBlasDiag diags[] = { CBlasNonUnit, CBlasUnit };
+
+  bool passed = true;
+  for (size_t s = 0; s < 2; s++) {
+    for (size_t u = 0; u < 2; u++) {
+      for (size_t t = 0; t < 2; t++) {
+        for (size_t d = 0; d < 2; d++) {
+          for (size_t j = 0; j < n; j++) {
+            for (size_t i = 0; i < m; i++)
+              refB[j * ldb + i] = B[j * ldb + i] = (double)rand() / (double)RAND_MAX;
+          }
+
+          dtrmm_ref(sides[s], uplos[u], transes[t], diags[d], m, n, alpha, A, lda, refB, ldb);
+          CU_ERROR_CHECK(cuMultiGPUDtrmm(handle, sides[s], uplos[u], transes[t], diags[d], m, n, alpha, A, lda, B, ldb));
+          CU_ERROR_CHECK(cuMultiGPUSynchronize(mGPU));
+
+          // Each element of B is a dot product of length at most k whose
+          // terms are in [0, 1]
+          bool ok = true;
+          double diff = 0.0;
+          for (size_t j = 0; j < n; j++) {
+            for (size_t i = 0; i < m; i++) {
+              double e = fabs(B[j * ldb + i] - refB[j * ldb + i]);
+              if (e > diff)
+                diff = e;
+              if (e > (double)(2 * k + 1) * (double)k * DBL_EPSILON)
+                ok = false;
+            }
+          }
+
+          fprintf(stdout, "%c%c%c%c %zux%zu Error: %.3e %s\n",
+                  (sides[s] == CBlasLeft) ? 'L' : 'R', (uplos[u] == CBlasUpper) ? 'U' : 'L',
+                  (transes[t] == CBlasNoTrans) ? 'N' : 'T', (diags[d] == CBlasNonUnit) ? 'N' : 'U',
+                  m, n, diff, (ok) ? "ok" : "wrong");
+          passed &= ok;
+        }
+      }
+    }
+  }
+
+  fprintf(stdout, "%sED!\n", (passed) ? "PASS" : "FAIL");
+
+  free(A);
+  free(B);
+  free(refB);
+
+  CU_ERROR_CHECK(cuMultiGPUBLASDestroy(handle));
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  return (int)!passed;
+}
@@ -0,0 +1,111 @@
+#include "blas.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+static double maxdiff(size_t m, size_t n, const double * A, size_t lda, const double * B, size_t ldb) {
+  double diff = 0.0;
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < m; i++) {
+      double d = fabs(A[j * lda + i] - B[j * ldb + i]);
+      if (d > diff)
+        diff = d;
+    }
+  }
+  return diff;
+}
+
+int main() {
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  CUmultiGPUBLAShandle handle;
+  CU_ERROR_CHECK(cuMultiGPUBLASCreate(&handle, mGPU));
+
+  const size_t n = 600, ld = n + 3;
+  double * A, * B, * C, * D, * refC;
+  if ((A = malloc(ld * n * sizeof(double))) == NULL ||
+      (B = malloc(ld * n * sizeof(double))) == NULL ||
+      (C = malloc(ld * n * sizeof(double))) == NULL ||
+      (D = malloc(ld * n * sizeof(double))) == NULL ||
+      (refC = malloc(ld * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate matrices\n", stderr);
+    return -1;
+  }
+
+  srand(0);
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < ld; i++) {
+      A[j * ld + i] = (double)rand() / (double)RAND_MAX;
+      B[j * ld + i] = (double)rand() / (double)RAND_MAX;
+    }
+  }
+
+  CU_ERROR_CHECK(cuMultiGPUBLASSetTileCache(handle, 256 << 20));
+
+  /* Tasks share the blocks of A and B they read */
+  size_t hits, misses, bytes;
+  CU_ERROR_CHECK(cuMultiGPUDgemm(handle, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, C, ld));
+  CU_ERROR_CHECK(cuMultiGPUBLASTileCacheGetInfo(handle, &hits, &misses, &bytes));
+  assert(hits > 0 && misses > 0 && bytes > 0);
+
+  dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, refC, ld);
+  assert(maxdiff(n, n, C, ld, refC, ld) < 1.0e-10 * (double)n);
+
+  /* The blocks stay on the devices for later calls */
+  size_t before = hits;
+  CU_ERROR_CHECK(cuMultiGPUDgemm(handle, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, C, ld));
+  CU_ERROR_CHECK(cuMultiGPUBLASTileCacheGetInfo(handle, &hits, NULL, NULL));
+  assert(hits > before);
+
+  /* Blocks written on the host are copied again once invalidated */
+  for (size_t j = 0; j < n; j++)
+    A[j * ld + j] += 1.0;
+  CU_ERROR_CHECK(cuMultiGPUBLASInvalidate(handle, A, ld, n, n, sizeof(double)));
+  CU_ERROR_CHECK(cuMultiGPUDgemm(handle, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, C, ld));
+  dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, refC, ld);
+  assert(maxdiff(n, n, C, ld, refC, ld) < 1.0e-10 * (double)n);
+
+  /* Results written by the multiGPU routines invalidate the blocks cached from
+   * them: C is read, overwritten and then read again */
+  CU_ERROR_CHECK(cuMultiGPUDgemm(handle, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, C, ld, B, ld, 0.0, D, ld));
+  CU_ERROR_CHECK(cuMultiGPUDgemm(handle, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, B, ld, A, ld, 0.0, C, ld));
+  CU_ERROR_CHECK(cuMultiGPUDgemm(handle, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, C, ld, B, ld, 0.0, D, ld));
+  dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, B, ld, A, ld, 0.0, refC, ld);
+  dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, refC, ld, B, ld, 0.0, C, ld);
+  assert(maxdiff(n, n, D, ld, C, ld) < 1.0e-10 * (double)(n * n));
+
+  /* Shrinking the cache frees it */
+  CU_ERROR_CHECK(cuMultiGPUBLASSetTileCache(handle, 0));
+  CU_ERROR_CHECK(cuMultiGPUBLASTileCacheGetInfo(handle, NULL, NULL, &bytes));
+  assert(bytes == 0);
+
+  /* The pipelines give back the memory of the last tiles before returning */
+  size_t borrowed;
+  CU_ERROR_CHECK(cuMultiGPUBLASMemGetInfo(handle, &borrowed, NULL, NULL));
+  assert(borrowed == 0);
+
+  free(A);
+  free(B);
+  free(C);
+  free(D);
+  free(refC);
+
+  CU_ERROR_CHECK(cuMultiGPUBLASDestroy(handle));
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  fputs("Blocks were reused from the tile cache\n", stdout);
+
+  return 0;
+}
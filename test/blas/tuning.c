@@ -0,0 +1,175 @@
+#include "blas.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+static double maxdiff(size_t m, size_t n, const double * A, size_t lda, const double * B, size_t ldb) {
+  double diff = 0.0;
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < m; i++) {
+      double d = fabs(A[j * lda + i] - B[j * ldb + i]);
+      if (d > diff)
+        diff = d;
+    }
+  }
+  return diff;
+}
+
+static bool equal(const CBlasBlocking * a, const CBlasBlocking * b) {
+  return a->mb == b->mb && a->nb == b->nb && a->kb == b->kb &&
+         a->trsm == b->trsm && a->trmm == b->trmm && a->threads == b->threads;
+}
+
+int main() {
+  const char * path = "tuning.txt";
+
+  /* Entries are set and got by routine and model */
+  const CBlasBlocking tile = { .mb = 96, .nb = 160, .kb = 48 };
+  CBlasBlocking blocking;
+  CU_ERROR_CHECK(cuBLASTuningSet("Test Device", CBlasDgemmN, &tile));
+  CU_ERROR_CHECK(cuBLASTuningGet("Test Device", CBlasDgemmN, &blocking));
+  assert(equal(&blocking, &tile));
+  assert(cuBLASTuningGet("Test Device", CBlasDgemmT, &blocking) == CUDA_ERROR_NOT_FOUND);
+  assert(cuBLASTuningGet("Other Device", CBlasDgemmN, &blocking) == CUDA_ERROR_NOT_FOUND);
+
+  const CBlasBlocking empty = { .mb = 0, .nb = 160, .kb = 48 };
+  assert(cuBLASTuningSet("Test Device", CBlasDgemmN, &empty) == CUDA_ERROR_INVALID_VALUE);
+
+  /* Only the tile size is used by the Cholesky entries */
+  const CBlasBlocking cholesky = { .mb = 64 };
+  CU_ERROR_CHECK(cuBLASTuningSet(NULL, CBlasDpotrf, &cholesky));
+  CU_ERROR_CHECK(cuBLASTuningGet(NULL, CBlasDpotrf, &blocking));
+  assert(equal(&blocking, &cholesky));
+  const CBlasBlocking untiled = { .mb = 0 };
+  assert(cuBLASTuningSet(NULL, CBlasDpotrf, &untiled) == CUDA_ERROR_INVALID_VALUE);
+
+  /* The database survives a round trip through a file */
+  CU_ERROR_CHECK(cuBLASTuningSave(path));
+  const CBlasBlocking changed = { .mb = 32, .nb = 32, .kb = 32 };
+  CU_ERROR_CHECK(cuBLASTuningSet("Test Device", CBlasDgemmN, &changed));
+  CU_ERROR_CHECK(cuBLASTuningLoad(path));
+  CU_ERROR_CHECK(cuBLASTuningGet("Test Device", CBlasDgemmN, &blocking));
+  assert(equal(&blocking, &tile));
+
+  /* Nothing is loaded from a malformed file */
+  FILE * file;
+  if ((file = fopen(path, "w")) == NULL) {
+    fputs("Unable to write tuning database\n", stderr);
+    return -1;
+  }
+  fputs("dgemm_n 64 64 64 0 0 0 Test Device\nzgemm_x 64 64 64 0 0 0 Test Device\n", file);
+  fclose(file);
+  assert(cuBLASTuningLoad(path) == CUDA_ERROR_INVALID_VALUE);
+  CU_ERROR_CHECK(cuBLASTuningGet("Test Device", CBlasDgemmN, &blocking));
+  assert(equal(&blocking, &tile));
+  remove(path);
+  assert(cuBLASTuningLoad(path) == CUDA_ERROR_FILE_NOT_FOUND);
+
+  const size_t n = 300, ld = n + 3;
+  double * A, * B, * C, * refC;
+  if ((A = malloc(ld * n * sizeof(double))) == NULL ||
+      (B = malloc(ld * n * sizeof(double))) == NULL ||
+      (C = malloc(ld * n * sizeof(double))) == NULL ||
+      (refC = malloc(ld * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate matrices\n", stderr);
+    return -1;
+  }
+
+  srand(0);
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < ld; i++) {
+      A[j * ld + i] = (double)rand() / (double)RAND_MAX;
+      B[j * ld + i] = (double)rand() / (double)RAND_MAX;
+    }
+    A[j * ld + j] += (double)n;
+  }
+
+  /* The engine runs with the blocking set for the host processor, which need
+   * not be a multiple of the micro-tile */
+  dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, refC, ld);
+
+  const CBlasBlocking engine = { .mb = 40, .nb = 72, .kb = 24, .trsm = 8, .trmm = 24, .threads = 2 };
+  CU_ERROR_CHECK(cuBLASTuningSet(NULL, CBlasDengine, &engine));
+  CU_ERROR_CHECK(cuBLASTuningGet(cuBLASTuningHostModel(), CBlasDengine, &blocking));
+  assert(equal(&blocking, &engine));
+
+  dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, C, ld);
+  assert(maxdiff(n, n, C, ld, refC, ld) < 1.0e-10 * (double)n);
+
+  /* Multiplying by the triangle undoes solving with it */
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < n; i++)
+      refC[j * ld + i] = B[j * ld + i];
+  }
+  dtrsm(CBlasLeft, CBlasLower, CBlasNoTrans, CBlasNonUnit, n, n, 1.0, A, ld, B, ld);
+  dtrmm(CBlasLeft, CBlasLower, CBlasNoTrans, CBlasNonUnit, n, n, 1.0, A, ld, B, ld);
+  assert(maxdiff(n, n, B, ld, refC, ld) < 1.0e-10 * (double)n);
+
+  /* The tuner leaves a valid entry for the host processor */
+  CU_ERROR_CHECK(cuBLASTuneHost(CBlasDengine, 64));
+  CU_ERROR_CHECK(cuBLASTuningGet(NULL, CBlasDengine, &blocking));
+  assert(blocking.mb > 0 && blocking.nb > 0 && blocking.kb > 0 &&
+         blocking.trsm > 0 && blocking.trmm > 0 && blocking.threads >= 0);
+
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  CUmultiGPUBLAShandle handle;
+  CU_ERROR_CHECK(cuMultiGPUBLASCreate(&handle, mGPU));
+
+  /* Without entries for the devices the tiles are the compiled-in defaults */
+  CBlasBlocking defaults;
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, CBlasDgemmN, &defaults));
+  assert(defaults.mb > 0 && defaults.nb > 0 && defaults.kb > 0);
+  assert(cuMultiGPUBLASGetBlocking(handle, CBlasDpotrf, &blocking) == CUDA_ERROR_INVALID_VALUE);
+
+  /* The multiGPU routines split matrices into the tiles set for the devices */
+  for (int i = 0; i < deviceCount; i++) {
+    char name[256];
+    CU_ERROR_CHECK(cuDeviceGetName(name, 256, devices[i]));
+    CU_ERROR_CHECK(cuBLASTuningSet(name, CBlasDgemmN, &tile));
+  }
+  CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(handle, CBlasDgemmN, &blocking));
+  assert(blocking.mb == tile.mb && blocking.nb == tile.nb && blocking.kb == tile.kb);
+
+  CU_ERROR_CHECK(cuMultiGPUDgemm(handle, CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, C, ld));
+  dgemm(CBlasNoTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, refC, ld);
+  assert(maxdiff(n, n, C, ld, refC, ld) < 1.0e-10 * (double)n);
+
+  /* The tuner sets an entry for every device */
+  CU_ERROR_CHECK(cuMultiGPUBLASTune(handle, CBlasDgemmT, 256));
+  for (int i = 0; i < deviceCount; i++) {
+    char name[256];
+    CU_ERROR_CHECK(cuDeviceGetName(name, 256, devices[i]));
+    CU_ERROR_CHECK(cuBLASTuningGet(name, CBlasDgemmT, &blocking));
+    assert(blocking.mb > 0 && blocking.nb > 0 && blocking.kb > 0);
+  }
+
+  CU_ERROR_CHECK(cuMultiGPUDgemm(handle, CBlasTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, C, ld));
+  dgemm(CBlasTrans, CBlasNoTrans, n, n, n, 1.0, A, ld, B, ld, 0.0, refC, ld);
+  assert(maxdiff(n, n, C, ld, refC, ld) < 1.0e-10 * (double)n);
+
+  free(A);
+  free(B);
+  free(C);
+  free(refC);
+
+  CU_ERROR_CHECK(cuMultiGPUBLASDestroy(handle));
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  fputs("Block sizes were looked up in the tuning database\n", stdout);
+
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include "lapack.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "ref/dtrtri_ref.c"
+#include "ref/dlauum_ref.c"
+#include "util/dlatmc.c"
+
+/**
+ * Largest difference between A and refA relative to the largest element of
+ * refA.
+ */
+static double error(size_t n, const double * A, const double * refA, size_t lda) {
+  double diff = 0.0, norm = 0.0;
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < n; i++) {
+      double d = fabs(A[j * lda + i] - refA[j * lda + i]);
+      if (d > diff)
+        diff = d;
+      d = fabs(refA[j * lda + i]);
+      if (d > norm)
+        norm = d;
+    }
+  }
+  return (norm > 0.0) ? diff / norm : diff;
+}
+
+/**
+ * Checks cuMultiGPUDtrtri and cuMultiGPUDlauum against the references for
+ * matrices spanning several blocks so that every step runs the device update
+ * on the lookahead thread while the host works on the next diagonal block.
+ * The inverse is also checked with a zero on the diagonal of a later block so
+ * that the singularity is found while an update is in flight.
+ */
+int main(int argc, char * argv[]) {
+  size_t n = 0;
+
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [n]\n"
+                    "where:\n"
+                    "  n  is the size of the matrices (default three and a half blocks)\n",
+            argv[0]);
+    return 1;
+  }
+
+  if (argc == 2) {
+    if (sscanf(argv[1], "%zu", &n) != 1) {
+      fprintf(stderr, "Unable to parse number from '%s'\n", argv[1]);
+      return 1;
+    }
+  }
+
+  srand(0);
+
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  if (n == 0) {
+    CUmultiGPUBLAShandle blas_handle;
+    CU_ERROR_CHECK(cuMultiGPUBLASCreate(&blas_handle, mGPU));
+    CBlasBlocking blockingN, blockingT;
+    CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(blas_handle, CBlasDgemmN, &blockingN));
+    CU_ERROR_CHECK(cuMultiGPUBLASGetBlocking(blas_handle, CBlasDgemmT, &blockingT));
+    CU_ERROR_CHECK(cuMultiGPUBLASDestroy(blas_handle));
+    const size_t nb = (blockingN.mb > blockingT.mb) ? blockingN.mb : blockingT.mb;
+    n = 3 * nb + nb / 2 + 1;
+  }
+
+  CUmultiGPULAPACKhandle handle;
+  CU_ERROR_CHECK(cuMultiGPULAPACKCreate(&handle, mGPU));
+
+  const size_t lda = (n + 1u) & ~1u;
+  double * A, * refA;
+  if ((A = malloc(lda * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate A\n", stderr);
+    return -1;
+  }
+  if ((refA = malloc(lda * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate refA\n", stderr);
+    return -2;
+  }
+
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const CBlasDiag diags[] = { CBlasNonUnit, CBlasUnit };
+  long info, rInfo;
+  bool passed = true;
+
+  for (size_t u = 0; u < 2; u++) {
+    for (size_t d = 0; d < 3; d++) {
+      if (dlatmc(n, 2.0, A, lda) != 0) {
+        fputs("Unable to initialise A\n", stderr);
+        return -3;
+      }
+      // The third pass inverts a singular matrix
+      if (d == 2)
+        A[(n - n / 4) * lda + n - n / 4] = 0.0;
+      for (size_t j = 0; j < n; j++)
+        memcpy(&refA[j * lda], &A[j * lda], n * sizeof(double));
+
+      const CBlasDiag diag = diags[d % 2];
+      dtrtri_ref(uplos[u], diag, n, refA, lda, &rInfo);
+      CUresult result = cuMultiGPUDtrtri(handle, uplos[u], diag, n, A, lda, &info);
+      if (result != CUDA_SUCCESS && !(result == CUDA_ERROR_INVALID_VALUE && info > 0))
+        CU_ERROR_CHECK(result);
+      CU_ERROR_CHECK(cuMultiGPUSynchronize(mGPU));
+
+      const double diff = (rInfo == 0) ? error(n, A, refA, lda) : 0.0;
+      const bool ok = (info == rInfo) && diff <= (double)n * DBL_EPSILON;
+      fprintf(stdout, "DTRTRI %c%c %zu info: %ld (%ld) Error: %.3e %s\n",
+              (uplos[u] == CBlasUpper) ? 'U' : 'L', (diag == CBlasNonUnit) ? 'N' : 'U',
+              n, info, rInfo, diff, (ok) ? "ok" : "wrong");
+      passed &= ok;
+    }
+
+    if (dlatmc(n, 2.0, A, lda) != 0) {
+      fputs("Unable to initialise A\n", stderr);
+      return -3;
+    }
+    for (size_t j = 0; j < n; j++)
+      memcpy(&refA[j * lda], &A[j * lda], n * sizeof(double));
+
+    dlauum_ref(uplos[u], n, refA, lda, &rInfo);
+    CU_ERROR_CHECK(cuMultiGPUDlauum(handle, uplos[u], n, A, lda, &info));
+    CU_ERROR_CHECK(cuMultiGPUSynchronize(mGPU));
+
+    const double diff = error(n, A, refA, lda);
+    const bool ok = (info == rInfo) && diff <= (double)n * DBL_EPSILON;
+    fprintf(stdout, "DLAUUM %c  %zu info: %ld (%ld) Error: %.3e %s\n",
+            (uplos[u] == CBlasUpper) ? 'U' : 'L', n, info, rInfo, diff, (ok) ? "ok" : "wrong");
+    passed &= ok;
+  }
+
+  fprintf(stdout, "%sED!\n", (passed) ? "PASS" : "FAIL");
+
+  free(A);
+  free(refA);
+
+  CU_ERROR_CHECK(cuMultiGPULAPACKDestroy(handle));
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  return (int)!passed;
+}
@@ -0,0 +1,194 @@
+#include "lapack.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <assert.h>
+
+static double maxdiff(size_t n, const double * A, const double * B, size_t ld) {
+  double diff = 0.0;
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < n; i++) {
+      double d = fabs(A[j * ld + i] - B[j * ld + i]);
+      if (d > diff)
+        diff = d;
+    }
+  }
+  return diff;
+}
+
+static double zmaxdiff(size_t n, const double complex * A, const double complex * B, size_t ld) {
+  double diff = 0.0;
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < n; i++) {
+      double d = cabs(A[j * ld + i] - B[j * ld + i]);
+      if (d > diff)
+        diff = d;
+    }
+  }
+  return diff;
+}
+
+int main() {
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  CUmultiGPULAPACKhandle handle;
+  CU_ERROR_CHECK(cuMultiGPULAPACKCreate(&handle, mGPU));
+
+  /* The last block is short and the leading dimension is not the size */
+  const size_t n = 300, nb = 64, ld = n + 5;
+  double * A, * B, * C, * ref;
+  if ((A = malloc(ld * n * sizeof(double))) == NULL ||
+      (B = malloc(ld * n * sizeof(double))) == NULL ||
+      (C = malloc(ld * n * sizeof(double))) == NULL ||
+      (ref = malloc(ld * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate matrices\n", stderr);
+    return -1;
+  }
+
+  srand(0);
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < ld; i++)
+      B[j * ld + i] = (double)rand() / (double)RAND_MAX;
+  }
+  dgemm(CBlasNoTrans, CBlasTrans, n, n, n, 1.0, B, ld, B, ld, 0.0, A, ld);
+  for (size_t j = 0; j < n; j++)
+    A[j * ld + j] += (double)n;
+
+  /* Arguments are checked */
+  CUmultiGPUMatrix M;
+  assert(cuMultiGPUMatrixCreate(&M, handle, n, n, 0, sizeof(double)) == CUDA_ERROR_INVALID_VALUE);
+  assert(cuMultiGPUMatrixCreate(&M, handle, n, n, nb, 3) == CUDA_ERROR_INVALID_VALUE);
+
+  CU_ERROR_CHECK(cuMultiGPUMatrixCreate(&M, handle, n, n, nb, sizeof(double)));
+
+  int p, q;
+  CU_ERROR_CHECK(cuMultiGPUMatrixGetGrid(M, &p, &q));
+  assert(p * q == deviceCount && p <= q);
+
+  /* Scattering and gathering gives back the same matrix */
+  assert(cuMultiGPUMatrixScatter(M, A, n - 1) == CUDA_ERROR_INVALID_VALUE);
+  CU_ERROR_CHECK(cuMultiGPUMatrixScatter(M, A, ld));
+  memcpy(C, B, ld * n * sizeof(double));
+  CU_ERROR_CHECK(cuMultiGPUMatrixGather(M, C, ld));
+  assert(maxdiff(n, A, C, ld) == 0.0);
+
+  long info;
+  CUmultiGPUMatrix Z;
+  CU_ERROR_CHECK(cuMultiGPUMatrixCreate(&Z, handle, n, n, nb, sizeof(double complex)));
+  assert(cuMultiGPUDpotrfMatrix(handle, CBlasLower, Z, &info) == CUDA_ERROR_INVALID_VALUE && info == -3);
+
+  CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  for (int u = 0; u < 2; u++) {
+    const CBlasUplo uplo = uplos[u];
+
+    /* The factorisations match the host and leave the other triangle alone */
+    CU_ERROR_CHECK(cuMultiGPUMatrixScatter(M, A, ld));
+    CU_ERROR_CHECK(cuMultiGPUDpotrfMatrix(handle, uplo, M, &info));
+    assert(info == 0);
+    CU_ERROR_CHECK(cuMultiGPUMatrixGather(M, C, ld));
+    memcpy(ref, A, ld * n * sizeof(double));
+    dpotrf(uplo, n, ref, ld, &info);
+    assert(info == 0);
+    assert(maxdiff(n, C, ref, ld) < 1.0e-10);
+
+    CBlasDiag diags[] = { CBlasNonUnit, CBlasUnit };
+    for (int d = 0; d < 2; d++) {
+      CU_ERROR_CHECK(cuMultiGPUMatrixScatter(M, ref, ld));
+      CU_ERROR_CHECK(cuMultiGPUDtrtriMatrix(handle, uplo, diags[d], M, &info));
+      assert(info == 0);
+      CU_ERROR_CHECK(cuMultiGPUMatrixGather(M, C, ld));
+      memcpy(B, ref, ld * n * sizeof(double));
+      dtrtri(uplo, diags[d], n, B, ld, &info);
+      assert(maxdiff(n, C, B, ld) < 1.0e-10);
+    }
+
+    CU_ERROR_CHECK(cuMultiGPUMatrixScatter(M, ref, ld));
+    CU_ERROR_CHECK(cuMultiGPUDlauumMatrix(handle, uplo, M, &info));
+    CU_ERROR_CHECK(cuMultiGPUMatrixGather(M, C, ld));
+    memcpy(B, ref, ld * n * sizeof(double));
+    dlauum(uplo, n, B, ld, &info);
+    assert(maxdiff(n, C, B, ld) < 1.0e-10 * (double)n);
+
+    /* The inverse stays on the devices from the factorisation onwards */
+    CU_ERROR_CHECK(cuMultiGPUMatrixScatter(M, A, ld));
+    CU_ERROR_CHECK(cuMultiGPUDpotrfMatrix(handle, uplo, M, &info));
+    CU_ERROR_CHECK(cuMultiGPUDpotriMatrix(handle, uplo, M, &info));
+    assert(info == 0);
+    CU_ERROR_CHECK(cuMultiGPUMatrixGather(M, C, ld));
+    dpotri(uplo, n, ref, ld, &info);
+    assert(maxdiff(n, C, ref, ld) < 1.0e-12);
+
+    /* Matrices that are not positive definite fail where the host does */
+    memcpy(B, A, ld * n * sizeof(double));
+    B[200 * ld + 200] = -1.0;
+    CU_ERROR_CHECK(cuMultiGPUMatrixScatter(M, B, ld));
+    assert(cuMultiGPUDpotrfMatrix(handle, uplo, M, &info) == CUDA_ERROR_INVALID_VALUE);
+    long hostInfo;
+    dpotrf(uplo, n, B, ld, &hostInfo);
+    assert(info == hostInfo && info > 0);
+  }
+
+  /* Complex matrices use the conjugate transpose */
+  double complex * X, * Y, * Zref;
+  if ((X = malloc(ld * n * sizeof(double complex))) == NULL ||
+      (Y = malloc(ld * n * sizeof(double complex))) == NULL ||
+      (Zref = malloc(ld * n * sizeof(double complex))) == NULL) {
+    fputs("Unable to allocate matrices\n", stderr);
+    return -1;
+  }
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < ld; i++)
+      Y[j * ld + i] = (double)rand() / (double)RAND_MAX + ((double)rand() / (double)RAND_MAX) * I;
+  }
+  zgemm(CBlasNoTrans, CBlasConjTrans, n, n, n, 1.0, Y, ld, Y, ld, 0.0, X, ld);
+  for (size_t j = 0; j < n; j++)
+    X[j * ld + j] += (double)n;
+
+  for (int u = 0; u < 2; u++) {
+    CU_ERROR_CHECK(cuMultiGPUMatrixScatter(Z, X, ld));
+    CU_ERROR_CHECK(cuMultiGPUZpotrfMatrix(handle, uplos[u], Z, &info));
+    CU_ERROR_CHECK(cuMultiGPUZpotriMatrix(handle, uplos[u], Z, &info));
+    assert(info == 0);
+    CU_ERROR_CHECK(cuMultiGPUMatrixGather(Z, Y, ld));
+    memcpy(Zref, X, ld * n * sizeof(double complex));
+    zpotrf(uplos[u], n, Zref, ld, &info);
+    zpotri(uplos[u], n, Zref, ld, &info);
+    assert(zmaxdiff(n, Y, Zref, ld) < 1.0e-12);
+  }
+
+  CU_ERROR_CHECK(cuMultiGPUMatrixDestroy(M));
+  CU_ERROR_CHECK(cuMultiGPUMatrixDestroy(Z));
+
+  /* The matrices gave their memory back to the pools */
+  size_t borrowed;
+  CU_ERROR_CHECK(cuMultiGPULAPACKMemGetInfo(handle, &borrowed, NULL, NULL));
+  assert(borrowed == 0);
+
+  free(A);
+  free(B);
+  free(C);
+  free(ref);
+  free(X);
+  free(Y);
+  free(Zref);
+
+  CU_ERROR_CHECK(cuMultiGPULAPACKDestroy(handle));
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  fprintf(stdout, "Factorised and inverted matrices on a %d x %d grid\n", p, q);
+
+  return 0;
+}
@@ -45,6 +45,8 @@ int main(int argc, char * argv[]) {
   size_t lda;
   long info, rInfo;
 
+  CU_ERROR_CHECK(cuInit(0));
+
   int deviceCount;
   CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
 
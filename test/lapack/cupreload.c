@@ -0,0 +1,59 @@
+#include "lapack.h"
+#include "error.h"
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+int main(int argc, char * argv[]) {
+  int d = 0;
+
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [device]\n"
+                    "where:\n"
+                    "  device  is the GPU to use (default 0)\n", argv[0]);
+    return 1;
+  }
+
+  if (argc > 1 && sscanf(argv[1], "%d", &d) != 1) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[1]);
+    return 1;
+  }
+
+  CU_ERROR_CHECK(cuInit(0));
+
+  CUdevice device;
+  CU_ERROR_CHECK(cuDeviceGet(&device, d));
+
+  CUcontext context;
+  CU_ERROR_CHECK(cuCtxCreate(&context, CU_CTX_SCHED_BLOCKING_SYNC, device));
+
+  CULAPACKhandle handle;
+  CU_ERROR_CHECK(cuLAPACKCreate(&handle));
+
+  /* Preloading twice does nothing the second time */
+  CU_ERROR_CHECK(cuLAPACKPreload(handle));
+  CU_ERROR_CHECK(cuLAPACKPreload(handle));
+
+  /* Kernels run from the preloaded tables */
+  const size_t n = 100;
+  double x[n];
+  for (size_t j = 0; j < n; j++)
+    x[j] = exp(1.0);
+
+  CUdeviceptr dx;
+  CU_ERROR_CHECK(cuMemAlloc(&dx, n * sizeof(double)));
+  CU_ERROR_CHECK(cuMemcpyHtoD(dx, x, n * sizeof(double)));
+
+  double res;
+  CU_ERROR_CHECK(cuDlogdet(handle, dx, 1, n, &res, NULL));
+  assert(fabs(res - 2.0 * (double)n) < 1.0e-10);
+
+  CU_ERROR_CHECK(cuMemFree(dx));
+
+  CU_ERROR_CHECK(cuLAPACKDestroy(handle));
+  CU_ERROR_CHECK(cuCtxDestroy(context));
+
+  fputs("Kernels were preloaded\n", stdout);
+
+  return 0;
+}
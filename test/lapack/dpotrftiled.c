@@ -0,0 +1,99 @@
+#include "lapack.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "ref/dpotrf_ref.c"
+#include "util/dlatmc.c"
+
+/**
+ * Checks the tiled dpotrf against the reference with the tile size taken from
+ * the tuning database and from potrfTile, including a matrix that stops being
+ * positive definite in a later tile.
+ */
+int main(int argc, char * argv[]) {
+  size_t n = 300;
+
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [n]\n"
+                    "where:\n"
+                    "  n  is the size of the matrix (default %zu)\n", argv[0], n);
+    return 1;
+  }
+
+  if (argc == 2) {
+    if (sscanf(argv[1], "%zu", &n) != 1) {
+      fprintf(stderr, "Unable to parse number from '%s'\n", argv[1]);
+      return 1;
+    }
+  }
+
+  srand(0);
+
+  const size_t lda = (n + 1u) & ~1u;
+  double * A, * refA;
+  if ((A = malloc(lda * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate A\n", stderr);
+    return -1;
+  }
+  if ((refA = malloc(lda * n * sizeof(double))) == NULL) {
+    fputs("Unable to allocate refA\n", stderr);
+    return -2;
+  }
+
+  potrfAlgorithm = CLapackPotrfTiled;
+  const CBlasBlocking tile = { .mb = 48 };
+  CU_ERROR_CHECK(cuBLASTuningSet(NULL, CBlasDpotrf, &tile));
+
+  const CBlasUplo uplos[] = { CBlasUpper, CBlasLower };
+  const size_t tiles[] = { 0, 100 };
+  long info, rInfo;
+  bool passed = true;
+
+  for (size_t u = 0; u < 2; u++) {
+    for (size_t t = 0; t < 2; t++) {
+      for (size_t pd = 0; pd < 2; pd++) {
+        if (dlatmc(n, 2.0, A, lda) != 0) {
+          fputs("Unable to initialise A\n", stderr);
+          return -3;
+        }
+        // The second matrix is not positive definite
+        if (pd == 1)
+          A[(n - n / 4) * lda + n - n / 4] = -1.0;
+        for (size_t j = 0; j < n; j++)
+          memcpy(&refA[j * lda], &A[j * lda], n * sizeof(double));
+
+        potrfTile = tiles[t];
+        dpotrf_ref(uplos[u], n, refA, lda, &rInfo);
+        dpotrf(uplos[u], n, A, lda, &info);
+
+        // Only the columns before a failure are finished
+        const size_t m = (rInfo == 0) ? n : (size_t)rInfo - 1;
+        double diff = 0.0;
+        for (size_t j = 0; j < m; j++) {
+          for (size_t i = 0; i < m; i++) {
+            double d = fabs(A[j * lda + i] - refA[j * lda + i]);
+            if (d > diff)
+              diff = d;
+          }
+        }
+
+        const bool ok = (info == rInfo) && diff <= (double)n * DBL_EPSILON;
+        fprintf(stdout, "%c tile %zu %zu info: %ld (%ld) Error: %.3e %s\n",
+                (uplos[u] == CBlasUpper) ? 'U' : 'L', (tiles[t] == 0) ? tile.mb : tiles[t],
+                n, info, rInfo, diff, (ok) ? "ok" : "wrong");
+        passed &= ok;
+      }
+    }
+  }
+
+  fprintf(stdout, "%sED!\n", (passed) ? "PASS" : "FAIL");
+
+  free(A);
+  free(refA);
+
+  return (int)!passed;
+}
@@ -0,0 +1,115 @@
+#include "lapack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+int main(int argc, char * argv[]) {
+  CBlasUplo uplo;
+  size_t n;
+
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <uplo> <n>\n"
+                    "where:\n"
+                    "  uplo  is 'u' or 'U' for CBlasUpper or 'l' or 'L' for CBlasLower\n"
+                    "  n     is the size of the matrix\n", argv[0]);
+    return 1;
+  }
+
+  char u;
+  if (sscanf(argv[1], "%c", &u) != 1) {
+    fprintf(stderr, "Unable to read character from '%s'\n", argv[1]);
+    return 1;
+  }
+  switch (u) {
+    case 'U': case 'u': uplo = CBlasUpper; break;
+    case 'L': case 'l': uplo = CBlasLower; break;
+    default: fprintf(stderr, "Unknown uplo '%c'\n", u); return 1;
+  }
+
+  if (sscanf(argv[2], "%zu", &n) != 1) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[2]);
+    return 2;
+  }
+
+  srand(0);
+
+  float * A, * AP, * B;
+  size_t lda;
+  long info;
+
+  lda = n + 3u;
+  if ((A = malloc(lda * n * sizeof(float))) == NULL) {
+    fputs("Unable to allocate A\n", stderr);
+    return -1;
+  }
+  if ((AP = malloc(((n * (n + 1)) / 2 + 1) * sizeof(float))) == NULL) {
+    fputs("Unable to allocate AP\n", stderr);
+    return -2;
+  }
+  if ((B = malloc(lda * n * sizeof(float))) == NULL) {
+    fputs("Unable to allocate B\n", stderr);
+    return -3;
+  }
+
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < lda; i++) {
+      A[j * lda + i] = (float)rand() / (float)RAND_MAX;
+      B[j * lda + i] = -1.0f;
+    }
+  }
+
+  // The leading dimension must be at least n
+  strttp(uplo, n, A, n - 1, AP, &info);
+  bool passed = (n == 0 || info == -4);
+  stpttr(uplo, n, AP, B, n - 1, &info);
+  passed &= (n == 0 || info == -5);
+
+  strttp(uplo, n, A, lda, AP, &info);
+  passed &= (info == 0);
+
+  // Columns of the triangle follow each other in the packed array
+  size_t k = 0;
+  for (size_t j = 0; j < n; j++) {
+    const size_t start = (uplo == CBlasUpper) ? 0 : j;
+    const size_t end = (uplo == CBlasUpper) ? j + 1 : n;
+    for (size_t i = start; i < end; i++)
+      passed &= (AP[k++] == A[j * lda + i]);
+  }
+
+  // Unpacking gives back the triangle and leaves the rest of B alone
+  stpttr(uplo, n, AP, B, lda, &info);
+  passed &= (info == 0);
+  for (size_t j = 0; j < n; j++) {
+    for (size_t i = 0; i < lda; i++) {
+      const bool triangle = (i < n) && ((uplo == CBlasUpper) ? i <= j : i >= j);
+      passed &= (B[j * lda + i] == ((triangle) ? A[j * lda + i] : -1.0f));
+    }
+  }
+
+  struct timeval start, stop;
+  if (gettimeofday(&start, NULL) != 0) {
+    fprintf(stderr, "gettimeofday failed at %s:%d\n", __FILE__, __LINE__);
+    return -4;
+  }
+  for (size_t i = 0; i < 20; i++) {
+    strttp(uplo, n, A, lda, AP, &info);
+    stpttr(uplo, n, AP, B, lda, &info);
+  }
+  if (gettimeofday(&stop, NULL) != 0) {
+    fprintf(stderr, "gettimeofday failed at %s:%d\n", __FILE__, __LINE__);
+    return -5;
+  }
+
+  double time = ((double)(stop.tv_sec - start.tv_sec) +
+                 (double)(stop.tv_usec - start.tv_usec) * 1.e-6) / 20.0;
+  const size_t bandwidth = 4 * ((n * (n + 1)) / 2) * sizeof(float);
+  fprintf(stdout, "%.3es %.3gGB/s\n%sED!\n", time,
+          (double)bandwidth / (time * (double)(1 << 30)), (passed) ? "PASS" : "FAIL");
+
+  free(A);
+  free(AP);
+  free(B);
+
+  return (int)!passed;
+}
@@ -36,6 +36,8 @@ int main() {
   CU_ERROR_CHECK(cuTaskCreate(&task, print, NULL, 0));
 
   assert(cuMultiGPURunTask(mGPU, 1, task) == CUDA_ERROR_INVALID_VALUE);
+  int context = 1;
+  assert(cuMultiGPURunTasks(mGPU, &context, &task, 1) == CUDA_ERROR_INVALID_VALUE);
   assert(cuMultiGPURunTask(mGPU, 0, task) == CUDA_SUCCESS);
 
   CU_ERROR_CHECK(cuMultiGPUSynchronize(mGPU));
@@ -0,0 +1,95 @@
+#include "cumultigpu.h"
+#include <stdio.h>
+#include <assert.h>
+#include "error.h"
+
+// Record the context the task ran on and whether it had a CUDA context
+CUresult where(const void * args) {
+  int * context = *(int **)args;
+  CUcontext current;
+  CU_ERROR_CHECK(cuCtxGetCurrent(&current));
+  context[0] = cuMultiGPUGetCurrentContext();
+  context[1] = (current != NULL);
+  return CUDA_SUCCESS;
+}
+
+int main() {
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  /* Put the host between the GPUs */
+  const int n = deviceCount + 1, host = n / 2;
+  CUdevice devices[n];
+  for (int i = 0, d = 0; i < n; i++) {
+    if (i == host)
+      devices[i] = CU_MULTIGPU_HOST;
+    else
+      CU_ERROR_CHECK(cuDeviceGet(&devices[i], d++));
+  }
+
+  /* Only one host device may be given */
+  CUmultiGPU mGPU;
+  CUdevice hosts[] = { CU_MULTIGPU_HOST, CU_MULTIGPU_HOST };
+  assert(cuMultiGPUCreate(&mGPU, hosts, 2) == CUDA_ERROR_INVALID_VALUE);
+
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, n));
+  assert(cuMultiGPUGetContextCount(mGPU) == n);
+
+  /* Tasks on the host context run without a CUDA context */
+  for (int i = 0; i < n; i++) {
+    assert(!cuMultiGPUIsHost(mGPU, i) == (i != host));
+
+    int context[2] = { -1, -1 }, * ptr = context;
+    CUtask task;
+    CUresult result;
+    CU_ERROR_CHECK(cuTaskCreate(&task, where, &ptr, sizeof(int *)));
+    CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, i, task));
+    CU_ERROR_CHECK(cuTaskDestroy(task, &result));
+    assert(result == CUDA_SUCCESS);
+    assert(context[0] == i);
+    assert(context[1] == (i != host));
+  }
+  CU_ERROR_CHECK(cuMultiGPUSynchronize(mGPU));
+
+  /* Make the host three times slower than the GPUs */
+  if (n > 1) {
+    for (int i = 0; i < n; i++) {
+      CUmultiGPUModel model = { (i == host) ? 1.0e9 : 3.0e9, (i == host) ? 0.0 : 1.0e10 };
+      CU_ERROR_CHECK(cuMultiGPUSetModel(mGPU, i, &model));
+    }
+
+    /* Tiles are compute bound so the copies hardly count */
+    const int total = 60;
+    int contexts[total];
+    CU_ERROR_CHECK(cuMultiGPUPartition(mGPU, 1.0e9, 1.0e3, contexts, (size_t)total));
+
+    /* Shares are 1 for the host and 3 for each GPU */
+    int count[n];
+    for (int i = 0; i < n; i++)
+      count[i] = 0;
+    for (int j = 0; j < total; j++)
+      count[contexts[j]]++;
+
+    const int shares = 1 + 3 * (n - 1);
+    for (int i = 0; i < n; i++) {
+      const int expected = total * ((i == host) ? 1 : 3) / shares;
+      assert(count[i] >= expected - 1 && count[i] <= expected + 1);
+    }
+
+    /* Every context gets a tile early on */
+    for (int i = 0; i < n; i++) {
+      int j = 0;
+      while (j < shares && contexts[j] != i)
+        j++;
+      assert(j < shares);
+    }
+  }
+
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  fputs("Host context ran tasks and tiles were partitioned by speed\n", stdout);
+
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include "cumultigpu.h"
+#include <stdio.h>
+#include <assert.h>
+#include "error.h"
+
+static const char * path = "cumultigpumodel.txt";
+
+int main() {
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount], reversed[deviceCount];
+  for (int i = 0; i < deviceCount; i++) {
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+    CU_ERROR_CHECK(cuDeviceGet(&reversed[deviceCount - i - 1], i));
+  }
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  /* With no models the tiles are dealt out in turn */
+  int contexts[100];
+  CU_ERROR_CHECK(cuMultiGPUPartition(mGPU, 1.0e9, 1.0e8, contexts, 100));
+  for (int j = 0; j < 100; j++)
+    assert(contexts[j] == j % deviceCount);
+
+  /* Arguments are checked */
+  CUmultiGPUModel model = { -1.0, 0.0 };
+  assert(cuMultiGPUSetModel(mGPU, 0, &model) == CUDA_ERROR_INVALID_VALUE);
+  assert(cuMultiGPUGetModel(mGPU, deviceCount, &model) == CUDA_ERROR_INVALID_VALUE);
+  assert(cuMultiGPURecordThroughput(mGPU, 0, 1.0, 0.0, 0.0) == CUDA_ERROR_INVALID_VALUE);
+  assert(cuMultiGPURecordThroughput(mGPU, -1, 1.0, 0.0, 1.0) == CUDA_ERROR_INVALID_VALUE);
+
+  /* The throughput is a running average of the measurements */
+  CU_ERROR_CHECK(cuMultiGPURecordThroughput(mGPU, 0, 1.0e9, 0.0, 1.0));
+  CU_ERROR_CHECK(cuMultiGPUGetModel(mGPU, 0, &model));
+  assert(model.throughput == 1.0e9 && model.bandwidth == 0.0);
+  CU_ERROR_CHECK(cuMultiGPURecordThroughput(mGPU, 0, 2.0e9, 0.0, 1.0));
+  CU_ERROR_CHECK(cuMultiGPUGetModel(mGPU, 0, &model));
+  assert(model.throughput == 1.25e9);
+
+  /* The time for the copies is taken off, but by no more than half */
+  model.throughput = 1.0e9;
+  model.bandwidth = 1.0e9;
+  CU_ERROR_CHECK(cuMultiGPUSetModel(mGPU, 0, &model));
+  CU_ERROR_CHECK(cuMultiGPURecordThroughput(mGPU, 0, 1.0e9, 0.5e9, 1.5));
+  CU_ERROR_CHECK(cuMultiGPUGetModel(mGPU, 0, &model));
+  assert(model.throughput == 1.0e9);
+  CU_ERROR_CHECK(cuMultiGPURecordThroughput(mGPU, 0, 1.0e9, 2.0e9, 1.0));
+  CU_ERROR_CHECK(cuMultiGPUGetModel(mGPU, 0, &model));
+  assert(model.throughput == 1.25e9);
+
+  /* Give every context the same throughput but make the copies to the last
+   * context ten times slower: a tile takes 1.1s on the others and 2s on it */
+  for (int i = 0; i < deviceCount; i++) {
+    model.throughput = 1.0e9;
+    model.bandwidth = (i == deviceCount - 1) ? 1.0e8 : 1.0e9;
+    CU_ERROR_CHECK(cuMultiGPUSetModel(mGPU, i, &model));
+  }
+  CU_ERROR_CHECK(cuMultiGPUPartition(mGPU, 1.0e9, 1.0e8, contexts, 100));
+
+  int count[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    count[i] = 0;
+  for (int j = 0; j < 100; j++)
+    count[contexts[j]]++;
+
+  const double total = (deviceCount - 1) / 1.1 + 1.0 / 2.0;
+  for (int i = 0; i < deviceCount; i++) {
+    const double expected = 100.0 * ((i == deviceCount - 1) ? 1.0 / 2.0 : 1.0 / 1.1) / total;
+    assert(count[i] >= (int)expected - 1 && count[i] <= (int)expected + 1);
+  }
+
+  /* Models survive being saved and loaded */
+  CU_ERROR_CHECK(cuMultiGPUSaveModel(mGPU, path));
+
+  CUmultiGPU loaded;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&loaded, devices, deviceCount));
+  assert(cuMultiGPULoadModel(loaded, "does/not/exist") == CUDA_ERROR_FILE_NOT_FOUND);
+  CU_ERROR_CHECK(cuMultiGPULoadModel(loaded, path));
+  for (int i = 0; i < deviceCount; i++) {
+    CUmultiGPUModel a, b;
+    CU_ERROR_CHECK(cuMultiGPUGetModel(mGPU, i, &a));
+    CU_ERROR_CHECK(cuMultiGPUGetModel(loaded, i, &b));
+    assert(a.throughput == b.throughput && a.bandwidth == b.bandwidth);
+  }
+  CU_ERROR_CHECK(cuMultiGPUDestroy(loaded));
+
+  /* Models are not loaded onto contexts created on other devices */
+  CU_ERROR_CHECK(cuMultiGPUCreate(&loaded, reversed, deviceCount));
+  CU_ERROR_CHECK(cuMultiGPULoadModel(loaded, path));
+  for (int i = 0; i < deviceCount; i++) {
+    CU_ERROR_CHECK(cuMultiGPUGetModel(loaded, i, &model));
+    assert((model.throughput != 0.0) == (reversed[i] == devices[i]));
+  }
+
+  /* Malformed files change nothing */
+  FILE * file;
+  if ((file = fopen(path, "w")) == NULL) {
+    fprintf(stderr, "Unable to open %s\n", path);
+    return -1;
+  }
+  fputs("0 0 fast 1e9\n", file);
+  fclose(file);
+
+  model.throughput = 2.0e9;
+  model.bandwidth = 0.0;
+  CU_ERROR_CHECK(cuMultiGPUSetModel(loaded, 0, &model));
+  assert(cuMultiGPULoadModel(loaded, path) == CUDA_ERROR_INVALID_VALUE);
+  CU_ERROR_CHECK(cuMultiGPUGetModel(loaded, 0, &model));
+  assert(model.throughput == 2.0e9 && model.bandwidth == 0.0);
+
+  remove(path);
+
+  CU_ERROR_CHECK(cuMultiGPUDestroy(loaded));
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  fputs("Tiles were partitioned by the performance model\n", stdout);
+
+  return 0;
+}
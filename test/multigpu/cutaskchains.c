@@ -0,0 +1,125 @@
+#include "cumultigpu.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+struct args_st {
+  int * counter;                // Shared counter incremented by each task
+  int * order;                  // Value of the counter when this task ran
+};
+
+// Record when the task ran
+CUresult record(const void * args) {
+  const struct args_st * a = (const struct args_st *)args;
+  *a->order = __atomic_fetch_add(a->counter, 1, __ATOMIC_SEQ_CST);
+  return CUDA_SUCCESS;
+}
+
+/**
+ * Runs many short dependency chains with work stealing enabled so that the
+ * dependents released by one context are run by its peers and destroyed by the
+ * submitting thread while the releasing context is still finishing up.  More
+ * tasks than fit in the task pool are destroyed each round so that completed
+ * tasks are freed as well as recycled.
+ */
+int main(int argc, char * argv[]) {
+  size_t n = 16384, length = 4, rounds = 8;
+
+  if (argc > 4) {
+    fprintf(stderr, "Usage: %s [n [length [rounds]]]\n"
+                    "where:\n"
+                    "  n       is the number of tasks in each round (default %zu)\n"
+                    "  length  is the length of each chain (default %zu)\n"
+                    "  rounds  is the number of rounds (default %zu)\n",
+            argv[0], n, length, rounds);
+    return 1;
+  }
+
+  if (argc > 1 && sscanf(argv[1], "%zu", &n) != 1) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[1]);
+    return 1;
+  }
+
+  if (argc > 2 && (sscanf(argv[2], "%zu", &length) != 1 || length == 0)) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[2]);
+    return 2;
+  }
+
+  if (argc > 3 && sscanf(argv[3], "%zu", &rounds) != 1) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[3]);
+    return 3;
+  }
+
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+  multiGPUSchedule = CUmultiGPUScheduleSteal;
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  CUtask * tasks;
+  if ((tasks = malloc(n * sizeof(CUtask))) == NULL) {
+    fputs("Unable to allocate tasks\n", stderr);
+    return -1;
+  }
+
+  int * contexts;
+  if ((contexts = malloc(n * sizeof(int))) == NULL) {
+    fputs("Unable to allocate contexts\n", stderr);
+    return -2;
+  }
+
+  int * order;
+  if ((order = malloc(n * sizeof(int))) == NULL) {
+    fputs("Unable to allocate order\n", stderr);
+    return -3;
+  }
+
+  bool passed = true;
+
+  for (size_t r = 0; r < rounds; r++) {
+    int counter = 0;
+
+    // Each task depends on the one before it in its chain.  All the tasks are
+    // given to the first context so that the others have to steal them.
+    for (size_t j = 0; j < n; j++) {
+      struct args_st args = { &counter, &order[j] };
+      CU_ERROR_CHECK(cuTaskCreate(&tasks[j], record, &args, sizeof(struct args_st)));
+      if (j % length != 0)
+        CU_ERROR_CHECK(cuTaskAddDependency(tasks[j], tasks[j - 1]));
+      order[j] = -1;
+      contexts[j] = 0;
+    }
+
+    CU_ERROR_CHECK(cuMultiGPURunTasks(mGPU, contexts, tasks, n));
+
+    CUresult result;
+    CU_ERROR_CHECK(cuTaskDestroyAll(tasks, n, &result));
+    CU_ERROR_CHECK(result);
+
+    // Every task ran once and after the task before it in its chain
+    for (size_t j = 0; j < n; j++)
+      passed &= order[j] >= 0 && (j % length == 0 || order[j] > order[j - 1]);
+    passed &= (size_t)counter == n;
+  }
+
+  free(tasks);
+  free(contexts);
+  free(order);
+
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  fprintf(stdout, "%zu chains of %zu tasks over %d contexts %sED!\n",
+          rounds * ((n + length - 1) / length), length, deviceCount,
+          (passed) ? "PASS" : "FAIL");
+
+  return (int)!passed;
+}
@@ -0,0 +1,125 @@
+#include "cumultigpu.h"
+#include <stdio.h>
+#include <assert.h>
+#include "error.h"
+
+struct args_st {
+  int * counter;                // Shared counter incremented by each task
+  int * order;                  // Value of the counter when this task ran
+  CUresult result;              // Value to return
+};
+
+// Record when the task ran and return the requested result
+CUresult record(const void * args) {
+  const struct args_st * a = (const struct args_st *)args;
+  *a->order = __atomic_fetch_add(a->counter, 1, __ATOMIC_SEQ_CST);
+  return a->result;
+}
+
+// Count the callbacks and remember the last result passed to them
+static int callbacks = 0;
+static CUresult lastResult = CUDA_SUCCESS;
+void callback(CUresult result, void * data) {
+  __atomic_fetch_add(&callbacks, 1, __ATOMIC_SEQ_CST);
+  lastResult = result;
+  assert(data == &callbacks);
+}
+
+// Make another task depend on the task that is finishing
+struct chain_st {
+  CUtask self, next;
+};
+void chain(CUresult result, void * data) {
+  struct chain_st * c = (struct chain_st *)data;
+  CUresult error = cuTaskAddDependency(c->next, c->self);
+  assert(error == CUDA_SUCCESS && result == CUDA_SUCCESS);
+  (void)error;
+}
+
+int main() {
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  int counter = 0, order[5] = { -1, -1, -1, -1, -1 };
+  CUtask tasks[5];
+  for (int i = 0; i < 5; i++) {
+    struct args_st args = { &counter, &order[i], CUDA_SUCCESS };
+    CU_ERROR_CHECK(cuTaskCreate(&tasks[i], record, &args, sizeof(struct args_st)));
+  }
+
+  /* A task cannot depend on itself or on nothing */
+  assert(cuTaskAddDependency(tasks[0], tasks[0]) == CUDA_ERROR_INVALID_VALUE);
+  assert(cuTaskAddDependency(tasks[0], NULL) == CUDA_ERROR_INVALID_VALUE);
+  assert(cuTaskSetCallback(NULL, callback, NULL) == CUDA_ERROR_INVALID_VALUE);
+
+  /* Diamond: 0 -> { 1, 2 } -> 3 with a callback on the last task */
+  CU_ERROR_CHECK(cuTaskAddDependency(tasks[1], tasks[0]));
+  CU_ERROR_CHECK(cuTaskAddDependency(tasks[2], tasks[0]));
+  CU_ERROR_CHECK(cuTaskAddDependency(tasks[3], tasks[1]));
+  CU_ERROR_CHECK(cuTaskAddDependency(tasks[3], tasks[2]));
+  CU_ERROR_CHECK(cuTaskSetCallback(tasks[3], callback, &callbacks));
+
+  /* Submit the tasks in reverse order so that they have to wait */
+  for (int i = 3; i >= 0; i--)
+    CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, i % deviceCount, tasks[i]));
+
+  CUresult result;
+  CU_ERROR_CHECK(cuTaskDestroyAll(tasks, 4, &result));
+  assert(result == CUDA_SUCCESS);
+
+  /* Each task ran after the tasks it depends on */
+  assert(order[0] == 0);
+  assert(order[1] > order[0] && order[2] > order[0]);
+  assert(order[3] == 3);
+  assert(callbacks == 1 && lastResult == CUDA_SUCCESS);
+
+  /* Depending on a task that has already finished does not wait for it */
+  CUtask task;
+  struct args_st args = { &counter, &order[4], CUDA_ERROR_UNKNOWN };
+  CU_ERROR_CHECK(cuTaskCreate(&task, record, &args, sizeof(struct args_st)));
+  CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, 0, task));
+  CU_ERROR_CHECK(cuMultiGPUSynchronize(mGPU));
+  CU_ERROR_CHECK(cuTaskAddDependency(tasks[4], task));
+  CU_ERROR_CHECK(cuTaskSetCallback(tasks[4], callback, &callbacks));
+
+  /* A failed dependency stops the task from running and is passed on */
+  CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, 0, tasks[4]));
+  CU_ERROR_CHECK(cuTaskDestroy(tasks[4], &result));
+  assert(result == CUDA_ERROR_UNKNOWN);
+  assert(order[4] == 4);
+  assert(callbacks == 2 && lastResult == CUDA_ERROR_UNKNOWN);
+
+  CU_ERROR_CHECK(cuTaskDestroy(task, &result));
+  assert(result == CUDA_ERROR_UNKNOWN);
+
+  /* A callback may add dependents to the task it is called for */
+  int chained[2] = { -1, -1 };
+  struct chain_st c;
+  struct args_st first = { &counter, &chained[0], CUDA_SUCCESS };
+  struct args_st second = { &counter, &chained[1], CUDA_SUCCESS };
+  CU_ERROR_CHECK(cuTaskCreate(&c.self, record, &first, sizeof(struct args_st)));
+  CU_ERROR_CHECK(cuTaskCreate(&c.next, record, &second, sizeof(struct args_st)));
+  CU_ERROR_CHECK(cuTaskSetCallback(c.self, chain, &c));
+  CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, 0, c.self));
+  CU_ERROR_CHECK(cuTaskDestroy(c.self, &result));
+  assert(result == CUDA_SUCCESS);
+  CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, deviceCount - 1, c.next));
+  CU_ERROR_CHECK(cuTaskDestroy(c.next, &result));
+  assert(result == CUDA_SUCCESS);
+  assert(chained[1] > chained[0]);
+
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  fputs("Task graph ran in dependency order\n", stdout);
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include "cumultigpu.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+// Empty task used to measure scheduling overhead
+CUresult nop(const void * args) {
+  (void)args;
+  return CUDA_SUCCESS;
+}
+
+int main(int argc, char * argv[]) {
+  size_t n = 1000000, batch = 4096;
+
+  if (argc > 3) {
+    fprintf(stderr, "Usage: %s [n [batch]]\n"
+                    "where:\n"
+                    "  n      is the number of tasks to run (default 1000000)\n"
+                    "  batch  is the number of tasks in flight before waiting for them (default 4096)\n", argv[0]);
+    return 1;
+  }
+
+  if (argc > 1 && sscanf(argv[1], "%zu", &n) != 1) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[1]);
+    return 1;
+  }
+
+  if (argc > 2 && (sscanf(argv[2], "%zu", &batch) != 1 || batch == 0)) {
+    fprintf(stderr, "Unable to parse number from '%s'\n", argv[2]);
+    return 2;
+  }
+
+  CU_ERROR_CHECK(cuInit(0));
+
+  int deviceCount;
+  CU_ERROR_CHECK(cuDeviceGetCount(&deviceCount));
+
+  CUdevice devices[deviceCount];
+  for (int i = 0; i < deviceCount; i++)
+    CU_ERROR_CHECK(cuDeviceGet(&devices[i], i));
+
+  CUmultiGPU mGPU;
+  CU_ERROR_CHECK(cuMultiGPUCreate(&mGPU, devices, deviceCount));
+
+  CUtask * tasks;
+  if ((tasks = malloc(batch * sizeof(CUtask))) == NULL) {
+    fputs("Unable to allocate tasks\n", stderr);
+    return -1;
+  }
+
+  int * contexts;
+  if ((contexts = malloc(batch * sizeof(int))) == NULL) {
+    fputs("Unable to allocate contexts\n", stderr);
+    return -1;
+  }
+
+  // Submit tasks round-robin across the contexts in batches, waiting for each
+  // batch to complete before starting the next.  The first pass submits each
+  // task individually and the second submits each batch with one call.
+  for (int bulk = 0; bulk < 2; bulk++) {
+    struct timeval start, stop;
+    if (gettimeofday(&start, NULL) != 0) {
+      fputs("gettimeofday failed\n", stderr);
+      return -2;
+    }
+
+    for (size_t i = 0; i < n; i += batch) {
+      size_t nb = (n - i < batch) ? n - i : batch;
+
+      for (size_t j = 0; j < nb; j++) {
+        CU_ERROR_CHECK(cuTaskCreate(&tasks[j], nop, NULL, 0));
+        contexts[j] = (int)((i + j) % (size_t)deviceCount);
+        if (!bulk)
+          CU_ERROR_CHECK(cuMultiGPURunTask(mGPU, contexts[j], tasks[j]));
+      }
+
+      if (bulk)
+        CU_ERROR_CHECK(cuMultiGPURunTasks(mGPU, contexts, tasks, nb));
+
+      CUresult result;
+      CU_ERROR_CHECK(cuTaskDestroyAll(tasks, nb, &result));
+      if (result != CUDA_SUCCESS)
+        return (int)result;
+    }
+
+    if (gettimeofday(&stop, NULL) != 0) {
+      fputs("gettimeofday failed\n", stderr);
+      return -3;
+    }
+
+    double time = (double)(stop.tv_sec - start.tv_sec) +
+                  (double)(stop.tv_usec - start.tv_usec) * 1.e-6;
+
+    fprintf(stdout, "%s: %zu tasks on %d contexts in %.3es: %.3e tasks/s\n",
+            (bulk) ? "cuMultiGPURunTasks" : "cuMultiGPURunTask", n,
+            deviceCount, time, (double)n / time);
+  }
+
+  free(contexts);
+  free(tasks);
+
+  CU_ERROR_CHECK(cuMultiGPUDestroy(mGPU));
+
+  return 0;
+}